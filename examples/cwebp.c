@@ -193,6 +193,12 @@ static void PrintFullLosslessInfo(const WebPAuxStats* const stats,
   }
 }
 
+static void PrintThreadsUsed(const WebPAuxStats* const stats) {
+  if (stats->threads_used > 1) {
+    fprintf(stderr, "Threads:   %d\n", stats->threads_used);
+  }
+}
+
 static void PrintExtraInfoLossless(const WebPPicture* const pic,
                                    int short_output,
                                    const char* const file_name) {
@@ -204,6 +210,7 @@ static void PrintExtraInfoLossless(const WebPPicture* const pic,
     fprintf(stderr, "Dimension: %d x %d\n", pic->width, pic->height);
     fprintf(stderr, "Output:    %d bytes (%.2f bpp)\n", stats->coded_size,
             8.f * stats->coded_size / pic->width / pic->height);
+    PrintThreadsUsed(stats);
     PrintFullLosslessInfo(stats, "ARGB");
   }
 }
@@ -227,6 +234,7 @@ static void PrintExtraInfoLossy(const WebPPicture* const pic, int short_output,
             "           (%.2f bpp)\n",
             stats->coded_size, stats->PSNR[0], stats->PSNR[1], stats->PSNR[2],
             stats->PSNR[3], 8.f * stats->coded_size / pic->width / pic->height);
+    PrintThreadsUsed(stats);
     if (total > 0) {
       int totals[4] = {0, 0, 0, 0};
       fprintf(stderr,
@@ -589,7 +597,8 @@ static void HelpLong(void) {
   printf("     -preset must come first, as it overwrites other parameters\n");
   printf(
       "  -z <int> ............... activates lossless preset with given\n"
-      "                           level in [0:fast, ..., 9:slowest]\n");
+      "                           level in [0:fast, ..., 9:slowest],\n"
+      "                           or -1 for real-time encoding\n");
   printf("\n");
   printf(
       "  -m <int> ............... compression method (0=fast, 6=slowest), "
@@ -630,7 +639,9 @@ static void HelpLong(void) {
   printf(
       "  -resize_mode <string> .. one of: up_only, down_only,"
       " always (default)\n");
-  printf("  -mt .................... use multi-threading if available\n");
+  printf(
+      "  -mt [<n>] .............. use multi-threading if available\n"
+      "                           (with up to n threads)\n");
   printf("  -low_memory ............ reduce memory usage (slower encoding)\n");
   printf("  -map <int> ............. print map of extra info\n");
   printf("  -print_psnr ............ prints averaged PSNR distortion\n");
@@ -854,6 +865,9 @@ int main(int argc, const char* argv[]) {
       config.emulate_jpeg_size = 1;
     } else if (!strcmp(argv[c], "-mt")) {
       ++config.thread_level;  // increase thread level
+      if (c < argc - 1 && ExUtilIsInt(argv[c + 1])) {
+        config.thread_level = ExUtilGetInt(argv[++c], 0, &parse_error);
+      }
     } else if (!strcmp(argv[c], "-low_memory")) {
       config.low_memory = 1;
     } else if (!strcmp(argv[c], "-strong")) {
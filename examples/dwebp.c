@@ -96,7 +96,7 @@ static void Help(void) {
       "  -nodither .... disable dithering\n"
       "  -dither <d> .. dithering strength (in 0..100)\n"
       "  -alpha_dither  use alpha-plane dithering if needed\n"
-      "  -mt .......... use multi-threading\n"
+      "  -mt [<n>] .... use multi-threading, with up to n threads\n"
       "  -crop <x> <y> <w> <h> ... crop output with the given rectangle\n"
       "  -resize <w> <h> ......... resize output (*after* any cropping)\n"
       "  -flip ........ flip the output vertically\n"
@@ -273,6 +273,9 @@ int main(int argc, const char* argv[]) {
       }
     } else if (!strcmp(argv[c], "-mt")) {
       config.options.use_threads = 1;
+      if (c < argc - 1 && ExUtilIsInt(argv[c + 1])) {
+        config.options.use_threads = ExUtilGetInt(argv[++c], 0, &parse_error);
+      }
     } else if (!strcmp(argv[c], "-alpha_dither")) {
       config.options.alpha_dithering_strength = 100;
     } else if (!strcmp(argv[c], "-nodither")) {
@@ -62,6 +62,13 @@ float ExUtilGetFloat(const char* const v, int* const error) {
   return f;
 }
 
+int ExUtilIsInt(const char* const v) {
+  char* end = NULL;
+  if (v == NULL || *v == '\0') return 0;
+  (void)strtol(v, &end, 10);
+  return (*end == '\0');
+}
+
 //------------------------------------------------------------------------------
 
 static void ResetCommandLineArguments(int argc, const char* argv[],
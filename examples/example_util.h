@@ -30,6 +30,10 @@ uint32_t ExUtilGetUInt(const char* const v, int base, int* const error);
 int ExUtilGetInt(const char* const v, int base, int* const error);
 float ExUtilGetFloat(const char* const v, int* const error);
 
+// Returns true if the whole string 'v' is a base-10 integer. Useful for
+// optional option values, which must not be mistaken for file names.
+int ExUtilIsInt(const char* const v);
+
 // This variant of ExUtilGetInt() will parse multiple integers from a
 // comma-separated list. Up to 'max_output' integers are parsed.
 // The result is placed in the output[] array, and the number of integers
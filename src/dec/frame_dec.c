@@ -80,15 +80,12 @@ static void DoUVTransform(uint32_t bits, const int16_t* const src,
   }
 }
 
-static void ReconstructRow(const VP8Decoder* const dec,
-                           const VP8ThreadContext* ctx) {
+// Initialize the left and top-left samples of the first block of a row.
+static void InitLeftSamples(uint8_t* const yuv_b, int mb_y) {
   int j;
-  int mb_x;
-  const int mb_y = ctx->mb_y;
-  const int cache_id = ctx->id;
-  uint8_t* const y_dst = dec->yuv_b + Y_OFF;
-  uint8_t* const u_dst = dec->yuv_b + U_OFF;
-  uint8_t* const v_dst = dec->yuv_b + V_OFF;
+  uint8_t* const y_dst = yuv_b + Y_OFF;
+  uint8_t* const u_dst = yuv_b + U_OFF;
+  uint8_t* const v_dst = yuv_b + V_OFF;
 
   // Initialize left-most block.
   for (j = 0; j < 16; ++j) {
@@ -109,102 +106,116 @@ static void ReconstructRow(const VP8Decoder* const dec,
     WEBP_UNSAFE_MEMSET(u_dst - BPS - 1, 127, 8 + 1);
     WEBP_UNSAFE_MEMSET(v_dst - BPS - 1, 127, 8 + 1);
   }
+}
 
-  // Reconstruct one row.
-  for (mb_x = 0; mb_x < dec->mb_w; ++mb_x) {
-    const VP8MBData* const block = ctx->mb_data + mb_x;
-
-    // Rotate in the left samples from previously decoded block. We move four
-    // pixels at a time for alignment reason, and because of in-loop filter.
-    if (mb_x > 0) {
-      for (j = -1; j < 16; ++j) {
-        Copy32b(&y_dst[j * BPS - 4], &y_dst[j * BPS + 12]);
-      }
-      for (j = -1; j < 8; ++j) {
-        Copy32b(&u_dst[j * BPS - 4], &u_dst[j * BPS + 4]);
-        Copy32b(&v_dst[j * BPS - 4], &v_dst[j * BPS + 4]);
-      }
+// Reconstruct one macroblock. Blocks of a row must be processed in order,
+// starting with a call to InitLeftSamples().
+static void ReconstructMB(const VP8Decoder* const dec,
+                          const VP8ThreadContext* ctx, int mb_x) {
+  int j;
+  const int mb_y = ctx->mb_y;
+  const int cache_id = ctx->id;
+  uint8_t* const y_dst = ctx->yuv_b + Y_OFF;
+  uint8_t* const u_dst = ctx->yuv_b + U_OFF;
+  uint8_t* const v_dst = ctx->yuv_b + V_OFF;
+  const VP8MBData* const block = ctx->mb_data + mb_x;
+
+  // Rotate in the left samples from previously decoded block. We move four
+  // pixels at a time for alignment reason, and because of in-loop filter.
+  if (mb_x > 0) {
+    for (j = -1; j < 16; ++j) {
+      Copy32b(&y_dst[j * BPS - 4], &y_dst[j * BPS + 12]);
     }
-    {
-      // bring top samples into the cache
-      VP8TopSamples* const top_yuv = dec->yuv_t + mb_x;
-      const int16_t* const coeffs = block->coeffs;
-      uint32_t bits = block->non_zero_y;
-      int n;
-
-      if (mb_y > 0) {
-        WEBP_UNSAFE_MEMCPY(y_dst - BPS, top_yuv[0].y, 16);
-        WEBP_UNSAFE_MEMCPY(u_dst - BPS, top_yuv[0].u, 8);
-        WEBP_UNSAFE_MEMCPY(v_dst - BPS, top_yuv[0].v, 8);
-      }
+    for (j = -1; j < 8; ++j) {
+      Copy32b(&u_dst[j * BPS - 4], &u_dst[j * BPS + 4]);
+      Copy32b(&v_dst[j * BPS - 4], &v_dst[j * BPS + 4]);
+    }
+  }
+  {
+    // bring top samples into the cache
+    VP8TopSamples* const top_yuv = dec->yuv_t + mb_x;
+    const int16_t* const coeffs = block->coeffs;
+    uint32_t bits = block->non_zero_y;
+    int n;
 
-      // predict and add residuals
-      if (block->is_i4x4) {  // 4x4
-        uint32_t* const top_right = (uint32_t*)(y_dst - BPS + 16);
+    if (mb_y > 0) {
+      WEBP_UNSAFE_MEMCPY(y_dst - BPS, top_yuv[0].y, 16);
+      WEBP_UNSAFE_MEMCPY(u_dst - BPS, top_yuv[0].u, 8);
+      WEBP_UNSAFE_MEMCPY(v_dst - BPS, top_yuv[0].v, 8);
+    }
 
-        if (mb_y > 0) {
-          if (mb_x >= dec->mb_w - 1) {  // on rightmost border
-            WEBP_UNSAFE_MEMSET(top_right, top_yuv[0].y[15], sizeof(*top_right));
-          } else {
-            WEBP_UNSAFE_MEMCPY(top_right, top_yuv[1].y, sizeof(*top_right));
-          }
-        }
-        // replicate the top-right pixels below
-        top_right[BPS] = top_right[2 * BPS] = top_right[3 * BPS] = top_right[0];
+    // predict and add residuals
+    if (block->is_i4x4) {  // 4x4
+      uint32_t* const top_right = (uint32_t*)(y_dst - BPS + 16);
 
-        // predict and add residuals for all 4x4 blocks in turn.
-        for (n = 0; n < 16; ++n, bits <<= 2) {
-          uint8_t* const dst = y_dst + kScan[n];
-          VP8PredLuma4[block->imodes[n]](dst);
-          DoTransform(bits, coeffs + n * 16, dst);
-        }
-      } else {  // 16x16
-        const int pred_func = CheckMode(mb_x, mb_y, block->imodes[0]);
-        VP8PredLuma16[pred_func](y_dst);
-        if (bits != 0) {
-          for (n = 0; n < 16; ++n, bits <<= 2) {
-            DoTransform(bits, coeffs + n * 16, y_dst + kScan[n]);
-          }
+      if (mb_y > 0) {
+        if (mb_x >= dec->mb_w - 1) {  // on rightmost border
+          WEBP_UNSAFE_MEMSET(top_right, top_yuv[0].y[15], sizeof(*top_right));
+        } else {
+          WEBP_UNSAFE_MEMCPY(top_right, top_yuv[1].y, sizeof(*top_right));
         }
       }
-      {
-        // Chroma
-        const uint32_t bits_uv = block->non_zero_uv;
-        const int pred_func = CheckMode(mb_x, mb_y, block->uvmode);
-        VP8PredChroma8[pred_func](u_dst);
-        VP8PredChroma8[pred_func](v_dst);
-        DoUVTransform(bits_uv >> 0, coeffs + 16 * 16, u_dst);
-        DoUVTransform(bits_uv >> 8, coeffs + 20 * 16, v_dst);
+      // replicate the top-right pixels below
+      top_right[BPS] = top_right[2 * BPS] = top_right[3 * BPS] = top_right[0];
+
+      // predict and add residuals for all 4x4 blocks in turn.
+      for (n = 0; n < 16; ++n, bits <<= 2) {
+        uint8_t* const dst = y_dst + kScan[n];
+        VP8PredLuma4[block->imodes[n]](dst);
+        DoTransform(bits, coeffs + n * 16, dst);
       }
-
-      // stash away top samples for next block
-      if (mb_y < dec->mb_h - 1) {
-        WEBP_UNSAFE_MEMCPY(top_yuv[0].y, y_dst + 15 * BPS, 16);
-        WEBP_UNSAFE_MEMCPY(top_yuv[0].u, u_dst + 7 * BPS, 8);
-        WEBP_UNSAFE_MEMCPY(top_yuv[0].v, v_dst + 7 * BPS, 8);
+    } else {  // 16x16
+      const int pred_func = CheckMode(mb_x, mb_y, block->imodes[0]);
+      VP8PredLuma16[pred_func](y_dst);
+      if (bits != 0) {
+        for (n = 0; n < 16; ++n, bits <<= 2) {
+          DoTransform(bits, coeffs + n * 16, y_dst + kScan[n]);
+        }
       }
     }
-    // Transfer reconstructed samples from yuv_b cache to final destination.
     {
-      const int y_offset = cache_id * 16 * dec->cache_y_stride;
-      const int uv_offset = cache_id * 8 * dec->cache_uv_stride;
-      uint8_t* const y_out = dec->cache_y + mb_x * 16 + y_offset;
-      uint8_t* const u_out = dec->cache_u + mb_x * 8 + uv_offset;
-      uint8_t* const v_out = dec->cache_v + mb_x * 8 + uv_offset;
-      for (j = 0; j < 16; ++j) {
-        WEBP_UNSAFE_MEMCPY(y_out + j * dec->cache_y_stride, y_dst + j * BPS,
-                           16);
-      }
-      for (j = 0; j < 8; ++j) {
-        WEBP_UNSAFE_MEMCPY(u_out + j * dec->cache_uv_stride, u_dst + j * BPS,
-                           8);
-        WEBP_UNSAFE_MEMCPY(v_out + j * dec->cache_uv_stride, v_dst + j * BPS,
-                           8);
-      }
+      // Chroma
+      const uint32_t bits_uv = block->non_zero_uv;
+      const int pred_func = CheckMode(mb_x, mb_y, block->uvmode);
+      VP8PredChroma8[pred_func](u_dst);
+      VP8PredChroma8[pred_func](v_dst);
+      DoUVTransform(bits_uv >> 0, coeffs + 16 * 16, u_dst);
+      DoUVTransform(bits_uv >> 8, coeffs + 20 * 16, v_dst);
+    }
+
+    // stash away top samples for next block
+    if (mb_y < dec->mb_h - 1) {
+      WEBP_UNSAFE_MEMCPY(top_yuv[0].y, y_dst + 15 * BPS, 16);
+      WEBP_UNSAFE_MEMCPY(top_yuv[0].u, u_dst + 7 * BPS, 8);
+      WEBP_UNSAFE_MEMCPY(top_yuv[0].v, v_dst + 7 * BPS, 8);
+    }
+  }
+  // Transfer reconstructed samples from yuv_b cache to final destination.
+  {
+    const int y_offset = cache_id * 16 * dec->cache_y_stride;
+    const int uv_offset = cache_id * 8 * dec->cache_uv_stride;
+    uint8_t* const y_out = dec->cache_y + mb_x * 16 + y_offset;
+    uint8_t* const u_out = dec->cache_u + mb_x * 8 + uv_offset;
+    uint8_t* const v_out = dec->cache_v + mb_x * 8 + uv_offset;
+    for (j = 0; j < 16; ++j) {
+      WEBP_UNSAFE_MEMCPY(y_out + j * dec->cache_y_stride, y_dst + j * BPS, 16);
+    }
+    for (j = 0; j < 8; ++j) {
+      WEBP_UNSAFE_MEMCPY(u_out + j * dec->cache_uv_stride, u_dst + j * BPS, 8);
+      WEBP_UNSAFE_MEMCPY(v_out + j * dec->cache_uv_stride, v_dst + j * BPS, 8);
     }
   }
 }
 
+static void ReconstructRow(const VP8Decoder* const dec,
+                           const VP8ThreadContext* ctx) {
+  int mb_x;
+  InitLeftSamples(ctx->yuv_b, ctx->mb_y);
+  for (mb_x = 0; mb_x < dec->mb_w; ++mb_x) {
+    ReconstructMB(dec, ctx, mb_x);
+  }
+}
+
 //------------------------------------------------------------------------------
 // Filtering
 
@@ -215,8 +226,9 @@ static void ReconstructRow(const VP8Decoder* const dec,
 //                 U/V, so it's 8 samples total (because of the 2x upsampling).
 static const uint8_t kFilterExtraRows[3] = {0, 2, 8};
 
-static void DoFilter(const VP8Decoder* const dec, int mb_x, int mb_y) {
-  const VP8ThreadContext* const ctx = &dec->thread_ctx;
+static void DoFilter(const VP8Decoder* const dec,
+                     const VP8ThreadContext* const ctx, int mb_x) {
+  const int mb_y = ctx->mb_y;
   const int cache_id = ctx->id;
   const int y_bps = dec->cache_y_stride;
   const VP8FInfo* const f_info = ctx->f_info + mb_x;
@@ -246,31 +258,31 @@ static void DoFilter(const VP8Decoder* const dec, int mb_x, int mb_y) {
     uint8_t* const v_dst = dec->cache_v + cache_id * 8 * uv_bps + mb_x * 8;
     const int hev_thresh = f_info->hev_thresh;
     if (mb_x > 0) {
-      VP8HFilter16(y_dst, y_bps, limit + 4, ilevel, hev_thresh);
-      VP8HFilter8(u_dst, v_dst, uv_bps, limit + 4, ilevel, hev_thresh);
+      VP8HFilterMB(y_dst, y_bps, u_dst, v_dst, uv_bps, limit + 4, ilevel,
+                   hev_thresh);
     }
     if (f_info->f_inner) {
-      VP8HFilter16i(y_dst, y_bps, limit, ilevel, hev_thresh);
-      VP8HFilter8i(u_dst, v_dst, uv_bps, limit, ilevel, hev_thresh);
+      VP8HFilterMBi(y_dst, y_bps, u_dst, v_dst, uv_bps, limit, ilevel,
+                    hev_thresh);
     }
     if (mb_y > 0) {
-      VP8VFilter16(y_dst, y_bps, limit + 4, ilevel, hev_thresh);
-      VP8VFilter8(u_dst, v_dst, uv_bps, limit + 4, ilevel, hev_thresh);
+      VP8VFilterMB(y_dst, y_bps, u_dst, v_dst, uv_bps, limit + 4, ilevel,
+                   hev_thresh);
     }
     if (f_info->f_inner) {
-      VP8VFilter16i(y_dst, y_bps, limit, ilevel, hev_thresh);
-      VP8VFilter8i(u_dst, v_dst, uv_bps, limit, ilevel, hev_thresh);
+      VP8VFilterMBi(y_dst, y_bps, u_dst, v_dst, uv_bps, limit, ilevel,
+                    hev_thresh);
     }
   }
 }
 
 // Filter the decoded macroblock row (if needed)
-static void FilterRow(const VP8Decoder* const dec) {
+static void FilterRow(const VP8Decoder* const dec,
+                      const VP8ThreadContext* const ctx) {
   int mb_x;
-  const int mb_y = dec->thread_ctx.mb_y;
-  assert(dec->thread_ctx.filter_row);
+  assert(ctx->filter_row);
   for (mb_x = dec->tl_mb_x; mb_x < dec->br_mb_x; ++mb_x) {
-    DoFilter(dec, mb_x, mb_y);
+    DoFilter(dec, ctx, mb_x);
   }
 }
 
@@ -382,11 +394,11 @@ static void Dither8x8(VP8Random* const rg, uint8_t* dst, int bps, int amp) {
   VP8DitherCombine8x8(dither, dst, bps);
 }
 
-static void DitherRow(VP8Decoder* const dec) {
+static void DitherRow(VP8Decoder* const dec,
+                      const VP8ThreadContext* const ctx) {
   int mb_x;
   assert(dec->dither);
   for (mb_x = dec->tl_mb_x; mb_x < dec->br_mb_x; ++mb_x) {
-    const VP8ThreadContext* const ctx = &dec->thread_ctx;
     const VP8MBData* const data = ctx->mb_data + mb_x;
     const int cache_id = ctx->id;
     const int uv_bps = dec->cache_uv_stride;
@@ -412,12 +424,41 @@ static void DitherRow(VP8Decoder* const dec) {
 
 #define MACROBLOCK_VPOS(mb_y) ((mb_y) * 16)  // vertical position of a MB
 
-// Finalize and transmit a complete row. Return false in case of user-abort.
-static int FinishRow(void* arg1, void* arg2) {
-  VP8Decoder* const dec = (VP8Decoder*)arg1;
-  VP8Io* const io = (VP8Io*)arg2;
+// Copy the bottom samples of the last cache row above the first cache row, for
+// the macroblock columns in [mb_x_start, mb_x_end). These samples are still to
+// be filtered and emitted along with the next row.
+static void RotateCache(const VP8Decoder* const dec, int mb_x_start,
+                        int mb_x_end) {
+  const int extra_y_rows = kFilterExtraRows[dec->filter_type];
+  const int last_id = dec->num_caches - 1;
+  const int y_stride = dec->cache_y_stride;
+  const int uv_stride = dec->cache_uv_stride;
+  const int y_width = (mb_x_end - mb_x_start) * 16;
+  const int uv_width = (mb_x_end - mb_x_start) * 8;
+  uint8_t* const ydst =
+      dec->cache_y - extra_y_rows * y_stride + mb_x_start * 16;
+  uint8_t* const udst =
+      dec->cache_u - (extra_y_rows / 2) * uv_stride + mb_x_start * 8;
+  uint8_t* const vdst =
+      dec->cache_v - (extra_y_rows / 2) * uv_stride + mb_x_start * 8;
+  const uint8_t* const ysrc = ydst + (last_id + 1) * 16 * y_stride;
+  const uint8_t* const usrc = udst + (last_id + 1) * 8 * uv_stride;
+  const uint8_t* const vsrc = vdst + (last_id + 1) * 8 * uv_stride;
+  int j;
+  for (j = 0; j < extra_y_rows; ++j) {
+    WEBP_UNSAFE_MEMCPY(ydst + j * y_stride, ysrc + j * y_stride, y_width);
+  }
+  for (j = 0; j < extra_y_rows / 2; ++j) {
+    WEBP_UNSAFE_MEMCPY(udst + j * uv_stride, usrc + j * uv_stride, uv_width);
+    WEBP_UNSAFE_MEMCPY(vdst + j * uv_stride, vsrc + j * uv_stride, uv_width);
+  }
+}
+
+// Finalize and transmit a complete row, which is already reconstructed and
+// filtered. Return false in case of user-abort.
+static int FinishRow(VP8Decoder* const dec, const VP8ThreadContext* const ctx,
+                     VP8Io* const io) {
   int ok = 1;
-  const VP8ThreadContext* const ctx = &dec->thread_ctx;
   const int cache_id = ctx->id;
   const int extra_y_rows = kFilterExtraRows[dec->filter_type];
   const int ysize = extra_y_rows * dec->cache_y_stride;
@@ -431,16 +472,8 @@ static int FinishRow(void* arg1, void* arg2) {
   const int is_first_row = (mb_y == 0);
   const int is_last_row = (mb_y >= dec->br_mb_y - 1);
 
-  if (dec->mt_method == 2) {
-    ReconstructRow(dec, ctx);
-  }
-
-  if (ctx->filter_row) {
-    FilterRow(dec);
-  }
-
   if (dec->dither) {
-    DitherRow(dec);
+    DitherRow(dec, ctx);
   }
 
   if (io->put != NULL) {
@@ -496,16 +529,11 @@ static int FinishRow(void* arg1, void* arg2) {
       ok = io->put(io);
     }
   }
-  // rotate top samples if needed
-  if (cache_id + 1 == dec->num_caches) {
-    if (!is_last_row) {
-      WEBP_UNSAFE_MEMCPY(dec->cache_y - ysize, ydst + 16 * dec->cache_y_stride,
-                         ysize);
-      WEBP_UNSAFE_MEMCPY(dec->cache_u - uvsize, udst + 8 * dec->cache_uv_stride,
-                         uvsize);
-      WEBP_UNSAFE_MEMCPY(dec->cache_v - uvsize, vdst + 8 * dec->cache_uv_stride,
-                         uvsize);
-    }
+  // Rotate top samples if needed. In the wavefront case without dithering,
+  // this is done column by column by the next row instead (see ProcessRowMT).
+  if (cache_id + 1 == dec->num_caches && !is_last_row &&
+      (dec->mt_method == 0 || dec->dither)) {
+    RotateCache(dec, 0, dec->mb_w);
   }
 
   return ok;
@@ -513,44 +541,114 @@ static int FinishRow(void* arg1, void* arg2) {
 
 #undef MACROBLOCK_VPOS
 
+// Multi-threaded row processing: (parse,) reconstruct and filter the row as a
+// wavefront trailing the previous row by two macroblocks, then emit it in
+// order. The two macroblocks delay is needed because of the top-right samples
+// used by intra4x4 prediction, and because the filtering of a macroblock
+// modifies the samples on its left and top borders. The parsing of residuals
+// only needs the top non-zero context, but must also wait for the previous row
+// of the same token partition to be fully parsed.
+static int ProcessRowMT(void* arg1, void* arg2) {
+  VP8Decoder* const dec = (VP8Decoder*)arg1;
+  VP8ThreadContext* const ctx = (VP8ThreadContext*)arg2;
+  const int mb_y = ctx->mb_y;
+  const int mb_w = dec->mb_w;
+  const int stride = mb_w + 1;
+  const int num_threads = dec->num_threads;
+  VP8ThreadContext* const prev =
+      &dec->thread_ctx[(mb_y + num_threads - 1) % num_threads];
+  // With dithering, the random generator must be used in row order. Hence the
+  // whole filtering + dithering must happen once the previous row is done.
+  const int filter_now = ctx->filter_row && !dec->dither;
+  const int rotate =
+      (dec->filter_type > 0 && ctx->id == 0 && mb_y > 0 && !dec->dither);
+  const int parse = (dec->mt_method == 3);
+  const int num_parts = (int)dec->num_parts_minus_one + 1;
+  VP8BitReader* const token_br = &dec->parts[mb_y & dec->num_parts_minus_one];
+  VP8MB left = {0, 0};
+  int parse_ok = 1;
+  int mb_x;
+  int ok = 1;
+
+  if (parse && mb_y >= num_parts) {
+    const int prev_y = mb_y - num_parts;
+    WebPCounterWait(&dec->thread_ctx[prev_y % num_threads].progress,
+                    prev_y * stride + mb_w);
+  }
+  InitLeftSamples(ctx->yuv_b, mb_y);
+  for (mb_x = 0; mb_x < mb_w; ++mb_x) {
+    if (mb_y > 0) {
+      const int needed = (mb_x + 2 < mb_w) ? mb_x + 2 : mb_w;
+      WebPCounterWait(&prev->progress, (mb_y - 1) * stride + needed);
+    }
+    if (parse) {
+      parse_ok &= VP8DecodeMBInRow(dec, mb_x, &left, ctx->mb_data,
+                                   ctx->f_info, token_br);
+    }
+    if (rotate) RotateCache(dec, mb_x, mb_x + 1);
+    ReconstructMB(dec, ctx, mb_x);
+    if (filter_now && mb_x >= dec->tl_mb_x && mb_x < dec->br_mb_x) {
+      DoFilter(dec, ctx, mb_x);
+    }
+    WebPCounterSet(&ctx->progress, mb_y * stride + mb_x + 1);
+  }
+
+  WebPCounterWait(&dec->rows_done, mb_y);
+  if (!parse_ok && !dec->row_error) {
+    ok = VP8SetError(dec, VP8_STATUS_NOT_ENOUGH_DATA,
+                     "Premature end-of-file encountered.");
+    dec->row_error = 1;
+  }
+  if (ctx->filter_row && dec->dither) {
+    FilterRow(dec, ctx);
+  }
+  // Once a row failed, the following ones are not emitted anymore.
+  if (!dec->row_error) {
+    ok = FinishRow(dec, ctx, &ctx->io);
+    dec->row_error = !ok;
+  }
+  // Always signal the row as done, so that the next ones don't block.
+  WebPCounterSet(&dec->rows_done, mb_y + 1);
+  return ok;
+}
+
 //------------------------------------------------------------------------------
 
 int VP8ProcessRow(VP8Decoder* const dec, VP8Io* const io) {
   int ok = 1;
-  VP8ThreadContext* const ctx = &dec->thread_ctx;
   const int filter_row = (dec->filter_type > 0) &&
                          (dec->mb_y >= dec->tl_mb_y) &&
                          (dec->mb_y <= dec->br_mb_y);
   if (dec->mt_method == 0) {
+    VP8ThreadContext* const ctx = &dec->thread_ctx[0];
     // ctx->id and ctx->f_info are already set
     ctx->mb_y = dec->mb_y;
     ctx->filter_row = filter_row;
     ReconstructRow(dec, ctx);
-    ok = FinishRow(dec, io);
+    if (filter_row) FilterRow(dec, ctx);
+    ok = FinishRow(dec, ctx, io);
   } else {
-    WebPWorker* const worker = &dec->worker;
-    // Finish previous job *before* updating context
+    VP8ThreadContext* const ctx =
+        &dec->thread_ctx[dec->mb_y % dec->num_threads];
+    WebPWorker* const worker = &ctx->worker;
+    // Finish previous job of this worker *before* updating its context
     ok &= WebPGetWorkerInterface()->Sync(worker);
     assert(worker->status == OK);
-    if (ok) {  // spawn a new deblocking/output job
+    if (ok) {  // spawn a new reconstruction/deblocking/output job
+      VP8MBData* const tmp = ctx->mb_data;  // swap macroblock data
+      ctx->mb_data = dec->mb_data;
+      dec->mb_data = tmp;
       ctx->io = *io;
       ctx->id = dec->cache_id;
       ctx->mb_y = dec->mb_y;
       ctx->filter_row = filter_row;
-      if (dec->mt_method == 2) {  // swap macroblock data
-        VP8MBData* const tmp = ctx->mb_data;
-        ctx->mb_data = dec->mb_data;
-        dec->mb_data = tmp;
-      } else {
-        // perform reconstruction directly in main thread
-        ReconstructRow(dec, ctx);
-      }
-      if (filter_row) {  // swap filter info
-        VP8FInfo* const tmp = ctx->f_info;
+      // With mt_method 3, filter info is produced by the worker itself.
+      if (filter_row && dec->mt_method == 2) {  // swap filter info
+        VP8FInfo* const tmp_f_info = ctx->f_info;
         ctx->f_info = dec->f_info;
-        dec->f_info = tmp;
+        dec->f_info = tmp_f_info;
       }
-      // (reconstruct)+filter in parallel
+      // (parse+)reconstruct+filter in parallel
       WebPGetWorkerInterface()->Launch(worker);
       if (++dec->cache_id == dec->num_caches) {
         dec->cache_id = 0;
@@ -560,6 +658,17 @@ int VP8ProcessRow(VP8Decoder* const dec, VP8Io* const io) {
   return ok;
 }
 
+int VP8SyncThreads(VP8Decoder* const dec) {
+  int ok = 1;
+  if (dec->mt_method > 0) {
+    int i;
+    for (i = 0; i < dec->num_threads; ++i) {
+      ok &= WebPGetWorkerInterface()->Sync(&dec->thread_ctx[i].worker);
+    }
+  }
+  return ok;
+}
+
 //------------------------------------------------------------------------------
 // Finish setting up the decoding parameter once user's setup() is called.
 
@@ -616,10 +725,7 @@ VP8StatusCode VP8EnterCritical(VP8Decoder* const dec, VP8Io* const io) {
 }
 
 int VP8ExitCritical(VP8Decoder* const dec, VP8Io* const io) {
-  int ok = 1;
-  if (dec->mt_method > 0) {
-    ok = WebPGetWorkerInterface()->Sync(&dec->worker);
-  }
+  const int ok = VP8SyncThreads(dec);
 
   if (io->teardown != NULL) {
     io->teardown(io);
@@ -628,52 +734,85 @@ int VP8ExitCritical(VP8Decoder* const dec, VP8Io* const io) {
 }
 
 //------------------------------------------------------------------------------
-// For multi-threaded decoding we need to use 3 rows of 16 pixels as delay line.
+// For multi-threaded decoding, the parsing is done in the main thread and each
+// row is then reconstructed, filtered and output by one of the 'num_threads'
+// workers, in a round-robin fashion. A row only starts when its worker is done
+// with the previous row assigned to it, so at most 'num_threads' rows are being
+// processed at any time. The put() calls are serialized in row order.
+// With several token partitions (mt_method 3), only the intra modes are parsed
+// in the main thread, and the residuals are parsed by the workers: rows from
+// different partitions are then parsed concurrently.
 //
-// Reason is: the deblocking filter cannot deblock the bottom horizontal edges
-// immediately, and needs to wait for first few rows of the next macroblock to
-// be decoded. Hence, deblocking is lagging behind by 4 or 8 pixels (depending
-// on strength).
-// With two threads, the vertical positions of the rows being decoded are:
-// Decode:  [ 0..15][16..31][32..47][48..63][64..79][...
-// Deblock:         [ 0..11][12..27][28..43][44..59][...
-// If we use two threads and two caches of 16 pixels, the sequence would be:
-// Decode:  [ 0..15][16..31][ 0..15!!][16..31][ 0..15][...
-// Deblock:         [ 0..11][12..27!!][-4..11][12..27][...
-// The problem occurs during row [12..15!!] that both the decoding and
-// deblocking threads are writing simultaneously.
-// With 3 cache lines, one get a safe write pattern:
+// Each row uses its own cache row of 16 pixels. The deblocking filter cannot
+// deblock the bottom horizontal edges immediately, and needs to wait for first
+// few rows of the next macroblock to be decoded: the output is lagging behind
+// by 4 or 8 pixels (depending on strength). With 'num_threads' rows in flight,
+// the oldest one still needs the bottom samples of the row above it, hence
+// 'num_threads + 1' cache rows are needed:
 // Decode:  [ 0..15][16..31][32..47][ 0..15][16..31][32..47][0..
 // Deblock:         [ 0..11][12..27][28..43][-4..11][12..27][28...
-// Note that multi-threaded output _without_ deblocking can make use of two
-// cache lines of 16 pixels only, since there's no lagging behind. The decoding
-// and output process have non-concurrent writing:
-// Decode:  [ 0..15][16..31][ 0..15][16..31][...
-// io->put:         [ 0..15][16..31][ 0..15][...
+// Note that multi-threaded output _without_ deblocking can make use of
+// 'num_threads' cache lines of 16 pixels only, since there's no lagging behind.
 
-#define MT_CACHE_LINES 3
 #define ST_CACHE_LINES 1  // 1 cache row only for single-threaded case
 
 // Initialize multi/single-thread worker
 static int InitThreadContext(VP8Decoder* const dec) {
+  const int num_ctx = (dec->mt_method > 0) ? dec->num_threads : 1;
+  int i;
   dec->cache_id = 0;
+  dec->row_error = 0;
+  if (num_ctx > dec->num_thread_ctx) {  // Larger sets are kept for reuse.
+    VP8ClearThreads(dec);
+    dec->thread_ctx = (VP8ThreadContext*)WebPSafeCalloc(
+        (uint64_t)num_ctx, sizeof(*dec->thread_ctx));
+    if (dec->thread_ctx == NULL) {
+      return VP8SetError(dec, VP8_STATUS_OUT_OF_MEMORY,
+                         "thread context allocation failed.");
+    }
+    dec->num_thread_ctx = num_ctx;
+    for (i = 0; i < num_ctx; ++i) {
+      WebPGetWorkerInterface()->Init(&dec->thread_ctx[i].worker);
+    }
+  }
   if (dec->mt_method > 0) {
-    WebPWorker* const worker = &dec->worker;
-    if (!WebPGetWorkerInterface()->Reset(worker)) {
+    WebPCounterDelete(&dec->rows_done);
+    if (!WebPCounterInit(&dec->rows_done, 0)) {
       return VP8SetError(dec, VP8_STATUS_OUT_OF_MEMORY,
                          "thread initialization failed.");
     }
-    worker->data1 = dec;
-    worker->data2 = (void*)&dec->thread_ctx.io;
-    worker->hook = FinishRow;
-    dec->num_caches =
-        (dec->filter_type > 0) ? MT_CACHE_LINES : MT_CACHE_LINES - 1;
+    for (i = 0; i < num_ctx; ++i) {
+      VP8ThreadContext* const ctx = &dec->thread_ctx[i];
+      WebPWorker* const worker = &ctx->worker;
+      WebPCounterDelete(&ctx->progress);
+      if (!WebPCounterInit(&ctx->progress, 0) ||
+          !WebPGetWorkerInterface()->Reset(worker)) {
+        return VP8SetError(dec, VP8_STATUS_OUT_OF_MEMORY,
+                           "thread initialization failed.");
+      }
+      worker->data1 = dec;
+      worker->data2 = (void*)ctx;
+      worker->hook = ProcessRowMT;
+    }
+    dec->num_caches = dec->num_threads + ((dec->filter_type > 0) ? 1 : 0);
   } else {
     dec->num_caches = ST_CACHE_LINES;
   }
   return 1;
 }
 
+void VP8ClearThreads(VP8Decoder* const dec) {
+  int i;
+  for (i = 0; i < dec->num_thread_ctx; ++i) {
+    WebPGetWorkerInterface()->End(&dec->thread_ctx[i].worker);
+    WebPCounterDelete(&dec->thread_ctx[i].progress);
+  }
+  WebPCounterDelete(&dec->rows_done);
+  WebPSafeFree(dec->thread_ctx);
+  dec->thread_ctx = NULL;
+  dec->num_thread_ctx = 0;
+}
+
 int VP8GetThreadMethod(const WebPDecoderOptions* const options,
                        const WebPHeaderStructure* const headers, int width,
                        int height) {
@@ -685,12 +824,31 @@ int VP8GetThreadMethod(const WebPDecoderOptions* const options,
   (void)height;
   assert(headers == NULL || !headers->is_lossless);
 #if defined(WEBP_USE_THREAD)
-  if (width >= MIN_WIDTH_FOR_THREADS) return 2;
+  if (width >= (WebPWorkersArePooled() ? MIN_WIDTH_FOR_POOLED_THREADS
+                                       : MIN_WIDTH_FOR_THREADS)) {
+    return 2;
+  }
 #endif
   return 0;
 }
 
-#undef MT_CACHE_LINES
+int VP8GetNumThreads(const WebPDecoderOptions* const options, int mt_method,
+                     int width, int height) {
+  int num_threads;
+  if (mt_method == 0) return 0;
+  assert(options != NULL);
+  // 'use_threads' is the total number of threads, including the main one
+  // which does the parsing. Any non-zero value means at least one worker.
+  num_threads = options->use_threads - 1;
+  if (num_threads > MAX_DECODING_THREADS - 1) {
+    num_threads = MAX_DECODING_THREADS - 1;
+  }
+  // There's no point in having more workers than what the wavefront allows.
+  if (num_threads > (height + 15) >> 4) num_threads = (height + 15) >> 4;
+  if (num_threads > (width + 31) >> 5) num_threads = (width + 31) >> 5;
+  return (num_threads < 1) ? 1 : num_threads;
+}
+
 #undef ST_CACHE_LINES
 
 //------------------------------------------------------------------------------
@@ -703,13 +861,15 @@ static int AllocateMemory(VP8Decoder* const dec) {
   const size_t intra_pred_mode_size = 4 * mb_w * sizeof(uint8_t);
   const size_t top_size = sizeof(VP8TopSamples) * mb_w;
   const size_t mb_info_size = (mb_w + 1) * sizeof(VP8MB);
+  // In multi-thread mode, each thread context has its own reconstruction
+  // data, in addition to the ones being parsed. Only the contexts in use are
+  // set up (more may have been kept from a previous picture).
+  const int num_ctx = (dec->mt_method > 0) ? dec->num_threads : 1;
+  const int num_bufs = (dec->mt_method > 0) ? num_ctx + 1 : 1;
   const size_t f_info_size =
-      (dec->filter_type > 0)
-          ? mb_w * (dec->mt_method > 0 ? 2 : 1) * sizeof(VP8FInfo)
-          : 0;
-  const size_t yuv_size = YUV_SIZE * sizeof(*dec->yuv_b);
-  const size_t mb_data_size =
-      (dec->mt_method == 2 ? 2 : 1) * mb_w * sizeof(*dec->mb_data);
+      (dec->filter_type > 0) ? mb_w * num_bufs * sizeof(VP8FInfo) : 0;
+  const size_t yuv_size = YUV_SIZE * sizeof(uint8_t);
+  const size_t mb_data_size = num_bufs * mb_w * sizeof(*dec->mb_data);
   const size_t cache_height =
       (16 * num_caches + kFilterExtraRows[dec->filter_type]) * 3 / 2;
   const size_t cache_size = top_size * cache_height;
@@ -719,9 +879,11 @@ static int AllocateMemory(VP8Decoder* const dec) {
           ? (uint64_t)dec->pic_hdr.width * dec->pic_hdr.height
           : 0ULL;
   const uint64_t needed = (uint64_t)intra_pred_mode_size + top_size +
-                          mb_info_size + f_info_size + yuv_size + mb_data_size +
-                          cache_size + alpha_size + WEBP_ALIGN_CST;
+                          mb_info_size + f_info_size + num_ctx * yuv_size +
+                          mb_data_size + cache_size + alpha_size +
+                          WEBP_ALIGN_CST;
   uint8_t* mem;
+  int i;
 
   if (!CheckSizeOverflow(needed)) return 0;  // check for overflow
   if (needed > dec->mem_size) {
@@ -748,27 +910,28 @@ static int AllocateMemory(VP8Decoder* const dec) {
 
   dec->f_info = f_info_size ? (VP8FInfo*)mem : NULL;
   mem += f_info_size;
-  dec->thread_ctx.id = 0;
-  dec->thread_ctx.f_info = dec->f_info;
-  if (dec->filter_type > 0 && dec->mt_method > 0) {
-    // secondary cache line. The deblocking process need to make use of the
-    // filtering strength from previous macroblock row, while the new ones
-    // are being decoded in parallel. We'll just swap the pointers.
-    dec->thread_ctx.f_info += mb_w;
-  }
 
   mem = (uint8_t*)WEBP_ALIGN(mem);
   assert((yuv_size & WEBP_ALIGN_CST) == 0);
-  dec->yuv_b = mem;
-  mem += yuv_size;
+  for (i = 0; i < num_ctx; ++i) {
+    dec->thread_ctx[i].yuv_b = mem;
+    mem += yuv_size;
+  }
 
   dec->mb_data = (VP8MBData*)mem;
-  dec->thread_ctx.mb_data = (VP8MBData*)mem;
-  if (dec->mt_method == 2) {
-    dec->thread_ctx.mb_data += mb_w;
-  }
   mem += mb_data_size;
 
+  for (i = 0; i < num_ctx; ++i) {
+    VP8ThreadContext* const ctx = &dec->thread_ctx[i];
+    // In multi-thread mode, the row being processed by a thread context makes
+    // use of its own filtering strength and reconstruction data, while the new
+    // ones are being parsed in parallel. We'll just swap the pointers.
+    const int offset = (dec->mt_method > 0) ? (i + 1) * mb_w : 0;
+    ctx->id = 0;
+    ctx->f_info = (dec->f_info != NULL) ? dec->f_info + offset : NULL;
+    ctx->mb_data = dec->mb_data + offset;
+  }
+
   dec->cache_y_stride = 16 * mb_w;
   dec->cache_uv_stride = 8 * mb_w;
   {
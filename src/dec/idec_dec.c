@@ -463,6 +463,8 @@ static VP8StatusCode DecodePartition0(WebPIDecoder* const idec) {
   // This change must be done before calling VP8InitFrame()
   dec->mt_method =
       VP8GetThreadMethod(params->options, NULL, io->width, io->height);
+  dec->num_threads = VP8GetNumThreads(params->options, dec->mt_method,
+                                      io->width, io->height);
   VP8InitDithering(params->options, dec);
 
   dec->status = CopyParts0Data(idec);
@@ -516,10 +518,8 @@ static VP8StatusCode DecodeRemaining(WebPIDecoder* const idec) {
           return IDecError(idec, VP8_STATUS_BITSTREAM_ERROR);
         }
         // Synchronize the threads.
-        if (dec->mt_method > 0) {
-          if (!WebPGetWorkerInterface()->Sync(&dec->worker)) {
-            return IDecError(idec, VP8_STATUS_BITSTREAM_ERROR);
-          }
+        if (!VP8SyncThreads(dec)) {
+          return IDecError(idec, VP8_STATUS_BITSTREAM_ERROR);
         }
         RestoreContext(&context, dec, token_br);
         return VP8_STATUS_SUSPENDED;
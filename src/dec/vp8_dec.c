@@ -72,7 +72,6 @@ VP8Decoder* VP8New(void) {
   VP8Decoder* const dec = (VP8Decoder*)WebPSafeCalloc(1ULL, sizeof(*dec));
   if (dec != NULL) {
     SetOk(dec);
-    WebPGetWorkerInterface()->Init(&dec->worker);
     dec->ready = 0;
     dec->num_parts_minus_one = 0;
     InitGetCoeffs();
@@ -530,14 +529,13 @@ static WEBP_INLINE uint32_t NzCodeBits(uint32_t nz_coeffs, int nz, int dc_nz) {
   return nz_coeffs;
 }
 
-static int ParseResiduals(VP8Decoder* const dec, VP8MB* const mb,
+static int ParseResiduals(const VP8Decoder* const dec, VP8MB* const mb,
+                          VP8MB* const left_mb, VP8MBData* const block,
                           VP8BitReader* const token_br) {
-  const VP8BandProbas*(*const bands)[16 + 1] = dec->proba.bands_ptr;
+  const VP8BandProbas* const(*const bands)[16 + 1] = dec->proba.bands_ptr;
   const VP8BandProbas* const* ac_proba;
-  VP8MBData* const block = dec->mb_data + dec->mb_x;
   const VP8QuantMatrix* const q = &dec->dqm[block->segment];
   int16_t* dst = block->coeffs;
-  VP8MB* const left_mb = dec->mb_info - 1;
   uint8_t tnz, lnz;
   uint32_t non_zero_y = 0;
   uint32_t non_zero_uv = 0;
@@ -625,13 +623,19 @@ static int ParseResiduals(VP8Decoder* const dec, VP8MB* const mb,
 // Main loop
 
 int VP8DecodeMB(VP8Decoder* const dec, VP8BitReader* const token_br) {
-  VP8MB* const left = dec->mb_info - 1;
-  VP8MB* const mb = dec->mb_info + dec->mb_x;
-  VP8MBData* const block = dec->mb_data + dec->mb_x;
+  return VP8DecodeMBInRow(dec, dec->mb_x, dec->mb_info - 1, dec->mb_data,
+                          dec->f_info, token_br);
+}
+
+int VP8DecodeMBInRow(const VP8Decoder* const dec, int mb_x, VP8MB* const left,
+                     VP8MBData* const mb_data, VP8FInfo* const f_info,
+                     VP8BitReader* const token_br) {
+  VP8MB* const mb = dec->mb_info + mb_x;
+  VP8MBData* const block = mb_data + mb_x;
   int skip = dec->use_skip_proba ? block->skip : 0;
 
   if (!skip) {
-    skip = ParseResiduals(dec, mb, token_br);
+    skip = ParseResiduals(dec, mb, left, block, token_br);
   } else {
     left->nz = mb->nz = 0;
     if (!block->is_i4x4) {
@@ -643,7 +647,7 @@ int VP8DecodeMB(VP8Decoder* const dec, VP8BitReader* const token_br) {
   }
 
   if (dec->filter_type > 0) {  // store filter info
-    VP8FInfo* const finfo = dec->f_info + dec->mb_x;
+    VP8FInfo* const finfo = f_info + mb_x;
     *finfo = dec->fstrengths[block->segment][block->is_i4x4];
     finfo->f_inner |= !skip;
   }
@@ -668,10 +672,12 @@ static int ParseFrame(VP8Decoder* const dec, VP8Io* io) {
       return VP8SetError(dec, VP8_STATUS_NOT_ENOUGH_DATA,
                          "Premature end-of-partition0 encountered.");
     }
-    for (; dec->mb_x < dec->mb_w; ++dec->mb_x) {
-      if (!VP8DecodeMB(dec, token_br)) {
-        return VP8SetError(dec, VP8_STATUS_NOT_ENOUGH_DATA,
-                           "Premature end-of-file encountered.");
+    if (dec->mt_method != 3) {  // otherwise, residuals are parsed by workers
+      for (; dec->mb_x < dec->mb_w; ++dec->mb_x) {
+        if (!VP8DecodeMB(dec, token_br)) {
+          return VP8SetError(dec, VP8_STATUS_NOT_ENOUGH_DATA,
+                             "Premature end-of-file encountered.");
+        }
       }
     }
     VP8InitScanline(dec);  // Prepare for next scanline
@@ -681,9 +687,7 @@ static int ParseFrame(VP8Decoder* const dec, VP8Io* io) {
       return VP8SetError(dec, VP8_STATUS_USER_ABORT, "Output aborted.");
     }
   }
-  if (dec->mt_method > 0) {
-    if (!WebPGetWorkerInterface()->Sync(&dec->worker)) return 0;
-  }
+  if (!VP8SyncThreads(dec)) return 0;
 
   return 1;
 }
@@ -706,6 +710,13 @@ int VP8Decode(VP8Decoder* const dec, VP8Io* const io) {
   }
   assert(dec->ready);
 
+  // When there are several token partitions, the residuals of rows from
+  // different partitions can be parsed concurrently by the workers.
+  if (dec->mt_method == 2 && dec->num_threads > 1 &&
+      dec->num_parts_minus_one > 0) {
+    dec->mt_method = 3;
+  }
+
   // Finish setting up the decoding parameter. Will call io->setup().
   ok = (VP8EnterCritical(dec, io) == VP8_STATUS_OK);
   if (ok) {  // good to go.
@@ -732,7 +743,7 @@ void VP8Clear(VP8Decoder* const dec) {
   if (dec == NULL) {
     return;
   }
-  WebPGetWorkerInterface()->End(&dec->worker);
+  VP8ClearThreads(dec);
   WebPDeallocateAlphaMemory(dec);
   WebPSafeFree(dec->mem);
   dec->mem = NULL;
@@ -741,4 +752,33 @@ void VP8Clear(VP8Decoder* const dec) {
   dec->ready = 0;
 }
 
+void VP8Reset(VP8Decoder* const dec, size_t max_memory) {
+  void* mem;
+  size_t mem_size;
+  VP8ThreadContext* thread_ctx;
+  int num_thread_ctx;
+  WebPCounter rows_done;
+  if (dec == NULL) {
+    return;
+  }
+  WebPDeallocateAlphaMemory(dec);
+  if (dec->mem_size > max_memory) {
+    WebPSafeFree(dec->mem);
+    dec->mem = NULL;
+    dec->mem_size = 0;
+  }
+  mem = dec->mem;
+  mem_size = dec->mem_size;
+  thread_ctx = dec->thread_ctx;
+  num_thread_ctx = dec->num_thread_ctx;
+  rows_done = dec->rows_done;
+  WEBP_UNSAFE_MEMSET(dec, 0, sizeof(*dec));
+  dec->mem = mem;
+  dec->mem_size = mem_size;
+  dec->thread_ctx = thread_ctx;
+  dec->num_thread_ctx = num_thread_ctx;
+  dec->rows_done = rows_done;
+  SetOk(dec);
+}
+
 //------------------------------------------------------------------------------
@@ -153,6 +153,11 @@ const char* VP8StatusMessage(VP8Decoder* const dec);
 // Not a mandatory call between calls to VP8Decode().
 void VP8Clear(VP8Decoder* const dec);
 
+// Prepares the decoder for a new picture, as if freshly returned by VP8New(),
+// but keeps the worker threads and the main memory chunk for reuse. The latter
+// is released if it is larger than 'max_memory' bytes.
+void VP8Reset(VP8Decoder* const dec, size_t max_memory);
+
 // Destroy the decoder object.
 void VP8Delete(VP8Decoder* const dec);
 
@@ -70,6 +70,10 @@ extern "C" {
 
 // minimal width under which lossy multi-threading is always disabled
 #define MIN_WIDTH_FOR_THREADS 512
+// same, when the workers don't need a thread to be created for each of them
+#define MIN_WIDTH_FOR_POOLED_THREADS 256
+// maximal number of threads used for lossy decoding (including the caller's)
+#define MAX_DECODING_THREADS 32
 
 //------------------------------------------------------------------------------
 // Headers
@@ -170,12 +174,17 @@ typedef struct {
 
 // Persistent information needed by the parallel processing
 typedef struct {
-  int id;              // cache row to process (in [0..2])
+  int id;              // cache row to process (in [0..num_caches-1])
   int mb_y;            // macroblock position of the row
   int filter_row;      // true if row-filtering is needed
   VP8FInfo* f_info;    // filter strengths (swapped with dec->f_info)
   VP8MBData* mb_data;  // reconstruction data (swapped with dec->mb_data)
+  uint8_t* yuv_b;      // reconstruction scratch block (size = YUV_SIZE)
   VP8Io io;            // copy of the VP8Io to pass to put()
+  WebPWorker worker;   // thread processing the rows assigned to this context
+  // Number of macroblocks of the current row that are reconstructed (and
+  // filtered), offset by 'mb_y * (mb_w + 1)' so that it stays monotonic.
+  WebPCounter progress;
 } VP8ThreadContext;
 
 // Saved top samples, per macroblock. Fits into a cache-line.
@@ -201,13 +210,19 @@ struct VP8Decoder {
   VP8FilterHeader filter_hdr;
   VP8SegmentHeader segment_hdr;
 
-  // Worker
-  WebPWorker worker;
-  int mt_method;   // multi-thread method: 0=off, 1=[parse+recon][filter]
-                   // 2=[parse][recon+filter]
-  int cache_id;    // current cache row
-  int num_caches;  // number of cached rows of 16 pixels (1, 2 or 3)
-  VP8ThreadContext thread_ctx;  // Thread context
+  // Workers
+  int mt_method;    // multi-thread method: 0=off, 2=[parse][recon+filter]
+                    // 3=[parse modes][parse residuals+recon+filter]
+  int num_threads;  // number of [recon+filter] workers (mt_method > 0)
+  int cache_id;     // current cache row
+  int num_caches;   // number of cached rows of 16 pixels
+  // Thread contexts: one per worker, or a single one if mt_method is 0.
+  // With several workers, rows are dispatched in a round-robin fashion and
+  // processed as a wavefront: row N+1 trails row N by two macroblocks.
+  VP8ThreadContext* thread_ctx;
+  int num_thread_ctx;     // number of allocated thread contexts
+  WebPCounter rows_done;  // number of rows output so far (mt_method > 0)
+  int row_error;          // true if outputting a row failed (mt_method > 0)
 
   // dimension, in macroblock units.
   int mb_w, mb_h;
@@ -241,7 +256,6 @@ struct VP8Decoder {
 
   VP8MB* mb_info;    // contextual macroblock info (mb_w + 1)
   VP8FInfo* f_info;  // filter strength info
-  uint8_t* yuv_b;    // main block for Y/U/V (size = YUV_SIZE)
 
   uint8_t* cache_y;  // macroblock row for storing unfiltered samples
   uint8_t* cache_u;
@@ -304,6 +318,15 @@ WEBP_NODISCARD int VP8ExitCritical(VP8Decoder* const dec, VP8Io* const io);
 int VP8GetThreadMethod(const WebPDecoderOptions* const options,
                        const WebPHeaderStructure* const headers, int width,
                        int height);
+// Return the number of workers to use with the given multi-threading method,
+// depending on options and picture size.
+int VP8GetNumThreads(const WebPDecoderOptions* const options, int mt_method,
+                     int width, int height);
+// Waits for all the workers to finish their current row. Returns false in
+// case of error.
+WEBP_NODISCARD int VP8SyncThreads(VP8Decoder* const dec);
+// Terminates the workers and releases the thread contexts.
+void VP8ClearThreads(VP8Decoder* const dec);
 // Initialize dithering post-process if needed.
 void VP8InitDithering(const WebPDecoderOptions* const options,
                       VP8Decoder* const dec);
@@ -314,6 +337,14 @@ void VP8InitScanline(VP8Decoder* const dec);
 // Decode one macroblock. Returns false if there is not enough data.
 WEBP_NODISCARD int VP8DecodeMB(VP8Decoder* const dec,
                                VP8BitReader* const token_br);
+// Same as VP8DecodeMB() for the macroblock 'mb_x' of a row, whose left context,
+// parsed data and filter info are passed explicitly. 'dec' is not modified,
+// apart from the top context 'dec->mb_info[mb_x]'.
+WEBP_NODISCARD int VP8DecodeMBInRow(const VP8Decoder* const dec, int mb_x,
+                                    VP8MB* const left,
+                                    VP8MBData* const mb_data,
+                                    VP8FInfo* const f_info,
+                                    VP8BitReader* const token_br);
 
 // in alpha.c
 const uint8_t* VP8DecompressAlphaRows(VP8Decoder* const dec,
@@ -38,6 +38,12 @@
 WEBP_ASSUME_UNSAFE_INDEXABLE_ABI
 
 #define NUM_ARGB_CACHE_ROWS 16
+// Minimum number of literals decoded per entry of a literal table.
+#define LITERAL_TABLE_LITERALS_PER_ENTRY 4
+// Minimum fill of a literal table, in eighths.
+#define LITERAL_TABLE_MIN_HITS 6
+// Minimum number of pixels per row for the rows to be output by a worker.
+#define MIN_WIDTH_FOR_WORKER 256
 
 static const int kCodeLengthLiterals = 16;
 static const int kCodeLengthRepeatCode = 16;
@@ -242,6 +248,133 @@ static void BuildPackedTable(HTreeGroup* const htree_group) {
   }
 }
 
+// Stores in 'num_codes[len]' the number of codes of 'table' of each length
+// 'len' up to 'max_len' <= HUFFMAN_TABLE_BITS.
+static void CountShortCodes(const HuffmanCode* const table, int max_len,
+                            int num_codes[HUFFMAN_TABLE_BITS + 1]) {
+  uint32_t key;
+  assert(max_len <= HUFFMAN_TABLE_BITS);
+  WEBP_UNSAFE_MEMSET(num_codes, 0, (max_len + 1) * sizeof(*num_codes));
+  for (key = 0; key < (1u << max_len); ++key) {
+    // The first key of a code is the code itself.
+    const int bits = table[key].bits;
+    if (bits <= max_len && key < (1u << bits)) ++num_codes[bits];
+  }
+}
+
+// Stores in 'codes' the codes of 'table' of at most 'max_len' bits, by
+// increasing length, with the bits of each code in 'value' >> 16. Returns the
+// number of codes.
+static int GetShortCodes(const HuffmanCode* const table, int max_len,
+                         HuffmanCode32* const codes) {
+  int num_codes[HUFFMAN_TABLE_BITS + 1];
+  int offsets[HUFFMAN_TABLE_BITS + 1];
+  uint32_t key;
+  int len;
+  CountShortCodes(table, max_len, num_codes);
+  offsets[0] = 0;
+  for (len = 1; len <= max_len; ++len) {
+    offsets[len] = offsets[len - 1] + num_codes[len - 1];
+  }
+  for (key = 0; key < (1u << max_len); ++key) {
+    const int bits = table[key].bits;
+    if (bits <= max_len && key < (1u << bits)) {
+      HuffmanCode32* const code = &codes[offsets[bits]++];
+      code->bits = bits;
+      code->value = ((uint32_t)key << 16) | table[key].value;
+    }
+  }
+  return offsets[max_len];
+}
+
+// Returns the number of entries of a literal table of 'num_bits' bits filled
+// for 'htree_group', i.e. (1 << num_bits) times the probability, as modeled by
+// the code lengths, that the red, blue and alpha codes of a literal fit.
+static uint32_t GetLiteralTableHits(const HTreeGroup* const htree_group,
+                                    int num_bits) {
+  const int max_len =
+      (num_bits < HUFFMAN_TABLE_BITS) ? num_bits : HUFFMAN_TABLE_BITS;
+  int red[HUFFMAN_TABLE_BITS + 1];
+  int blue[HUFFMAN_TABLE_BITS + 1];
+  int alpha[HUFFMAN_TABLE_BITS + 1];
+  uint32_t hits = 0;
+  int r, b, a;
+  CountShortCodes(htree_group->htrees[RED], max_len, red);
+  CountShortCodes(htree_group->htrees[BLUE], max_len, blue);
+  CountShortCodes(htree_group->htrees[ALPHA], max_len, alpha);
+  for (r = 0; r <= max_len; ++r) {
+    for (b = 0; b <= max_len && r + b <= num_bits; ++b) {
+      for (a = 0; a <= max_len && r + b + a <= num_bits; ++a) {
+        hits += (uint32_t)(red[r] * blue[b] * alpha[a])
+                << (num_bits - r - b - a);
+      }
+    }
+  }
+  return hits;
+}
+
+// Returns the probability, as modeled by the code lengths and in 1/32768th,
+// that a green symbol decoded with 'table' is a literal.
+static uint32_t GetLiteralProbability(const HuffmanCode* const table) {
+  uint32_t probability = 0;
+  uint32_t key;
+  for (key = 0; key < (1u << HUFFMAN_TABLE_BITS); ++key) {
+    const int nbits = table[key].bits - HUFFMAN_TABLE_BITS;
+    if (nbits <= 0) {
+      if (table[key].value < NUM_LITERAL_CODES) probability += 1u << 7;
+    } else {
+      // Second-level table of 'nbits' bits.
+      const HuffmanCode* const table2 = &table[key + table[key].value];
+      uint32_t key2;
+      for (key2 = 0; key2 < (1u << nbits); ++key2) {
+        if (table2[key2].value < NUM_LITERAL_CODES) {
+          probability += 1u << (7 - nbits);
+        }
+      }
+    }
+  }
+  return probability;
+}
+
+// Fills the literal table of 'htree_group' with all the combinations of red,
+// blue and alpha codes fitting in 'literal_bits' bits. The other entries are
+// left to 0.
+static void BuildLiteralTable(const HTreeGroup* const htree_group,
+                              uint32_t* const table) {
+  const int num_bits = htree_group->literal_bits;
+  const int max_len =
+      (num_bits < HUFFMAN_TABLE_BITS) ? num_bits : HUFFMAN_TABLE_BITS;
+  const uint32_t size = 1u << num_bits;
+  HuffmanCode32 red[1 << HUFFMAN_TABLE_BITS];
+  HuffmanCode32 blue[1 << HUFFMAN_TABLE_BITS];
+  HuffmanCode32 alpha[1 << HUFFMAN_TABLE_BITS];
+  const int num_red = GetShortCodes(htree_group->htrees[RED], max_len, red);
+  const int num_blue = GetShortCodes(htree_group->htrees[BLUE], max_len, blue);
+  const int num_alpha =
+      GetShortCodes(htree_group->htrees[ALPHA], max_len, alpha);
+  int r, b, a;
+  WEBP_UNSAFE_MEMSET(table, 0, size * sizeof(*table));
+  for (r = 0; r < num_red; ++r) {
+    for (b = 0; b < num_blue && red[r].bits + blue[b].bits <= num_bits; ++b) {
+      const int rb_bits = red[r].bits + blue[b].bits;
+      const uint32_t rb_key = (red[r].value >> 16) |
+                              ((blue[b].value >> 16) << red[r].bits);
+      const uint32_t rb_value =
+          ((red[r].value & 0xff) << 16) | (blue[b].value & 0xff);
+      for (a = 0; a < num_alpha && rb_bits + alpha[a].bits <= num_bits; ++a) {
+        const int bits = rb_bits + alpha[a].bits;
+        const uint32_t value =
+            rb_value | ((alpha[a].value & 0xff) << 24) | (bits << 8);
+        uint32_t key;
+        for (key = rb_key | ((alpha[a].value >> 16) << rb_bits); key < size;
+             key += 1u << bits) {
+          table[key] = value;
+        }
+      }
+    }
+  }
+}
+
 static int ReadHuffmanCodeLengths(VP8LDecoder* const dec,
                                   const int* const code_length_code_lengths,
                                   int num_symbols, int* const code_lengths) {
@@ -357,6 +490,73 @@ static int ReadHuffmanCode(int alphabet_size, VP8LDecoder* const dec,
   return size;
 }
 
+// Builds the literal tables of the 'htree_groups' decoding enough literals for
+// the tables to be worth it, possibly with fewer bits than 'literal_bits'.
+// 'huffman_image' holds the group of each tile, or is NULL if there is only
+// one group. Returns false in case of memory error.
+static int BuildLiteralTables(VP8LDecoder* const dec, int xsize, int ysize,
+                              const uint32_t* const huffman_image,
+                              int num_htree_groups,
+                              HTreeGroup* const htree_groups,
+                              HuffmanTables* const huffman_tables) {
+  const int bits = dec->hdr.huffman_subsample_bits;
+  uint64_t* num_pixels;
+  uint64_t total_size = 0;
+  uint32_t* table;
+  int i;
+  assert(huffman_tables->literal_tables == NULL);
+  num_pixels = (uint64_t*)WebPSafeCalloc((uint64_t)num_htree_groups,
+                                         sizeof(*num_pixels));
+  if (num_pixels == NULL) return VP8LSetError(dec, VP8_STATUS_OUT_OF_MEMORY);
+  if (huffman_image == NULL) {
+    num_pixels[0] = (uint64_t)xsize * ysize;
+  } else {
+    const int huffman_pixs =
+        VP8LSubSampleSize(xsize, bits) * VP8LSubSampleSize(ysize, bits);
+    for (i = 0; i < huffman_pixs; ++i) {
+      num_pixels[huffman_image[i]] += (uint64_t)1 << (2 * bits);
+    }
+  }
+  for (i = 0; i < num_htree_groups; ++i) {
+    HTreeGroup* const htree_group = &htree_groups[i];
+    // Roughly the number of literals, as copies are counted as many symbols.
+    const uint64_t num_literals =
+        (htree_group->literal_bits > 0)
+            ? (num_pixels[i] *
+               GetLiteralProbability(htree_group->htrees[GREEN])) >> 15
+            : 0;
+    while (htree_group->literal_bits > 0 &&
+           ((uint64_t)LITERAL_TABLE_LITERALS_PER_ENTRY
+            << htree_group->literal_bits) > num_literals) {
+      --htree_group->literal_bits;
+    }
+    if (htree_group->literal_bits == 0 ||
+        GetLiteralTableHits(htree_group, htree_group->literal_bits) <
+            ((uint32_t)LITERAL_TABLE_MIN_HITS << htree_group->literal_bits) /
+                8) {
+      // A miss costs more than the regular decoding.
+      htree_group->literal_bits = 0;
+    }
+    total_size += (htree_group->literal_bits > 0)
+                      ? (uint64_t)1 << htree_group->literal_bits
+                      : 0;
+  }
+  WebPSafeFree(num_pixels);
+  if (total_size == 0) return 1;
+  table = (uint32_t*)WebPSafeMalloc(total_size, sizeof(*table));
+  if (table == NULL) return VP8LSetError(dec, VP8_STATUS_OUT_OF_MEMORY);
+  huffman_tables->literal_tables = table;
+  for (i = 0; i < num_htree_groups; ++i) {
+    HTreeGroup* const htree_group = &htree_groups[i];
+    if (htree_group->literal_bits > 0) {
+      BuildLiteralTable(htree_group, table);
+      htree_group->literal_table = table;
+      table += 1u << htree_group->literal_bits;
+    }
+  }
+  return 1;
+}
+
 static int ReadHuffmanCodes(VP8LDecoder* const dec, int xsize, int ysize,
                             int color_cache_bits, int allow_recursion) {
   int i;
@@ -427,7 +627,9 @@ static int ReadHuffmanCodes(VP8LDecoder* const dec, int xsize, int ysize,
 
   if (!ReadHuffmanCodesHelper(color_cache_bits, num_htree_groups,
                               num_htree_groups_max, mapping, dec,
-                              huffman_tables, &htree_groups)) {
+                              huffman_tables, &htree_groups) ||
+      !BuildLiteralTables(dec, xsize, ysize, huffman_image, num_htree_groups,
+                          htree_groups, huffman_tables)) {
     goto Error;
   }
   ok = 1;
@@ -502,6 +704,7 @@ int ReadHuffmanCodesHelper(int color_cache_bits, int num_htree_groups,
       int total_size = 0;
       int is_trivial_literal = 1;
       int max_bits = 0;
+      int max_literal_bits = 0;  // for red, blue and alpha
       for (j = 0; j < HUFFMAN_CODES_PER_META_CODE; ++j) {
         int alphabet_size = kAlphabetSize[j];
         if (j == 0 && color_cache_bits > 0) {
@@ -527,6 +730,7 @@ int ReadHuffmanCodesHelper(int color_cache_bits, int num_htree_groups,
             }
           }
           max_bits += local_max_bits;
+          if (j != GREEN) max_literal_bits += local_max_bits;
         }
       }
       htree_group->is_trivial_literal = is_trivial_literal;
@@ -544,6 +748,11 @@ int ReadHuffmanCodesHelper(int color_cache_bits, int num_htree_groups,
       htree_group->use_packed_table =
           !htree_group->is_trivial_code && (max_bits < HUFFMAN_PACKED_BITS);
       if (htree_group->use_packed_table) BuildPackedTable(htree_group);
+      htree_group->literal_bits =
+          (is_trivial_literal || htree_group->use_packed_table) ? 0
+          : (max_literal_bits < HUFFMAN_LITERAL_BITS) ? max_literal_bits
+                                                      : HUFFMAN_LITERAL_BITS;
+      htree_group->literal_table = NULL;
     }
   }
   ok = 1;
@@ -868,11 +1077,54 @@ static void ApplyInverseTransforms(VP8LDecoder* const dec, int start_row,
   }
 }
 
+// Transforms, scales & color-converts the decoded rows [first_row, last_row).
+static void EmitRowBatch(VP8LDecoder* const dec, int first_row, int last_row) {
+  VP8Io* const io = dec->io;
+  const uint32_t* const rows = dec->pixels + dec->width * first_row;
+  uint8_t* rows_data = (uint8_t*)dec->argb_cache;
+  const int in_stride = io->width * sizeof(uint32_t);  // in unit of RGBA
+  ApplyInverseTransforms(dec, first_row, last_row - first_row, rows);
+  if (!SetCropWindow(io, first_row, last_row, &rows_data, in_stride)) {
+    // Nothing to output (this time).
+  } else {
+    const WebPDecBuffer* const output = dec->output;
+    if (WebPIsRGBMode(output->colorspace)) {  // convert to RGBA
+      const WebPRGBABuffer* const buf = &output->u.RGBA;
+      uint8_t* const rgba =
+          buf->rgba + (ptrdiff_t)dec->last_out_row * buf->stride;
+      const int num_rows_out =
+#if !defined(WEBP_REDUCE_SIZE)
+          io->use_scaling ? EmitRescaledRowsRGBA(dec, rows_data, in_stride,
+                                                 io->mb_h, rgba, buf->stride)
+                          :
+#endif  // WEBP_REDUCE_SIZE
+                          EmitRows(output->colorspace, rows_data, in_stride,
+                                   io->mb_w, io->mb_h, rgba, buf->stride);
+      // Update 'last_out_row'.
+      dec->last_out_row += num_rows_out;
+    } else {  // convert to YUVA
+      dec->last_out_row =
+          io->use_scaling
+              ? EmitRescaledRowsYUVA(dec, rows_data, in_stride, io->mb_h)
+              : EmitRowsYUVA(rows_data, io, in_stride,
+                             dec->accumulated_rgb_pixels, dec);
+    }
+    assert(dec->last_out_row <= output->height);
+  }
+}
+
+static int EmitRowBatchHook(void* arg1, void* arg2) {
+  VP8LDecoder* const dec = (VP8LDecoder*)arg1;
+  (void)arg2;
+  EmitRowBatch(dec, dec->worker_first_row, dec->worker_last_row);
+  return 1;
+}
+
 // Processes (transforms, scales & color-converts) the rows decoded after the
-// last call.
+// last call. With 'use_worker', this is done by the worker thread, which only
+// reads the rows of 'pixels' that are fully decoded.
 static void ProcessRows(VP8LDecoder* const dec, int row,
                         int wait_for_biggest_batch) {
-  const uint32_t* const rows = dec->pixels + dec->width * dec->last_row;
   int num_rows;
 
   // In case of YUV conversion and if we do not need to get to the last row.
@@ -898,36 +1150,16 @@ static void ProcessRows(VP8LDecoder* const dec, int row,
   // of argb_cache), but we currently don't need more than that.
   assert(num_rows <= NUM_ARGB_CACHE_ROWS);
   if (num_rows > 0) {  // Emit output.
-    VP8Io* const io = dec->io;
-    uint8_t* rows_data = (uint8_t*)dec->argb_cache;
-    const int in_stride = io->width * sizeof(uint32_t);  // in unit of RGBA
-    ApplyInverseTransforms(dec, dec->last_row, num_rows, rows);
-    if (!SetCropWindow(io, dec->last_row, row, &rows_data, in_stride)) {
-      // Nothing to output (this time).
+    if (dec->use_worker) {
+      const WebPWorkerInterface* const worker_interface =
+          WebPGetWorkerInterface();
+      // Wait for the previous batch, which used the same 'argb_cache'.
+      worker_interface->Sync(&dec->worker);
+      dec->worker_first_row = dec->last_row;
+      dec->worker_last_row = row;
+      worker_interface->Launch(&dec->worker);
     } else {
-      const WebPDecBuffer* const output = dec->output;
-      if (WebPIsRGBMode(output->colorspace)) {  // convert to RGBA
-        const WebPRGBABuffer* const buf = &output->u.RGBA;
-        uint8_t* const rgba =
-            buf->rgba + (ptrdiff_t)dec->last_out_row * buf->stride;
-        const int num_rows_out =
-#if !defined(WEBP_REDUCE_SIZE)
-            io->use_scaling ? EmitRescaledRowsRGBA(dec, rows_data, in_stride,
-                                                   io->mb_h, rgba, buf->stride)
-                            :
-#endif  // WEBP_REDUCE_SIZE
-                            EmitRows(output->colorspace, rows_data, in_stride,
-                                     io->mb_w, io->mb_h, rgba, buf->stride);
-        // Update 'last_out_row'.
-        dec->last_out_row += num_rows_out;
-      } else {  // convert to YUVA
-        dec->last_out_row =
-            io->use_scaling
-                ? EmitRescaledRowsYUVA(dec, rows_data, in_stride, io->mb_h)
-                : EmitRowsYUVA(rows_data, io, in_stride,
-                               dec->accumulated_rgb_pixels, dec);
-      }
-      assert(dec->last_out_row <= output->height);
+      EmitRowBatch(dec, dec->last_row, row);
     }
   }
 
@@ -1218,132 +1450,14 @@ static void RestoreState(VP8LDecoder* const dec) {
 }
 
 #define SYNC_EVERY_N_ROWS 8  // minimum number of rows between check-points
-static int DecodeImageData(VP8LDecoder* const dec, uint32_t* const data,
-                           int width, int height, int last_row,
-                           ProcessRowsFunc process_func) {
-  int row = dec->last_pixel / width;
-  int col = dec->last_pixel % width;
+// Finishes DecodeImageData() once 'src' reached 'src_last' or the end of the
+// bitstream, 'row' being the row of 'src'.
+static int EndDecodeImageData(VP8LDecoder* const dec,
+                              const uint32_t* const data,
+                              const uint32_t* const src,
+                              const uint32_t* const src_last, int row,
+                              int last_row, ProcessRowsFunc process_func) {
   VP8LBitReader* const br = &dec->br;
-  VP8LMetadata* const hdr = &dec->hdr;
-  uint32_t* src = data + dec->last_pixel;
-  uint32_t* last_cached = src;
-  uint32_t* const src_end = data + width * height;     // End of data
-  uint32_t* const src_last = data + width * last_row;  // Last pixel to decode
-  const int len_code_limit = NUM_LITERAL_CODES + NUM_LENGTH_CODES;
-  const int color_cache_limit = len_code_limit + hdr->color_cache_size;
-  int next_sync_row = dec->incremental ? row : 1 << 24;
-  VP8LColorCache* const color_cache =
-      (hdr->color_cache_size > 0) ? &hdr->color_cache : NULL;
-  const int mask = hdr->huffman_mask;
-  const HTreeGroup* htree_group =
-      (src < src_last) ? GetHtreeGroupForPos(hdr, col, row) : NULL;
-  assert(dec->last_row < last_row);
-  assert(src_last <= src_end);
-
-  while (src < src_last) {
-    int code;
-    if (row >= next_sync_row) {
-      SaveState(dec, (int)(src - data));
-      next_sync_row = row + SYNC_EVERY_N_ROWS;
-    }
-    // Only update when changing tile. Note we could use this test:
-    // if "((((prev_col ^ col) | prev_row ^ row)) > mask)" -> tile changed
-    // but that's actually slower and needs storing the previous col/row.
-    if ((col & mask) == 0) {
-      htree_group = GetHtreeGroupForPos(hdr, col, row);
-    }
-    assert(htree_group != NULL);
-    if (htree_group->is_trivial_code) {
-      *src = htree_group->literal_arb;
-      goto AdvanceByOne;
-    }
-    VP8LFillBitWindow(br);
-    if (htree_group->use_packed_table) {
-      code = ReadPackedSymbols(htree_group, br, src);
-      if (VP8LIsEndOfStream(br)) break;
-      if (code == PACKED_NON_LITERAL_CODE) goto AdvanceByOne;
-    } else {
-      code = ReadSymbol(htree_group->htrees[GREEN], br);
-    }
-    if (code < NUM_LITERAL_CODES) {  // Literal
-      if (htree_group->is_trivial_literal) {
-        if (VP8LIsEndOfStream(br)) break;
-        *src = htree_group->literal_arb | (code << 8);
-      } else {
-        int red, blue, alpha;
-        red = ReadSymbol(htree_group->htrees[RED], br);
-        VP8LFillBitWindow(br);
-        blue = ReadSymbol(htree_group->htrees[BLUE], br);
-        alpha = ReadSymbol(htree_group->htrees[ALPHA], br);
-        if (VP8LIsEndOfStream(br)) break;
-        *src = ((uint32_t)alpha << 24) | (red << 16) | (code << 8) | blue;
-      }
-    AdvanceByOne:
-      ++src;
-      ++col;
-      if (col >= width) {
-        col = 0;
-        ++row;
-        if (process_func != NULL) {
-          if (row <= last_row) {
-            process_func(dec, row, /*wait_for_biggest_batch=*/1);
-          }
-        }
-        if (color_cache != NULL) {
-          while (last_cached < src) {
-            VP8LColorCacheInsert(color_cache, *last_cached++);
-          }
-        }
-      }
-    } else if (code < len_code_limit) {  // Backward reference
-      int dist_code, dist;
-      const int length_sym = code - NUM_LITERAL_CODES;
-      const int length = GetCopyLength(length_sym, br);
-      const int dist_symbol = ReadSymbol(htree_group->htrees[DIST], br);
-      VP8LFillBitWindow(br);
-      dist_code = GetCopyDistance(dist_symbol, br);
-      dist = PlaneCodeToDistance(width, dist_code);
-
-      if (VP8LIsEndOfStream(br)) break;
-      if (src - data < (ptrdiff_t)dist || src_end - src < (ptrdiff_t)length) {
-        goto Error;
-      } else {
-        CopyBlock32b(src, dist, length);
-      }
-      src += length;
-      col += length;
-      while (col >= width) {
-        col -= width;
-        ++row;
-        if (process_func != NULL) {
-          if (row <= last_row) {
-            process_func(dec, row, /*wait_for_biggest_batch=*/1);
-          }
-        }
-      }
-      // Because of the check done above (before 'src' was incremented by
-      // 'length'), the following holds true.
-      assert(src <= src_end);
-      if (col & mask) htree_group = GetHtreeGroupForPos(hdr, col, row);
-      if (color_cache != NULL) {
-        while (last_cached < src) {
-          VP8LColorCacheInsert(color_cache, *last_cached++);
-        }
-      }
-    } else if (code < color_cache_limit) {  // Color cache
-      const int key = code - len_code_limit;
-      assert(color_cache != NULL);
-      if (VP8LIsEndOfStream(br)) break;
-      while (last_cached < src) {
-        VP8LColorCacheInsert(color_cache, *last_cached++);
-      }
-      *src = VP8LColorCacheLookup(color_cache, key);
-      goto AdvanceByOne;
-    } else {  // Not reached
-      goto Error;
-    }
-  }
-
   br->eos = VP8LIsEndOfStream(br);
   // In incremental decoding:
   // br->eos && src < src_last: if 'br' reached the end of the buffer and
@@ -1369,12 +1483,194 @@ static int DecodeImageData(VP8LDecoder* const dec, uint32_t* const data,
   } else {
     // if not incremental, and we are past the end of buffer (eos=1), then this
     // is a real bitstream error.
-    goto Error;
+    return VP8LSetError(dec, VP8_STATUS_BITSTREAM_ERROR);
   }
   return 1;
+}
 
-Error:
-  return VP8LSetError(dec, VP8_STATUS_BITSTREAM_ERROR);
+// Main decoding loop, in one version per combination of:
+//  - IS_TILED: false if all the pixels use the first htree group, so that
+//    there is no htree group to look up per tile,
+//  - USE_COLOR_CACHE: whether the image has a color cache.
+// clang-format off
+#define DECODE_IMAGE_DATA_FUNC(FUNC_NAME, IS_TILED, USE_COLOR_CACHE)           \
+static int FUNC_NAME(VP8LDecoder* const dec, uint32_t* const data, int width,  \
+                     int height, int last_row, ProcessRowsFunc process_func) { \
+  int row = dec->last_pixel / width;                                           \
+  int col = dec->last_pixel % width;                                           \
+  VP8LBitReader* const br = &dec->br;                                          \
+  VP8LMetadata* const hdr = &dec->hdr;                                         \
+  uint32_t* src = data + dec->last_pixel;                                      \
+  uint32_t* last_cached = src;                                                 \
+  /* End of data. */                                                           \
+  uint32_t* const src_end = data + width * height;                             \
+  /* Last pixel to decode. */                                                  \
+  uint32_t* const src_last = data + width * last_row;                          \
+  const int len_code_limit = NUM_LITERAL_CODES + NUM_LENGTH_CODES;             \
+  const int color_cache_limit = len_code_limit + hdr->color_cache_size;        \
+  int next_sync_row = dec->incremental ? row : 1 << 24;                        \
+  VP8LColorCache* const color_cache =                                          \
+      USE_COLOR_CACHE ? &hdr->color_cache : NULL;                              \
+  const int mask = hdr->huffman_mask;                                          \
+  const HTreeGroup* htree_group =                                              \
+      (src < src_last) ? GetHtreeGroupForPos(hdr, col, row) : NULL;            \
+  assert(dec->last_row < last_row);                                            \
+  assert(src_last <= src_end);                                                 \
+  assert(IS_TILED == (hdr->num_htree_groups > 1));                             \
+  assert(USE_COLOR_CACHE == (hdr->color_cache_size > 0));                      \
+                                                                               \
+  while (src < src_last) {                                                     \
+    int code;                                                                  \
+    if (row >= next_sync_row) {                                                \
+      SaveState(dec, (int)(src - data));                                       \
+      next_sync_row = row + SYNC_EVERY_N_ROWS;                                 \
+    }                                                                          \
+    /* Only update when changing tile. Note we could use this test:            \
+     * if "((((prev_col ^ col) | prev_row ^ row)) > mask)" -> tile changed     \
+     * but that's actually slower and needs storing the previous col/row. */   \
+    if (IS_TILED && (col & mask) == 0) {                                       \
+      htree_group = GetHtreeGroupForPos(hdr, col, row);                        \
+    }                                                                          \
+    assert(htree_group != NULL);                                               \
+    if (htree_group->is_trivial_code) {                                        \
+      *src = htree_group->literal_arb;                                         \
+      goto AdvanceByOne;                                                       \
+    }                                                                          \
+    VP8LFillBitWindow(br);                                                     \
+    if (htree_group->use_packed_table) {                                       \
+      code = ReadPackedSymbols(htree_group, br, src);                          \
+      if (VP8LIsEndOfStream(br)) break;                                        \
+      if (code == PACKED_NON_LITERAL_CODE) goto AdvanceByOne;                  \
+    } else {                                                                   \
+      code = ReadSymbol(htree_group->htrees[GREEN], br);                       \
+    }                                                                          \
+    if (code < NUM_LITERAL_CODES) {  /* Literal */                             \
+      if (htree_group->is_trivial_literal) {                                   \
+        if (VP8LIsEndOfStream(br)) break;                                      \
+        *src = htree_group->literal_arb | (code << 8);                         \
+      } else {                                                                 \
+        const uint32_t* const literal_table = htree_group->literal_table;      \
+        const uint32_t literal =                                               \
+            (literal_table != NULL)                                            \
+                ? literal_table[VP8LPrefetchBits(br) &                         \
+                                ((1u << htree_group->literal_bits) - 1)]       \
+                : 0;                                                           \
+        if (literal != 0) {                                                    \
+          /* Red, blue and alpha at once, in no more than HUFFMAN_LITERAL_BITS \
+           * bits. */                                                          \
+          VP8LSetBitPos(br, br->bit_pos + ((literal >> 8) & 0xff));            \
+          if (VP8LIsEndOfStream(br)) break;                                    \
+          *src = (literal & 0xffff00ffu) | (code << 8);                        \
+        } else {                                                               \
+          int red, blue, alpha;                                                \
+          red = ReadSymbol(htree_group->htrees[RED], br);                      \
+          VP8LFillBitWindow(br);                                               \
+          blue = ReadSymbol(htree_group->htrees[BLUE], br);                    \
+          alpha = ReadSymbol(htree_group->htrees[ALPHA], br);                  \
+          if (VP8LIsEndOfStream(br)) break;                                    \
+          *src = ((uint32_t)alpha << 24) | (red << 16) | (code << 8) | blue;   \
+        }                                                                      \
+      }                                                                        \
+    AdvanceByOne:                                                              \
+      ++src;                                                                   \
+      ++col;                                                                   \
+      if (col >= width) {                                                      \
+        col = 0;                                                               \
+        ++row;                                                                 \
+        if (process_func != NULL) {                                            \
+          if (row <= last_row) {                                               \
+            process_func(dec, row, /*wait_for_biggest_batch=*/1);              \
+          }                                                                    \
+        }                                                                      \
+        if (color_cache != NULL) {                                             \
+          while (last_cached < src) {                                          \
+            VP8LColorCacheInsert(color_cache, *last_cached++);                 \
+          }                                                                    \
+        }                                                                      \
+      }                                                                        \
+    } else if (code < len_code_limit) {  /* Backward reference */              \
+      int dist_code, dist;                                                     \
+      const int length_sym = code - NUM_LITERAL_CODES;                         \
+      const int length = GetCopyLength(length_sym, br);                        \
+      const int dist_symbol = ReadSymbol(htree_group->htrees[DIST], br);       \
+      VP8LFillBitWindow(br);                                                   \
+      dist_code = GetCopyDistance(dist_symbol, br);                            \
+      dist = PlaneCodeToDistance(width, dist_code);                            \
+                                                                               \
+      if (VP8LIsEndOfStream(br)) break;                                        \
+      if (src - data < (ptrdiff_t)dist || src_end - src < (ptrdiff_t)length) { \
+        goto Error;                                                            \
+      } else {                                                                 \
+        CopyBlock32b(src, dist, length);                                       \
+      }                                                                        \
+      src += length;                                                           \
+      col += length;                                                           \
+      while (col >= width) {                                                   \
+        col -= width;                                                          \
+        ++row;                                                                 \
+        if (process_func != NULL) {                                            \
+          if (row <= last_row) {                                               \
+            process_func(dec, row, /*wait_for_biggest_batch=*/1);              \
+          }                                                                    \
+        }                                                                      \
+      }                                                                        \
+      /* Because of the check done above (before 'src' was incremented by      \
+       * 'length'), the following holds true. */                               \
+      assert(src <= src_end);                                                  \
+      if (IS_TILED && (col & mask)) {                                          \
+        htree_group = GetHtreeGroupForPos(hdr, col, row);                      \
+      }                                                                        \
+      if (color_cache != NULL) {                                               \
+        while (last_cached < src) {                                            \
+          VP8LColorCacheInsert(color_cache, *last_cached++);                   \
+        }                                                                      \
+      }                                                                        \
+    } else if (USE_COLOR_CACHE &&                                              \
+               code < color_cache_limit) {  /* Color cache */                  \
+      const int key = code - len_code_limit;                                   \
+      assert(color_cache != NULL);                                             \
+      if (VP8LIsEndOfStream(br)) break;                                        \
+      while (last_cached < src) {                                              \
+        VP8LColorCacheInsert(color_cache, *last_cached++);                     \
+      }                                                                        \
+      *src = VP8LColorCacheLookup(color_cache, key);                           \
+      goto AdvanceByOne;                                                       \
+    } else {  /* Not reached */                                                \
+      goto Error;                                                              \
+    }                                                                          \
+  }                                                                            \
+  return EndDecodeImageData(dec, data, src, src_last, row, last_row,           \
+                            process_func);                                     \
+                                                                               \
+Error:                                                                         \
+  return VP8LSetError(dec, VP8_STATUS_BITSTREAM_ERROR);                        \
+}
+// clang-format on
+
+DECODE_IMAGE_DATA_FUNC(DecodeImageDataSingle, 0, 0)
+DECODE_IMAGE_DATA_FUNC(DecodeImageDataSingleCache, 0, 1)
+DECODE_IMAGE_DATA_FUNC(DecodeImageDataTiled, 1, 0)
+DECODE_IMAGE_DATA_FUNC(DecodeImageDataTiledCache, 1, 1)
+#undef DECODE_IMAGE_DATA_FUNC
+
+// Alpha data using only the green channel goes through DecodeAlphaData()
+// instead.
+static int DecodeImageData(VP8LDecoder* const dec, uint32_t* const data,
+                           int width, int height, int last_row,
+                           ProcessRowsFunc process_func) {
+  const VP8LMetadata* const hdr = &dec->hdr;
+  if (hdr->num_htree_groups > 1) {
+    return (hdr->color_cache_size > 0)
+               ? DecodeImageDataTiledCache(dec, data, width, height, last_row,
+                                           process_func)
+               : DecodeImageDataTiled(dec, data, width, height, last_row,
+                                      process_func);
+  }
+  return (hdr->color_cache_size > 0)
+             ? DecodeImageDataSingleCache(dec, data, width, height, last_row,
+                                          process_func)
+             : DecodeImageDataSingle(dec, data, width, height, last_row,
+                                     process_func);
 }
 
 // -----------------------------------------------------------------------------
@@ -1494,6 +1790,7 @@ VP8LDecoder* VP8LNew(void) {
   if (dec == NULL) return NULL;
   dec->status = VP8_STATUS_OK;
   dec->state = READ_DIM;
+  WebPGetWorkerInterface()->Init(&dec->worker);
 
   VP8LDspInit();  // Init critical function pointers.
 
@@ -1505,10 +1802,14 @@ VP8LDecoder* VP8LNew(void) {
 static void VP8LClear(VP8LDecoder* const dec) {
   int i;
   if (dec == NULL) return;
+  // The worker may still be reading 'pixels'.
+  WebPGetWorkerInterface()->End(&dec->worker);
+  dec->use_worker = 0;
   ClearMetadata(&dec->hdr);
 
   WebPSafeFree(dec->pixels);
   dec->pixels = NULL;
+  dec->pixels_size = 0;
   for (i = 0; i < dec->next_transform; ++i) {
     ClearTransform(&dec->transforms[i]);
   }
@@ -1521,6 +1822,27 @@ static void VP8LClear(VP8LDecoder* const dec) {
   dec->output = NULL;  // leave no trace behind
 }
 
+void VP8LReset(VP8LDecoder* const dec, size_t max_memory) {
+  uint32_t* pixels;
+  size_t pixels_size;
+  if (dec == NULL) return;
+  if (dec->pixels_size > max_memory) {
+    WebPSafeFree(dec->pixels);
+    dec->pixels = NULL;
+    dec->pixels_size = 0;
+  }
+  pixels = dec->pixels;
+  pixels_size = dec->pixels_size;
+  dec->pixels = NULL;
+  VP8LClear(dec);
+  WEBP_UNSAFE_MEMSET(dec, 0, sizeof(*dec));
+  dec->status = VP8_STATUS_OK;
+  dec->state = READ_DIM;
+  WebPGetWorkerInterface()->Init(&dec->worker);
+  dec->pixels = pixels;
+  dec->pixels_size = pixels_size;
+}
+
 void VP8LDelete(VP8LDecoder* const dec) {
   if (dec != NULL) {
     VP8LClear(dec);
@@ -1626,6 +1948,20 @@ End:
 
 //------------------------------------------------------------------------------
 // Allocate internal buffers dec->pixels and dec->argb_cache.
+
+// Makes dec->pixels hold at least 'num' elements of 'size' bytes, reusing the
+// current buffer if it is large enough.
+static int AllocatePixels(VP8LDecoder* const dec, uint64_t num, size_t size) {
+  if (dec->pixels != NULL && num * size <= dec->pixels_size) return 1;
+  WebPSafeFree(dec->pixels);
+  dec->pixels_size = 0;
+  dec->pixels = (uint32_t*)WebPSafeMalloc(num, size);
+  if (dec->pixels == NULL) return 0;
+  // down-cast is ok, thanks to WebPSafeMalloc() above.
+  dec->pixels_size = (size_t)(num * size);
+  return 1;
+}
+
 static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
   const uint64_t num_pixels = (uint64_t)dec->width * dec->height;
   // Scratch buffer corresponding to top-prediction row for transforming the
@@ -1644,8 +1980,7 @@ static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
   total_num_pixels =
       num_pixels + cache_top_pixels + cache_pixels + accumulated_rgb_pixels;
   assert(dec->width <= final_width);
-  dec->pixels = (uint32_t*)WebPSafeMalloc(total_num_pixels, sizeof(uint32_t));
-  if (dec->pixels == NULL) {
+  if (!AllocatePixels(dec, total_num_pixels, sizeof(uint32_t))) {
     dec->argb_cache = NULL;  // for soundness
     return VP8LSetError(dec, VP8_STATUS_OUT_OF_MEMORY);
   }
@@ -1662,8 +1997,7 @@ static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
 static int AllocateInternalBuffers8b(VP8LDecoder* const dec) {
   const uint64_t total_num_pixels = (uint64_t)dec->width * dec->height;
   dec->argb_cache = NULL;  // for soundness
-  dec->pixels = (uint32_t*)WebPSafeMalloc(total_num_pixels, sizeof(uint8_t));
-  if (dec->pixels == NULL) {
+  if (!AllocatePixels(dec, total_num_pixels, sizeof(uint8_t))) {
     return VP8LSetError(dec, VP8_STATUS_OUT_OF_MEMORY);
   }
   return 1;
@@ -1811,6 +2145,23 @@ Error:
   return 0;
 }
 
+// Returns true if the rows are to be processed by a worker thread while the
+// next ones are decoded. Incremental decoding is kept single-threaded since it
+// may re-decode rows after a suspension.
+static int UseWorker(const VP8LDecoder* const dec,
+                     const WebPDecoderOptions* const options) {
+#if defined(WEBP_USE_THREAD)
+  const VP8Io* const io = dec->io;
+  return (options != NULL && options->use_threads && !dec->incremental &&
+          io->width >= MIN_WIDTH_FOR_WORKER &&
+          io->crop_bottom - io->crop_top > NUM_ARGB_CACHE_ROWS);
+#else
+  (void)dec;
+  (void)options;
+  return 0;
+#endif
+}
+
 int VP8LDecodeImage(VP8LDecoder* const dec) {
   VP8Io* io = NULL;
   WebPDecParams* params = NULL;
@@ -1865,6 +2216,17 @@ int VP8LDecodeImage(VP8LDecoder* const dec) {
         }
       }
     }
+    if (UseWorker(dec, params->options)) {
+      WebPWorker* const worker = &dec->worker;
+      if (!WebPGetWorkerInterface()->Reset(worker)) {
+        VP8LSetError(dec, VP8_STATUS_OUT_OF_MEMORY);
+        goto Err;
+      }
+      worker->data1 = dec;
+      worker->data2 = NULL;
+      worker->hook = EmitRowBatchHook;
+      dec->use_worker = 1;
+    }
     dec->state = READ_DATA;
   }
 
@@ -1873,6 +2235,10 @@ int VP8LDecodeImage(VP8LDecoder* const dec) {
                        io->crop_bottom, ProcessRows)) {
     goto Err;
   }
+  if (dec->use_worker) {
+    // Wait for the last rows to be output.
+    WebPGetWorkerInterface()->Sync(&dec->worker);
+  }
 
   params->last_y = dec->last_out_row;
   return 1;
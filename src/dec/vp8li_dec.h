@@ -23,6 +23,7 @@
 #include "src/utils/color_cache_utils.h"
 #include "src/utils/huffman_utils.h"
 #include "src/utils/rescaler_utils.h"
+#include "src/utils/thread_utils.h"
 #include "src/webp/decode.h"
 #include "src/webp/format_constants.h"
 #include "src/webp/types.h"
@@ -68,6 +69,7 @@ struct VP8LDecoder {
 
   uint32_t* pixels;      // Internal data: either uint8_t* for alpha
                          // or uint32_t* for BGRA.
+  size_t pixels_size;    // Allocated size of 'pixels', in bytes.
   uint32_t* argb_cache;  // Scratch buffer for temporary BGRA storage.
   uint16_t* accumulated_rgb_pixels;  // Scratch buffer for accumulated RGB for
                                      // YUV conversion.
@@ -85,6 +87,13 @@ struct VP8LDecoder {
                      // color-converted yet.
   int last_out_row;  // last row output so far.
 
+  // If 'use_worker' is true, the decoded rows are transformed, scaled and
+  // color-converted by 'worker' while the next ones are being decoded.
+  int use_worker;
+  WebPWorker worker;
+  int worker_first_row;  // rows [worker_first_row, worker_last_row) are
+  int worker_last_row;   // processed by the current job of 'worker'.
+
   VP8LMetadata hdr;
 
   int next_transform;
@@ -126,6 +135,11 @@ WEBP_NODISCARD int VP8LDecodeHeader(VP8LDecoder* const dec, VP8Io* const io);
 // this function. Returns false in case of error, with updated dec->status.
 WEBP_NODISCARD int VP8LDecodeImage(VP8LDecoder* const dec);
 
+// Prepares the decoder for a new picture, as if freshly returned by VP8LNew(),
+// but keeps the 'pixels' buffer for reuse unless it is larger than
+// 'max_memory' bytes.
+void VP8LReset(VP8LDecoder* const dec, size_t max_memory);
+
 // Clears and deallocate a lossless decoder instance.
 void VP8LDelete(VP8LDecoder* const dec);
 
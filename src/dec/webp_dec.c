@@ -468,10 +468,56 @@ void WebPResetDecParams(WebPDecParams* const params) {
 //------------------------------------------------------------------------------
 // "Into" decoding variants
 
+struct WebPDecoderContext {
+  VP8Decoder* vp8_dec;    // lossy decoder, kept between calls
+  VP8LDecoder* vp8l_dec;  // lossless decoder, kept between calls
+  size_t max_memory;      // maximum size of the buffers kept between calls
+};
+
+// Returns the lossy decoder to use: either a new one, or the one from
+// 'context', if not NULL.
+static VP8Decoder* GetVP8Decoder(WebPDecoderContext* const context) {
+  if (context == NULL) return VP8New();
+  if (context->vp8_dec == NULL) context->vp8_dec = VP8New();
+  return context->vp8_dec;
+}
+
+static VP8LDecoder* GetVP8LDecoder(WebPDecoderContext* const context) {
+  if (context == NULL) return VP8LNew();
+  if (context->vp8l_dec == NULL) context->vp8l_dec = VP8LNew();
+  return context->vp8l_dec;
+}
+
+// Releases the decoders, or resets the ones kept by 'context' so that the
+// buffers they retain fit within context->max_memory.
+static void ReleaseDecoders(WebPDecoderContext* const context,
+                            VP8Decoder* const vp8_dec,
+                            VP8LDecoder* const vp8l_dec) {
+  if (context == NULL) {
+    VP8Delete(vp8_dec);
+    VP8LDelete(vp8l_dec);
+    return;
+  }
+  // The decoder just used gets the priority over the other one.
+  if (vp8_dec != NULL) {
+    VP8Reset(vp8_dec, context->max_memory);
+    if (context->vp8l_dec != NULL) {
+      VP8LReset(context->vp8l_dec,
+                context->max_memory - context->vp8_dec->mem_size);
+    }
+  } else if (vp8l_dec != NULL) {
+    VP8LReset(vp8l_dec, context->max_memory);
+    if (context->vp8_dec != NULL) {
+      VP8Reset(context->vp8_dec,
+               context->max_memory - context->vp8l_dec->pixels_size);
+    }
+  }
+}
+
 // Main flow
 WEBP_NODISCARD static VP8StatusCode DecodeInto(
     const uint8_t* WEBP_COUNTED_BY(data_size) const data, size_t data_size,
-    WebPDecParams* const params) {
+    WebPDecParams* const params, WebPDecoderContext* const context) {
   VP8StatusCode status;
   VP8Io io;
   WebPHeaderStructure headers;
@@ -493,7 +539,7 @@ WEBP_NODISCARD static VP8StatusCode DecodeInto(
   WebPInitCustomIo(params, &io);  // Plug the I/O functions.
 
   if (!headers.is_lossless) {
-    VP8Decoder* const dec = VP8New();
+    VP8Decoder* const dec = GetVP8Decoder(context);
     if (dec == NULL) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
@@ -511,15 +557,17 @@ WEBP_NODISCARD static VP8StatusCode DecodeInto(
         // This change must be done before calling VP8Decode()
         dec->mt_method =
             VP8GetThreadMethod(params->options, &headers, io.width, io.height);
+        dec->num_threads = VP8GetNumThreads(params->options, dec->mt_method,
+                                            io.width, io.height);
         VP8InitDithering(params->options, dec);
         if (!VP8Decode(dec, &io)) {
           status = dec->status;
         }
       }
     }
-    VP8Delete(dec);
+    ReleaseDecoders(context, dec, NULL);
   } else {
-    VP8LDecoder* const dec = VP8LNew();
+    VP8LDecoder* const dec = GetVP8LDecoder(context);
     if (dec == NULL) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
@@ -535,7 +583,7 @@ WEBP_NODISCARD static VP8StatusCode DecodeInto(
         }
       }
     }
-    VP8LDelete(dec);
+    ReleaseDecoders(context, NULL, dec);
   }
 
   if (status != VP8_STATUS_OK) {
@@ -567,7 +615,7 @@ WEBP_NODISCARD static uint8_t* DecodeIntoRGBABuffer(
   buf.u.RGBA.stride = stride;
   buf.u.RGBA.size = size;
   buf.is_external_memory = 1;
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   return rgba;
@@ -631,7 +679,7 @@ uint8_t* WebPDecodeYUVInto(const uint8_t* WEBP_COUNTED_BY(data_size) data,
   output.u.YUVA.v_stride = v_stride;
   output.u.YUVA.v_size = v_size;
   output.is_external_memory = 1;
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   return luma;
@@ -663,7 +711,7 @@ WEBP_NODISCARD static uint8_t* Decode(WEBP_CSP_MODE mode,
   if (height != NULL) *height = output.height;
 
   // Decode
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   if (keep_info != NULL) {  // keep track of the side-info
@@ -795,7 +843,8 @@ int WebPValidateDecoderConfig(const WebPDecoderConfig* config) {
 
   options = &config->options;
   // bypass_filtering, no_fancy_upsampling, use_cropping, use_scaling,
-  // use_threads, flip can be any integer and are interpreted as boolean.
+  // flip can be any integer and are interpreted as boolean.
+  // use_threads is interpreted as a thread count, and any value is valid.
 
   // Check for cropping.
   if (options->use_cropping && !WebPCheckCropDimensionsBasic(
@@ -851,8 +900,10 @@ VP8StatusCode WebPGetFeaturesInternal(const uint8_t* WEBP_COUNTED_BY(data_size)
   return GetFeatures(data, data_size, features);
 }
 
-VP8StatusCode WebPDecode(const uint8_t* WEBP_COUNTED_BY(data_size) data,
-                         size_t data_size, WebPDecoderConfig* config) {
+static VP8StatusCode DecodeConfig(
+    WebPDecoderContext* const context,
+    const uint8_t* WEBP_COUNTED_BY(data_size) data, size_t data_size,
+    WebPDecoderConfig* config) {
   WebPDecParams params;
   VP8StatusCode status;
 
@@ -881,18 +932,50 @@ VP8StatusCode WebPDecode(const uint8_t* WEBP_COUNTED_BY(data_size) data,
     in_mem_buffer.width = config->input.width;
     in_mem_buffer.height = config->input.height;
     params.output = &in_mem_buffer;
-    status = DecodeInto(data, data_size, &params);
+    status = DecodeInto(data, data_size, &params, context);
     if (status == VP8_STATUS_OK) {  // do the slow-copy
       status = WebPCopyDecBufferPixels(&in_mem_buffer, &config->output);
     }
     WebPFreeDecBuffer(&in_mem_buffer);
   } else {
-    status = DecodeInto(data, data_size, &params);
+    status = DecodeInto(data, data_size, &params, context);
   }
 
   return status;
 }
 
+VP8StatusCode WebPDecode(const uint8_t* WEBP_COUNTED_BY(data_size) data,
+                         size_t data_size, WebPDecoderConfig* config) {
+  return DecodeConfig(NULL, data, data_size, config);
+}
+
+//------------------------------------------------------------------------------
+// WebPDecoderContext
+
+WebPDecoderContext* WebPDecoderContextNew(size_t max_memory) {
+  WebPDecoderContext* const context =
+      (WebPDecoderContext*)WebPSafeCalloc(1ULL, sizeof(*context));
+  if (context != NULL) {
+    context->max_memory = max_memory;
+  }
+  return context;
+}
+
+void WebPDecoderContextDelete(WebPDecoderContext* context) {
+  if (context == NULL) return;
+  VP8Delete(context->vp8_dec);
+  VP8LDelete(context->vp8l_dec);
+  WebPSafeFree(context);
+}
+
+VP8StatusCode WebPDecodeWithContext(
+    WebPDecoderContext* context,
+    const uint8_t* WEBP_COUNTED_BY(data_size) data, size_t data_size,
+    WebPDecoderConfig* config) {
+  if (context == NULL) return VP8_STATUS_INVALID_PARAM;
+  return DecodeConfig(context, data, data_size, config);
+}
+
 //------------------------------------------------------------------------------
 // Cropping and rescaling.
 
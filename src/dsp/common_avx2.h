@@ -0,0 +1,64 @@
+// Copyright 2025 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+// AVX2 code common to several files.
+
+#ifndef WEBP_DSP_COMMON_AVX2_H_
+#define WEBP_DSP_COMMON_AVX2_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(WEBP_USE_AVX2)
+
+#include <immintrin.h>
+
+//------------------------------------------------------------------------------
+// Math functions.
+
+// Transpose four 4x4 16b matrices, two per 128-bit lane, horizontally stored
+// in registers: each lane is transposed like VP8Transpose_2_4x4_16b() does.
+static WEBP_INLINE void VP8Transpose_4_4x4_16b(
+    const __m256i* const in0, const __m256i* const in1,
+    const __m256i* const in2, const __m256i* const in3, __m256i* const out0,
+    __m256i* const out1, __m256i* const out2, __m256i* const out3) {
+  // a00 a01 a02 a03   b00 b01 b02 b03 | c00 c01 c02 c03   d00 d01 d02 d03
+  // a10 a11 a12 a13   b10 b11 b12 b13 | c10 c11 c12 c13   d10 d11 d12 d13
+  // a20 a21 a22 a23   b20 b21 b22 b23 | c20 c21 c22 c23   d20 d21 d22 d23
+  // a30 a31 a32 a33   b30 b31 b32 b33 | c30 c31 c32 c33   d30 d31 d32 d33
+  const __m256i transpose0_0 = _mm256_unpacklo_epi16(*in0, *in1);
+  const __m256i transpose0_1 = _mm256_unpacklo_epi16(*in2, *in3);
+  const __m256i transpose0_2 = _mm256_unpackhi_epi16(*in0, *in1);
+  const __m256i transpose0_3 = _mm256_unpackhi_epi16(*in2, *in3);
+  const __m256i transpose1_0 =
+      _mm256_unpacklo_epi32(transpose0_0, transpose0_1);
+  const __m256i transpose1_1 =
+      _mm256_unpacklo_epi32(transpose0_2, transpose0_3);
+  const __m256i transpose1_2 =
+      _mm256_unpackhi_epi32(transpose0_0, transpose0_1);
+  const __m256i transpose1_3 =
+      _mm256_unpackhi_epi32(transpose0_2, transpose0_3);
+  *out0 = _mm256_unpacklo_epi64(transpose1_0, transpose1_1);
+  *out1 = _mm256_unpackhi_epi64(transpose1_0, transpose1_1);
+  *out2 = _mm256_unpacklo_epi64(transpose1_2, transpose1_3);
+  *out3 = _mm256_unpackhi_epi64(transpose1_2, transpose1_3);
+  // a00 a10 a20 a30   b00 b10 b20 b30 | c00 c10 c20 c30   d00 d10 d20 d30
+  // a01 a11 a21 a31   b01 b11 b21 b31 | c01 c11 c21 c31   d01 d11 d21 d31
+  // a02 a12 a22 a32   b02 b12 b22 b32 | c02 c12 c22 c32   d02 d12 d22 d32
+  // a03 a13 a23 a33   b03 b13 b23 b33 | c03 c13 c23 c33   d03 d13 d23 d33
+}
+
+#endif  // WEBP_USE_AVX2
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // WEBP_DSP_COMMON_AVX2_H_
@@ -702,6 +702,39 @@ static void HFilter8i_C(uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
 }
 #endif  // !WEBP_NEON_OMIT_C_CODE || WEBP_NEON_WORK_AROUND_GCC
 
+// on the luma and chroma edges of a macroblock altogether
+static void VFilterMB_C(uint8_t* WEBP_RESTRICT y, int y_stride,
+                        uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                        int uv_stride, int thresh, int ithresh,
+                        int hev_thresh) {
+  VP8VFilter16(y, y_stride, thresh, ithresh, hev_thresh);
+  VP8VFilter8(u, v, uv_stride, thresh, ithresh, hev_thresh);
+}
+
+static void HFilterMB_C(uint8_t* WEBP_RESTRICT y, int y_stride,
+                        uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                        int uv_stride, int thresh, int ithresh,
+                        int hev_thresh) {
+  VP8HFilter16(y, y_stride, thresh, ithresh, hev_thresh);
+  VP8HFilter8(u, v, uv_stride, thresh, ithresh, hev_thresh);
+}
+
+static void VFilterMBi_C(uint8_t* WEBP_RESTRICT y, int y_stride,
+                         uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                         int uv_stride, int thresh, int ithresh,
+                         int hev_thresh) {
+  VP8VFilter16i(y, y_stride, thresh, ithresh, hev_thresh);
+  VP8VFilter8i(u, v, uv_stride, thresh, ithresh, hev_thresh);
+}
+
+static void HFilterMBi_C(uint8_t* WEBP_RESTRICT y, int y_stride,
+                         uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                         int uv_stride, int thresh, int ithresh,
+                         int hev_thresh) {
+  VP8HFilter16i(y, y_stride, thresh, ithresh, hev_thresh);
+  VP8HFilter8i(u, v, uv_stride, thresh, ithresh, hev_thresh);
+}
+
 //------------------------------------------------------------------------------
 
 static void DitherCombine8x8_C(const uint8_t* WEBP_RESTRICT dither,
@@ -735,6 +768,10 @@ VP8LumaFilterFunc VP8VFilter16i;
 VP8LumaFilterFunc VP8HFilter16i;
 VP8ChromaFilterFunc VP8VFilter8i;
 VP8ChromaFilterFunc VP8HFilter8i;
+VP8MacroblockFilterFunc VP8VFilterMB;
+VP8MacroblockFilterFunc VP8HFilterMB;
+VP8MacroblockFilterFunc VP8VFilterMBi;
+VP8MacroblockFilterFunc VP8HFilterMBi;
 VP8SimpleFilterFunc VP8SimpleVFilter16;
 VP8SimpleFilterFunc VP8SimpleHFilter16;
 VP8SimpleFilterFunc VP8SimpleVFilter16i;
@@ -746,6 +783,7 @@ void (*VP8DitherCombine8x8)(const uint8_t* WEBP_RESTRICT dither,
 extern VP8CPUInfo VP8GetCPUInfo;
 extern void VP8DspInitSSE2(void);
 extern void VP8DspInitSSE41(void);
+extern void VP8DspInitAVX2(void);
 extern void VP8DspInitNEON(void);
 extern void VP8DspInitMIPS32(void);
 extern void VP8DspInitMIPSdspR2(void);
@@ -780,6 +818,10 @@ WEBP_DSP_INIT_FUNC(VP8DspInit) {
   VP8HFilter8 = HFilter8_C;
   VP8HFilter8i = HFilter8i_C;
 #endif
+  VP8VFilterMB = VFilterMB_C;
+  VP8HFilterMB = HFilterMB_C;
+  VP8VFilterMBi = VFilterMBi_C;
+  VP8HFilterMBi = HFilterMBi_C;
 
 #if !WEBP_NEON_OMIT_C_CODE
   VP8PredLuma4[0] = DC4_C;
@@ -823,6 +865,11 @@ WEBP_DSP_INIT_FUNC(VP8DspInit) {
 #if defined(WEBP_HAVE_SSE41)
       if (VP8GetCPUInfo(kSSE4_1)) {
         VP8DspInitSSE41();
+#if defined(WEBP_HAVE_AVX2)
+        if (VP8GetCPUInfo(kAVX2)) {
+          VP8DspInitAVX2();
+        }
+#endif
       }
 #endif
     }
@@ -865,6 +912,10 @@ WEBP_DSP_INIT_FUNC(VP8DspInit) {
   assert(VP8HFilter16i != NULL);
   assert(VP8VFilter8i != NULL);
   assert(VP8HFilter8i != NULL);
+  assert(VP8VFilterMB != NULL);
+  assert(VP8HFilterMB != NULL);
+  assert(VP8VFilterMBi != NULL);
+  assert(VP8HFilterMBi != NULL);
   assert(VP8SimpleVFilter16 != NULL);
   assert(VP8SimpleHFilter16 != NULL);
   assert(VP8SimpleVFilter16i != NULL);
@@ -0,0 +1,800 @@
+// Copyright 2025 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+// AVX2 version of some decoding functions (idct, loop filtering).
+//
+// The 256-bit registers are used as two independent 128-bit lanes, each of
+// them processed exactly like the SSE2 code does: the loop filters handle the
+// luma edge of a macroblock in the low lane and the matching u/v edges in the
+// high lane, while the chroma transforms handle four 4x4 blocks at once.
+
+#include "src/dsp/dsp.h"
+
+#if defined(WEBP_USE_AVX2)
+#include <immintrin.h>
+
+#include "src/dec/vp8i_dec.h"
+#include "src/dsp/common_avx2.h"
+#include "src/dsp/cpu.h"
+#include "src/utils/utils.h"
+#include "src/webp/types.h"
+
+//------------------------------------------------------------------------------
+// Transforms (Paragraph 14.4)
+
+// Adds the 16b residuals of the low lane to the 8 pixels at 'dst', and those
+// of the high lane to the 8 pixels at 'dst + 4 * BPS', with saturation.
+static WEBP_INLINE void AddRows_AVX2(const __m256i* const residuals,
+                                     uint8_t* const dst) {
+  const __m128i top = _mm_loadl_epi64((const __m128i*)dst);
+  const __m128i bottom = _mm_loadl_epi64((const __m128i*)(dst + 4 * BPS));
+  const __m256i pixels = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(top, bottom));
+  // The lanes of 'pixels' hold the top and bottom rows, as do the residuals.
+  const __m256i sum = _mm256_add_epi16(pixels, *residuals);
+  const __m256i packed = _mm256_packus_epi16(sum, sum);
+  _mm_storel_epi64((__m128i*)dst, _mm256_castsi256_si128(packed));
+  _mm_storel_epi64((__m128i*)(dst + 4 * BPS),
+                   _mm256_extracti128_si256(packed, 1));
+}
+
+// Same as two calls to Transform_SSE2() with 'do_two' set: the blocks 0 and 1
+// are transformed in the low lane, the blocks 2 and 3 in the high lane.
+static void TransformUV_AVX2(const int16_t* WEBP_RESTRICT in,
+                             uint8_t* WEBP_RESTRICT dst) {
+  // See Transform_SSE2() for the 16b fixed point multiplication trick.
+  const __m256i k1 = _mm256_set1_epi16(20091);
+  const __m256i k2 = _mm256_set1_epi16(-30068);
+  __m256i T0, T1, T2, T3;
+  __m256i in0, in1, in2, in3;
+  {
+    // Each load holds one whole block: a0 a1 | a2 a3 (rows 0 to 3).
+    const __m256i A = _mm256_loadu_si256((const __m256i*)&in[0 * 16]);
+    const __m256i B = _mm256_loadu_si256((const __m256i*)&in[1 * 16]);
+    const __m256i C = _mm256_loadu_si256((const __m256i*)&in[2 * 16]);
+    const __m256i D = _mm256_loadu_si256((const __m256i*)&in[3 * 16]);
+    // a0 a1 | c0 c1     a2 a3 | c2 c3
+    const __m256i AC01 = _mm256_permute2x128_si256(A, C, 0x20);
+    const __m256i AC23 = _mm256_permute2x128_si256(A, C, 0x31);
+    // b0 b1 | d0 d1     b2 b3 | d2 d3
+    const __m256i BD01 = _mm256_permute2x128_si256(B, D, 0x20);
+    const __m256i BD23 = _mm256_permute2x128_si256(B, D, 0x31);
+    // a0 b0 | c0 d0     a1 b1 | c1 d1     a2 b2 | c2 d2     a3 b3 | c3 d3
+    in0 = _mm256_unpacklo_epi64(AC01, BD01);
+    in1 = _mm256_unpackhi_epi64(AC01, BD01);
+    in2 = _mm256_unpacklo_epi64(AC23, BD23);
+    in3 = _mm256_unpackhi_epi64(AC23, BD23);
+  }
+
+  // Vertical pass and subsequent transpose.
+  {
+    const __m256i a = _mm256_add_epi16(in0, in2);
+    const __m256i b = _mm256_sub_epi16(in0, in2);
+    // c = MUL(in1, K2) - MUL(in3, K1) = MUL(in1, k2) - MUL(in3, k1) + in1 - in3
+    const __m256i c1 = _mm256_mulhi_epi16(in1, k2);
+    const __m256i c2 = _mm256_mulhi_epi16(in3, k1);
+    const __m256i c3 = _mm256_sub_epi16(in1, in3);
+    const __m256i c4 = _mm256_sub_epi16(c1, c2);
+    const __m256i c = _mm256_add_epi16(c3, c4);
+    // d = MUL(in1, K1) + MUL(in3, K2) = MUL(in1, k1) + MUL(in3, k2) + in1 + in3
+    const __m256i d1 = _mm256_mulhi_epi16(in1, k1);
+    const __m256i d2 = _mm256_mulhi_epi16(in3, k2);
+    const __m256i d3 = _mm256_add_epi16(in1, in3);
+    const __m256i d4 = _mm256_add_epi16(d1, d2);
+    const __m256i d = _mm256_add_epi16(d3, d4);
+
+    const __m256i tmp0 = _mm256_add_epi16(a, d);
+    const __m256i tmp1 = _mm256_add_epi16(b, c);
+    const __m256i tmp2 = _mm256_sub_epi16(b, c);
+    const __m256i tmp3 = _mm256_sub_epi16(a, d);
+    VP8Transpose_4_4x4_16b(&tmp0, &tmp1, &tmp2, &tmp3, &T0, &T1, &T2, &T3);
+  }
+
+  // Horizontal pass and subsequent transpose.
+  {
+    const __m256i four = _mm256_set1_epi16(4);
+    const __m256i dc = _mm256_add_epi16(T0, four);
+    const __m256i a = _mm256_add_epi16(dc, T2);
+    const __m256i b = _mm256_sub_epi16(dc, T2);
+    const __m256i c1 = _mm256_mulhi_epi16(T1, k2);
+    const __m256i c2 = _mm256_mulhi_epi16(T3, k1);
+    const __m256i c3 = _mm256_sub_epi16(T1, T3);
+    const __m256i c4 = _mm256_sub_epi16(c1, c2);
+    const __m256i c = _mm256_add_epi16(c3, c4);
+    const __m256i d1 = _mm256_mulhi_epi16(T1, k1);
+    const __m256i d2 = _mm256_mulhi_epi16(T3, k2);
+    const __m256i d3 = _mm256_add_epi16(T1, T3);
+    const __m256i d4 = _mm256_add_epi16(d1, d2);
+    const __m256i d = _mm256_add_epi16(d3, d4);
+
+    const __m256i tmp0 = _mm256_add_epi16(a, d);
+    const __m256i tmp1 = _mm256_add_epi16(b, c);
+    const __m256i tmp2 = _mm256_sub_epi16(b, c);
+    const __m256i tmp3 = _mm256_sub_epi16(a, d);
+    const __m256i shifted0 = _mm256_srai_epi16(tmp0, 3);
+    const __m256i shifted1 = _mm256_srai_epi16(tmp1, 3);
+    const __m256i shifted2 = _mm256_srai_epi16(tmp2, 3);
+    const __m256i shifted3 = _mm256_srai_epi16(tmp3, 3);
+    VP8Transpose_4_4x4_16b(&shifted0, &shifted1, &shifted2, &shifted3, &T0,
+                           &T1, &T2, &T3);
+  }
+
+  // Add the inverse transforms to rows 0..3 (low lane) and 4..7 (high lane).
+  AddRows_AVX2(&T0, dst + 0 * BPS);
+  AddRows_AVX2(&T1, dst + 1 * BPS);
+  AddRows_AVX2(&T2, dst + 2 * BPS);
+  AddRows_AVX2(&T3, dst + 3 * BPS);
+}
+
+static void TransformDCUV_AVX2(const int16_t* WEBP_RESTRICT in,
+                               uint8_t* WEBP_RESTRICT dst) {
+  // A zero DC coefficient leaves its block untouched: (0 + 4) >> 3 = 0.
+  const int16_t dc0 = (int16_t)((in[0 * 16] + 4) >> 3);
+  const int16_t dc1 = (int16_t)((in[1 * 16] + 4) >> 3);
+  const int16_t dc2 = (int16_t)((in[2 * 16] + 4) >> 3);
+  const int16_t dc3 = (int16_t)((in[3 * 16] + 4) >> 3);
+  const __m256i residuals =
+      _mm256_setr_epi16(dc0, dc0, dc0, dc0, dc1, dc1, dc1, dc1, dc2, dc2, dc2,
+                        dc2, dc3, dc3, dc3, dc3);
+  AddRows_AVX2(&residuals, dst + 0 * BPS);
+  AddRows_AVX2(&residuals, dst + 1 * BPS);
+  AddRows_AVX2(&residuals, dst + 2 * BPS);
+  AddRows_AVX2(&residuals, dst + 3 * BPS);
+}
+
+//------------------------------------------------------------------------------
+// Loop Filter (Paragraph 15)
+
+// Compute abs(p - q) = subs(p - q) OR subs(q - p)
+#define MM_ABS(p, q) \
+  _mm256_or_si256(_mm256_subs_epu8((q), (p)), _mm256_subs_epu8((p), (q)))
+
+// Shift each byte of "x" by 3 bits while preserving by the sign bit.
+static WEBP_INLINE void SignedShift8b_AVX2(__m256i* const x) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i lo_0 = _mm256_unpacklo_epi8(zero, *x);
+  const __m256i hi_0 = _mm256_unpackhi_epi8(zero, *x);
+  const __m256i lo_1 = _mm256_srai_epi16(lo_0, 3 + 8);
+  const __m256i hi_1 = _mm256_srai_epi16(hi_0, 3 + 8);
+  *x = _mm256_packs_epi16(lo_1, hi_1);
+}
+
+#define FLIP_SIGN_BIT2(a, b)             \
+  do {                                   \
+    (a) = _mm256_xor_si256(a, sign_bit); \
+    (b) = _mm256_xor_si256(b, sign_bit); \
+  } while (0)
+
+#define FLIP_SIGN_BIT4(a, b, c, d) \
+  do {                             \
+    FLIP_SIGN_BIT2(a, b);          \
+    FLIP_SIGN_BIT2(c, d);          \
+  } while (0)
+
+// input/output is uint8_t
+static WEBP_INLINE void GetNotHEV_AVX2(const __m256i* const p1,
+                                       const __m256i* const p0,
+                                       const __m256i* const q0,
+                                       const __m256i* const q1, int hev_thresh,
+                                       __m256i* const not_hev) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i t_1 = MM_ABS(*p1, *p0);
+  const __m256i t_2 = MM_ABS(*q1, *q0);
+
+  const __m256i h = _mm256_set1_epi8(hev_thresh);
+  const __m256i t_max = _mm256_max_epu8(t_1, t_2);
+
+  const __m256i t_max_h = _mm256_subs_epu8(t_max, h);
+  // not_hev <= t1 && not_hev <= t2
+  *not_hev = _mm256_cmpeq_epi8(t_max_h, zero);
+}
+
+// input pixels are int8_t
+static WEBP_INLINE void GetBaseDelta_AVX2(const __m256i* const p1,
+                                          const __m256i* const p0,
+                                          const __m256i* const q0,
+                                          const __m256i* const q1,
+                                          __m256i* const delta) {
+  // beware of addition order, for saturation!
+  const __m256i p1_q1 = _mm256_subs_epi8(*p1, *q1);   // p1 - q1
+  const __m256i q0_p0 = _mm256_subs_epi8(*q0, *p0);   // q0 - p0
+  const __m256i s1 = _mm256_adds_epi8(p1_q1, q0_p0);  // p1 - q1 + 1 * (q0 - p0)
+  const __m256i s2 = _mm256_adds_epi8(q0_p0, s1);     // p1 - q1 + 2 * (q0 - p0)
+  const __m256i s3 = _mm256_adds_epi8(q0_p0, s2);     // p1 - q1 + 3 * (q0 - p0)
+  *delta = s3;
+}
+
+// input and output are int8_t
+static WEBP_INLINE void DoSimpleFilter_AVX2(__m256i* const p0,
+                                            __m256i* const q0,
+                                            const __m256i* const fl) {
+  const __m256i k3 = _mm256_set1_epi8(3);
+  const __m256i k4 = _mm256_set1_epi8(4);
+  __m256i v3 = _mm256_adds_epi8(*fl, k3);
+  __m256i v4 = _mm256_adds_epi8(*fl, k4);
+
+  SignedShift8b_AVX2(&v4);          // v4 >> 3
+  SignedShift8b_AVX2(&v3);          // v3 >> 3
+  *q0 = _mm256_subs_epi8(*q0, v4);  // q0 -= v4
+  *p0 = _mm256_adds_epi8(*p0, v3);  // p0 += v3
+}
+
+// Updates values of 2 pixels at MB edge during complex filtering.
+// Update operations:
+// q = q - delta and p = p + delta; where delta = [(a_hi >> 7), (a_lo >> 7)]
+// Pixels 'pi' and 'qi' are int8_t on input, uint8_t on output (sign flip).
+static WEBP_INLINE void Update2Pixels_AVX2(__m256i* const pi, __m256i* const qi,
+                                           const __m256i* const a0_lo,
+                                           const __m256i* const a0_hi) {
+  const __m256i a1_lo = _mm256_srai_epi16(*a0_lo, 7);
+  const __m256i a1_hi = _mm256_srai_epi16(*a0_hi, 7);
+  const __m256i delta = _mm256_packs_epi16(a1_lo, a1_hi);
+  const __m256i sign_bit = _mm256_set1_epi8((char)0x80);
+  *pi = _mm256_adds_epi8(*pi, delta);
+  *qi = _mm256_subs_epi8(*qi, delta);
+  FLIP_SIGN_BIT2(*pi, *qi);
+}
+
+// input pixels are uint8_t
+static WEBP_INLINE void NeedsFilter_AVX2(const __m256i* const p1,
+                                         const __m256i* const p0,
+                                         const __m256i* const q0,
+                                         const __m256i* const q1, int thresh,
+                                         __m256i* const mask) {
+  const __m256i m_thresh = _mm256_set1_epi8((char)thresh);
+  const __m256i t1 = MM_ABS(*p1, *q1);  // abs(p1 - q1)
+  const __m256i kFE = _mm256_set1_epi8((char)0xFE);
+  const __m256i t2 = _mm256_and_si256(t1, kFE);  // set lsb of each byte to zero
+  const __m256i t3 = _mm256_srli_epi16(t2, 1);   // abs(p1 - q1) / 2
+
+  const __m256i t4 = MM_ABS(*p0, *q0);          // abs(p0 - q0)
+  const __m256i t5 = _mm256_adds_epu8(t4, t4);  // abs(p0 - q0) * 2
+  const __m256i t6 = _mm256_adds_epu8(t5, t3);  // abs(p0-q0)*2 + abs(p1-q1)/2
+
+  const __m256i t7 = _mm256_subs_epu8(t6, m_thresh);  // mask <= m_thresh
+  *mask = _mm256_cmpeq_epi8(t7, _mm256_setzero_si256());
+}
+
+//------------------------------------------------------------------------------
+// Edge filtering functions
+
+// Applies filter on 4 pixels (p1, p0, q0 and q1)
+static WEBP_INLINE void DoFilter4_AVX2(__m256i* const p1, __m256i* const p0,
+                                       __m256i* const q0, __m256i* const q1,
+                                       const __m256i* const mask,
+                                       int hev_thresh) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i sign_bit = _mm256_set1_epi8((char)0x80);
+  const __m256i k64 = _mm256_set1_epi8(64);
+  const __m256i k3 = _mm256_set1_epi8(3);
+  const __m256i k4 = _mm256_set1_epi8(4);
+  __m256i not_hev;
+  __m256i t1, t2, t3;
+
+  // compute hev mask
+  GetNotHEV_AVX2(p1, p0, q0, q1, hev_thresh, &not_hev);
+
+  // convert to signed values
+  FLIP_SIGN_BIT4(*p1, *p0, *q0, *q1);
+
+  t1 = _mm256_subs_epi8(*p1, *q1);        // p1 - q1
+  t1 = _mm256_andnot_si256(not_hev, t1);  // hev(p1 - q1)
+  t2 = _mm256_subs_epi8(*q0, *p0);        // q0 - p0
+  t1 = _mm256_adds_epi8(t1, t2);          // hev(p1 - q1) + 1 * (q0 - p0)
+  t1 = _mm256_adds_epi8(t1, t2);          // hev(p1 - q1) + 2 * (q0 - p0)
+  t1 = _mm256_adds_epi8(t1, t2);          // hev(p1 - q1) + 3 * (q0 - p0)
+  t1 = _mm256_and_si256(t1, *mask);  // mask filter values we don't care about
+
+  t2 = _mm256_adds_epi8(t1, k3);    // 3 * (q0 - p0) + hev(p1 - q1) + 3
+  t3 = _mm256_adds_epi8(t1, k4);    // 3 * (q0 - p0) + hev(p1 - q1) + 4
+  SignedShift8b_AVX2(&t2);          // (3 * (q0 - p0) + hev(p1 - q1) + 3) >> 3
+  SignedShift8b_AVX2(&t3);          // (3 * (q0 - p0) + hev(p1 - q1) + 4) >> 3
+  *p0 = _mm256_adds_epi8(*p0, t2);  // p0 += t2
+  *q0 = _mm256_subs_epi8(*q0, t3);  // q0 -= t3
+  FLIP_SIGN_BIT2(*p0, *q0);
+
+  // this is equivalent to signed (a + 1) >> 1 calculation
+  t2 = _mm256_add_epi8(t3, sign_bit);
+  t3 = _mm256_avg_epu8(t2, zero);
+  t3 = _mm256_sub_epi8(t3, k64);
+
+  t3 = _mm256_and_si256(not_hev, t3);  // if !hev
+  *q1 = _mm256_subs_epi8(*q1, t3);     // q1 -= t3
+  *p1 = _mm256_adds_epi8(*p1, t3);     // p1 += t3
+  FLIP_SIGN_BIT2(*p1, *q1);
+}
+
+// Applies filter on 6 pixels (p2, p1, p0, q0, q1 and q2)
+static WEBP_INLINE void DoFilter6_AVX2(__m256i* const p2, __m256i* const p1,
+                                       __m256i* const p0, __m256i* const q0,
+                                       __m256i* const q1, __m256i* const q2,
+                                       const __m256i* const mask,
+                                       int hev_thresh) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i sign_bit = _mm256_set1_epi8((char)0x80);
+  __m256i a, not_hev;
+
+  // compute hev mask
+  GetNotHEV_AVX2(p1, p0, q0, q1, hev_thresh, &not_hev);
+
+  FLIP_SIGN_BIT4(*p1, *p0, *q0, *q1);
+  FLIP_SIGN_BIT2(*p2, *q2);
+  GetBaseDelta_AVX2(p1, p0, q0, q1, &a);
+
+  {  // do simple filter on pixels with hev
+    const __m256i m = _mm256_andnot_si256(not_hev, *mask);
+    const __m256i f = _mm256_and_si256(a, m);
+    DoSimpleFilter_AVX2(p0, q0, &f);
+  }
+
+  {  // do strong filter on pixels with not hev
+    const __m256i k9 = _mm256_set1_epi16(0x0900);
+    const __m256i k63 = _mm256_set1_epi16(63);
+
+    const __m256i m = _mm256_and_si256(not_hev, *mask);
+    const __m256i f = _mm256_and_si256(a, m);
+
+    const __m256i f_lo = _mm256_unpacklo_epi8(zero, f);
+    const __m256i f_hi = _mm256_unpackhi_epi8(zero, f);
+
+    const __m256i f9_lo = _mm256_mulhi_epi16(f_lo, k9);  // Filter (lo) * 9
+    const __m256i f9_hi = _mm256_mulhi_epi16(f_hi, k9);  // Filter (hi) * 9
+
+    const __m256i a2_lo = _mm256_add_epi16(f9_lo, k63);  // Filter * 9 + 63
+    const __m256i a2_hi = _mm256_add_epi16(f9_hi, k63);  // Filter * 9 + 63
+
+    const __m256i a1_lo = _mm256_add_epi16(a2_lo, f9_lo);  // Filter * 18 + 63
+    const __m256i a1_hi = _mm256_add_epi16(a2_hi, f9_hi);  // Filter * 18 + 63
+
+    const __m256i a0_lo = _mm256_add_epi16(a1_lo, f9_lo);  // Filter * 27 + 63
+    const __m256i a0_hi = _mm256_add_epi16(a1_hi, f9_hi);  // Filter * 27 + 63
+
+    Update2Pixels_AVX2(p2, q2, &a2_lo, &a2_hi);
+    Update2Pixels_AVX2(p1, q1, &a1_lo, &a1_hi);
+    Update2Pixels_AVX2(p0, q0, &a0_lo, &a0_hi);
+  }
+}
+
+#define MAX_DIFF1(p3, p2, p1, p0, m)          \
+  do {                                        \
+    (m) = MM_ABS(p1, p0);                     \
+    (m) = _mm256_max_epu8(m, MM_ABS(p3, p2)); \
+    (m) = _mm256_max_epu8(m, MM_ABS(p2, p1)); \
+  } while (0)
+
+#define MAX_DIFF2(p3, p2, p1, p0, m)          \
+  do {                                        \
+    (m) = _mm256_max_epu8(m, MM_ABS(p1, p0)); \
+    (m) = _mm256_max_epu8(m, MM_ABS(p3, p2)); \
+    (m) = _mm256_max_epu8(m, MM_ABS(p2, p1)); \
+  } while (0)
+
+static WEBP_INLINE void ComplexMask_AVX2(const __m256i* const p1,
+                                         const __m256i* const p0,
+                                         const __m256i* const q0,
+                                         const __m256i* const q1, int thresh,
+                                         int ithresh, __m256i* const mask) {
+  const __m256i it = _mm256_set1_epi8(ithresh);
+  const __m256i diff = _mm256_subs_epu8(*mask, it);
+  const __m256i thresh_mask = _mm256_cmpeq_epi8(diff, _mm256_setzero_si256());
+  __m256i filter_mask;
+  NeedsFilter_AVX2(p1, p0, q0, q1, thresh, &filter_mask);
+  *mask = _mm256_and_si256(thresh_mask, filter_mask);
+}
+
+//------------------------------------------------------------------------------
+// Loading and storing the samples around the edges. The luma samples go to the
+// low lane, the u and v ones to the high lane.
+
+static WEBP_INLINE __m256i Combine_AVX2(const __m128i* const lo,
+                                        const __m128i* const hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(*lo), *hi, 1);
+}
+
+// Loads the four rows starting at 'y', 'u' and 'v' across a horizontal edge.
+static WEBP_INLINE void LoadYUVRows4_AVX2(const uint8_t* y, int y_stride,
+                                          const uint8_t* u, const uint8_t* v,
+                                          int uv_stride, __m256i* const e1,
+                                          __m256i* const e2, __m256i* const e3,
+                                          __m256i* const e4) {
+  __m256i* const e[4] = {e1, e2, e3, e4};
+  int i;
+  for (i = 0; i < 4; ++i, y += y_stride, u += uv_stride, v += uv_stride) {
+    const __m128i Y = _mm_loadu_si128((const __m128i*)y);
+    const __m128i U = _mm_loadl_epi64((const __m128i*)u);
+    const __m128i V = _mm_loadl_epi64((const __m128i*)v);
+    const __m128i UV = _mm_unpacklo_epi64(U, V);
+    *e[i] = Combine_AVX2(&Y, &UV);
+  }
+}
+
+// Same as above for the luma samples only. The high lane is left undefined.
+static WEBP_INLINE void LoadYRows4_AVX2(const uint8_t* y, int y_stride,
+                                        __m256i* const e1, __m256i* const e2,
+                                        __m256i* const e3, __m256i* const e4) {
+  *e1 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&y[0]));
+  *e2 = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&y[y_stride]));
+  *e3 = _mm256_castsi128_si256(
+      _mm_loadu_si128((const __m128i*)&y[2 * y_stride]));
+  *e4 = _mm256_castsi128_si256(
+      _mm_loadu_si128((const __m128i*)&y[3 * y_stride]));
+}
+
+static WEBP_INLINE void StoreYUVRow_AVX2(const __m256i* const p, uint8_t* y,
+                                         uint8_t* u, uint8_t* v) {
+  const __m128i UV = _mm256_extracti128_si256(*p, 1);
+  _mm_storeu_si128((__m128i*)y, _mm256_castsi256_si128(*p));
+  _mm_storel_epi64((__m128i*)u, UV);
+  _mm_storel_epi64((__m128i*)v, _mm_srli_si128(UV, 8));
+}
+
+// reads 8 rows across a vertical edge.
+static WEBP_INLINE void Load8x4_AVX2(const uint8_t* const b, int stride,
+                                     __m128i* const p, __m128i* const q) {
+  // A0 = 63 62 61 60 23 22 21 20 43 42 41 40 03 02 01 00
+  // A1 = 73 72 71 70 33 32 31 30 53 52 51 50 13 12 11 10
+  const __m128i A0 = _mm_set_epi32(
+      WebPMemToInt32(&b[6 * stride]), WebPMemToInt32(&b[2 * stride]),
+      WebPMemToInt32(&b[4 * stride]), WebPMemToInt32(&b[0 * stride]));
+  const __m128i A1 = _mm_set_epi32(
+      WebPMemToInt32(&b[7 * stride]), WebPMemToInt32(&b[3 * stride]),
+      WebPMemToInt32(&b[5 * stride]), WebPMemToInt32(&b[1 * stride]));
+
+  // B0 = 53 43 52 42 51 41 50 40 13 03 12 02 11 01 10 00
+  // B1 = 73 63 72 62 71 61 70 60 33 23 32 22 31 21 30 20
+  const __m128i B0 = _mm_unpacklo_epi8(A0, A1);
+  const __m128i B1 = _mm_unpackhi_epi8(A0, A1);
+
+  // C0 = 33 23 13 03 32 22 12 02 31 21 11 01 30 20 10 00
+  // C1 = 73 63 53 43 72 62 52 42 71 61 51 41 70 60 50 40
+  const __m128i C0 = _mm_unpacklo_epi16(B0, B1);
+  const __m128i C1 = _mm_unpackhi_epi16(B0, B1);
+
+  // *p = 71 61 51 41 31 21 11 01 70 60 50 40 30 20 10 00
+  // *q = 73 63 53 43 33 23 13 03 72 62 52 42 32 22 12 02
+  *p = _mm_unpacklo_epi32(C0, C1);
+  *q = _mm_unpackhi_epi32(C0, C1);
+}
+
+// Reads 16 rows ('r0' pointing to the first 8, 'r8' to the last 8) of four
+// columns and transposes them. See Load16x4_SSE2() for the layout.
+static WEBP_INLINE void Load16x4_AVX2(const uint8_t* const r0,
+                                      const uint8_t* const r8, int stride,
+                                      __m128i* const p1, __m128i* const p0,
+                                      __m128i* const q0, __m128i* const q1) {
+  Load8x4_AVX2(r0, stride, p1, q0);
+  Load8x4_AVX2(r8, stride, p0, q1);
+  {
+    const __m128i t1 = *p1;
+    const __m128i t2 = *q0;
+    *p1 = _mm_unpacklo_epi64(t1, *p0);
+    *p0 = _mm_unpackhi_epi64(t1, *p0);
+    *q0 = _mm_unpacklo_epi64(t2, *q1);
+    *q1 = _mm_unpackhi_epi64(t2, *q1);
+  }
+}
+
+static WEBP_INLINE void Store4x4_AVX2(__m128i* const x, uint8_t* dst,
+                                      int stride) {
+  int i;
+  for (i = 0; i < 4; ++i, dst += stride) {
+    WebPInt32ToMem(dst, _mm_cvtsi128_si32(*x));
+    *x = _mm_srli_si128(*x, 4);
+  }
+}
+
+// Transpose back and store
+static WEBP_INLINE void Store16x4_AVX2(const __m128i* const p1,
+                                       const __m128i* const p0,
+                                       const __m128i* const q0,
+                                       const __m128i* const q1, uint8_t* r0,
+                                       uint8_t* r8, int stride) {
+  __m128i t1, p1_s, p0_s, q0_s, q1_s;
+
+  t1 = *p0;
+  p0_s = _mm_unpacklo_epi8(*p1, t1);
+  p1_s = _mm_unpackhi_epi8(*p1, t1);
+
+  t1 = *q0;
+  q0_s = _mm_unpacklo_epi8(t1, *q1);
+  q1_s = _mm_unpackhi_epi8(t1, *q1);
+
+  t1 = p0_s;
+  p0_s = _mm_unpacklo_epi16(t1, q0_s);
+  q0_s = _mm_unpackhi_epi16(t1, q0_s);
+
+  t1 = p1_s;
+  p1_s = _mm_unpacklo_epi16(t1, q1_s);
+  q1_s = _mm_unpackhi_epi16(t1, q1_s);
+
+  Store4x4_AVX2(&p0_s, r0, stride);
+  r0 += 4 * stride;
+  Store4x4_AVX2(&q0_s, r0, stride);
+
+  Store4x4_AVX2(&p1_s, r8, stride);
+  r8 += 4 * stride;
+  Store4x4_AVX2(&q1_s, r8, stride);
+}
+
+// Reads four columns of 8 rows at 'lo' (low lane) and 'hi' (high lane) across
+// a vertical edge. See Load8x4_AVX2() for the layout of each lane.
+static WEBP_INLINE void Load8x4x2_AVX2(const uint8_t* const lo, int lo_stride,
+                                       const uint8_t* const hi, int hi_stride,
+                                       __m256i* const p, __m256i* const q) {
+  const __m256i A0 = _mm256_set_epi32(
+      WebPMemToInt32(&hi[6 * hi_stride]), WebPMemToInt32(&hi[2 * hi_stride]),
+      WebPMemToInt32(&hi[4 * hi_stride]), WebPMemToInt32(&hi[0 * hi_stride]),
+      WebPMemToInt32(&lo[6 * lo_stride]), WebPMemToInt32(&lo[2 * lo_stride]),
+      WebPMemToInt32(&lo[4 * lo_stride]), WebPMemToInt32(&lo[0 * lo_stride]));
+  const __m256i A1 = _mm256_set_epi32(
+      WebPMemToInt32(&hi[7 * hi_stride]), WebPMemToInt32(&hi[3 * hi_stride]),
+      WebPMemToInt32(&hi[5 * hi_stride]), WebPMemToInt32(&hi[1 * hi_stride]),
+      WebPMemToInt32(&lo[7 * lo_stride]), WebPMemToInt32(&lo[3 * lo_stride]),
+      WebPMemToInt32(&lo[5 * lo_stride]), WebPMemToInt32(&lo[1 * lo_stride]));
+  const __m256i B0 = _mm256_unpacklo_epi8(A0, A1);
+  const __m256i B1 = _mm256_unpackhi_epi8(A0, A1);
+  const __m256i C0 = _mm256_unpacklo_epi16(B0, B1);
+  const __m256i C1 = _mm256_unpackhi_epi16(B0, B1);
+  *p = _mm256_unpacklo_epi32(C0, C1);
+  *q = _mm256_unpackhi_epi32(C0, C1);
+}
+
+// Reads four columns of the 16 luma rows at 'y' and of the 8 u and v rows.
+static WEBP_INLINE void LoadYUVCols4_AVX2(const uint8_t* const y, int y_stride,
+                                          const uint8_t* const u,
+                                          const uint8_t* const v,
+                                          int uv_stride, __m256i* const p1,
+                                          __m256i* const p0, __m256i* const q0,
+                                          __m256i* const q1) {
+  __m256i t1, t2;
+  Load8x4x2_AVX2(y, y_stride, u, uv_stride, &t1, &t2);
+  Load8x4x2_AVX2(y + 8 * y_stride, y_stride, v, uv_stride, p0, q1);
+  *p1 = _mm256_unpacklo_epi64(t1, *p0);
+  *p0 = _mm256_unpackhi_epi64(t1, *p0);
+  *q0 = _mm256_unpacklo_epi64(t2, *q1);
+  *q1 = _mm256_unpackhi_epi64(t2, *q1);
+}
+
+// Same as above for the luma samples only. The high lane is left undefined.
+static WEBP_INLINE void LoadYCols4_AVX2(const uint8_t* const y, int y_stride,
+                                        __m256i* const p1, __m256i* const p0,
+                                        __m256i* const q0, __m256i* const q1) {
+  __m128i y_p1, y_p0, y_q0, y_q1;
+  Load16x4_AVX2(y, y + 8 * y_stride, y_stride, &y_p1, &y_p0, &y_q0, &y_q1);
+  *p1 = _mm256_castsi128_si256(y_p1);
+  *p0 = _mm256_castsi128_si256(y_p0);
+  *q0 = _mm256_castsi128_si256(y_q0);
+  *q1 = _mm256_castsi128_si256(y_q1);
+}
+
+static WEBP_INLINE void StoreYCols4_AVX2(const __m256i* const p1,
+                                         const __m256i* const p0,
+                                         const __m256i* const q0,
+                                         const __m256i* const q1,
+                                         uint8_t* const y, int y_stride) {
+  const __m128i y_p1 = _mm256_castsi256_si128(*p1);
+  const __m128i y_p0 = _mm256_castsi256_si128(*p0);
+  const __m128i y_q0 = _mm256_castsi256_si128(*q0);
+  const __m128i y_q1 = _mm256_castsi256_si128(*q1);
+  Store16x4_AVX2(&y_p1, &y_p0, &y_q0, &y_q1, y, y + 8 * y_stride, y_stride);
+}
+
+// Transposes back the columns of both lanes, and stores them.
+static WEBP_INLINE void StoreYUVCols4_AVX2(
+    const __m256i* const p1, const __m256i* const p0, const __m256i* const q0,
+    const __m256i* const q1, uint8_t* const y, int y_stride, uint8_t* const u,
+    uint8_t* const v, int uv_stride) {
+  const __m256i p0_s = _mm256_unpacklo_epi8(*p1, *p0);
+  const __m256i p1_s = _mm256_unpackhi_epi8(*p1, *p0);
+  const __m256i q0_s = _mm256_unpacklo_epi8(*q0, *q1);
+  const __m256i q1_s = _mm256_unpackhi_epi8(*q0, *q1);
+  // rows 0..3 | 4..7 of the low lane ('y' and 'u') and of the high lane.
+  const __m256i r0 = _mm256_unpacklo_epi16(p0_s, q0_s);
+  const __m256i r4 = _mm256_unpackhi_epi16(p0_s, q0_s);
+  // rows 8..11 | 12..15 ('y + 8 * y_stride' and 'v').
+  const __m256i r8 = _mm256_unpacklo_epi16(p1_s, q1_s);
+  const __m256i r12 = _mm256_unpackhi_epi16(p1_s, q1_s);
+  __m128i x;
+  x = _mm256_castsi256_si128(r0);
+  Store4x4_AVX2(&x, y, y_stride);
+  x = _mm256_castsi256_si128(r4);
+  Store4x4_AVX2(&x, y + 4 * y_stride, y_stride);
+  x = _mm256_castsi256_si128(r8);
+  Store4x4_AVX2(&x, y + 8 * y_stride, y_stride);
+  x = _mm256_castsi256_si128(r12);
+  Store4x4_AVX2(&x, y + 12 * y_stride, y_stride);
+  x = _mm256_extracti128_si256(r0, 1);
+  Store4x4_AVX2(&x, u, uv_stride);
+  x = _mm256_extracti128_si256(r4, 1);
+  Store4x4_AVX2(&x, u + 4 * uv_stride, uv_stride);
+  x = _mm256_extracti128_si256(r8, 1);
+  Store4x4_AVX2(&x, v, uv_stride);
+  x = _mm256_extracti128_si256(r12, 1);
+  Store4x4_AVX2(&x, v + 4 * uv_stride, uv_stride);
+}
+
+//------------------------------------------------------------------------------
+// Complex In-loop filtering (Paragraph 15.3), on the luma and chroma edges of
+// a macroblock at once.
+
+// on macroblock edges
+static void VFilterMB_AVX2(uint8_t* WEBP_RESTRICT y, int y_stride,
+                           uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                           int uv_stride, int thresh, int ithresh,
+                           int hev_thresh) {
+  __m256i t1;
+  __m256i mask;
+  __m256i p2, p1, p0, q0, q1, q2;
+
+  // Load p3, p2, p1, p0
+  LoadYUVRows4_AVX2(y - 4 * y_stride, y_stride, u - 4 * uv_stride,
+                    v - 4 * uv_stride, uv_stride, &t1, &p2, &p1, &p0);
+  MAX_DIFF1(t1, p2, p1, p0, mask);
+
+  // Load q0, q1, q2, q3
+  LoadYUVRows4_AVX2(y, y_stride, u, v, uv_stride, &q0, &q1, &q2, &t1);
+  MAX_DIFF2(t1, q2, q1, q0, mask);
+
+  ComplexMask_AVX2(&p1, &p0, &q0, &q1, thresh, ithresh, &mask);
+  DoFilter6_AVX2(&p2, &p1, &p0, &q0, &q1, &q2, &mask, hev_thresh);
+
+  // Store
+  StoreYUVRow_AVX2(&p2, y - 3 * y_stride, u - 3 * uv_stride,
+                   v - 3 * uv_stride);
+  StoreYUVRow_AVX2(&p1, y - 2 * y_stride, u - 2 * uv_stride,
+                   v - 2 * uv_stride);
+  StoreYUVRow_AVX2(&p0, y - 1 * y_stride, u - 1 * uv_stride,
+                   v - 1 * uv_stride);
+  StoreYUVRow_AVX2(&q0, y, u, v);
+  StoreYUVRow_AVX2(&q1, y + 1 * y_stride, u + 1 * uv_stride,
+                   v + 1 * uv_stride);
+  StoreYUVRow_AVX2(&q2, y + 2 * y_stride, u + 2 * uv_stride,
+                   v + 2 * uv_stride);
+}
+
+static void HFilterMB_AVX2(uint8_t* WEBP_RESTRICT y, int y_stride,
+                           uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                           int uv_stride, int thresh, int ithresh,
+                           int hev_thresh) {
+  __m256i mask;
+  __m256i p3, p2, p1, p0, q0, q1, q2, q3;
+
+  LoadYUVCols4_AVX2(y - 4, y_stride, u - 4, v - 4, uv_stride, &p3, &p2, &p1,
+                    &p0);
+  MAX_DIFF1(p3, p2, p1, p0, mask);
+
+  LoadYUVCols4_AVX2(y, y_stride, u, v, uv_stride, &q0, &q1, &q2, &q3);
+  MAX_DIFF2(q3, q2, q1, q0, mask);
+
+  ComplexMask_AVX2(&p1, &p0, &q0, &q1, thresh, ithresh, &mask);
+  DoFilter6_AVX2(&p2, &p1, &p0, &q0, &q1, &q2, &mask, hev_thresh);
+
+  StoreYUVCols4_AVX2(&p3, &p2, &p1, &p0, y - 4, y_stride, u - 4, v - 4,
+                     uv_stride);
+  StoreYUVCols4_AVX2(&q0, &q1, &q2, &q3, y, y_stride, u, v, uv_stride);
+}
+
+// on inner edges: the first luma one is filtered along with the only chroma
+// one, the two others with the luma lane only.
+static void VFilterMBi_AVX2(uint8_t* WEBP_RESTRICT y, int y_stride,
+                            uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                            int uv_stride, int thresh, int ithresh,
+                            int hev_thresh) {
+  int k;
+  __m256i p3, p2, p1, p0;  // loop invariants
+
+  LoadYUVRows4_AVX2(y, y_stride, u, v, uv_stride, &p3, &p2, &p1, &p0);
+
+  for (k = 3; k > 0; --k) {
+    __m256i mask, tmp1, tmp2;
+    uint8_t* const b = y + 2 * y_stride;  // beginning of p1
+    y += 4 * y_stride;
+
+    MAX_DIFF1(p3, p2, p1, p0, mask);  // compute partial mask
+    if (k == 3) {
+      LoadYUVRows4_AVX2(y, y_stride, u + 4 * uv_stride, v + 4 * uv_stride,
+                        uv_stride, &p3, &p2, &tmp1, &tmp2);
+    } else {
+      LoadYRows4_AVX2(y, y_stride, &p3, &p2, &tmp1, &tmp2);
+    }
+    MAX_DIFF2(p3, p2, tmp1, tmp2, mask);
+
+    // p3 and p2 are not just temporary variables here: they will be
+    // re-used for next span. And q2/q3 will become p1/p0 accordingly.
+    ComplexMask_AVX2(&p1, &p0, &p3, &p2, thresh, ithresh, &mask);
+    DoFilter4_AVX2(&p1, &p0, &p3, &p2, &mask, hev_thresh);
+
+    // Store
+    if (k == 3) {
+      uint8_t* const bu = u + 2 * uv_stride;
+      uint8_t* const bv = v + 2 * uv_stride;
+      StoreYUVRow_AVX2(&p1, b, bu, bv);
+      StoreYUVRow_AVX2(&p0, b + y_stride, bu + uv_stride, bv + uv_stride);
+      StoreYUVRow_AVX2(&p3, b + 2 * y_stride, bu + 2 * uv_stride,
+                       bv + 2 * uv_stride);
+      StoreYUVRow_AVX2(&p2, b + 3 * y_stride, bu + 3 * uv_stride,
+                       bv + 3 * uv_stride);
+    } else {
+      _mm_storeu_si128((__m128i*)&b[0 * y_stride], _mm256_castsi256_si128(p1));
+      _mm_storeu_si128((__m128i*)&b[1 * y_stride], _mm256_castsi256_si128(p0));
+      _mm_storeu_si128((__m128i*)&b[2 * y_stride], _mm256_castsi256_si128(p3));
+      _mm_storeu_si128((__m128i*)&b[3 * y_stride], _mm256_castsi256_si128(p2));
+    }
+
+    // rotate samples
+    p1 = tmp1;
+    p0 = tmp2;
+  }
+}
+
+static void HFilterMBi_AVX2(uint8_t* WEBP_RESTRICT y, int y_stride,
+                            uint8_t* WEBP_RESTRICT u, uint8_t* WEBP_RESTRICT v,
+                            int uv_stride, int thresh, int ithresh,
+                            int hev_thresh) {
+  int k;
+  __m256i p3, p2, p1, p0;  // loop invariants
+
+  LoadYUVCols4_AVX2(y, y_stride, u, v, uv_stride, &p3, &p2, &p1, &p0);
+
+  for (k = 3; k > 0; --k) {
+    __m256i mask, tmp1, tmp2;
+    uint8_t* const b = y + 2;  // beginning of p1
+
+    y += 4;  // beginning of q0 (and next span)
+
+    MAX_DIFF1(p3, p2, p1, p0, mask);  // compute partial mask
+    if (k == 3) {
+      LoadYUVCols4_AVX2(y, y_stride, u + 4, v + 4, uv_stride, &p3, &p2, &tmp1,
+                        &tmp2);
+    } else {
+      LoadYCols4_AVX2(y, y_stride, &p3, &p2, &tmp1, &tmp2);
+    }
+    MAX_DIFF2(p3, p2, tmp1, tmp2, mask);
+
+    ComplexMask_AVX2(&p1, &p0, &p3, &p2, thresh, ithresh, &mask);
+    DoFilter4_AVX2(&p1, &p0, &p3, &p2, &mask, hev_thresh);
+
+    if (k == 3) {
+      StoreYUVCols4_AVX2(&p1, &p0, &p3, &p2, b, y_stride, u + 2, v + 2,
+                         uv_stride);
+    } else {
+      StoreYCols4_AVX2(&p1, &p0, &p3, &p2, b, y_stride);
+    }
+
+    // rotate samples
+    p1 = tmp1;
+    p0 = tmp2;
+  }
+}
+
+#undef MAX_DIFF1
+#undef MAX_DIFF2
+#undef FLIP_SIGN_BIT2
+#undef FLIP_SIGN_BIT4
+#undef MM_ABS
+
+//------------------------------------------------------------------------------
+// Entry point
+
+extern void VP8DspInitAVX2(void);
+
+WEBP_TSAN_IGNORE_FUNCTION void VP8DspInitAVX2(void) {
+  VP8TransformUV = TransformUV_AVX2;
+  VP8TransformDCUV = TransformDCUV_AVX2;
+
+  VP8VFilterMB = VFilterMB_AVX2;
+  VP8HFilterMB = HFilterMB_AVX2;
+  VP8VFilterMBi = VFilterMBi_AVX2;
+  VP8HFilterMBi = HFilterMBi_AVX2;
+}
+
+#else  // !WEBP_USE_AVX2
+
+WEBP_DSP_INIT_STUB(VP8DspInitAVX2)
+
+#endif  // WEBP_USE_AVX2
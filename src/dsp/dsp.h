@@ -268,6 +268,16 @@ extern VP8LumaFilterFunc VP8HFilter16i;
 extern VP8ChromaFilterFunc VP8VFilter8i;  // filtering u and v altogether
 extern VP8ChromaFilterFunc VP8HFilter8i;
 
+// on the luma and chroma edges of a macroblock altogether
+typedef void (*VP8MacroblockFilterFunc)(uint8_t* WEBP_RESTRICT y, int y_stride,
+                                        uint8_t* WEBP_RESTRICT u,
+                                        uint8_t* WEBP_RESTRICT v, int uv_stride,
+                                        int thresh, int ithresh, int hev_t);
+extern VP8MacroblockFilterFunc VP8VFilterMB;   // VP8VFilter16 + VP8VFilter8
+extern VP8MacroblockFilterFunc VP8HFilterMB;   // VP8HFilter16 + VP8HFilter8
+extern VP8MacroblockFilterFunc VP8VFilterMBi;  // VP8VFilter16i + VP8VFilter8i
+extern VP8MacroblockFilterFunc VP8HFilterMBi;  // VP8HFilter16i + VP8HFilter8i
+
 // Dithering. Combines dithering values (centered around 128) with dst[],
 // according to: dst[] = clip(dst[] + (((dither[]-128) + 8) >> 4)
 #define VP8_DITHER_DESCALE 4
@@ -0,0 +1,526 @@
+// Copyright 2025 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+// AVX2 version of some encoding functions.
+//
+// Most functions handle two 4x4 blocks at once, one per 128-bit lane, each of
+// them processed the same way as in the SSE2/SSE4.1 code.
+
+#include "src/dsp/dsp.h"
+
+#if defined(WEBP_USE_AVX2)
+#include <assert.h>
+#include <immintrin.h>
+
+#include "src/dsp/common_avx2.h"
+#include "src/dsp/cpu.h"
+#include "src/enc/vp8i_enc.h"
+#include "src/webp/types.h"
+
+// Returns a register with 'lo' in the low lane and 'hi' in the high lane.
+static WEBP_INLINE __m256i Combine_AVX2(const __m128i lo, const __m128i hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+// Stores the low lane of 'v' at 'lo' and the high lane at 'hi'.
+static WEBP_INLINE void Store2x128_AVX2(const __m256i v, int16_t* const lo,
+                                        int16_t* const hi) {
+  _mm_storeu_si128((__m128i*)lo, _mm256_castsi256_si128(v));
+  _mm_storeu_si128((__m128i*)hi, _mm256_extracti128_si256(v, 1));
+}
+
+// Returns the sum of the eight 32b values of 'v'.
+static WEBP_INLINE int HorizontalSum_AVX2(const __m256i v) {
+  const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(v),
+                                     _mm256_extracti128_si256(v, 1));
+  const __m128i sum2 = _mm_add_epi32(sum4, _mm_srli_si128(sum4, 8));
+  const __m128i sum1 = _mm_add_epi32(sum2, _mm_srli_si128(sum2, 4));
+  return _mm_cvtsi128_si32(sum1);
+}
+
+//------------------------------------------------------------------------------
+// Transforms (Paragraph 14.4)
+
+// See FTransformPass1_SSE2(): the two lanes hold one block each.
+static void FTransformPass1_AVX2(const __m256i* const in01,
+                                 const __m256i* const in23,
+                                 __m256i* const out01, __m256i* const out32) {
+  const __m256i k937 = _mm256_set1_epi32(937);
+  const __m256i k1812 = _mm256_set1_epi32(1812);
+
+  const __m256i k88p = _mm256_set1_epi16(8);
+  const __m256i k88m = _mm256_set1_epi32((int)0xfff80008);  // [8, -8, ...]
+  const __m256i k5352_2217p = _mm256_set1_epi32((2217 << 16) | 5352);
+  const __m256i k5352_2217m =
+      _mm256_set1_epi32((int)(((uint32_t)-5352 << 16) | 2217));
+
+  // *in01 = 00 01 10 11 02 03 12 13
+  // *in23 = 20 21 30 31 22 23 32 33
+  const __m256i shuf01_p =
+      _mm256_shufflehi_epi16(*in01, _MM_SHUFFLE(2, 3, 0, 1));
+  const __m256i shuf23_p =
+      _mm256_shufflehi_epi16(*in23, _MM_SHUFFLE(2, 3, 0, 1));
+  // 00 01 10 11 03 02 13 12
+  // 20 21 30 31 23 22 33 32
+  const __m256i s01 = _mm256_unpacklo_epi64(shuf01_p, shuf23_p);
+  const __m256i s32 = _mm256_unpackhi_epi64(shuf01_p, shuf23_p);
+  // 00 01 10 11 20 21 30 31
+  // 03 02 13 12 23 22 33 32
+  const __m256i a01 = _mm256_add_epi16(s01, s32);
+  const __m256i a32 = _mm256_sub_epi16(s01, s32);
+  // [d0 + d3 | d1 + d2 | ...] = [a0 a1 | a0' a1' | ... ]
+  // [d0 - d3 | d1 - d2 | ...] = [a3 a2 | a3' a2' | ... ]
+
+  const __m256i tmp0 = _mm256_madd_epi16(a01, k88p);  // [ (a0 + a1) << 3, ...]
+  const __m256i tmp2 = _mm256_madd_epi16(a01, k88m);  // [ (a0 - a1) << 3, ...]
+  const __m256i tmp1_1 = _mm256_madd_epi16(a32, k5352_2217p);
+  const __m256i tmp3_1 = _mm256_madd_epi16(a32, k5352_2217m);
+  const __m256i tmp1_2 = _mm256_add_epi32(tmp1_1, k1812);
+  const __m256i tmp3_2 = _mm256_add_epi32(tmp3_1, k937);
+  const __m256i tmp1 = _mm256_srai_epi32(tmp1_2, 9);
+  const __m256i tmp3 = _mm256_srai_epi32(tmp3_2, 9);
+  const __m256i s03 = _mm256_packs_epi32(tmp0, tmp2);
+  const __m256i s12 = _mm256_packs_epi32(tmp1, tmp3);
+  const __m256i s_lo = _mm256_unpacklo_epi16(s03, s12);  // 0 1 0 1 0 1...
+  const __m256i s_hi = _mm256_unpackhi_epi16(s03, s12);  // 2 3 2 3 2 3
+  const __m256i v23 = _mm256_unpackhi_epi32(s_lo, s_hi);
+  *out01 = _mm256_unpacklo_epi32(s_lo, s_hi);
+  *out32 = _mm256_shuffle_epi32(v23, _MM_SHUFFLE(1, 0, 3, 2));  // 3 2 3 2 ..
+}
+
+// See FTransformPass2_SSE2(). The coefficients of the block of the low lane
+// are stored in out[0..15], the ones of the high lane in out[16..31].
+static void FTransformPass2_AVX2(const __m256i* const v01,
+                                 const __m256i* const v32,
+                                 int16_t* WEBP_RESTRICT out) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i seven = _mm256_set1_epi16(7);
+  const __m256i k5352_2217 = _mm256_set1_epi32((5352 << 16) | 2217);
+  const __m256i k2217_5352 =
+      _mm256_set1_epi32((int)((2217u << 16) | (uint16_t)-5352));
+  const __m256i k12000_plus_one = _mm256_set1_epi32(12000 + (1 << 16));
+  const __m256i k51000 = _mm256_set1_epi32(51000);
+
+  // Same operations are done on the (0,3) and (1,2) pairs.
+  // a3 = v0 - v3
+  // a2 = v1 - v2
+  const __m256i a32 = _mm256_sub_epi16(*v01, *v32);
+  const __m256i a22 = _mm256_unpackhi_epi64(a32, a32);
+
+  const __m256i b23 = _mm256_unpacklo_epi16(a22, a32);
+  const __m256i c1 = _mm256_madd_epi16(b23, k5352_2217);
+  const __m256i c3 = _mm256_madd_epi16(b23, k2217_5352);
+  const __m256i d1 = _mm256_add_epi32(c1, k12000_plus_one);
+  const __m256i d3 = _mm256_add_epi32(c3, k51000);
+  const __m256i e1 = _mm256_srai_epi32(d1, 16);
+  const __m256i e3 = _mm256_srai_epi32(d3, 16);
+  // f1 = ((b3 * 5352 + b2 * 2217 + 12000) >> 16)
+  // f3 = ((b3 * 2217 - b2 * 5352 + 51000) >> 16)
+  const __m256i f1 = _mm256_packs_epi32(e1, e1);
+  const __m256i f3 = _mm256_packs_epi32(e3, e3);
+  // g1 = f1 + (a3 != 0), see FTransformPass2_SSE2().
+  const __m256i g1 = _mm256_add_epi16(f1, _mm256_cmpeq_epi16(a32, zero));
+
+  // a0 = v0 + v3
+  // a1 = v1 + v2
+  const __m256i a01 = _mm256_add_epi16(*v01, *v32);
+  const __m256i a01_plus_7 = _mm256_add_epi16(a01, seven);
+  const __m256i a11 = _mm256_unpackhi_epi64(a01, a01);
+  const __m256i c0 = _mm256_add_epi16(a01_plus_7, a11);
+  const __m256i c2 = _mm256_sub_epi16(a01_plus_7, a11);
+  // d0 = (a0 + a1 + 7) >> 4;
+  // d2 = (a0 - a1 + 7) >> 4;
+  const __m256i d0 = _mm256_srai_epi16(c0, 4);
+  const __m256i d2 = _mm256_srai_epi16(c2, 4);
+
+  const __m256i d0_g1 = _mm256_unpacklo_epi64(d0, g1);
+  const __m256i d2_f3 = _mm256_unpacklo_epi64(d2, f3);
+  _mm256_storeu_si256((__m256i*)&out[0],
+                      _mm256_permute2x128_si256(d0_g1, d2_f3, 0x20));
+  _mm256_storeu_si256((__m256i*)&out[16],
+                      _mm256_permute2x128_si256(d0_g1, d2_f3, 0x31));
+}
+
+static void FTransform2_AVX2(const uint8_t* WEBP_RESTRICT src,
+                             const uint8_t* WEBP_RESTRICT ref,
+                             int16_t* WEBP_RESTRICT out) {
+  __m256i shuf01, shuf23;
+  {
+    // Load src and ref, two rows at a time, and convert them to 16b.
+    const __m128i src0 = _mm_loadl_epi64((const __m128i*)&src[0 * BPS]);
+    const __m128i src1 = _mm_loadl_epi64((const __m128i*)&src[1 * BPS]);
+    const __m128i src2 = _mm_loadl_epi64((const __m128i*)&src[2 * BPS]);
+    const __m128i src3 = _mm_loadl_epi64((const __m128i*)&src[3 * BPS]);
+    const __m128i ref0 = _mm_loadl_epi64((const __m128i*)&ref[0 * BPS]);
+    const __m128i ref1 = _mm_loadl_epi64((const __m128i*)&ref[1 * BPS]);
+    const __m128i ref2 = _mm_loadl_epi64((const __m128i*)&ref[2 * BPS]);
+    const __m128i ref3 = _mm_loadl_epi64((const __m128i*)&ref[3 * BPS]);
+    const __m256i src01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(src0, src1));
+    const __m256i src23 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(src2, src3));
+    const __m256i ref01 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(ref0, ref1));
+    const __m256i ref23 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(ref2, ref3));
+    // Compute difference. -> 00 01 02 03 00' 01' 02' 03' | 10 .. 13 10' .. 13'
+    const __m256i diff01 = _mm256_sub_epi16(src01, ref01);
+    const __m256i diff23 = _mm256_sub_epi16(src23, ref23);
+    // Gather the rows of each block in its own lane.
+    // -> 00 01 02 03 10 11 12 13 | 00' 01' 02' 03' 10' 11' 12' 13'
+    const __m256i rows01 =
+        _mm256_permute4x64_epi64(diff01, _MM_SHUFFLE(3, 1, 2, 0));
+    const __m256i rows23 =
+        _mm256_permute4x64_epi64(diff23, _MM_SHUFFLE(3, 1, 2, 0));
+    // -> 00 01 10 11 02 03 12 13 | 00' 01' 10' 11' 02' 03' 12' 13'
+    shuf01 = _mm256_shuffle_epi32(rows01, _MM_SHUFFLE(3, 1, 2, 0));
+    shuf23 = _mm256_shuffle_epi32(rows23, _MM_SHUFFLE(3, 1, 2, 0));
+  }
+  {
+    __m256i v01, v32;
+    FTransformPass1_AVX2(&shuf01, &shuf23, &v01, &v32);
+    FTransformPass2_AVX2(&v01, &v32, out);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Compute susceptibility based on DCT-coeff histograms.
+
+static void CollectHistogram_AVX2(const uint8_t* WEBP_RESTRICT ref,
+                                  const uint8_t* WEBP_RESTRICT pred,
+                                  int start_block, int end_block,
+                                  VP8Histogram* WEBP_RESTRICT const histo) {
+  const __m256i max_coeff_thresh = _mm256_set1_epi16(MAX_COEFF_THRESH);
+  int j;
+  int distribution[MAX_COEFF_THRESH + 1] = {0};
+  // Blocks come in horizontally adjacent pairs (see VP8DspScan[]).
+  assert(!(start_block & 1) && !(end_block & 1));
+  for (j = start_block; j < end_block; j += 2) {
+    int16_t out[32];
+    int k;
+
+    FTransform2_AVX2(ref + VP8DspScan[j], pred + VP8DspScan[j], out);
+
+    // Convert coefficients to bin (within out[]).
+    {
+      // Load.
+      const __m256i out0 = _mm256_loadu_si256((__m256i*)&out[0]);
+      const __m256i out1 = _mm256_loadu_si256((__m256i*)&out[16]);
+      // v = abs(out) >> 3
+      const __m256i abs0 = _mm256_abs_epi16(out0);
+      const __m256i abs1 = _mm256_abs_epi16(out1);
+      const __m256i v0 = _mm256_srai_epi16(abs0, 3);
+      const __m256i v1 = _mm256_srai_epi16(abs1, 3);
+      // bin = min(v, MAX_COEFF_THRESH)
+      const __m256i bin0 = _mm256_min_epi16(v0, max_coeff_thresh);
+      const __m256i bin1 = _mm256_min_epi16(v1, max_coeff_thresh);
+      // Store.
+      _mm256_storeu_si256((__m256i*)&out[0], bin0);
+      _mm256_storeu_si256((__m256i*)&out[16], bin1);
+    }
+
+    // Convert coefficients to bin.
+    for (k = 0; k < 32; ++k) {
+      ++distribution[out[k]];
+    }
+  }
+  VP8SetHistogramData(distribution, histo);
+}
+
+//------------------------------------------------------------------------------
+// Metric
+
+static WEBP_INLINE int SSE_16xN_AVX2(const uint8_t* WEBP_RESTRICT a,
+                                     const uint8_t* WEBP_RESTRICT b,
+                                     int num_rows) {
+  __m256i sum = _mm256_setzero_si256();
+  int i;
+  for (i = 0; i < num_rows; ++i, a += BPS, b += BPS) {
+    const __m256i a0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)a));
+    const __m256i b0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)b));
+    const __m256i d0 = _mm256_sub_epi16(a0, b0);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(d0, d0));
+  }
+  return HorizontalSum_AVX2(sum);
+}
+
+static int SSE16x16_AVX2(const uint8_t* WEBP_RESTRICT a,
+                         const uint8_t* WEBP_RESTRICT b) {
+  return SSE_16xN_AVX2(a, b, 16);
+}
+
+static int SSE16x8_AVX2(const uint8_t* WEBP_RESTRICT a,
+                        const uint8_t* WEBP_RESTRICT b) {
+  return SSE_16xN_AVX2(a, b, 8);
+}
+
+// Loads the 8 pixels of rows 'ptr' and 'ptr + BPS', as 16b.
+#define LOAD_8x2x16b(ptr)                                                 \
+  _mm256_cvtepu8_epi16(                                                   \
+      _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(ptr)),          \
+                         _mm_loadl_epi64((const __m128i*)((ptr) + BPS))))
+
+static int SSE8x8_AVX2(const uint8_t* WEBP_RESTRICT a,
+                       const uint8_t* WEBP_RESTRICT b) {
+  __m256i sum = _mm256_setzero_si256();
+  int i;
+  for (i = 0; i < 4; ++i, a += 2 * BPS, b += 2 * BPS) {
+    const __m256i a01 = LOAD_8x2x16b(a);
+    const __m256i b01 = LOAD_8x2x16b(b);
+    const __m256i d01 = _mm256_sub_epi16(a01, b01);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(d01, d01));
+  }
+  return HorizontalSum_AVX2(sum);
+}
+#undef LOAD_8x2x16b
+
+//------------------------------------------------------------------------------
+// Texture distortion
+//
+// We try to match the spectral content (weighted) between source and
+// reconstructed samples.
+
+// Hadamard transform of the two horizontally adjacent 4x4 blocks at 'inA' and
+// of the matching ones at 'inB', see TTransform_SSE41(). Returns the sum of
+// the two Disto4x4() values.
+static int Disto2x4x4_AVX2(const uint8_t* WEBP_RESTRICT const inA,
+                           const uint8_t* WEBP_RESTRICT const inB,
+                           const __m256i* const w_0, const __m256i* const w_8) {
+  __m256i tmp_0, tmp_1, tmp_2, tmp_3;
+
+  // Load and combine inputs.
+  {
+    const __m128i inA_0 = _mm_loadl_epi64((const __m128i*)&inA[BPS * 0]);
+    const __m128i inA_1 = _mm_loadl_epi64((const __m128i*)&inA[BPS * 1]);
+    const __m128i inA_2 = _mm_loadl_epi64((const __m128i*)&inA[BPS * 2]);
+    const __m128i inA_3 = _mm_loadl_epi64((const __m128i*)&inA[BPS * 3]);
+    const __m128i inB_0 = _mm_loadl_epi64((const __m128i*)&inB[BPS * 0]);
+    const __m128i inB_1 = _mm_loadl_epi64((const __m128i*)&inB[BPS * 1]);
+    const __m128i inB_2 = _mm_loadl_epi64((const __m128i*)&inB[BPS * 2]);
+    const __m128i inB_3 = _mm_loadl_epi64((const __m128i*)&inB[BPS * 3]);
+
+    // Combine inA and inB: the left blocks go to the low lane, the right
+    // blocks to the high lane.
+    tmp_0 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi32(inA_0, inB_0));
+    tmp_1 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi32(inA_1, inB_1));
+    tmp_2 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi32(inA_2, inB_2));
+    tmp_3 = _mm256_cvtepu8_epi16(_mm_unpacklo_epi32(inA_3, inB_3));
+    // a00 a01 a02 a03   b00 b01 b02 b03 | a04 a05 a06 a07   b04 b05 b06 b07
+    // a10 a11 a12 a13   b10 b11 b12 b13 | a14 a15 a16 a17   b14 b15 b16 b17
+    // a20 a21 a22 a23   b20 b21 b22 b23 | a24 a25 a26 a27   b24 b25 b26 b27
+    // a30 a31 a32 a33   b30 b31 b32 b33 | a34 a35 a36 a37   b34 b35 b36 b37
+  }
+
+  // Vertical pass first to avoid a transpose (vertical and horizontal passes
+  // are commutative because w/kWeightY is symmetric) and subsequent transpose.
+  {
+    const __m256i a0 = _mm256_add_epi16(tmp_0, tmp_2);
+    const __m256i a1 = _mm256_add_epi16(tmp_1, tmp_3);
+    const __m256i a2 = _mm256_sub_epi16(tmp_1, tmp_3);
+    const __m256i a3 = _mm256_sub_epi16(tmp_0, tmp_2);
+    const __m256i b0 = _mm256_add_epi16(a0, a1);
+    const __m256i b1 = _mm256_add_epi16(a3, a2);
+    const __m256i b2 = _mm256_sub_epi16(a3, a2);
+    const __m256i b3 = _mm256_sub_epi16(a0, a1);
+    VP8Transpose_4_4x4_16b(&b0, &b1, &b2, &b3, &tmp_0, &tmp_1, &tmp_2, &tmp_3);
+  }
+
+  // Horizontal pass and difference of weighted sums.
+  {
+    const __m256i a0 = _mm256_add_epi16(tmp_0, tmp_2);
+    const __m256i a1 = _mm256_add_epi16(tmp_1, tmp_3);
+    const __m256i a2 = _mm256_sub_epi16(tmp_1, tmp_3);
+    const __m256i a3 = _mm256_sub_epi16(tmp_0, tmp_2);
+    const __m256i b0 = _mm256_add_epi16(a0, a1);
+    const __m256i b1 = _mm256_add_epi16(a3, a2);
+    const __m256i b2 = _mm256_sub_epi16(a3, a2);
+    const __m256i b3 = _mm256_sub_epi16(a0, a1);
+
+    // Separate the transforms of inA and inB.
+    __m256i A_b0 = _mm256_unpacklo_epi64(b0, b1);
+    __m256i A_b2 = _mm256_unpacklo_epi64(b2, b3);
+    __m256i B_b0 = _mm256_unpackhi_epi64(b0, b1);
+    __m256i B_b2 = _mm256_unpackhi_epi64(b2, b3);
+
+    A_b0 = _mm256_abs_epi16(A_b0);
+    A_b2 = _mm256_abs_epi16(A_b2);
+    B_b0 = _mm256_abs_epi16(B_b0);
+    B_b2 = _mm256_abs_epi16(B_b2);
+
+    // weighted sums
+    A_b0 = _mm256_madd_epi16(A_b0, *w_0);
+    A_b2 = _mm256_madd_epi16(A_b2, *w_8);
+    B_b0 = _mm256_madd_epi16(B_b0, *w_0);
+    B_b2 = _mm256_madd_epi16(B_b2, *w_8);
+    A_b0 = _mm256_add_epi32(A_b0, A_b2);
+    B_b0 = _mm256_add_epi32(B_b0, B_b2);
+
+    // difference of weighted sums, summed within each lane
+    {
+      const __m256i diff = _mm256_sub_epi32(A_b0, B_b0);
+      const __m128i sum4 = _mm_hadd_epi32(_mm256_castsi256_si128(diff),
+                                          _mm256_extracti128_si256(diff, 1));
+      // left block sum, right block sum
+      const __m128i sum2 = _mm_hadd_epi32(sum4, sum4);
+      const __m128i disto = _mm_srli_epi32(_mm_abs_epi32(sum2), 5);
+      return _mm_cvtsi128_si32(disto) + _mm_extract_epi32(disto, 1);
+    }
+  }
+}
+
+static int Disto16x16_AVX2(const uint8_t* WEBP_RESTRICT const a,
+                           const uint8_t* WEBP_RESTRICT const b,
+                           const uint16_t* WEBP_RESTRICT const w) {
+  const __m256i w_0 =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&w[0]));
+  const __m256i w_8 =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)&w[8]));
+  int D = 0;
+  int x, y;
+  for (y = 0; y < 16 * BPS; y += 4 * BPS) {
+    for (x = 0; x < 16; x += 8) {
+      D += Disto2x4x4_AVX2(a + x + y, b + x + y, &w_0, &w_8);
+    }
+  }
+  return D;
+}
+
+//------------------------------------------------------------------------------
+// Quantization
+//
+
+// Generates a pshufb constant for shuffling 16b words, in both lanes.
+#define PSHUFB_CST(A, B, C, D, E, F, G, H)                          \
+  _mm256_broadcastsi128_si256(                                      \
+      _mm_set_epi8(2 * (H) + 1, 2 * (H) + 0, 2 * (G) + 1, 2 * (G) + 0, \
+                   2 * (F) + 1, 2 * (F) + 0, 2 * (E) + 1, 2 * (E) + 0, \
+                   2 * (D) + 1, 2 * (D) + 0, 2 * (C) + 1, 2 * (C) + 0, \
+                   2 * (B) + 1, 2 * (B) + 0, 2 * (A) + 1, 2 * (A) + 0))
+
+// Loads the 128b at 'ptr' in both lanes.
+#define LOAD_x2(ptr) \
+  _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(ptr)))
+
+// Same as DoQuantizeBlock_SSE41() on the two blocks at once: the coefficients
+// 0..7 (resp. 8..15) of each block are held in 'x0' (resp. 'x8'), in[0..15]
+// in the low lane and in[16..31] in the high lane.
+static int Quantize2Blocks_AVX2(int16_t in[32], int16_t out[32],
+                                const VP8Matrix* WEBP_RESTRICT const mtx) {
+  const __m256i max_coeff_2047 = _mm256_set1_epi16(MAX_LEVEL);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i out0, out8;
+  __m256i packed_out;
+
+  // Load all inputs.
+  __m256i in0 = Combine_AVX2(_mm_loadu_si128((__m128i*)&in[0]),
+                             _mm_loadu_si128((__m128i*)&in[16]));
+  __m256i in8 = Combine_AVX2(_mm_loadu_si128((__m128i*)&in[8]),
+                             _mm_loadu_si128((__m128i*)&in[24]));
+  const __m256i iq0 = LOAD_x2(&mtx->iq[0]);
+  const __m256i iq8 = LOAD_x2(&mtx->iq[8]);
+  const __m256i q0 = LOAD_x2(&mtx->q[0]);
+  const __m256i q8 = LOAD_x2(&mtx->q[8]);
+  const __m256i sharpen0 = LOAD_x2(&mtx->sharpen[0]);
+  const __m256i sharpen8 = LOAD_x2(&mtx->sharpen[8]);
+
+  // coeff = abs(in) + sharpen
+  const __m256i coeff0 = _mm256_add_epi16(_mm256_abs_epi16(in0), sharpen0);
+  const __m256i coeff8 = _mm256_add_epi16(_mm256_abs_epi16(in8), sharpen8);
+
+  // out = (coeff * iQ + B) >> QFIX
+  {
+    // doing calculations with 32b precision (QFIX=17)
+    // out = (coeff * iQ)
+    const __m256i coeff_iQ0H = _mm256_mulhi_epu16(coeff0, iq0);
+    const __m256i coeff_iQ0L = _mm256_mullo_epi16(coeff0, iq0);
+    const __m256i coeff_iQ8H = _mm256_mulhi_epu16(coeff8, iq8);
+    const __m256i coeff_iQ8L = _mm256_mullo_epi16(coeff8, iq8);
+    __m256i out_00 = _mm256_unpacklo_epi16(coeff_iQ0L, coeff_iQ0H);
+    __m256i out_04 = _mm256_unpackhi_epi16(coeff_iQ0L, coeff_iQ0H);
+    __m256i out_08 = _mm256_unpacklo_epi16(coeff_iQ8L, coeff_iQ8H);
+    __m256i out_12 = _mm256_unpackhi_epi16(coeff_iQ8L, coeff_iQ8H);
+    // out = (coeff * iQ + B)
+    const __m256i bias_00 = LOAD_x2(&mtx->bias[0]);
+    const __m256i bias_04 = LOAD_x2(&mtx->bias[4]);
+    const __m256i bias_08 = LOAD_x2(&mtx->bias[8]);
+    const __m256i bias_12 = LOAD_x2(&mtx->bias[12]);
+    out_00 = _mm256_add_epi32(out_00, bias_00);
+    out_04 = _mm256_add_epi32(out_04, bias_04);
+    out_08 = _mm256_add_epi32(out_08, bias_08);
+    out_12 = _mm256_add_epi32(out_12, bias_12);
+    // out = QUANTDIV(coeff, iQ, B, QFIX)
+    out_00 = _mm256_srai_epi32(out_00, QFIX);
+    out_04 = _mm256_srai_epi32(out_04, QFIX);
+    out_08 = _mm256_srai_epi32(out_08, QFIX);
+    out_12 = _mm256_srai_epi32(out_12, QFIX);
+
+    // pack result as 16b
+    out0 = _mm256_packs_epi32(out_00, out_04);
+    out8 = _mm256_packs_epi32(out_08, out_12);
+
+    // if (coeff > 2047) coeff = 2047
+    out0 = _mm256_min_epi16(out0, max_coeff_2047);
+    out8 = _mm256_min_epi16(out8, max_coeff_2047);
+  }
+
+  // put sign back
+  out0 = _mm256_sign_epi16(out0, in0);
+  out8 = _mm256_sign_epi16(out8, in8);
+
+  // in = out * Q
+  in0 = _mm256_mullo_epi16(out0, q0);
+  in8 = _mm256_mullo_epi16(out8, q8);
+
+  Store2x128_AVX2(in0, &in[0], &in[16]);
+  Store2x128_AVX2(in8, &in[8], &in[24]);
+
+  // zigzag the output before storing it, see DoQuantizeBlock_SSE41().
+  {
+    const __m256i kCst_lo = PSHUFB_CST(0, 1, 4, -1, 5, 2, 3, 6);
+    const __m256i kCst_7 = PSHUFB_CST(-1, -1, -1, -1, 7, -1, -1, -1);
+    const __m256i tmp_lo = _mm256_shuffle_epi8(out0, kCst_lo);
+    const __m256i tmp_7 = _mm256_shuffle_epi8(out0, kCst_7);  // extract #7
+    const __m256i kCst_hi = PSHUFB_CST(1, 4, 5, 2, -1, 3, 6, 7);
+    const __m256i kCst_8 = PSHUFB_CST(-1, -1, -1, 0, -1, -1, -1, -1);
+    const __m256i tmp_hi = _mm256_shuffle_epi8(out8, kCst_hi);
+    const __m256i tmp_8 = _mm256_shuffle_epi8(out8, kCst_8);  // extract #8
+    const __m256i out_z0 = _mm256_or_si256(tmp_lo, tmp_8);
+    const __m256i out_z8 = _mm256_or_si256(tmp_hi, tmp_7);
+    Store2x128_AVX2(out_z0, &out[0], &out[16]);
+    Store2x128_AVX2(out_z8, &out[8], &out[24]);
+    packed_out = _mm256_packs_epi16(out_z0, out_z8);
+  }
+
+  // detect if all 'out' values are zeroes or not, for each block
+  {
+    const uint32_t zeros =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(packed_out, zero));
+    return ((zeros & 0xffff) != 0xffff) | (((zeros >> 16) != 0xffff) << 1);
+  }
+}
+
+#undef LOAD_x2
+#undef PSHUFB_CST
+
+//------------------------------------------------------------------------------
+// Entry point
+
+extern void VP8EncDspInitAVX2(void);
+
+WEBP_TSAN_IGNORE_FUNCTION void VP8EncDspInitAVX2(void) {
+  VP8CollectHistogram = CollectHistogram_AVX2;
+  VP8EncQuantize2Blocks = Quantize2Blocks_AVX2;
+  VP8FTransform2 = FTransform2_AVX2;
+  VP8SSE16x16 = SSE16x16_AVX2;
+  VP8SSE16x8 = SSE16x8_AVX2;
+  VP8SSE8x8 = SSE8x8_AVX2;
+  VP8TDisto16x16 = Disto16x16_AVX2;
+}
+
+#else  // !WEBP_USE_AVX2
+
+WEBP_DSP_INIT_STUB(VP8EncDspInitAVX2)
+
+#endif  // WEBP_USE_AVX2
@@ -18,6 +18,7 @@
 #include <emmintrin.h>
 #include <immintrin.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "src/dsp/cpu.h"
 #include "src/dsp/lossless.h"
@@ -326,6 +327,150 @@ static uint64_t CombinedShannonEntropy_AVX2(const uint32_t X[256],
   return retval;
 }
 
+// Streaks longer than 3, per zero/non-zero value. The shorter ones are deduced
+// from the total number of zeros.
+typedef struct {
+  int counts[2];
+  int lengths[2];
+} LongStreaks;
+
+static WEBP_INLINE void AddStreak(int streak, int is_nonzero,
+                                  LongStreaks* const long_streaks) {
+  const int is_long = (streak > 3);
+  long_streaks->counts[is_nonzero] += is_long;
+  long_streaks->lengths[is_nonzero] += streak & -is_long;
+}
+
+// Same as the C version, but the bit entropy is gathered per element rather
+// than per streak: only the streaks are found from the positions where the sum
+// changes.
+static void GetCombinedEntropyUnrefined_AVX2(
+    const uint32_t X[], const uint32_t Y[], int length,
+    VP8LBitEntropy* WEBP_RESTRICT const bit_entropy,
+    VP8LStreaks* WEBP_RESTRICT const stats) {
+  int i;
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sum = zero, max_val = zero, num_zeros = zero, entropy = zero;
+  uint32_t xy = X[0] + Y[0];
+  uint32_t sum_scalar = xy, max_val_scalar = xy;
+  int num_zeros_scalar = (xy == 0);
+  uint64_t entropy_scalar = VP8LFastSLog2(xy);
+  int streak_start = 0;
+  int is_nonzero = (xy != 0);
+  int last_nonzero_start = is_nonzero ? 0 : -1;
+  LongStreaks long_streaks = {{0, 0}, {0, 0}};
+
+  VP8LBitEntropyInit(bit_entropy);
+
+  for (i = 1; i + 32 <= length; i += 32) {
+    uint32_t changes = 0, nonzeros = 0;
+    int k;
+    for (k = 0; k < 32; k += 8) {
+      const __m256i x = _mm256_loadu_si256((const __m256i*)(X + i + k));
+      const __m256i y = _mm256_loadu_si256((const __m256i*)(Y + i + k));
+      const __m256i x_prev =
+          _mm256_loadu_si256((const __m256i*)(X + i + k - 1));
+      const __m256i y_prev =
+          _mm256_loadu_si256((const __m256i*)(Y + i + k - 1));
+      const __m256i xy_v = _mm256_add_epi32(x, y);
+      const __m256i is_same =
+          _mm256_cmpeq_epi32(xy_v, _mm256_add_epi32(x_prev, y_prev));
+      const __m256i is_zero = _mm256_cmpeq_epi32(xy_v, zero);
+      const __m256i is_small =
+          _mm256_cmpeq_epi32(_mm256_srli_epi32(xy_v, 8), zero);
+      changes |= ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(is_same)) ^
+                  0xffu) << k;
+      nonzeros |= ((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(is_zero)) ^
+                   0xffu) << k;
+      sum = _mm256_add_epi32(sum, xy_v);
+      max_val = _mm256_max_epu32(max_val, xy_v);
+      num_zeros = _mm256_sub_epi32(num_zeros, is_zero);
+      if (_mm256_movemask_ps(_mm256_castsi256_ps(is_small)) == 0xff) {
+        // All the values are in the kSLog2Table[] range.
+        const __m256i e0 = _mm256_i32gather_epi64(
+            (const long long*)kSLog2Table, _mm256_castsi256_si128(xy_v), 8);
+        const __m256i e1 = _mm256_i32gather_epi64(
+            (const long long*)kSLog2Table, _mm256_extracti128_si256(xy_v, 1),
+            8);
+        entropy = _mm256_add_epi64(entropy, _mm256_add_epi64(e0, e1));
+      } else {
+        int j;
+        for (j = 0; j < 8; ++j) {
+          entropy_scalar += VP8LFastSLog2(X[i + k + j] + Y[i + k + j]);
+        }
+      }
+    }
+    if (changes != 0) {
+      const int first = BitsCtz(changes);
+      const int last = BitsLog2Floor(changes);
+      const uint32_t nonzero_starts = changes & nonzeros;
+      // Positions followed by two others in the same streak, between the first
+      // and last streak starts: they belong to streaks longer than 3.
+      const uint32_t same = ~changes;
+      uint32_t long_streaks_mask = same & (same >> 1) & (same >> 2) &
+                                   ~((2u << first) - 1) & ((1u << last) - 1);
+      // The streak started in a previous group ends here.
+      AddStreak(i + first - streak_start, is_nonzero, &long_streaks);
+      while (long_streaks_mask != 0) {
+        const int p = BitsCtz(long_streaks_mask);
+        const int start = BitsLog2Floor(changes & ((1u << p) - 1));
+        const int end = BitsCtz(changes & ~((2u << p) - 1));
+        AddStreak(end - start, (nonzeros >> start) & 1, &long_streaks);
+        long_streaks_mask &= ~((1u << end) - 1);
+      }
+      if (nonzero_starts != 0) {
+        last_nonzero_start = i + BitsLog2Floor(nonzero_starts);
+      }
+      streak_start = i + last;
+      is_nonzero = (nonzeros >> last) & 1;
+    }
+  }
+  for (; i < length; ++i) {
+    xy = X[i] + Y[i];
+    sum_scalar += xy;
+    if (max_val_scalar < xy) max_val_scalar = xy;
+    num_zeros_scalar += (xy == 0);
+    entropy_scalar += VP8LFastSLog2(xy);
+    if (xy != X[i - 1] + Y[i - 1]) {
+      AddStreak(i - streak_start, is_nonzero, &long_streaks);
+      streak_start = i;
+      is_nonzero = (xy != 0);
+      if (is_nonzero) last_nonzero_start = i;
+    }
+  }
+  AddStreak(length - streak_start, is_nonzero, &long_streaks);
+
+  {
+    // Horizontal reductions.
+    uint32_t tmp[8];
+    uint64_t tmp64[4];
+    int j;
+    _mm256_storeu_si256((__m256i*)tmp, sum);
+    for (j = 0; j < 8; ++j) sum_scalar += tmp[j];
+    _mm256_storeu_si256((__m256i*)tmp, max_val);
+    for (j = 0; j < 8; ++j) {
+      if (max_val_scalar < tmp[j]) max_val_scalar = tmp[j];
+    }
+    _mm256_storeu_si256((__m256i*)tmp, num_zeros);
+    for (j = 0; j < 8; ++j) num_zeros_scalar += (int)tmp[j];
+    _mm256_storeu_si256((__m256i*)tmp64, entropy);
+    for (j = 0; j < 4; ++j) entropy_scalar += tmp64[j];
+  }
+  stats->counts[0] = long_streaks.counts[0];
+  stats->counts[1] = long_streaks.counts[1];
+  stats->streaks[0][1] = long_streaks.lengths[0];
+  stats->streaks[1][1] = long_streaks.lengths[1];
+  stats->streaks[0][0] = num_zeros_scalar - long_streaks.lengths[0];
+  stats->streaks[1][0] = length - num_zeros_scalar - long_streaks.lengths[1];
+  bit_entropy->sum = sum_scalar;
+  bit_entropy->nonzeros = length - num_zeros_scalar;
+  bit_entropy->max_val = max_val_scalar;
+  if (last_nonzero_start >= 0) {
+    bit_entropy->nonzero_code = (uint32_t)last_nonzero_start;
+  }
+  bit_entropy->entropy = VP8LFastSLog2(sum_scalar) - entropy_scalar;
+}
+
 #else
 
 #define DONT_USE_COMBINED_SHANNON_ENTROPY_SSE2_FUNC  // won't be faster
@@ -707,6 +852,7 @@ WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInitAVX2(void) {
   VP8LAddVector = AddVector_AVX2;
   VP8LAddVectorEq = AddVectorEq_AVX2;
   VP8LCombinedShannonEntropy = CombinedShannonEntropy_AVX2;
+  VP8LGetCombinedEntropyUnrefined = GetCombinedEntropyUnrefined_AVX2;
   VP8LVectorMismatch = VectorMismatch_AVX2;
   VP8LBundleColorMap = BundleColorMap_AVX2;
 
@@ -321,6 +321,79 @@ static uint64_t CombinedShannonEntropy_SSE2(const uint32_t X[256],
   return retval;
 }
 
+static WEBP_INLINE void GetEntropyUnrefinedHelper(
+    uint32_t val, int i, uint32_t* WEBP_RESTRICT const val_prev,
+    int* WEBP_RESTRICT const i_prev,
+    VP8LBitEntropy* WEBP_RESTRICT const bit_entropy,
+    VP8LStreaks* WEBP_RESTRICT const stats) {
+  const int streak = i - *i_prev;
+
+  // Gather info for the bit entropy.
+  if (*val_prev != 0) {
+    bit_entropy->sum += (*val_prev) * streak;
+    bit_entropy->nonzeros += streak;
+    bit_entropy->nonzero_code = *i_prev;
+    bit_entropy->entropy += VP8LFastSLog2(*val_prev) * streak;
+    if (bit_entropy->max_val < *val_prev) {
+      bit_entropy->max_val = *val_prev;
+    }
+  }
+
+  // Gather info for the Huffman cost.
+  stats->counts[*val_prev != 0] += (streak > 3);
+  stats->streaks[*val_prev != 0][(streak > 3)] += streak;
+
+  *val_prev = val;
+  *i_prev = i;
+}
+
+// Returns the bit mask of the 4 sums X[i] + Y[i] that differ from the previous
+// ones X[i - 1] + Y[i - 1].
+static WEBP_INLINE int GetChangeMask_SSE2(const uint32_t* const X,
+                                          const uint32_t* const Y) {
+  const __m128i x = _mm_loadu_si128((const __m128i*)X);
+  const __m128i y = _mm_loadu_si128((const __m128i*)Y);
+  const __m128i x_prev = _mm_loadu_si128((const __m128i*)(X - 1));
+  const __m128i y_prev = _mm_loadu_si128((const __m128i*)(Y - 1));
+  const __m128i eq =
+      _mm_cmpeq_epi32(_mm_add_epi32(x, y), _mm_add_epi32(x_prev, y_prev));
+  return _mm_movemask_ps(_mm_castsi128_ps(eq)) ^ 0xf;
+}
+
+// Same as the C version, except that only the positions where the sum changes
+// are visited: the histograms are mostly made of streaks.
+static void GetCombinedEntropyUnrefined_SSE2(
+    const uint32_t X[], const uint32_t Y[], int length,
+    VP8LBitEntropy* WEBP_RESTRICT const bit_entropy,
+    VP8LStreaks* WEBP_RESTRICT const stats) {
+  int i;
+  int i_prev = 0;
+  uint32_t xy_prev = X[0] + Y[0];
+
+  memset(stats, 0, sizeof(*stats));
+  VP8LBitEntropyInit(bit_entropy);
+
+  for (i = 1; i + 8 <= length; i += 8) {
+    int changes = GetChangeMask_SSE2(X + i, Y + i) |
+                  (GetChangeMask_SSE2(X + i + 4, Y + i + 4) << 4);
+    while (changes) {
+      const int j = i + BitsCtz(changes);
+      GetEntropyUnrefinedHelper(X[j] + Y[j], j, &xy_prev, &i_prev, bit_entropy,
+                                stats);
+      changes &= changes - 1;
+    }
+  }
+  for (; i < length; ++i) {
+    const uint32_t xy = X[i] + Y[i];
+    if (xy != xy_prev) {
+      GetEntropyUnrefinedHelper(xy, i, &xy_prev, &i_prev, bit_entropy, stats);
+    }
+  }
+  GetEntropyUnrefinedHelper(0, i, &xy_prev, &i_prev, bit_entropy, stats);
+
+  bit_entropy->entropy = VP8LFastSLog2(bit_entropy->sum) - bit_entropy->entropy;
+}
+
 #else
 
 #define DONT_USE_COMBINED_SHANNON_ENTROPY_SSE2_FUNC  // won't be faster
@@ -712,6 +785,7 @@ WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInitSSE2(void) {
   VP8LAddVectorEq = AddVectorEq_SSE2;
 #if !defined(DONT_USE_COMBINED_SHANNON_ENTROPY_SSE2_FUNC)
   VP8LCombinedShannonEntropy = CombinedShannonEntropy_SSE2;
+  VP8LGetCombinedEntropyUnrefined = GetCombinedEntropyUnrefined_SSE2;
 #endif
   VP8LVectorMismatch = VectorMismatch_SSE2;
   VP8LBundleColorMap = VP8LBundleColorMap_SSE;
@@ -232,6 +232,7 @@ extern VP8CPUInfo VP8GetCPUInfo;
 extern void WebPInitYUV444ConvertersMIPSdspR2(void);
 extern void WebPInitYUV444ConvertersSSE2(void);
 extern void WebPInitYUV444ConvertersSSE41(void);
+extern void WebPInitYUV444ConvertersAVX2(void);
 
 WEBP_DSP_INIT_FUNC(WebPInitYUV444Converters) {
   WebPYUV444Converters[MODE_RGBA] = WebPYuv444ToRgba_C;
@@ -255,6 +256,11 @@ WEBP_DSP_INIT_FUNC(WebPInitYUV444Converters) {
 #if defined(WEBP_HAVE_SSE41)
     if (VP8GetCPUInfo(kSSE4_1)) {
       WebPInitYUV444ConvertersSSE41();
+#if defined(WEBP_HAVE_AVX2)
+      if (VP8GetCPUInfo(kAVX2)) {
+        WebPInitYUV444ConvertersAVX2();
+      }
+#endif
     }
 #endif
 #if defined(WEBP_USE_MIPS_DSP_R2)
@@ -270,6 +276,7 @@ WEBP_DSP_INIT_FUNC(WebPInitYUV444Converters) {
 
 extern void WebPInitUpsamplersSSE2(void);
 extern void WebPInitUpsamplersSSE41(void);
+extern void WebPInitUpsamplersAVX2(void);
 extern void WebPInitUpsamplersNEON(void);
 extern void WebPInitUpsamplersMIPSdspR2(void);
 extern void WebPInitUpsamplersMSA(void);
@@ -300,6 +307,11 @@ WEBP_DSP_INIT_FUNC(WebPInitUpsamplers) {
 #if defined(WEBP_HAVE_SSE41)
     if (VP8GetCPUInfo(kSSE4_1)) {
       WebPInitUpsamplersSSE41();
+#if defined(WEBP_HAVE_AVX2)
+      if (VP8GetCPUInfo(kAVX2)) {
+        WebPInitUpsamplersAVX2();
+      }
+#endif
     }
 #endif
 #if defined(WEBP_USE_MIPS_DSP_R2)
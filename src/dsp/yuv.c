@@ -90,6 +90,7 @@ WebPSamplerRowFunc WebPSamplers[MODE_LAST];
 extern VP8CPUInfo VP8GetCPUInfo;
 extern void WebPInitSamplersSSE2(void);
 extern void WebPInitSamplersSSE41(void);
+extern void WebPInitSamplersAVX2(void);
 extern void WebPInitSamplersMIPS32(void);
 extern void WebPInitSamplersMIPSdspR2(void);
 
@@ -116,6 +117,11 @@ WEBP_DSP_INIT_FUNC(WebPInitSamplers) {
 #if defined(WEBP_HAVE_SSE41)
     if (VP8GetCPUInfo(kSSE4_1)) {
       WebPInitSamplersSSE41();
+#if defined(WEBP_HAVE_AVX2)
+      if (VP8GetCPUInfo(kAVX2)) {
+        WebPInitSamplersAVX2();
+      }
+#endif
     }
 #endif  // WEBP_HAVE_SSE41
 #if defined(WEBP_USE_MIPS32)
@@ -221,16 +227,16 @@ void WebPConvertRGBA32ToUV_C(const uint16_t* WEBP_RESTRICT rgb,
 #if defined(USE_GAMMA_COMPRESSION)
 
 // Gamma correction compensates loss of resolution during chroma subsampling.
-#define GAMMA_FIX 12     // fixed-point precision for linear values
-#define GAMMA_TAB_FIX 7  // fixed-point fractional bits precision
-#define GAMMA_TAB_SIZE (1 << (GAMMA_FIX - GAMMA_TAB_FIX))
+#define GAMMA_FIX WEBP_GAMMA_FIX
+#define GAMMA_TAB_FIX WEBP_GAMMA_TAB_FIX
+#define GAMMA_TAB_SIZE WEBP_GAMMA_TAB_SIZE
 static const double kGamma = 0.80;
 static const int kGammaScale = ((1 << GAMMA_FIX) - 1);
 static const int kGammaTabScale = (1 << GAMMA_TAB_FIX);
 static const int kGammaTabRounder = (1 << GAMMA_TAB_FIX >> 1);
 
-static int kLinearToGammaTab[GAMMA_TAB_SIZE + 1];
-static uint16_t kGammaToLinearTab[256];
+int WebPLinearToGammaTab[GAMMA_TAB_SIZE + 1];
+uint16_t WebPGammaToLinearTab[256 + 1];
 static volatile int kGammaTablesOk = 0;
 extern VP8CPUInfo VP8GetCPUInfo;
 
@@ -240,25 +246,27 @@ WEBP_DSP_INIT_FUNC(WebPInitGammaTables) {
     const double scale = (double)(1 << GAMMA_TAB_FIX) / kGammaScale;
     const double norm = 1. / 255.;
     for (v = 0; v <= 255; ++v) {
-      kGammaToLinearTab[v] =
+      WebPGammaToLinearTab[v] =
           (uint16_t)(pow(norm * v, kGamma) * kGammaScale + .5);
     }
+    // padding, for 32b loads
+    WebPGammaToLinearTab[256] = WebPGammaToLinearTab[255];
     for (v = 0; v <= GAMMA_TAB_SIZE; ++v) {
-      kLinearToGammaTab[v] = (int)(255. * pow(scale * v, 1. / kGamma) + .5);
+      WebPLinearToGammaTab[v] = (int)(255. * pow(scale * v, 1. / kGamma) + .5);
     }
     kGammaTablesOk = 1;
   }
 }
 
 static WEBP_INLINE uint32_t GammaToLinear(uint8_t v) {
-  return kGammaToLinearTab[v];
+  return WebPGammaToLinearTab[v];
 }
 
 static WEBP_INLINE int Interpolate(int v) {
   const int tab_pos = v >> (GAMMA_TAB_FIX + 2);   // integer part
   const int x = v & ((kGammaTabScale << 2) - 1);  // fractional part
-  const int v0 = kLinearToGammaTab[tab_pos];
-  const int v1 = kLinearToGammaTab[tab_pos + 1];
+  const int v0 = WebPLinearToGammaTab[tab_pos];
+  const int v1 = WebPLinearToGammaTab[tab_pos + 1];
   const int y = v1 * x + v0 * ((kGammaTabScale << 2) - x);  // interpolate
   assert(tab_pos + 1 < GAMMA_TAB_SIZE + 1);
   return y;
@@ -487,9 +495,10 @@ void WebPAccumulateRGBA(const uint8_t* const r_ptr, const uint8_t* const g_ptr,
   }
 }
 
-void WebPAccumulateRGB(const uint8_t* const r_ptr, const uint8_t* const g_ptr,
-                       const uint8_t* const b_ptr, int step, int rgb_stride,
-                       uint16_t* dst, int width) {
+void WebPAccumulateRGB_C(const uint8_t* const r_ptr,
+                         const uint8_t* const g_ptr,
+                         const uint8_t* const b_ptr, int step, int rgb_stride,
+                         uint16_t* dst, int width) {
   int i, j;
   for (i = 0, j = 0; i < (width >> 1); i += 1, j += 2 * step, dst += 4) {
     dst[0] = SUM4(r_ptr + j, step);
@@ -631,6 +640,11 @@ void (*WebPImportYUVAFromRGBALastLine)(
     int has_alpha, int width, uint16_t* tmp_rgb, uint8_t* dst_y, uint8_t* dst_u,
     uint8_t* dst_v, uint8_t* dst_a);
 
+void (*WebPAccumulateRGB)(const uint8_t* const r_ptr,
+                          const uint8_t* const g_ptr,
+                          const uint8_t* const b_ptr, int step, int rgb_stride,
+                          uint16_t* dst, int width);
+
 void (*WebPConvertARGBToY)(const uint32_t* WEBP_RESTRICT argb,
                            uint8_t* WEBP_RESTRICT y, int width);
 void (*WebPConvertARGBToUV)(const uint32_t* WEBP_RESTRICT argb,
@@ -639,6 +653,7 @@ void (*WebPConvertARGBToUV)(const uint32_t* WEBP_RESTRICT argb,
 
 extern void WebPInitConvertARGBToYUVSSE2(void);
 extern void WebPInitConvertARGBToYUVSSE41(void);
+extern void WebPInitConvertARGBToYUVAVX2(void);
 extern void WebPInitConvertARGBToYUVNEON(void);
 
 WEBP_DSP_INIT_FUNC(WebPInitConvertARGBToYUV) {
@@ -652,6 +667,7 @@ WEBP_DSP_INIT_FUNC(WebPInitConvertARGBToYUV) {
 
   WebPImportYUVAFromRGBA = ImportYUVAFromRGBA_C;
   WebPImportYUVAFromRGBALastLine = ImportYUVAFromRGBALastLine_C;
+  WebPAccumulateRGB = WebPAccumulateRGB_C;
 
   if (VP8GetCPUInfo != NULL) {
 #if defined(WEBP_HAVE_SSE2)
@@ -662,6 +678,11 @@ WEBP_DSP_INIT_FUNC(WebPInitConvertARGBToYUV) {
 #if defined(WEBP_HAVE_SSE41)
     if (VP8GetCPUInfo(kSSE4_1)) {
       WebPInitConvertARGBToYUVSSE41();
+#if defined(WEBP_HAVE_AVX2)
+      if (VP8GetCPUInfo(kAVX2)) {
+        WebPInitConvertARGBToYUVAVX2();
+      }
+#endif
     }
 #endif  // WEBP_HAVE_SSE41
   }
@@ -673,9 +694,15 @@ WEBP_DSP_INIT_FUNC(WebPInitConvertARGBToYUV) {
   }
 #endif  // WEBP_HAVE_NEON
 
+#if !defined(USE_GAMMA_COMPRESSION)
+  // The SIMD versions only implement the gamma-compressed averaging.
+  WebPAccumulateRGB = WebPAccumulateRGB_C;
+#endif
+
   assert(WebPConvertARGBToY != NULL);
   assert(WebPConvertARGBToUV != NULL);
   assert(WebPConvertRGBToY != NULL);
   assert(WebPConvertBGRToY != NULL);
   assert(WebPConvertRGBA32ToUV != NULL);
+  assert(WebPAccumulateRGB != NULL);
 }
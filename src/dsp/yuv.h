@@ -208,6 +208,43 @@ void VP8YuvToBgr32_SSE41(const uint8_t* WEBP_RESTRICT y,
 
 #endif  // WEBP_USE_SSE41
 
+//-----------------------------------------------------------------------------
+// AVX2 extra functions (mostly for upsampling_avx2.c)
+
+#if defined(WEBP_USE_AVX2)
+
+// Process 32 pixels and store the result (16b, 24b or 32b per pixel) in *dst.
+void VP8YuvToRgba32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToRgb32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                        const uint8_t* WEBP_RESTRICT u,
+                        const uint8_t* WEBP_RESTRICT v,
+                        uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToBgra32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToBgr32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                        const uint8_t* WEBP_RESTRICT u,
+                        const uint8_t* WEBP_RESTRICT v,
+                        uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToArgb32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToRgba444432_AVX2(const uint8_t* WEBP_RESTRICT y,
+                             const uint8_t* WEBP_RESTRICT u,
+                             const uint8_t* WEBP_RESTRICT v,
+                             uint8_t* WEBP_RESTRICT dst);
+void VP8YuvToRgb56532_AVX2(const uint8_t* WEBP_RESTRICT y,
+                           const uint8_t* WEBP_RESTRICT u,
+                           const uint8_t* WEBP_RESTRICT v,
+                           uint8_t* WEBP_RESTRICT dst);
+
+#endif  // WEBP_USE_AVX2
+
 //------------------------------------------------------------------------------
 // RGB -> YUV conversion
 
@@ -252,12 +289,26 @@ extern void (*WebPImportYUVAFromRGBALastLine)(
 void WebPAccumulateRGBA(const uint8_t* const r_ptr, const uint8_t* const g_ptr,
                         const uint8_t* const b_ptr, const uint8_t* const a_ptr,
                         int rgb_stride, uint16_t* dst, int width);
-void WebPAccumulateRGB(const uint8_t* const r_ptr, const uint8_t* const g_ptr,
-                       const uint8_t* const b_ptr, int step, int rgb_stride,
-                       uint16_t* dst, int width);
+extern void (*WebPAccumulateRGB)(const uint8_t* const r_ptr,
+                                 const uint8_t* const g_ptr,
+                                 const uint8_t* const b_ptr, int step,
+                                 int rgb_stride, uint16_t* dst, int width);
+void WebPAccumulateRGB_C(const uint8_t* const r_ptr,
+                         const uint8_t* const g_ptr,
+                         const uint8_t* const b_ptr, int step, int rgb_stride,
+                         uint16_t* dst, int width);
 // Must be called before calling WebPAccumulateRGB*.
 void WebPInitGammaTables(void);
 
+// Gamma tables used by WebPAccumulateRGB*(), set by WebPInitGammaTables().
+// Samples are made linear with WEBP_GAMMA_FIX bits of precision, and sums of
+// four linear values are mapped back by interpolating WebPLinearToGammaTab[].
+#define WEBP_GAMMA_FIX 12     // fixed-point precision for linear values
+#define WEBP_GAMMA_TAB_FIX 7  // fixed-point fractional bits precision
+#define WEBP_GAMMA_TAB_SIZE (1 << (WEBP_GAMMA_FIX - WEBP_GAMMA_TAB_FIX))
+extern int WebPLinearToGammaTab[WEBP_GAMMA_TAB_SIZE + 1];
+extern uint16_t WebPGammaToLinearTab[256 + 1];  // last entry is padding
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -0,0 +1,1073 @@
+// Copyright 2025 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+// YUV<->RGB conversion functions, AVX2 version.
+//
+// The arithmetic is the one of the SSE2 code, on 16 samples per register.
+
+#include "src/dsp/yuv.h"
+
+#if defined(WEBP_USE_AVX2)
+#include <assert.h>
+#include <immintrin.h>
+
+#include "src/dsp/cpu.h"
+#include "src/dsp/dsp.h"
+#include "src/webp/decode.h"
+#include "src/webp/types.h"
+
+// Loads the 16 bytes at 'lo' in the low lane and the ones at 'hi' in the high
+// lane.
+static WEBP_INLINE __m256i Load2x128_AVX2(const uint8_t* const lo,
+                                          const uint8_t* const hi) {
+  const __m128i a = _mm_loadu_si128((const __m128i*)lo);
+  const __m128i b = _mm_loadu_si128((const __m128i*)hi);
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1);
+}
+
+//-----------------------------------------------------------------------------
+// Convert spans of 32 pixels to various RGB formats for the fancy upsampler.
+
+// These constants are 14b fixed-point version of ITU-R BT.601 constants.
+// R = (19077 * y             + 26149 * v - 14234) >> 6
+// G = (19077 * y -  6419 * u - 13320 * v +  8708) >> 6
+// B = (19077 * y + 33050 * u             - 17685) >> 6
+static void ConvertYUV444ToRGB_AVX2(const __m256i* const Y0,
+                                    const __m256i* const U0,
+                                    const __m256i* const V0, __m256i* const R,
+                                    __m256i* const G, __m256i* const B) {
+  const __m256i k19077 = _mm256_set1_epi16(19077);
+  const __m256i k26149 = _mm256_set1_epi16(26149);
+  const __m256i k14234 = _mm256_set1_epi16(14234);
+  // 33050 doesn't fit in a signed short: only use this with unsigned arithmetic
+  const __m256i k33050 = _mm256_set1_epi16((short)33050);
+  const __m256i k17685 = _mm256_set1_epi16(17685);
+  const __m256i k6419 = _mm256_set1_epi16(6419);
+  const __m256i k13320 = _mm256_set1_epi16(13320);
+  const __m256i k8708 = _mm256_set1_epi16(8708);
+
+  const __m256i Y1 = _mm256_mulhi_epu16(*Y0, k19077);
+
+  const __m256i R0 = _mm256_mulhi_epu16(*V0, k26149);
+  const __m256i R1 = _mm256_sub_epi16(Y1, k14234);
+  const __m256i R2 = _mm256_add_epi16(R1, R0);
+
+  const __m256i G0 = _mm256_mulhi_epu16(*U0, k6419);
+  const __m256i G1 = _mm256_mulhi_epu16(*V0, k13320);
+  const __m256i G2 = _mm256_add_epi16(Y1, k8708);
+  const __m256i G3 = _mm256_add_epi16(G0, G1);
+  const __m256i G4 = _mm256_sub_epi16(G2, G3);
+
+  // be careful with the saturated *unsigned* arithmetic here!
+  const __m256i B0 = _mm256_mulhi_epu16(*U0, k33050);
+  const __m256i B1 = _mm256_adds_epu16(B0, Y1);
+  const __m256i B2 = _mm256_subs_epu16(B1, k17685);
+
+  // use logical shift for B2, which can be larger than 32767
+  *R = _mm256_srai_epi16(R2, 6);  // range: [-14234, 30815]
+  *G = _mm256_srai_epi16(G4, 6);  // range: [-10953, 27710]
+  *B = _mm256_srli_epi16(B2, 6);  // range: [0, 34238]
+}
+
+// Load the 16 bytes into the *upper* part of 16b words. That's "<< 8".
+static WEBP_INLINE __m256i Load_HI_16_AVX2(const uint8_t* src) {
+  const __m128i tmp = _mm_loadu_si128((const __m128i*)src);
+  return _mm256_slli_epi16(_mm256_cvtepu8_epi16(tmp), 8);
+}
+
+// Load and replicate 8 U/V samples
+static WEBP_INLINE __m256i Load_UV_HI_8_AVX2(const uint8_t* src) {
+  const __m128i tmp0 = _mm_loadl_epi64((const __m128i*)src);
+  const __m128i tmp1 = _mm_unpacklo_epi8(tmp0, tmp0);  // replicate samples
+  return _mm256_slli_epi16(_mm256_cvtepu8_epi16(tmp1), 8);
+}
+
+// Convert 16 samples of YUV444 to R/G/B
+static void YUV444ToRGB_AVX2(const uint8_t* WEBP_RESTRICT const y,
+                             const uint8_t* WEBP_RESTRICT const u,
+                             const uint8_t* WEBP_RESTRICT const v,
+                             __m256i* const R, __m256i* const G,
+                             __m256i* const B) {
+  const __m256i Y0 = Load_HI_16_AVX2(y), U0 = Load_HI_16_AVX2(u),
+                V0 = Load_HI_16_AVX2(v);
+  ConvertYUV444ToRGB_AVX2(&Y0, &U0, &V0, R, G, B);
+}
+
+// Convert 16 samples of YUV420 to R/G/B
+static void YUV420ToRGB_AVX2(const uint8_t* WEBP_RESTRICT const y,
+                             const uint8_t* WEBP_RESTRICT const u,
+                             const uint8_t* WEBP_RESTRICT const v,
+                             __m256i* const R, __m256i* const G,
+                             __m256i* const B) {
+  const __m256i Y0 = Load_HI_16_AVX2(y), U0 = Load_UV_HI_8_AVX2(u),
+                V0 = Load_UV_HI_8_AVX2(v);
+  ConvertYUV444ToRGB_AVX2(&Y0, &U0, &V0, R, G, B);
+}
+
+// Pack R/G/B/A results into 32b output.
+static WEBP_INLINE void PackAndStore4_AVX2(const __m256i* const R,
+                                           const __m256i* const G,
+                                           const __m256i* const B,
+                                           const __m256i* const A,
+                                           uint8_t* WEBP_RESTRICT const dst) {
+  const __m256i rb = _mm256_packus_epi16(*R, *B);
+  const __m256i ga = _mm256_packus_epi16(*G, *A);
+  const __m256i rg = _mm256_unpacklo_epi8(rb, ga);
+  const __m256i ba = _mm256_unpackhi_epi8(rb, ga);
+  // pixels 0..3 | 8..11 and 4..7 | 12..15
+  const __m256i RGBA_lo = _mm256_unpacklo_epi16(rg, ba);
+  const __m256i RGBA_hi = _mm256_unpackhi_epi16(rg, ba);
+  _mm256_storeu_si256((__m256i*)(dst + 0),
+                      _mm256_permute2x128_si256(RGBA_lo, RGBA_hi, 0x20));
+  _mm256_storeu_si256((__m256i*)(dst + 32),
+                      _mm256_permute2x128_si256(RGBA_lo, RGBA_hi, 0x31));
+}
+
+// Pack R/G/B/A results into 16b output.
+static WEBP_INLINE void PackAndStore4444_AVX2(
+    const __m256i* const R, const __m256i* const G, const __m256i* const B,
+    const __m256i* const A, uint8_t* WEBP_RESTRICT const dst) {
+#if (WEBP_SWAP_16BIT_CSP == 0)
+  const __m256i rg0 = _mm256_packus_epi16(*R, *G);
+  const __m256i ba0 = _mm256_packus_epi16(*B, *A);
+#else
+  const __m256i rg0 = _mm256_packus_epi16(*B, *A);
+  const __m256i ba0 = _mm256_packus_epi16(*R, *G);
+#endif
+  const __m256i mask_0xf0 = _mm256_set1_epi8((char)0xf0);
+  const __m256i rb1 = _mm256_unpacklo_epi8(rg0, ba0);  // rbrbrbrbrb...
+  const __m256i ga1 = _mm256_unpackhi_epi8(rg0, ba0);  // gagagagaga...
+  const __m256i rb2 = _mm256_and_si256(rb1, mask_0xf0);
+  const __m256i ga2 =
+      _mm256_srli_epi16(_mm256_and_si256(ga1, mask_0xf0), 4);
+  const __m256i rgba4444 = _mm256_or_si256(rb2, ga2);
+  _mm256_storeu_si256((__m256i*)dst, rgba4444);
+}
+
+// Pack R/G/B results into 16b output.
+static WEBP_INLINE void PackAndStore565_AVX2(const __m256i* const R,
+                                             const __m256i* const G,
+                                             const __m256i* const B,
+                                             uint8_t* WEBP_RESTRICT const dst) {
+  const __m256i r0 = _mm256_packus_epi16(*R, *R);
+  const __m256i g0 = _mm256_packus_epi16(*G, *G);
+  const __m256i b0 = _mm256_packus_epi16(*B, *B);
+  const __m256i r1 = _mm256_and_si256(r0, _mm256_set1_epi8((char)0xf8));
+  const __m256i b1 =
+      _mm256_and_si256(_mm256_srli_epi16(b0, 3), _mm256_set1_epi8(0x1f));
+  const __m256i g1 = _mm256_srli_epi16(
+      _mm256_and_si256(g0, _mm256_set1_epi8((char)0xe0)), 5);
+  const __m256i g2 = _mm256_slli_epi16(
+      _mm256_and_si256(g0, _mm256_set1_epi8(0x1c)), 3);
+  const __m256i rg = _mm256_or_si256(r1, g1);
+  const __m256i gb = _mm256_or_si256(g2, b1);
+#if (WEBP_SWAP_16BIT_CSP == 0)
+  const __m256i rgb565 = _mm256_unpacklo_epi8(rg, gb);
+#else
+  const __m256i rgb565 = _mm256_unpacklo_epi8(gb, rg);
+#endif
+  _mm256_storeu_si256((__m256i*)dst, rgb565);
+}
+
+// Returns a pshufb constant for both lanes.
+#define SHUFF_CST(A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P) \
+  _mm256_broadcastsi128_si256(                                    \
+      _mm_set_epi8(A, B, C, D, E, F, G, H, I, J, K, L, M, N, O, P))
+
+// Pack the planar buffers of 32 samples, 16b each:
+// rrrr... rrrr... gggg... gggg... bbbb... bbbb....
+// triplet by triplet in the output buffer rgb as rgbrgbrgbrgb ...
+// Each lane is processed as in VP8PlanarTo24b_SSE41(): the low one holds the
+// first 16 pixels, the high one the last 16 pixels.
+static WEBP_INLINE void PlanarTo24b_AVX2(const __m256i* const in0,
+                                         const __m256i* const in1,
+                                         const __m256i* const in2,
+                                         const __m256i* const in3,
+                                         const __m256i* const in4,
+                                         const __m256i* const in5,
+                                         uint8_t* WEBP_RESTRICT const rgb) {
+  // Cast to 8b, with the pixels 0..15 in the low lane.
+  const __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(*in0, *in1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(*in2, *in3),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(*in4, *in5),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  __m256i out0, out1, out2;
+  // Process R.
+  {
+    const __m256i shuff0 = SHUFF_CST(5, -1, -1, 4, -1, -1, 3, -1, -1, 2, -1, -1,
+                                     1, -1, -1, 0);
+    const __m256i shuff1 = SHUFF_CST(-1, 10, -1, -1, 9, -1, -1, 8, -1, -1, 7,
+                                     -1, -1, 6, -1, -1);
+    const __m256i shuff2 = SHUFF_CST(-1, -1, 15, -1, -1, 14, -1, -1, 13, -1,
+                                     -1, 12, -1, -1, 11, -1);
+    out0 = _mm256_shuffle_epi8(r, shuff0);
+    out1 = _mm256_shuffle_epi8(r, shuff1);
+    out2 = _mm256_shuffle_epi8(r, shuff2);
+  }
+  // Process G.
+  {
+    const __m256i shuff0 = SHUFF_CST(-1, -1, 4, -1, -1, 3, -1, -1, 2, -1, -1,
+                                     1, -1, -1, 0, -1);
+    const __m256i shuff1 = SHUFF_CST(10, -1, -1, 9, -1, -1, 8, -1, -1, 7, -1,
+                                     -1, 6, -1, -1, 5);
+    const __m256i shuff2 = SHUFF_CST(-1, 15, -1, -1, 14, -1, -1, 13, -1, -1,
+                                     12, -1, -1, 11, -1, -1);
+    out0 = _mm256_or_si256(out0, _mm256_shuffle_epi8(g, shuff0));
+    out1 = _mm256_or_si256(out1, _mm256_shuffle_epi8(g, shuff1));
+    out2 = _mm256_or_si256(out2, _mm256_shuffle_epi8(g, shuff2));
+  }
+  // Process B.
+  {
+    const __m256i shuff0 = SHUFF_CST(-1, 4, -1, -1, 3, -1, -1, 2, -1, -1, 1,
+                                     -1, -1, 0, -1, -1);
+    const __m256i shuff1 = SHUFF_CST(-1, -1, 9, -1, -1, 8, -1, -1, 7, -1, -1,
+                                     6, -1, -1, 5, -1);
+    const __m256i shuff2 = SHUFF_CST(15, -1, -1, 14, -1, -1, 13, -1, -1, 12,
+                                     -1, -1, 11, -1, -1, 10);
+    out0 = _mm256_or_si256(out0, _mm256_shuffle_epi8(b, shuff0));
+    out1 = _mm256_or_si256(out1, _mm256_shuffle_epi8(b, shuff1));
+    out2 = _mm256_or_si256(out2, _mm256_shuffle_epi8(b, shuff2));
+  }
+  // out0, out1 and out2 hold the bytes 0..47 in their low lanes, and the bytes
+  // 48..95 in their high lanes.
+  _mm256_storeu_si256((__m256i*)(rgb + 0),
+                      _mm256_permute2x128_si256(out0, out1, 0x20));
+  _mm256_storeu_si256((__m256i*)(rgb + 32),
+                      _mm256_permute2x128_si256(out2, out0, 0x30));
+  _mm256_storeu_si256((__m256i*)(rgb + 64),
+                      _mm256_permute2x128_si256(out1, out2, 0x31));
+}
+
+void VP8YuvToRgba32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n < 32; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV444ToRGB_AVX2(y + n, u + n, v + n, &R, &G, &B);
+    PackAndStore4_AVX2(&R, &G, &B, &kAlpha, dst);
+  }
+}
+
+void VP8YuvToBgra32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n < 32; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV444ToRGB_AVX2(y + n, u + n, v + n, &R, &G, &B);
+    PackAndStore4_AVX2(&B, &G, &R, &kAlpha, dst);
+  }
+}
+
+void VP8YuvToArgb32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                         const uint8_t* WEBP_RESTRICT u,
+                         const uint8_t* WEBP_RESTRICT v,
+                         uint8_t* WEBP_RESTRICT dst) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n < 32; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV444ToRGB_AVX2(y + n, u + n, v + n, &R, &G, &B);
+    PackAndStore4_AVX2(&kAlpha, &R, &G, &B, dst);
+  }
+}
+
+void VP8YuvToRgba444432_AVX2(const uint8_t* WEBP_RESTRICT y,
+                             const uint8_t* WEBP_RESTRICT u,
+                             const uint8_t* WEBP_RESTRICT v,
+                             uint8_t* WEBP_RESTRICT dst) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n < 32; n += 16, dst += 32) {
+    __m256i R, G, B;
+    YUV444ToRGB_AVX2(y + n, u + n, v + n, &R, &G, &B);
+    PackAndStore4444_AVX2(&R, &G, &B, &kAlpha, dst);
+  }
+}
+
+void VP8YuvToRgb56532_AVX2(const uint8_t* WEBP_RESTRICT y,
+                           const uint8_t* WEBP_RESTRICT u,
+                           const uint8_t* WEBP_RESTRICT v,
+                           uint8_t* WEBP_RESTRICT dst) {
+  int n;
+  for (n = 0; n < 32; n += 16, dst += 32) {
+    __m256i R, G, B;
+    YUV444ToRGB_AVX2(y + n, u + n, v + n, &R, &G, &B);
+    PackAndStore565_AVX2(&R, &G, &B, dst);
+  }
+}
+
+void VP8YuvToRgb32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                        const uint8_t* WEBP_RESTRICT u,
+                        const uint8_t* WEBP_RESTRICT v,
+                        uint8_t* WEBP_RESTRICT dst) {
+  __m256i R0, R1, G0, G1, B0, B1;
+
+  YUV444ToRGB_AVX2(y + 0, u + 0, v + 0, &R0, &G0, &B0);
+  YUV444ToRGB_AVX2(y + 16, u + 16, v + 16, &R1, &G1, &B1);
+
+  // Pack as RGBRGBRGBRGB.
+  PlanarTo24b_AVX2(&R0, &R1, &G0, &G1, &B0, &B1, dst);
+}
+
+void VP8YuvToBgr32_AVX2(const uint8_t* WEBP_RESTRICT y,
+                        const uint8_t* WEBP_RESTRICT u,
+                        const uint8_t* WEBP_RESTRICT v,
+                        uint8_t* WEBP_RESTRICT dst) {
+  __m256i R0, R1, G0, G1, B0, B1;
+
+  YUV444ToRGB_AVX2(y + 0, u + 0, v + 0, &R0, &G0, &B0);
+  YUV444ToRGB_AVX2(y + 16, u + 16, v + 16, &R1, &G1, &B1);
+
+  // Pack as BGRBGRBGRBGR.
+  PlanarTo24b_AVX2(&B0, &B1, &G0, &G1, &R0, &R1, dst);
+}
+
+//-----------------------------------------------------------------------------
+// Arbitrary-length row conversion functions
+
+static void YuvToRgbaRow_AVX2(const uint8_t* WEBP_RESTRICT y,
+                              const uint8_t* WEBP_RESTRICT u,
+                              const uint8_t* WEBP_RESTRICT v,
+                              uint8_t* WEBP_RESTRICT dst, int len) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n + 16 <= len; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV420ToRGB_AVX2(y, u, v, &R, &G, &B);
+    PackAndStore4_AVX2(&R, &G, &B, &kAlpha, dst);
+    y += 16;
+    u += 8;
+    v += 8;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToRgba(y[0], u[0], v[0], dst);
+    dst += 4;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToBgraRow_AVX2(const uint8_t* WEBP_RESTRICT y,
+                              const uint8_t* WEBP_RESTRICT u,
+                              const uint8_t* WEBP_RESTRICT v,
+                              uint8_t* WEBP_RESTRICT dst, int len) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n + 16 <= len; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV420ToRGB_AVX2(y, u, v, &R, &G, &B);
+    PackAndStore4_AVX2(&B, &G, &R, &kAlpha, dst);
+    y += 16;
+    u += 8;
+    v += 8;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToBgra(y[0], u[0], v[0], dst);
+    dst += 4;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToArgbRow_AVX2(const uint8_t* WEBP_RESTRICT y,
+                              const uint8_t* WEBP_RESTRICT u,
+                              const uint8_t* WEBP_RESTRICT v,
+                              uint8_t* WEBP_RESTRICT dst, int len) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n + 16 <= len; n += 16, dst += 64) {
+    __m256i R, G, B;
+    YUV420ToRGB_AVX2(y, u, v, &R, &G, &B);
+    PackAndStore4_AVX2(&kAlpha, &R, &G, &B, dst);
+    y += 16;
+    u += 8;
+    v += 8;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToArgb(y[0], u[0], v[0], dst);
+    dst += 4;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToRgba4444Row_AVX2(const uint8_t* WEBP_RESTRICT y,
+                                  const uint8_t* WEBP_RESTRICT u,
+                                  const uint8_t* WEBP_RESTRICT v,
+                                  uint8_t* WEBP_RESTRICT dst, int len) {
+  const __m256i kAlpha = _mm256_set1_epi16(255);
+  int n;
+  for (n = 0; n + 16 <= len; n += 16, dst += 32) {
+    __m256i R, G, B;
+    YUV420ToRGB_AVX2(y, u, v, &R, &G, &B);
+    PackAndStore4444_AVX2(&R, &G, &B, &kAlpha, dst);
+    y += 16;
+    u += 8;
+    v += 8;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToRgba4444(y[0], u[0], v[0], dst);
+    dst += 2;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToRgb565Row_AVX2(const uint8_t* WEBP_RESTRICT y,
+                                const uint8_t* WEBP_RESTRICT u,
+                                const uint8_t* WEBP_RESTRICT v,
+                                uint8_t* WEBP_RESTRICT dst, int len) {
+  int n;
+  for (n = 0; n + 16 <= len; n += 16, dst += 32) {
+    __m256i R, G, B;
+    YUV420ToRGB_AVX2(y, u, v, &R, &G, &B);
+    PackAndStore565_AVX2(&R, &G, &B, dst);
+    y += 16;
+    u += 8;
+    v += 8;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToRgb565(y[0], u[0], v[0], dst);
+    dst += 2;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToRgbRow_AVX2(const uint8_t* WEBP_RESTRICT y,
+                             const uint8_t* WEBP_RESTRICT u,
+                             const uint8_t* WEBP_RESTRICT v,
+                             uint8_t* WEBP_RESTRICT dst, int len) {
+  int n;
+  for (n = 0; n + 32 <= len; n += 32, dst += 32 * 3) {
+    __m256i R0, R1, G0, G1, B0, B1;
+
+    YUV420ToRGB_AVX2(y + 0, u + 0, v + 0, &R0, &G0, &B0);
+    YUV420ToRGB_AVX2(y + 16, u + 8, v + 8, &R1, &G1, &B1);
+
+    // Pack as RGBRGBRGBRGB.
+    PlanarTo24b_AVX2(&R0, &R1, &G0, &G1, &B0, &B1, dst);
+
+    y += 32;
+    u += 16;
+    v += 16;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToRgb(y[0], u[0], v[0], dst);
+    dst += 3;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+static void YuvToBgrRow_AVX2(const uint8_t* WEBP_RESTRICT y,
+                             const uint8_t* WEBP_RESTRICT u,
+                             const uint8_t* WEBP_RESTRICT v,
+                             uint8_t* WEBP_RESTRICT dst, int len) {
+  int n;
+  for (n = 0; n + 32 <= len; n += 32, dst += 32 * 3) {
+    __m256i R0, R1, G0, G1, B0, B1;
+
+    YUV420ToRGB_AVX2(y + 0, u + 0, v + 0, &R0, &G0, &B0);
+    YUV420ToRGB_AVX2(y + 16, u + 8, v + 8, &R1, &G1, &B1);
+
+    // Pack as BGRBGRBGRBGR.
+    PlanarTo24b_AVX2(&B0, &B1, &G0, &G1, &R0, &R1, dst);
+
+    y += 32;
+    u += 16;
+    v += 16;
+  }
+  for (; n < len; ++n) {  // Finish off
+    VP8YuvToBgr(y[0], u[0], v[0], dst);
+    dst += 3;
+    y += 1;
+    u += (n & 1);
+    v += (n & 1);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Entry point
+
+extern void WebPInitSamplersAVX2(void);
+
+WEBP_TSAN_IGNORE_FUNCTION void WebPInitSamplersAVX2(void) {
+  WebPSamplers[MODE_RGB] = YuvToRgbRow_AVX2;
+  WebPSamplers[MODE_RGBA] = YuvToRgbaRow_AVX2;
+  WebPSamplers[MODE_BGR] = YuvToBgrRow_AVX2;
+  WebPSamplers[MODE_BGRA] = YuvToBgraRow_AVX2;
+  WebPSamplers[MODE_ARGB] = YuvToArgbRow_AVX2;
+  WebPSamplers[MODE_RGBA_4444] = YuvToRgba4444Row_AVX2;
+  WebPSamplers[MODE_RGB_565] = YuvToRgb565Row_AVX2;
+  WebPSamplers[MODE_rgbA] = YuvToRgbaRow_AVX2;
+  WebPSamplers[MODE_bgrA] = YuvToBgraRow_AVX2;
+  WebPSamplers[MODE_Argb] = YuvToArgbRow_AVX2;
+  WebPSamplers[MODE_rgbA_4444] = YuvToRgba4444Row_AVX2;
+}
+
+//------------------------------------------------------------------------------
+// RGB24/32 -> YUV converters
+
+#define WEBP_AVX2_SHUFF(OUT)                              \
+  do {                                                    \
+    const __m256i tmp0 = _mm256_shuffle_epi8(A0, shuff0); \
+    const __m256i tmp1 = _mm256_shuffle_epi8(A1, shuff1); \
+    const __m256i tmp2 = _mm256_shuffle_epi8(A2, shuff2); \
+                                                          \
+    /* OR everything to get one channel */                \
+    const __m256i tmp3 = _mm256_or_si256(tmp0, tmp1);     \
+    out[OUT] = _mm256_or_si256(tmp3, tmp2);               \
+  } while (0);
+
+// Unpack the 8b input rgbrgbrgbrgb ... of 32 pixels as contiguous registers:
+// out[0] = rrrr..., out[1] = gggg..., out[2] = bbbb..., each lane being
+// processed as in RGBPackedToPlanar_SSE41(): the low lane holds the first 16
+// pixels, the high one the last 16 pixels.
+static WEBP_INLINE void RGB24PackedToPlanar_AVX2(
+    const uint8_t* WEBP_RESTRICT const rgb, __m256i* const out /*out[3]*/) {
+  const __m256i A0 = Load2x128_AVX2(rgb + 0, rgb + 48);
+  const __m256i A1 = Load2x128_AVX2(rgb + 16, rgb + 64);
+  const __m256i A2 = Load2x128_AVX2(rgb + 32, rgb + 80);
+
+  // Compute RR.
+  {
+    const __m256i shuff0 = SHUFF_CST(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                     15, 12, 9, 6, 3, 0);
+    const __m256i shuff1 = SHUFF_CST(-1, -1, -1, -1, -1, 14, 11, 8, 5, 2, -1,
+                                     -1, -1, -1, -1, -1);
+    const __m256i shuff2 = SHUFF_CST(13, 10, 7, 4, 1, -1, -1, -1, -1, -1, -1,
+                                     -1, -1, -1, -1, -1);
+    WEBP_AVX2_SHUFF(0)
+  }
+  // Compute GG.
+  {
+    const __m256i shuff0 = SHUFF_CST(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                     -1, 13, 10, 7, 4, 1);
+    const __m256i shuff1 = SHUFF_CST(-1, -1, -1, -1, -1, 15, 12, 9, 6, 3, 0,
+                                     -1, -1, -1, -1, -1);
+    const __m256i shuff2 = SHUFF_CST(14, 11, 8, 5, 2, -1, -1, -1, -1, -1, -1,
+                                     -1, -1, -1, -1, -1);
+    WEBP_AVX2_SHUFF(1)
+  }
+  // Compute BB.
+  {
+    const __m256i shuff0 = SHUFF_CST(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                     -1, 14, 11, 8, 5, 2);
+    const __m256i shuff1 = SHUFF_CST(-1, -1, -1, -1, -1, -1, 13, 10, 7, 4, 1,
+                                     -1, -1, -1, -1, -1);
+    const __m256i shuff2 = SHUFF_CST(15, 12, 9, 6, 3, 0, -1, -1, -1, -1, -1,
+                                     -1, -1, -1, -1, -1);
+    WEBP_AVX2_SHUFF(2)
+  }
+}
+
+#undef WEBP_AVX2_SHUFF
+
+// Unpack 16 pixels of 8b four-channel input c0c1c2c3c0c1c2c3... as:
+// *c02 = c0c0c0... (16) | c2c2c2... (16) and *c13 = c1c1c1... | c3c3c3...
+static WEBP_INLINE void Packed32bToPlanar_AVX2(const uint8_t* const src,
+                                               __m256i* const c02,
+                                               __m256i* const c13) {
+  const __m256i shuff =
+      SHUFF_CST(15, 11, 7, 3, 14, 10, 6, 2, 13, 9, 5, 1, 12, 8, 4, 0);
+  const __m256i perm = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  const __m256i in0 = _mm256_loadu_si256((const __m256i*)(src + 0));
+  const __m256i in1 = _mm256_loadu_si256((const __m256i*)(src + 32));
+  // c0 c1 c2 c3, four pixels each, in each lane
+  const __m256i A0 = _mm256_shuffle_epi8(in0, shuff);
+  const __m256i A1 = _mm256_shuffle_epi8(in1, shuff);
+  // c0 c1 | c2 c3, eight pixels each
+  const __m256i B0 = _mm256_permutevar8x32_epi32(A0, perm);
+  const __m256i B1 = _mm256_permutevar8x32_epi32(A1, perm);
+  *c02 = _mm256_unpacklo_epi64(B0, B1);
+  *c13 = _mm256_unpackhi_epi64(B0, B1);
+}
+
+// Unpack the 8b input of 32 pixels rgbargbargba... (or bgra..., if 'swap_rb')
+// as contiguous registers, with the first 16 pixels in the low lanes:
+// out[0] = rrrr..., out[1] = gggg..., out[2] = bbbb...
+static WEBP_INLINE void RGB32PackedToPlanar_AVX2(
+    const uint8_t* WEBP_RESTRICT const rgba, int swap_rb,
+    __m256i* const out /*out[3]*/) {
+  __m256i c02_0, c13_0, c02_1, c13_1;
+  Packed32bToPlanar_AVX2(rgba + 0, &c02_0, &c13_0);
+  Packed32bToPlanar_AVX2(rgba + 64, &c02_1, &c13_1);
+  out[swap_rb ? 2 : 0] = _mm256_permute2x128_si256(c02_0, c02_1, 0x20);
+  out[1] = _mm256_permute2x128_si256(c13_0, c13_1, 0x20);
+  out[swap_rb ? 0 : 2] = _mm256_permute2x128_si256(c02_0, c02_1, 0x31);
+}
+
+// This macro computes (RG * MULT_RG + GB * MULT_GB + ROUNDER) >> DESCALE_FIX
+// It's a macro and not a function because we need to use immediate values with
+// srai_epi32, e.g.
+#define TRANSFORM(RG_LO, RG_HI, GB_LO, GB_HI, MULT_RG, MULT_GB, ROUNDER, \
+                  DESCALE_FIX, OUT)                                      \
+  do {                                                                   \
+    const __m256i V0_lo = _mm256_madd_epi16(RG_LO, MULT_RG);             \
+    const __m256i V0_hi = _mm256_madd_epi16(RG_HI, MULT_RG);             \
+    const __m256i V1_lo = _mm256_madd_epi16(GB_LO, MULT_GB);             \
+    const __m256i V1_hi = _mm256_madd_epi16(GB_HI, MULT_GB);             \
+    const __m256i V2_lo = _mm256_add_epi32(V0_lo, V1_lo);                \
+    const __m256i V2_hi = _mm256_add_epi32(V0_hi, V1_hi);                \
+    const __m256i V3_lo = _mm256_add_epi32(V2_lo, ROUNDER);              \
+    const __m256i V3_hi = _mm256_add_epi32(V2_hi, ROUNDER);              \
+    const __m256i V5_lo = _mm256_srai_epi32(V3_lo, DESCALE_FIX);         \
+    const __m256i V5_hi = _mm256_srai_epi32(V3_hi, DESCALE_FIX);         \
+    (OUT) = _mm256_packs_epi32(V5_lo, V5_hi);                            \
+  } while (0)
+
+#define MK_CST_16(A, B) \
+  _mm256_set1_epi32((int)(((uint32_t)(B) << 16) | (uint16_t)(A)))
+static WEBP_INLINE void ConvertRGBToYImpl_AVX2(const __m256i* const R,
+                                               const __m256i* const G,
+                                               const __m256i* const B,
+                                               __m256i* const Y) {
+  const __m256i kRG_y = MK_CST_16(16839, 33059 - 16384);
+  const __m256i kGB_y = MK_CST_16(16384, 6420);
+  const __m256i kHALF_Y = _mm256_set1_epi32((16 << YUV_FIX) + YUV_HALF);
+
+  const __m256i RG_lo = _mm256_unpacklo_epi16(*R, *G);
+  const __m256i RG_hi = _mm256_unpackhi_epi16(*R, *G);
+  const __m256i GB_lo = _mm256_unpacklo_epi16(*G, *B);
+  const __m256i GB_hi = _mm256_unpackhi_epi16(*G, *B);
+  TRANSFORM(RG_lo, RG_hi, GB_lo, GB_hi, kRG_y, kGB_y, kHALF_Y, YUV_FIX, *Y);
+}
+
+static WEBP_INLINE void ConvertRGBToUV_AVX2(const __m256i* const R,
+                                            const __m256i* const G,
+                                            const __m256i* const B,
+                                            __m256i* const U,
+                                            __m256i* const V) {
+  const __m256i kRG_u = MK_CST_16(-9719, -19081);
+  const __m256i kGB_u = MK_CST_16(0, 28800);
+  const __m256i kRG_v = MK_CST_16(28800, 0);
+  const __m256i kGB_v = MK_CST_16(-24116, -4684);
+  const __m256i kHALF_UV =
+      _mm256_set1_epi32(((128 << YUV_FIX) + YUV_HALF) << 2);
+
+  const __m256i RG_lo = _mm256_unpacklo_epi16(*R, *G);
+  const __m256i RG_hi = _mm256_unpackhi_epi16(*R, *G);
+  const __m256i GB_lo = _mm256_unpacklo_epi16(*G, *B);
+  const __m256i GB_hi = _mm256_unpackhi_epi16(*G, *B);
+  TRANSFORM(RG_lo, RG_hi, GB_lo, GB_hi, kRG_u, kGB_u, kHALF_UV, YUV_FIX + 2,
+            *U);
+  TRANSFORM(RG_lo, RG_hi, GB_lo, GB_hi, kRG_v, kGB_v, kHALF_UV, YUV_FIX + 2,
+            *V);
+}
+
+#undef MK_CST_16
+#undef TRANSFORM
+
+// Converts the 32 pixels of the 8b planes 'rgb_plane' and stores the 8b Y.
+// Samples 0..7 and 16..23 are widened together, so that packing them back
+// restores the original order.
+static WEBP_INLINE void ConvertRGBToYHelper_AVX2(
+    const __m256i* const rgb_plane /*in[3]*/, uint8_t* WEBP_RESTRICT y) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i r, g, b, Y0, Y1;
+
+  // Convert to 16-bit Y.
+  r = _mm256_unpacklo_epi8(rgb_plane[0], zero);
+  g = _mm256_unpacklo_epi8(rgb_plane[1], zero);
+  b = _mm256_unpacklo_epi8(rgb_plane[2], zero);
+  ConvertRGBToYImpl_AVX2(&r, &g, &b, &Y0);
+
+  // Convert to 16-bit Y.
+  r = _mm256_unpackhi_epi8(rgb_plane[0], zero);
+  g = _mm256_unpackhi_epi8(rgb_plane[1], zero);
+  b = _mm256_unpackhi_epi8(rgb_plane[2], zero);
+  ConvertRGBToYImpl_AVX2(&r, &g, &b, &Y1);
+
+  // Cast to 8-bit and store.
+  _mm256_storeu_si256((__m256i*)y, _mm256_packus_epi16(Y0, Y1));
+}
+
+static void ConvertRGBToY_AVX2(const uint8_t* WEBP_RESTRICT rgb,
+                               uint8_t* WEBP_RESTRICT y, int width, int step) {
+  const int max_width = width & ~31;
+  int i;
+  __m256i rgb_plane[3];
+  if (step == 3) {
+    for (i = 0; i < max_width; i += 32, rgb += 3 * 32) {
+      RGB24PackedToPlanar_AVX2(rgb, rgb_plane);
+      ConvertRGBToYHelper_AVX2(rgb_plane, y + i);
+    }
+  } else {
+    for (i = 0; i < max_width; i += 32, rgb += 4 * 32) {
+      RGB32PackedToPlanar_AVX2(rgb, /*swap_rb=*/0, rgb_plane);
+      ConvertRGBToYHelper_AVX2(rgb_plane, y + i);
+    }
+  }
+  for (; i < width; ++i, rgb += step) {  // left-over
+    y[i] = VP8RGBToY(rgb[0], rgb[1], rgb[2], YUV_HALF);
+  }
+}
+
+static void ConvertBGRToY_AVX2(const uint8_t* WEBP_RESTRICT bgr,
+                               uint8_t* WEBP_RESTRICT y, int width, int step) {
+  const int max_width = width & ~31;
+  int i;
+  __m256i bgr_plane[3];
+  if (step == 3) {
+    for (i = 0; i < max_width; i += 32, bgr += 3 * 32) {
+      __m256i tmp;
+      RGB24PackedToPlanar_AVX2(bgr, bgr_plane);
+      tmp = bgr_plane[0];
+      bgr_plane[0] = bgr_plane[2];
+      bgr_plane[2] = tmp;
+      ConvertRGBToYHelper_AVX2(bgr_plane, y + i);
+    }
+  } else {
+    for (i = 0; i < max_width; i += 32, bgr += 4 * 32) {
+      RGB32PackedToPlanar_AVX2(bgr, /*swap_rb=*/1, bgr_plane);
+      ConvertRGBToYHelper_AVX2(bgr_plane, y + i);
+    }
+  }
+  for (; i < width; ++i, bgr += step) {  // left-over
+    y[i] = VP8RGBToY(bgr[2], bgr[1], bgr[0], YUV_HALF);
+  }
+}
+
+static void ConvertARGBToY_AVX2(const uint32_t* WEBP_RESTRICT argb,
+                                uint8_t* WEBP_RESTRICT y, int width) {
+  const int max_width = width & ~31;
+  int i;
+  for (i = 0; i < max_width; i += 32) {
+    __m256i rgb_plane[3];
+    // ARGB values are stored as bgra in memory.
+    RGB32PackedToPlanar_AVX2((const uint8_t*)&argb[i], /*swap_rb=*/1,
+                             rgb_plane);
+    ConvertRGBToYHelper_AVX2(rgb_plane, y + i);
+  }
+  for (; i < width; ++i) {  // left-over
+    const uint32_t p = argb[i];
+    y[i] =
+        VP8RGBToY((p >> 16) & 0xff, (p >> 8) & 0xff, (p >> 0) & 0xff, YUV_HALF);
+  }
+}
+
+// Horizontal add (doubled) of two 16b values, result is 16b.
+// in: A | B | C | D | ... -> out: 2*(A+B) | 2*(C+D) | ...
+static void HorizontalAddPack_AVX2(const __m256i* const A,
+                                   const __m256i* const B, __m256i* const out) {
+  const __m256i k2 = _mm256_set1_epi16(2);
+  const __m256i C = _mm256_madd_epi16(*A, k2);
+  const __m256i D = _mm256_madd_epi16(*B, k2);
+  *out = _mm256_packs_epi32(C, D);
+}
+
+// Computes the 16b U and V values of 32 ARGB pixels, in order.
+static WEBP_INLINE void ARGBToUV32_AVX2(const uint32_t* WEBP_RESTRICT argb,
+                                        __m256i* const U, __m256i* const V) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i rgb_plane[3], rgb[3];
+  int k;
+  RGB32PackedToPlanar_AVX2((const uint8_t*)argb, /*swap_rb=*/1, rgb_plane);
+  for (k = 0; k < 3; ++k) {
+    // Pixels 0..7 | 16..23 and 8..15 | 24..31: once summed pairwise and
+    // packed, the results are in order.
+    const __m256i lo = _mm256_unpacklo_epi8(rgb_plane[k], zero);
+    const __m256i hi = _mm256_unpackhi_epi8(rgb_plane[k], zero);
+    HorizontalAddPack_AVX2(&lo, &hi, &rgb[k]);
+  }
+  ConvertRGBToUV_AVX2(&rgb[0], &rgb[1], &rgb[2], U, V);
+}
+
+static void ConvertARGBToUV_AVX2(const uint32_t* WEBP_RESTRICT argb,
+                                 uint8_t* WEBP_RESTRICT u,
+                                 uint8_t* WEBP_RESTRICT v, int src_width,
+                                 int do_store) {
+  const int max_width = src_width & ~31;
+  int i;
+  for (i = 0; i + 64 <= max_width; i += 64, u += 32, v += 32) {
+    __m256i U0, V0, U1, V1;
+    ARGBToUV32_AVX2(&argb[i + 0], &U0, &V0);
+    ARGBToUV32_AVX2(&argb[i + 32], &U1, &V1);
+    U0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(U0, U1),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+    V0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(V0, V1),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+    if (!do_store) {
+      const __m256i prev_u = _mm256_loadu_si256((const __m256i*)u);
+      const __m256i prev_v = _mm256_loadu_si256((const __m256i*)v);
+      U0 = _mm256_avg_epu8(U0, prev_u);
+      V0 = _mm256_avg_epu8(V0, prev_v);
+    }
+    _mm256_storeu_si256((__m256i*)u, U0);
+    _mm256_storeu_si256((__m256i*)v, V0);
+  }
+  if (i < max_width) {  // 32 pixels left
+    __m256i U0, V0;
+    __m128i U, V;
+    ARGBToUV32_AVX2(&argb[i], &U0, &V0);
+    U0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(U0, U0),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+    V0 = _mm256_permute4x64_epi64(_mm256_packus_epi16(V0, V0),
+                                  _MM_SHUFFLE(3, 1, 2, 0));
+    U = _mm256_castsi256_si128(U0);
+    V = _mm256_castsi256_si128(V0);
+    if (!do_store) {
+      U = _mm_avg_epu8(U, _mm_loadu_si128((const __m128i*)u));
+      V = _mm_avg_epu8(V, _mm_loadu_si128((const __m128i*)v));
+    }
+    _mm_storeu_si128((__m128i*)u, U);
+    _mm_storeu_si128((__m128i*)v, V);
+    i += 32;
+    u += 16;
+    v += 16;
+  }
+  if (i < src_width) {  // left-over
+    WebPConvertARGBToUV_C(argb + i, u, v, src_width - i, do_store);
+  }
+}
+
+// Convert 16 packed RGBX 16b-values to r[], g[], b[]. The samples are not
+// stored in order but as 0 1 4 5 8 9 12 13 | 2 3 6 7 10 11 14 15.
+static WEBP_INLINE void RGBA32PackedToPlanar_16b_AVX2(
+    const uint16_t* WEBP_RESTRICT const rgbx, __m256i* const r,
+    __m256i* const g, __m256i* const b) {
+  // r0 g0 b0 x0 r1 g1 b1 x1 | r2 g2 b2 x2 r3 g3 b3 x3
+  const __m256i in0 = _mm256_loadu_si256((const __m256i*)(rgbx + 0));
+  const __m256i in1 = _mm256_loadu_si256((const __m256i*)(rgbx + 16));
+  const __m256i in2 = _mm256_loadu_si256((const __m256i*)(rgbx + 32));
+  const __m256i in3 = _mm256_loadu_si256((const __m256i*)(rgbx + 48));
+  // r0 r1 g0 g1 b0 b1 x0 x1 | r2 r3 g2 g3 b2 b3 x2 x3
+  const __m256i shuff =
+      SHUFF_CST(15, 14, 7, 6, 13, 12, 5, 4, 11, 10, 3, 2, 9, 8, 1, 0);
+  const __m256i A0 = _mm256_shuffle_epi8(in0, shuff);
+  const __m256i A1 = _mm256_shuffle_epi8(in1, shuff);
+  const __m256i A2 = _mm256_shuffle_epi8(in2, shuff);
+  const __m256i A3 = _mm256_shuffle_epi8(in3, shuff);
+  // r0 r1 r4 r5 g0 g1 g4 g5 | r2 r3 r6 r7 g2 g3 g6 g7
+  // b0 b1 b4 b5 x0 x1 x4 x5 | b2 b3 b6 b7 x2 x3 x6 x7
+  const __m256i B0 = _mm256_unpacklo_epi32(A0, A1);
+  const __m256i B1 = _mm256_unpackhi_epi32(A0, A1);
+  const __m256i B2 = _mm256_unpacklo_epi32(A2, A3);
+  const __m256i B3 = _mm256_unpackhi_epi32(A2, A3);
+  // Gather the channels.
+  *r = _mm256_unpacklo_epi64(B0, B2);
+  *g = _mm256_unpackhi_epi64(B0, B2);
+  *b = _mm256_unpacklo_epi64(B1, B3);
+}
+
+// Stores the 32 (resp. 16) 8b values of 'x' of the pixels
+// 0 1 4 5 8 9 ... | 2 3 6 7 10 11 ... in order.
+static WEBP_INLINE void StoreUV32_AVX2(const __m256i x,
+                                       uint8_t* WEBP_RESTRICT const dst) {
+  const __m128i lo = _mm256_castsi256_si128(x);
+  const __m128i hi = _mm256_extracti128_si256(x, 1);
+  _mm_storeu_si128((__m128i*)(dst + 0), _mm_unpacklo_epi16(lo, hi));
+  _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(lo, hi));
+}
+
+static WEBP_INLINE void StoreUV16_AVX2(const __m256i x,
+                                       uint8_t* WEBP_RESTRICT const dst) {
+  const __m128i lo = _mm256_castsi256_si128(x);
+  const __m128i hi = _mm256_extracti128_si256(x, 1);
+  _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(lo, hi));
+}
+
+static void ConvertRGBA32ToUV_AVX2(const uint16_t* WEBP_RESTRICT rgb,
+                                   uint8_t* WEBP_RESTRICT u,
+                                   uint8_t* WEBP_RESTRICT v, int width) {
+  const int max_width = width & ~15;
+  const uint16_t* const last_rgb = rgb + 4 * max_width;
+  while (rgb + 2 * 64 <= last_rgb) {
+    __m256i r, g, b, U0, V0, U1, V1;
+    RGBA32PackedToPlanar_16b_AVX2(rgb + 0, &r, &g, &b);
+    ConvertRGBToUV_AVX2(&r, &g, &b, &U0, &V0);
+    RGBA32PackedToPlanar_16b_AVX2(rgb + 64, &r, &g, &b);
+    ConvertRGBToUV_AVX2(&r, &g, &b, &U1, &V1);
+    StoreUV32_AVX2(_mm256_packus_epi16(U0, U1), u);
+    StoreUV32_AVX2(_mm256_packus_epi16(V0, V1), v);
+    u += 32;
+    v += 32;
+    rgb += 2 * 64;
+  }
+  if (rgb < last_rgb) {  // 16 pixels left
+    __m256i r, g, b, U0, V0;
+    RGBA32PackedToPlanar_16b_AVX2(rgb, &r, &g, &b);
+    ConvertRGBToUV_AVX2(&r, &g, &b, &U0, &V0);
+    StoreUV16_AVX2(_mm256_packus_epi16(U0, U0), u);
+    StoreUV16_AVX2(_mm256_packus_epi16(V0, V0), v);
+    u += 16;
+    v += 16;
+    rgb += 64;
+  }
+  if (max_width < width) {  // left-over
+    WebPConvertRGBA32ToUV_C(rgb, u, v, width - max_width);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Gamma-compressed averaging of R/G/B over 2x2 blocks, see WebPAccumulateRGB().
+
+// Returns the linear values of the 8 samples of 'v', as 32b.
+static WEBP_INLINE __m256i GammaToLinear_AVX2(const __m128i v) {
+  const __m256i idx = _mm256_cvtepu8_epi32(v);
+  // The 16b table is padded so that the last 32b load is safe.
+  const __m256i lin =
+      _mm256_i32gather_epi32((const int*)WebPGammaToLinearTab, idx, 2);
+  return _mm256_and_si256(lin, _mm256_set1_epi32(0xffff));
+}
+
+// Sums the linear values of the 32 samples of 'row0' and 'row1' over 2x2
+// blocks. The 16 sums are stored as 0 1 4 5 | 2 3 6 7 in sum[0], and the
+// same way for blocks 8..15 in sum[1].
+static WEBP_INLINE void SumToLinear_AVX2(const __m256i* const row0,
+                                         const __m256i* const row1,
+                                         __m256i* const sum /*sum[2]*/) {
+  const __m128i a0 = _mm256_castsi256_si128(*row0);
+  const __m128i a1 = _mm256_extracti128_si256(*row0, 1);
+  const __m128i b0 = _mm256_castsi256_si128(*row1);
+  const __m128i b1 = _mm256_extracti128_si256(*row1, 1);
+  const __m256i s0 =
+      _mm256_add_epi32(GammaToLinear_AVX2(a0), GammaToLinear_AVX2(b0));
+  const __m256i s1 =
+      _mm256_add_epi32(GammaToLinear_AVX2(_mm_srli_si128(a0, 8)),
+                       GammaToLinear_AVX2(_mm_srli_si128(b0, 8)));
+  const __m256i s2 =
+      _mm256_add_epi32(GammaToLinear_AVX2(a1), GammaToLinear_AVX2(b1));
+  const __m256i s3 =
+      _mm256_add_epi32(GammaToLinear_AVX2(_mm_srli_si128(a1, 8)),
+                       GammaToLinear_AVX2(_mm_srli_si128(b1, 8)));
+  sum[0] = _mm256_hadd_epi32(s0, s1);
+  sum[1] = _mm256_hadd_epi32(s2, s3);
+}
+
+// Same as LinearToGamma(v, 0) in yuv.c: interpolates WebPLinearToGammaTab[].
+// Its 33 entries fit in 8b: 'tab' holds them as the pshufb tables of the
+// entries 0..15, 16..31, 1..16 and 17..32 (v0 and v1 of the interpolation).
+static WEBP_INLINE __m256i LinearToGamma_AVX2(const __m256i v,
+                                              const __m256i* const tab) {
+  const int kTabScale = (1 << WEBP_GAMMA_TAB_FIX) << 2;
+  const __m256i tab_pos = _mm256_srli_epi32(v, WEBP_GAMMA_TAB_FIX + 2);
+  const __m256i x = _mm256_and_si256(v, _mm256_set1_epi32(kTabScale - 1));
+  // tab_pos is less than 32: its bit #4 selects the table. The upper bytes of
+  // the index are set to 0x80 to get zeros there.
+  const __m256i idx =
+      _mm256_or_si256(tab_pos, _mm256_set1_epi32((int)0x80808000));
+  const __m256i select = _mm256_slli_epi32(tab_pos, 3);
+  const __m256i v0 =
+      _mm256_blendv_epi8(_mm256_shuffle_epi8(tab[0], idx),
+                         _mm256_shuffle_epi8(tab[1], idx), select);
+  const __m256i v1 =
+      _mm256_blendv_epi8(_mm256_shuffle_epi8(tab[2], idx),
+                         _mm256_shuffle_epi8(tab[3], idx), select);
+  // v0 and v1 are 8b values and x is less than kTabScale: use a 16b madd for
+  // v1 * x + v0 * (kTabScale - x).
+  const __m256i V = _mm256_or_si256(v0, _mm256_slli_epi32(v1, 16));
+  const __m256i X = _mm256_blend_epi16(
+      _mm256_sub_epi32(_mm256_set1_epi32(kTabScale), x),
+      _mm256_slli_epi32(x, 16), 0xaa);
+  const __m256i y = _mm256_madd_epi16(V, X);
+  const __m256i kRounder = _mm256_set1_epi32(1 << WEBP_GAMMA_TAB_FIX >> 1);
+  return _mm256_srli_epi32(_mm256_add_epi32(y, kRounder), WEBP_GAMMA_TAB_FIX);
+}
+
+static void AccumulateRGB_AVX2(const uint8_t* const r_ptr,
+                               const uint8_t* const g_ptr,
+                               const uint8_t* const b_ptr, int step,
+                               int rgb_stride, uint16_t* dst, int width) {
+  // Only packed rgb/bgr(x) samples are handled: find the first channel.
+  const int swap_rb = (b_ptr < r_ptr);
+  const uint8_t* const src = swap_rb ? b_ptr : r_ptr;
+  int i = 0;
+  if ((step == 3 || step == 4) && g_ptr == src + 1 &&
+      (swap_rb ? r_ptr : b_ptr) == src + 2) {
+    __m256i tab[4];
+    {
+      uint8_t tab8[WEBP_GAMMA_TAB_SIZE + 1];
+      int k;
+      for (k = 0; k <= WEBP_GAMMA_TAB_SIZE; ++k) {
+        assert(WebPLinearToGammaTab[k] >= 0 && WebPLinearToGammaTab[k] < 256);
+        tab8[k] = (uint8_t)WebPLinearToGammaTab[k];
+      }
+      for (k = 0; k < 4; ++k) {
+        const uint8_t* const start = tab8 + (k & 1) * 16 + (k >> 1);
+        tab[k] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i*)start));
+      }
+    }
+    // Only read the bytes the C version reads: up to the last third channel.
+    for (; (i + 32) * step <= (width - 1) * step + 3; i += 32, dst += 4 * 16) {
+      __m256i row0[3], row1[3], sum[3][2];
+      int k;
+      if (step == 3) {
+        RGB24PackedToPlanar_AVX2(src + i * 3, row0);
+        RGB24PackedToPlanar_AVX2(src + i * 3 + rgb_stride, row1);
+      } else {
+        RGB32PackedToPlanar_AVX2(src + i * 4, /*swap_rb=*/0, row0);
+        RGB32PackedToPlanar_AVX2(src + i * 4 + rgb_stride, /*swap_rb=*/0,
+                                 row1);
+      }
+      for (k = 0; k < 3; ++k) {
+        SumToLinear_AVX2(&row0[k], &row1[k], sum[k]);
+        sum[k][0] = LinearToGamma_AVX2(sum[k][0], tab);
+        sum[k][1] = LinearToGamma_AVX2(sum[k][1], tab);
+      }
+      for (k = 0; k < 2; ++k) {
+        const __m256i r = sum[swap_rb ? 2 : 0][k];
+        const __m256i b = sum[swap_rb ? 0 : 2][k];
+        const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(sum[1][k], 16));
+        // r | g | b | 0 for the blocks 0..3 and 4..7.
+        const __m256i rgb0 = _mm256_unpacklo_epi32(rg, b);
+        const __m256i rgb1 = _mm256_unpackhi_epi32(rg, b);
+        _mm256_storeu_si256((__m256i*)(dst + 32 * k + 0), rgb0);
+        _mm256_storeu_si256((__m256i*)(dst + 32 * k + 16), rgb1);
+      }
+    }
+  }
+  if (i < width) {  // left-over
+    WebPAccumulateRGB_C(r_ptr + i * step, g_ptr + i * step, b_ptr + i * step,
+                        step, rgb_stride, dst, width - i);
+  }
+}
+
+#undef SHUFF_CST
+
+//------------------------------------------------------------------------------
+
+extern void WebPInitConvertARGBToYUVAVX2(void);
+
+WEBP_TSAN_IGNORE_FUNCTION void WebPInitConvertARGBToYUVAVX2(void) {
+  WebPConvertARGBToY = ConvertARGBToY_AVX2;
+  WebPConvertARGBToUV = ConvertARGBToUV_AVX2;
+
+  WebPConvertRGBToY = ConvertRGBToY_AVX2;
+  WebPConvertBGRToY = ConvertBGRToY_AVX2;
+
+  WebPConvertRGBA32ToUV = ConvertRGBA32ToUV_AVX2;
+
+  WebPAccumulateRGB = AccumulateRGB_AVX2;
+}
+
+//------------------------------------------------------------------------------
+
+#else  // !WEBP_USE_AVX2
+
+WEBP_DSP_INIT_STUB(WebPInitSamplersAVX2)
+WEBP_DSP_INIT_STUB(WebPInitConvertARGBToYUVAVX2)
+
+#endif  // WEBP_USE_AVX2
@@ -87,7 +87,7 @@ static int EncodeLossless(const uint8_t* const data, int width, int height,
       (use_quality_100 && effort_level == 6) ? 100 : 8.f * effort_level;
   assert(config.quality >= 0 && config.quality <= 100.f);
 
-  ok = VP8LEncodeStream(&config, &picture, bw);
+  ok = VP8LEncodeStream(&config, &picture, bw, /*enc=*/NULL);
   WebPPictureFree(&picture);
   ok = ok && !bw->error;
   if (!ok) {
@@ -237,36 +237,89 @@ static void InitFilterTrial(FilterTrial* const score) {
   VP8BitWriterInit(&score->bw, 0);
 }
 
+// Filter trials, possibly run in parallel.
+typedef struct {
+  const uint8_t* alpha;
+  int width, height;
+  size_t data_size;
+  int method, reduce_levels, effort_level;
+  int filters[WEBP_FILTER_LAST];  // filter to use for each trial
+  FilterTrial trials[WEBP_FILTER_LAST];
+} FilterTrials;
+
+static int FilterTrialHook(void* data, int index) {
+  FilterTrials* const ft = (FilterTrials*)data;
+  FilterTrial* const trial = &ft->trials[index];
+  uint8_t* const filtered_alpha =
+      (uint8_t*)WebPSafeMalloc(1ULL, ft->data_size);
+  int ok;
+  if (filtered_alpha == NULL) return 0;
+  ok = EncodeAlphaInternal(ft->alpha, ft->width, ft->height, ft->method,
+                           ft->filters[index], ft->reduce_levels,
+                           ft->effort_level, filtered_alpha, trial);
+  WebPSafeFree(filtered_alpha);
+  return ok;
+}
+
+// Tries all the filters of 'try_map' with up to 'num_threads' threads, and
+// keeps the smallest result in 'best'. Ties go to the lowest filter, so that
+// the output doesn't depend on the number of threads.
+static int TryFilters(const uint8_t* alpha, int width, int height,
+                      size_t data_size, int method, uint32_t try_map,
+                      int reduce_levels, int effort_level, int num_threads,
+                      FilterTrial* const best) {
+  FilterTrials ft;
+  int num_trials = 0;
+  int filter, n;
+  int ok;
+
+  ft.alpha = alpha;
+  ft.width = width;
+  ft.height = height;
+  ft.data_size = data_size;
+  ft.method = method;
+  ft.reduce_levels = reduce_levels;
+  ft.effort_level = effort_level;
+  for (filter = WEBP_FILTER_NONE; try_map; ++filter, try_map >>= 1) {
+    if (try_map & 1) {
+      ft.filters[num_trials] = filter;
+      // Always initialized, as the trial may be skipped in case of error.
+      InitFilterTrial(&ft.trials[num_trials]);
+      ++num_trials;
+    }
+  }
+  ok = WebPParallelFor(num_trials, num_threads, FilterTrialHook, &ft);
+  for (n = 0; n < num_trials; ++n) {
+    FilterTrial* const trial = &ft.trials[n];
+    if (ok && trial->score < best->score) {
+      VP8BitWriterWipeOut(&best->bw);
+      *best = *trial;
+    } else {
+      VP8BitWriterWipeOut(&trial->bw);
+    }
+  }
+  return ok;
+}
+
 static int ApplyFiltersAndEncode(const uint8_t* alpha, int width, int height,
                                  size_t data_size, int method, int filter,
                                  int reduce_levels, int effort_level,
-                                 uint8_t** const output,
+                                 int num_threads, uint8_t** const output,
                                  size_t* const output_size,
                                  WebPAuxStats* const stats) {
   int ok = 1;
+  int num_jobs = 1;
   FilterTrial best;
   uint32_t try_map = GetFilterMap(alpha, width, height, filter, effort_level);
   InitFilterTrial(&best);
 
   if (try_map != FILTER_TRY_NONE) {
-    uint8_t* filtered_alpha = (uint8_t*)WebPSafeMalloc(1ULL, data_size);
-    if (filtered_alpha == NULL) return 0;
-
-    for (filter = WEBP_FILTER_NONE; ok && try_map; ++filter, try_map >>= 1) {
-      if (try_map & 1) {
-        FilterTrial trial;
-        ok = EncodeAlphaInternal(alpha, width, height, method, filter,
-                                 reduce_levels, effort_level, filtered_alpha,
-                                 &trial);
-        if (ok && trial.score < best.score) {
-          VP8BitWriterWipeOut(&best.bw);
-          best = trial;
-        } else {
-          VP8BitWriterWipeOut(&trial.bw);
-        }
-      }
-    }
-    WebPSafeFree(filtered_alpha);
+    int num_filters = 0;
+    uint32_t map;
+    for (map = try_map; map != 0; map >>= 1) num_filters += (map & 1);
+    num_jobs = (num_threads < num_filters) ? num_threads : num_filters;
+    ok = TryFilters(alpha, width, height, data_size, method, try_map,
+                    reduce_levels, effort_level, num_jobs, &best);
   } else {
     ok = EncodeAlphaInternal(alpha, width, height, method, WEBP_FILTER_NONE,
                              reduce_levels, effort_level, NULL, &best);
@@ -283,6 +336,7 @@ static int ApplyFiltersAndEncode(const uint8_t* alpha, int width, int height,
       stats->lossless_size = best.stats.lossless_size;
       stats->lossless_hdr_size = best.stats.lossless_hdr_size;
       stats->lossless_data_size = best.stats.lossless_data_size;
+      stats->threads_used = num_jobs;
     }
 #else
     (void)stats;
@@ -349,8 +403,9 @@ static int EncodeAlpha(VP8Encoder* const enc, int quality, int method,
   if (ok) {
     VP8FiltersInit();
     ok = ApplyFiltersAndEncode(quant_alpha, width, height, data_size, method,
-                               filter, reduce_levels, effort_level, output,
-                               output_size, pic->stats);
+                               filter, reduce_levels, effort_level,
+                               enc->num_threads, output, output_size,
+                               pic->stats);
     if (!ok) {
       WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);  // imprecise
     }
@@ -375,17 +375,16 @@ static void ResetAllMBInfo(VP8Encoder* const enc) {
 
 // struct used to collect job result
 typedef struct {
-  WebPWorker worker;
   int alphas[MAX_ALPHA + 1];
   int alpha, uv_alpha;
   VP8EncIterator it;
   int delta_progress;
 } SegmentJob;
 
-// main work call
-static int DoSegmentsJob(void* arg1, void* arg2) {
-  SegmentJob* const job = (SegmentJob*)arg1;
-  VP8EncIterator* const it = (VP8EncIterator*)arg2;
+// main work call, for the job #'index' of the 'data' array
+static int DoSegmentsJob(void* data, int index) {
+  SegmentJob* const job = (SegmentJob*)data + index;
+  VP8EncIterator* const it = &job->it;
   int ok = 1;
   if (!VP8IteratorIsDone(it)) {
     uint8_t tmp[32 + WEBP_ALIGN_CST];
@@ -400,30 +399,25 @@ static int DoSegmentsJob(void* arg1, void* arg2) {
   return ok;
 }
 
-#ifdef WEBP_USE_THREAD
 static void MergeJobs(const SegmentJob* const src, SegmentJob* const dst) {
   int i;
   for (i = 0; i <= MAX_ALPHA; ++i) dst->alphas[i] += src->alphas[i];
   dst->alpha += src->alpha;
   dst->uv_alpha += src->uv_alpha;
 }
-#endif
 
 // initialize the job struct with some tasks to perform
 static void InitSegmentJob(VP8Encoder* const enc, SegmentJob* const job,
                            int start_row, int end_row) {
-  WebPGetWorkerInterface()->Init(&job->worker);
-  job->worker.data1 = job;
-  job->worker.data2 = &job->it;
-  job->worker.hook = DoSegmentsJob;
   VP8IteratorInit(enc, &job->it);
   VP8IteratorSetRow(&job->it, start_row);
   VP8IteratorSetCountDown(&job->it, (end_row - start_row) * enc->mb_w);
   memset(job->alphas, 0, sizeof(job->alphas));
   job->alpha = 0;
   job->uv_alpha = 0;
-  // only one of both jobs can record the progress, since we don't
-  // expect the user's hook to be multi-thread safe
+  // only the first job can record the progress, since we don't expect the
+  // user's hook to be multi-thread safe (WebPParallelFor() runs this job on
+  // the calling thread).
   job->delta_progress = (start_row == 0) ? 20 : 0;
 }
 
@@ -437,49 +431,34 @@ int VP8EncAnalyze(VP8Encoder* const enc) {
   if (do_segments) {
     const int last_row = enc->mb_h;
     const int total_mb = last_row * enc->mb_w;
-#ifdef WEBP_USE_THREAD
-    // We give a little more than a half work to the main thread.
-    const int split_row = (9 * last_row + 15) >> 4;
-    const int kMinSplitRow = 2;  // minimal rows needed for mt to be worth it
-    const int do_mt = (enc->thread_level > 0) && (split_row >= kMinSplitRow);
-#else
-    const int do_mt = 0;
-#endif
-    const WebPWorkerInterface* const worker_interface =
-        WebPGetWorkerInterface();
+    const int kMinRowsPerJob = 2;  // minimal rows needed for mt to be worth it
+    const int max_jobs = last_row / kMinRowsPerJob;
+    const int num_jobs = (enc->num_threads < max_jobs) ? enc->num_threads
+                         : (max_jobs > 1)               ? max_jobs
+                                                        : 1;
     SegmentJob main_job;
-    if (do_mt) {
-#ifdef WEBP_USE_THREAD
-      SegmentJob side_job;
-      // Note the use of '&' instead of '&&' because we must call the functions
-      // no matter what.
-      InitSegmentJob(enc, &main_job, 0, split_row);
-      InitSegmentJob(enc, &side_job, split_row, last_row);
-      // we don't need to call Reset() on main_job.worker, since we're calling
-      // WebPWorkerExecute() on it
-      ok &= worker_interface->Reset(&side_job.worker);
-      // launch the two jobs in parallel
-      if (ok) {
-        worker_interface->Launch(&side_job.worker);
-        worker_interface->Execute(&main_job.worker);
-        ok &= worker_interface->Sync(&side_job.worker);
-        ok &= worker_interface->Sync(&main_job.worker);
+    SegmentJob* jobs = &main_job;
+    int n;
+    if (num_jobs > 1) {
+      jobs = (SegmentJob*)WebPSafeMalloc(num_jobs, sizeof(*jobs));
+      ok = (jobs != NULL);
+    }
+    if (ok) {
+      // The rows are split evenly between the jobs, which run in parallel.
+      for (n = 0; n < num_jobs; ++n) {
+        InitSegmentJob(enc, &jobs[n], n * last_row / num_jobs,
+                       (n + 1) * last_row / num_jobs);
       }
-      worker_interface->End(&side_job.worker);
-      if (ok) MergeJobs(&side_job, &main_job);  // merge results together
-#endif                                          // WEBP_USE_THREAD
-    } else {
-      // Even for single-thread case, we use the generic Worker tools.
-      InitSegmentJob(enc, &main_job, 0, last_row);
-      worker_interface->Execute(&main_job.worker);
-      ok &= worker_interface->Sync(&main_job.worker);
+      ok = WebPParallelFor(num_jobs, num_jobs, DoSegmentsJob, jobs);
+      for (n = 1; n < num_jobs; ++n) MergeJobs(&jobs[n], &jobs[0]);
+      if (num_jobs > enc->threads_used) enc->threads_used = num_jobs;
     }
-    worker_interface->End(&main_job.worker);
     if (ok) {
-      enc->alpha = main_job.alpha / total_mb;
-      enc->uv_alpha = main_job.uv_alpha / total_mb;
-      AssignSegments(enc, main_job.alphas);
+      enc->alpha = jobs[0].alpha / total_mb;
+      enc->uv_alpha = jobs[0].uv_alpha / total_mb;
+      AssignSegments(enc, jobs[0].alphas);
     }
+    if (jobs != &main_job) WebPSafeFree(jobs);
   } else {  // Use only one default segment.
     ResetAllMBInfo(enc);
   }
@@ -117,24 +117,10 @@ static WEBP_INLINE int64_t GetDistanceCost(const CostModel* const m,
          ((int64_t)extra_bits << LOG_2_PRECISION_BITS);
 }
 
-static WEBP_INLINE void AddSingleLiteralWithCostModel(
-    const uint32_t* const argb, VP8LColorCache* const hashers,
-    const CostModel* const cost_model, int idx, int use_color_cache,
-    int64_t prev_cost, int64_t* const cost, uint16_t* const dist_array) {
-  int64_t cost_val = prev_cost;
-  const uint32_t color = argb[idx];
-  const int ix = use_color_cache ? VP8LColorCacheContains(hashers, color) : -1;
-  if (ix >= 0) {
-    // use_color_cache is true and hashers contains color
-    cost_val += DivRound(GetCacheCost(cost_model, ix) * 68, 100);
-  } else {
-    if (use_color_cache) VP8LColorCacheInsert(hashers, color);
-    cost_val += DivRound(GetLiteralCost(cost_model, color) * 82, 100);
-  }
-  if (cost[idx] > cost_val) {
-    cost[idx] = cost_val;
-    dist_array[idx] = 1;  // only one is inserted.
-  }
+// Same as DivRound(cost * percent, 100) for a non-negative 'cost', but cheaper.
+static WEBP_INLINE int64_t GetPercentOfCost(int64_t cost, uint32_t percent) {
+  assert(cost >= 0);
+  return (int64_t)(((uint64_t)cost * percent + 50) / 100);
 }
 
 // -----------------------------------------------------------------------------
@@ -143,6 +129,12 @@ static WEBP_INLINE void AddSingleLiteralWithCostModel(
 // Empirical value to avoid high memory consumption but good for performance.
 #define COST_CACHE_INTERVAL_SIZE_MAX 500
 
+// The costs are only needed from the current pixel to the last pixel reached by
+// the copies pushed so far, which is less than 2 * MAX_LENGTH pixels ahead (see
+// BackwardReferencesHashChainDistanceOnly). They are kept in a circular buffer
+// of COST_WINDOW_SIZE values, a power of 2 with some margin.
+#define COST_WINDOW_SIZE (1 << (MAX_LENGTH_BITS + 2))
+
 // To perform backward reference every pixel at index 'index' is considered and
 // the cost for the MAX_LENGTH following pixels computed. Those following pixels
 // at index 'index' + k (k from 0 to MAX_LENGTH) have a cost of:
@@ -154,18 +146,15 @@ static WEBP_INLINE void AddSingleLiteralWithCostModel(
 // An interval is defined by the 'index' of the pixel that generated it and
 // is only useful in a range of indices from 'start' to 'end' (exclusive), i.e.
 // it contains the minimum value for pixels between start and end.
-// Intervals are stored in a linked list and ordered by 'start'. When a new
-// interval has a better value, old intervals are split or removed. There are
-// therefore no overlapping intervals.
-typedef struct CostInterval CostInterval;
-struct CostInterval {
+// Intervals are stored in an array and ordered by 'start'. When a new interval
+// has a better value, old intervals are split or removed. There are therefore
+// no overlapping intervals.
+typedef struct {
   int64_t cost;
   int start;
   int end;
   int index;
-  CostInterval* previous;
-  CostInterval* next;
-};
+} CostInterval;
 
 // The GetLengthCost(cost_model, k) are cached in a CostCacheInterval.
 typedef struct {
@@ -178,86 +167,38 @@ typedef struct {
 // It caches the different CostCacheInterval, caches the different
 // GetLengthCost(cost_model, k) in cost_cache and the CostInterval's (whose
 // 'count' is limited by COST_CACHE_INTERVAL_SIZE_MAX).
-#define COST_MANAGER_MAX_FREE_LIST 10
 typedef struct {
-  CostInterval* head;
+  CostInterval intervals[COST_CACHE_INTERVAL_SIZE_MAX];
   int count;  // The number of stored intervals.
   CostCacheInterval* cache_intervals;
   size_t cache_intervals_size;
   // Contains the GetLengthCost(cost_model, k).
   int64_t cost_cache[MAX_LENGTH];
-  int64_t* costs;
+  // Contains the GetCacheCost(cost_model, k) weighted for literals.
+  uint32_t cache_costs[1 << MAX_COLOR_CACHE_BITS];
+  // The cost of pixel 'i' is costs[i & (COST_WINDOW_SIZE - 1)].
+  int64_t costs[COST_WINDOW_SIZE];
   uint16_t* dist_array;
-  // Most of the time, we only need few intervals -> use a free-list, to avoid
-  // fragmentation with small allocs in most common cases.
-  CostInterval intervals[COST_MANAGER_MAX_FREE_LIST];
-  CostInterval* free_intervals;
-  // These are regularly malloc'd remains. This list can't grow larger than than
-  // size COST_CACHE_INTERVAL_SIZE_MAX - COST_MANAGER_MAX_FREE_LIST, note.
-  CostInterval* recycled_intervals;
 } CostManager;
 
-static void CostIntervalAddToFreeList(CostManager* const manager,
-                                      CostInterval* const interval) {
-  interval->next = manager->free_intervals;
-  manager->free_intervals = interval;
-}
-
-static int CostIntervalIsInFreeList(const CostManager* const manager,
-                                    const CostInterval* const interval) {
-  return (interval >= &manager->intervals[0] &&
-          interval <= &manager->intervals[COST_MANAGER_MAX_FREE_LIST - 1]);
-}
-
-static void CostManagerInitFreeList(CostManager* const manager) {
-  int i;
-  manager->free_intervals = NULL;
-  for (i = 0; i < COST_MANAGER_MAX_FREE_LIST; ++i) {
-    CostIntervalAddToFreeList(manager, &manager->intervals[i]);
-  }
-}
-
-static void DeleteIntervalList(CostManager* const manager,
-                               const CostInterval* interval) {
-  while (interval != NULL) {
-    const CostInterval* const next = interval->next;
-    if (!CostIntervalIsInFreeList(manager, interval)) {
-      WebPSafeFree((void*)interval);
-    }  // else: do nothing
-    interval = next;
-  }
-}
-
 static void CostManagerClear(CostManager* const manager) {
   if (manager == NULL) return;
 
-  WebPSafeFree(manager->costs);
   WebPSafeFree(manager->cache_intervals);
-
-  // Clear the interval lists.
-  DeleteIntervalList(manager, manager->head);
-  manager->head = NULL;
-  DeleteIntervalList(manager, manager->recycled_intervals);
-  manager->recycled_intervals = NULL;
-
-  // Reset pointers, 'count' and 'cache_intervals_size'.
-  memset(manager, 0, sizeof(*manager));
-  CostManagerInitFreeList(manager);
+  manager->cache_intervals = NULL;
+  manager->cache_intervals_size = 0;
+  manager->count = 0;
 }
 
 static int CostManagerInit(CostManager* const manager,
                            uint16_t* const dist_array, int pix_count,
-                           const CostModel* const cost_model) {
+                           int cache_bits, const CostModel* const cost_model) {
   int i;
   const int cost_cache_size = (pix_count > MAX_LENGTH) ? MAX_LENGTH : pix_count;
 
-  manager->costs = NULL;
   manager->cache_intervals = NULL;
-  manager->head = NULL;
-  manager->recycled_intervals = NULL;
   manager->count = 0;
   manager->dist_array = dist_array;
-  CostManagerInitFreeList(manager);
 
   // Fill in the 'cost_cache'.
   // Has to be done in two passes due to a GCC bug on i686
@@ -308,27 +249,58 @@ static int CostManagerInit(CostManager* const manager,
            manager->cache_intervals_size);
   }
 
-  manager->costs = (int64_t*)WebPSafeMalloc(pix_count, sizeof(*manager->costs));
-  if (manager->costs == NULL) {
-    CostManagerClear(manager);
-    return 0;
-  }
   // Set the initial 'costs' to INT64_MAX for every pixel as we will keep the
   // minimum.
-  for (i = 0; i < pix_count; ++i) manager->costs[i] = WEBP_INT64_MAX;
+  for (i = 0; i < COST_WINDOW_SIZE; ++i) manager->costs[i] = WEBP_INT64_MAX;
+
+  if (cache_bits > 0) {
+    for (i = 0; i < (1 << cache_bits); ++i) {
+      manager->cache_costs[i] =
+          (uint32_t)GetPercentOfCost(GetCacheCost(cost_model, i), 68);
+    }
+  }
 
   return 1;
 }
 
+// Returns the cost of pixel 'i', which must be in the current window.
+static WEBP_INLINE int64_t* GetCost(CostManager* const manager, int i) {
+  return &manager->costs[i & (COST_WINDOW_SIZE - 1)];
+}
+
+// Updates the cost of the pixel at 'idx' if it is cheaper as a literal after a
+// pixel costing 'prev_cost'.
+static WEBP_INLINE void AddSingleLiteralWithCostModel(
+    CostManager* const manager, const uint32_t* const argb,
+    VP8LColorCache* const hashers, const CostModel* const cost_model, int idx,
+    int use_color_cache, int64_t prev_cost) {
+  int64_t cost_val = prev_cost;
+  int64_t* const cost = GetCost(manager, idx);
+  const uint32_t color = argb[idx];
+  const int ix = use_color_cache ? VP8LColorCacheContains(hashers, color) : -1;
+  if (ix >= 0) {
+    // use_color_cache is true and hashers contains color
+    cost_val += manager->cache_costs[ix];
+  } else {
+    if (use_color_cache) VP8LColorCacheInsert(hashers, color);
+    cost_val += GetPercentOfCost(GetLiteralCost(cost_model, color), 82);
+  }
+  if (*cost > cost_val) {
+    *cost = cost_val;
+    manager->dist_array[idx] = 1;  // only one is inserted.
+  }
+}
+
 // Given the cost and the position that define an interval, update the cost at
 // pixel 'i' if it is smaller than the previously computed value.
 static WEBP_INLINE void UpdateCost(CostManager* const manager, int i,
                                    int position, int64_t cost) {
   const int k = i - position;
+  int64_t* const cost_i = GetCost(manager, i);
   assert(k >= 0 && k < MAX_LENGTH);
 
-  if (manager->costs[i] > cost) {
-    manager->costs[i] = cost;
+  if (*cost_i > cost) {
+    *cost_i = cost;
     manager->dist_array[i] = k + 1;
   }
 }
@@ -342,33 +314,12 @@ static WEBP_INLINE void UpdateCostPerInterval(CostManager* const manager,
   for (i = start; i < end; ++i) UpdateCost(manager, i, position, cost);
 }
 
-// Given two intervals, make 'prev' be the previous one of 'next' in 'manager'.
-static WEBP_INLINE void ConnectIntervals(CostManager* const manager,
-                                         CostInterval* const prev,
-                                         CostInterval* const next) {
-  if (prev != NULL) {
-    prev->next = next;
-  } else {
-    manager->head = next;
-  }
-
-  if (next != NULL) next->previous = prev;
-}
-
-// Pop an interval in the manager.
-static WEBP_INLINE void PopInterval(CostManager* const manager,
-                                    CostInterval* const interval) {
-  if (interval == NULL) return;
-
-  ConnectIntervals(manager, interval->previous, interval->next);
-  if (CostIntervalIsInFreeList(manager, interval)) {
-    CostIntervalAddToFreeList(manager, interval);
-  } else {  // recycle regularly malloc'd intervals too
-    interval->next = manager->recycled_intervals;
-    manager->recycled_intervals = interval;
-  }
+// Remove the interval at index 'k' in the manager.
+static WEBP_INLINE void PopInterval(CostManager* const manager, int k) {
+  assert(k >= 0 && k < manager->count);
   --manager->count;
-  assert(manager->count >= 0);
+  memmove(&manager->intervals[k], &manager->intervals[k + 1],
+          (manager->count - k) * sizeof(manager->intervals[0]));
 }
 
 // Update the cost at index i by going over all the stored intervals that
@@ -377,83 +328,51 @@ static WEBP_INLINE void PopInterval(CostManager* const manager,
 // end before 'i' will be popped.
 static WEBP_INLINE void UpdateCostAtIndex(CostManager* const manager, int i,
                                           int do_clean_intervals) {
-  CostInterval* current = manager->head;
-
-  while (current != NULL && current->start <= i) {
-    CostInterval* const next = current->next;
-    if (current->end <= i) {
-      if (do_clean_intervals) {
-        // We have an outdated interval, remove it.
-        PopInterval(manager, current);
-      }
+  CostInterval* const intervals = manager->intervals;
+  int k, num_kept = 0;
+
+  for (k = 0; k < manager->count && intervals[k].start <= i; ++k) {
+    if (intervals[k].end <= i) {
+      // We have an outdated interval, remove it.
+      if (do_clean_intervals) continue;
     } else {
-      UpdateCost(manager, i, current->index, current->cost);
+      UpdateCost(manager, i, intervals[k].index, intervals[k].cost);
     }
-    current = next;
-  }
-}
-
-// Given a current orphan interval and its previous interval, before
-// it was orphaned (which can be NULL), set it at the right place in the list
-// of intervals using the 'start' ordering and the previous interval as a hint.
-static WEBP_INLINE void PositionOrphanInterval(CostManager* const manager,
-                                               CostInterval* const current,
-                                               CostInterval* previous) {
-  assert(current != NULL);
-
-  if (previous == NULL) previous = manager->head;
-  while (previous != NULL && current->start < previous->start) {
-    previous = previous->previous;
+    if (num_kept != k) intervals[num_kept] = intervals[k];
+    ++num_kept;
   }
-  while (previous != NULL && previous->next != NULL &&
-         previous->next->start < current->start) {
-    previous = previous->next;
+  if (num_kept != k) {
+    memmove(&intervals[num_kept], &intervals[k],
+            (manager->count - k) * sizeof(intervals[0]));
+    manager->count -= k - num_kept;
   }
-
-  if (previous != NULL) {
-    ConnectIntervals(manager, current, previous->next);
-  } else {
-    ConnectIntervals(manager, current, manager->head);
-  }
-  ConnectIntervals(manager, previous, current);
 }
 
-// Insert an interval in the list contained in the manager by starting at
-// 'interval_in' as a hint. The intervals are sorted by 'start' value.
-static WEBP_INLINE void InsertInterval(CostManager* const manager,
-                                       CostInterval* const interval_in,
-                                       int64_t cost, int position, int start,
-                                       int end) {
-  CostInterval* interval_new;
+// Insert an interval in the array contained in the manager by starting at
+// index 'hint'. The intervals are sorted by 'start' value.
+// Returns the index of the inserted interval, or -1 if it was not stored.
+static WEBP_INLINE int InsertInterval(CostManager* const manager, int hint,
+                                      int64_t cost, int position, int start,
+                                      int end) {
+  CostInterval* const intervals = manager->intervals;
+  int k = hint;
 
-  if (start >= end) return;
+  if (start >= end) return -1;
   if (manager->count >= COST_CACHE_INTERVAL_SIZE_MAX) {
     // Serialize the interval if we cannot store it.
     UpdateCostPerInterval(manager, start, end, position, cost);
-    return;
+    return -1;
   }
-  if (manager->free_intervals != NULL) {
-    interval_new = manager->free_intervals;
-    manager->free_intervals = interval_new->next;
-  } else if (manager->recycled_intervals != NULL) {
-    interval_new = manager->recycled_intervals;
-    manager->recycled_intervals = interval_new->next;
-  } else {  // malloc for good
-    interval_new = (CostInterval*)WebPSafeMalloc(1, sizeof(*interval_new));
-    if (interval_new == NULL) {
-      // Write down the interval if we cannot create it.
-      UpdateCostPerInterval(manager, start, end, position, cost);
-      return;
-    }
-  }
-
-  interval_new->cost = cost;
-  interval_new->index = position;
-  interval_new->start = start;
-  interval_new->end = end;
-  PositionOrphanInterval(manager, interval_new, interval_in);
-
+  while (k > 0 && start < intervals[k - 1].start) --k;
+  while (k < manager->count && intervals[k].start < start) ++k;
+  memmove(&intervals[k + 1], &intervals[k],
+          (manager->count - k) * sizeof(intervals[0]));
+  intervals[k].cost = cost;
+  intervals[k].index = position;
+  intervals[k].start = start;
+  intervals[k].end = end;
   ++manager->count;
+  return k;
 }
 
 // Given a new cost interval defined by its start at position, its length value
@@ -464,8 +383,11 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
                                      int64_t distance_cost, int position,
                                      int len) {
   size_t i;
-  CostInterval* interval = manager->head;
-  CostInterval* interval_next;
+  // Index of the current interval, which is moved along when intervals are
+  // inserted before it.
+  int cur = 0;
+  int inserted;
+  CostInterval* const intervals = manager->intervals;
   const CostCacheInterval* const cost_cache_intervals =
       manager->cache_intervals;
   // If the interval is small enough, no need to deal with the heavy
@@ -476,12 +398,13 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
     int j;
     for (j = position; j < position + len; ++j) {
       const int k = j - position;
+      int64_t* const cost_j = GetCost(manager, j);
       int64_t cost_tmp;
       assert(k >= 0 && k < MAX_LENGTH);
       cost_tmp = distance_cost + manager->cost_cache[k];
 
-      if (manager->costs[j] > cost_tmp) {
-        manager->costs[j] = cost_tmp;
+      if (*cost_j > cost_tmp) {
+        *cost_j = cost_tmp;
         manager->dist_array[j] = k + 1;
       }
     }
@@ -498,9 +421,8 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
         (cost_cache_intervals[i].end > len ? len : cost_cache_intervals[i].end);
     const int64_t cost = distance_cost + cost_cache_intervals[i].cost;
 
-    for (; interval != NULL && interval->start < end;
-         interval = interval_next) {
-      interval_next = interval->next;
+    for (; cur < manager->count && intervals[cur].start < end; ++cur) {
+      CostInterval* const interval = &intervals[cur];
 
       // Make sure we have some overlap
       if (start >= interval->end) continue;
@@ -514,8 +436,9 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
         // If we are worse than what we already have, add whatever we have so
         // far up to interval.
         const int start_new = interval->end;
-        InsertInterval(manager, interval, cost, position, start,
-                       interval->start);
+        inserted = InsertInterval(manager, cur, cost, position, start,
+                                  interval->start);
+        if (inserted >= 0 && inserted <= cur) ++cur;
         start = start_new;
         if (start >= end) break;
         continue;
@@ -528,7 +451,8 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
           // [**************************************************************[
           // start                                                        end
           // We can safely remove the old interval as it is fully included.
-          PopInterval(manager, interval);
+          PopInterval(manager, cur);
+          --cur;
         } else {
           //              [------------------------------------[
           //              interval->start          interval->end
@@ -546,9 +470,11 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
           // We have to split the old interval as it fully contains the new one.
           const int end_original = interval->end;
           interval->end = start;
-          InsertInterval(manager, interval, interval->cost, interval->index,
-                         end, end_original);
-          interval = interval->next;
+          // The current interval is then the second part of the old one if it
+          // was stored, the next one otherwise: both are right after.
+          InsertInterval(manager, cur, interval->cost, interval->index, end,
+                         end_original);
+          ++cur;
           break;
         } else {
           // [------------------------------------[
@@ -560,7 +486,8 @@ static WEBP_INLINE void PushInterval(CostManager* const manager,
       }
     }
     // Insert the remaining interval from start to end.
-    InsertInterval(manager, interval, cost, position, start, end);
+    inserted = InsertInterval(manager, cur, cost, position, start, end);
+    if (inserted >= 0 && inserted <= cur) ++cur;
   }
 }
 
@@ -598,7 +525,8 @@ static int BackwardReferencesHashChainDistanceOnly(
     goto Error;
   }
 
-  if (!CostManagerInit(cost_manager, dist_array, pix_count, cost_model)) {
+  if (!CostManagerInit(cost_manager, dist_array, pix_count, cache_bits,
+                       cost_model)) {
     goto Error;
   }
 
@@ -606,19 +534,17 @@ static int BackwardReferencesHashChainDistanceOnly(
   // non-processed locations from this point.
   dist_array[0] = 0;
   // Add first pixel as literal.
-  AddSingleLiteralWithCostModel(argb, &hashers, cost_model, /*idx=*/0,
-                                use_color_cache, /*prev_cost=*/0,
-                                cost_manager->costs, dist_array);
+  AddSingleLiteralWithCostModel(cost_manager, argb, &hashers, cost_model,
+                                /*idx=*/0, use_color_cache, /*prev_cost=*/0);
 
   for (i = 1; i < pix_count; ++i) {
-    const int64_t prev_cost = cost_manager->costs[i - 1];
+    const int64_t prev_cost = *GetCost(cost_manager, i - 1);
     int offset, len;
     VP8LHashChainFindCopy(hash_chain, i, &offset, &len);
 
     // Try adding the pixel as a literal.
-    AddSingleLiteralWithCostModel(argb, &hashers, cost_model, i,
-                                  use_color_cache, prev_cost,
-                                  cost_manager->costs, dist_array);
+    AddSingleLiteralWithCostModel(cost_manager, argb, &hashers, cost_model, i,
+                                  use_color_cache, prev_cost);
 
     // If we are dealing with a non-literal.
     if (len >= 2) {
@@ -666,14 +592,19 @@ static int BackwardReferencesHashChainDistanceOnly(
           UpdateCostAtIndex(cost_manager, j - 1, 0);
           UpdateCostAtIndex(cost_manager, j, 0);
 
-          PushInterval(cost_manager, cost_manager->costs[j - 1] + offset_cost,
-                       j, len_j);
+          // As j <= reach + 1 < i + len, the costs stay in the window.
+          assert(j + len_j <= i + 2 * MAX_LENGTH);
+          PushInterval(cost_manager,
+                       *GetCost(cost_manager, j - 1) + offset_cost, j, len_j);
           reach = j + len_j - 1;
         }
       }
     }
 
     UpdateCostAtIndex(cost_manager, i, 1);
+    // The cost of the previous pixel is not needed anymore: its place in the
+    // window is now for a pixel COST_WINDOW_SIZE further.
+    *GetCost(cost_manager, i - 1) = WEBP_INT64_MAX;
     offset_prev = offset;
     len_prev = len;
   }
@@ -21,6 +21,7 @@
 #include "src/enc/histogram_enc.h"
 #include "src/enc/vp8i_enc.h"
 #include "src/utils/color_cache_utils.h"
+#include "src/utils/thread_utils.h"
 #include "src/utils/utils.h"
 #include "src/webp/encode.h"
 #include "src/webp/format_constants.h"
@@ -207,16 +208,28 @@ int VP8LHashChainInit(VP8LHashChain* const p, int size) {
   p->offset_length = (uint32_t*)WebPSafeMalloc(size, sizeof(*p->offset_length));
   if (p->offset_length == NULL) return 0;
   p->size = size;
+  p->owns_memory = 1;
 
   return 1;
 }
 
+void VP8LHashChainInitWithMemory(VP8LHashChain* const p, uint32_t* memory,
+                                 int size) {
+  assert(p->size == 0);
+  assert(p->offset_length == NULL);
+  assert(memory != NULL && size > 0);
+  p->offset_length = memory;
+  p->size = size;
+  p->owns_memory = 0;
+}
+
 void VP8LHashChainClear(VP8LHashChain* const p) {
   assert(p != NULL);
-  WebPSafeFree(p->offset_length);
+  if (p->owns_memory) WebPSafeFree(p->offset_length);
 
   p->size = 0;
   p->offset_length = NULL;
+  p->owns_memory = 0;
 }
 
 // -----------------------------------------------------------------------------
@@ -252,44 +265,46 @@ static WEBP_INLINE int MaxFindCopyLength(int len) {
   return (len < MAX_LENGTH) ? len : MAX_LENGTH;
 }
 
-int VP8LHashChainFill(VP8LHashChain* const p, int quality,
-                      const uint32_t* const argb, int xsize, int ysize,
-                      int low_effort, const WebPPicture* const pic,
-                      int percent_range, int* const percent) {
-  const int size = xsize * ysize;
-  const int iter_max = GetMaxItersForQuality(quality);
-  const uint32_t window_size = GetWindowSizeForHashChain(quality, xsize);
-  int remaining_percent = percent_range;
-  int percent_start = *percent;
-  int pos;
-  int argb_comp;
-  uint32_t base_position;
-  int32_t* hash_to_first_index;
-  // Temporarily use the p->offset_length as a hash chain.
-  int32_t* chain = (int32_t*)p->offset_length;
-  assert(size > 0);
-  assert(p->size != 0);
-  assert(p->offset_length != NULL);
-
-  if (size <= 2) {
-    p->offset_length[0] = p->offset_length[size - 1] = 0;
-    return 1;
-  }
-
-  hash_to_first_index =
-      (int32_t*)WebPSafeMalloc(HASH_SIZE, sizeof(*hash_to_first_index));
-  if (hash_to_first_index == NULL) {
-    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
-  }
-
-  percent_range = remaining_percent / 2;
-  remaining_percent -= percent_range;
-
-  // Set the int32_t array to -1.
-  memset(hash_to_first_index, 0xff, HASH_SIZE * sizeof(*hash_to_first_index));
-  // Fill the chain linking pixels with the same hash.
-  argb_comp = (argb[0] == argb[1]);
-  for (pos = 0; pos < size - 2;) {
+// Maximum number of bands the hash chain is split into for multi-threading.
+#define HASH_CHAIN_MAX_BANDS MAX_ENCODING_THREADS
+// Each band needs its own hash table, so they are kept large enough.
+#define HASH_CHAIN_MIN_BAND_SIZE (4 * HASH_SIZE)
+
+typedef struct {
+  int length;                  // length of the match, 0 if none
+  uint32_t distance;           // distance to the match, 0 if none
+  uint32_t max_base_position;  // last position the length was increased at
+} HashChainMatch;
+
+typedef struct {
+  const uint32_t* argb;
+  int xsize;
+  int size;
+  int iter_max;
+  uint32_t window_size;
+  int low_effort;
+  int32_t* chain;  // links each pixel to the previous one with the same hash
+  uint32_t* offset_length;  // output, may be the same memory as 'chain'
+  // The following is only used when filling by bands.
+  int num_bands;
+  int starts[HASH_CHAIN_MAX_BANDS + 1];  // first pixel of each linked band
+  int32_t* hash_tables;  // one hash table per band
+  HashChainMatch matches[HASH_CHAIN_MAX_BANDS];  // match at each band start
+} HashChainFiller;
+
+// Links each pixel in [start, end) to the previous pixel having the same hash
+// in 'chain'. 'last' holds the last position seen for each hash. Returns the
+// position reached, which may be past 'end' if a stretch of identical pixels
+// straddles it.
+static int LinkPixels(const HashChainFiller* const f, int start, int end,
+                      int32_t* const last) {
+  const uint32_t* const argb = f->argb;
+  const int size = f->size;
+  int32_t* const chain = f->chain;
+  int pos = start;
+  int argb_comp = (argb[pos] == argb[pos + 1]);
+  assert(end <= size - 2);
+  while (pos < end) {
     uint32_t hash_code;
     const int argb_comp_next = (argb[pos + 1] == argb[pos + 2]);
     if (argb_comp && argb_comp_next) {
@@ -319,26 +334,329 @@ int VP8LHashChainFill(VP8LHashChain* const p, int quality,
       while (len) {
         tmp[1] = len--;
         hash_code = GetPixPairHash64(tmp);
-        chain[pos] = hash_to_first_index[hash_code];
-        hash_to_first_index[hash_code] = pos++;
+        chain[pos] = last[hash_code];
+        last[hash_code] = pos++;
       }
+      // The pixel after a stretch can't start a new one: its follower
+      // differs.
       argb_comp = 0;
     } else {
       // Just move one pixel forward.
       hash_code = GetPixPairHash64(argb + pos);
-      chain[pos] = hash_to_first_index[hash_code];
-      hash_to_first_index[hash_code] = pos++;
+      chain[pos] = last[hash_code];
+      last[hash_code] = pos++;
       argb_comp = argb_comp_next;
     }
+  }
+  return pos;
+}
+
+// Finds the longest match for the pixel at 'base_position' among the
+// previous pixels having the same hash.
+static void FindMatch(const HashChainFiller* const f, uint32_t base_position,
+                      HashChainMatch* const m) {
+  const uint32_t* const argb = f->argb;
+  const int xsize = f->xsize;
+  const int max_len = MaxFindCopyLength(f->size - 1 - base_position);
+  const uint32_t* const argb_start = argb + base_position;
+  int iter = f->iter_max;
+  int best_length = 0;
+  uint32_t best_distance = 0;
+  uint32_t best_argb;
+  const int min_pos = (base_position > f->window_size)
+                          ? base_position - f->window_size
+                          : 0;
+  const int length_max = (max_len < 256) ? max_len : 256;
+  int pos = f->chain[base_position];
+
+  if (!f->low_effort) {
+    int curr_length;
+    // Heuristic: use the comparison with the above line as an initialization.
+    if (base_position >= (uint32_t)xsize) {
+      curr_length = FindMatchLength(argb_start - xsize, argb_start,
+                                    best_length, max_len);
+      if (curr_length > best_length) {
+        best_length = curr_length;
+        best_distance = xsize;
+      }
+      --iter;
+    }
+    // Heuristic: compare to the previous pixel.
+    curr_length =
+        FindMatchLength(argb_start - 1, argb_start, best_length, max_len);
+    if (curr_length > best_length) {
+      best_length = curr_length;
+      best_distance = 1;
+    }
+    --iter;
+    // Skip the for loop if we already have the maximum.
+    if (best_length == MAX_LENGTH) pos = min_pos - 1;
+  }
+  best_argb = argb_start[best_length];
+
+  for (; pos >= min_pos && --iter; pos = f->chain[pos]) {
+    int curr_length;
+    assert(base_position > (uint32_t)pos);
+
+    if (argb[pos + best_length] != best_argb) continue;
+
+    curr_length = VP8LVectorMismatch(argb + pos, argb_start, max_len);
+    if (best_length < curr_length) {
+      best_length = curr_length;
+      best_distance = base_position - pos;
+      best_argb = argb_start[best_length];
+      // Stop if we have reached a good enough length.
+      if (best_length >= length_max) break;
+    }
+  }
+  m->length = best_length;
+  m->distance = best_distance;
+  m->max_base_position = base_position;
+}
+
+// Extends to 'base_position' the match 'm' of the pixel on its right, in case
+// the two intervals continue matching to the left. Returns false if a new
+// match has to be searched for instead.
+static WEBP_INLINE int ExtendMatch(const uint32_t* const argb,
+                                   uint32_t base_position,
+                                   HashChainMatch* const m) {
+  // Stop if we don't have a match.
+  if (m->distance == 0) return 0;
+  // Stop if we cannot extend the matching intervals to the left.
+  if (base_position < m->distance ||
+      argb[base_position - m->distance] != argb[base_position]) {
+    return 0;
+  }
+  // Stop if we are matching at its limit because there could be a closer
+  // matching interval with the same maximum length. Then again, if the
+  // matching interval is as close as possible (distance == 1), we will never
+  // find anything better so let's continue.
+  if (m->length == MAX_LENGTH && m->distance != 1 &&
+      base_position + MAX_LENGTH < m->max_base_position) {
+    return 0;
+  }
+  if (m->length < MAX_LENGTH) {
+    ++m->length;
+    m->max_base_position = base_position;
+  }
+  return 1;
+}
+
+static WEBP_INLINE uint32_t PackMatch(const HashChainMatch* const m) {
+  assert(m->length <= MAX_LENGTH);
+  assert(m->distance <= WINDOW_SIZE);
+  return (m->distance << MAX_LENGTH_BITS) | (uint32_t)m->length;
+}
+
+// Finds the best match interval of the pixels in [lo, hi], from right to
+// left. Once a match is found, it is extended to the left as long as the
+// intervals keep matching. 'm' is the match of the pixel at 'hi + 1' (with a
+// distance of 0 if unknown) and receives the one of the pixel at 'lo'.
+static void FindMatches(const HashChainFiller* const f, int lo, int hi,
+                        HashChainMatch* const m) {
+  int base_position;
+  for (base_position = hi; base_position >= lo; --base_position) {
+    if (!ExtendMatch(f->argb, base_position, m)) {
+      FindMatch(f, base_position, m);
+    }
+    f->offset_length[base_position] = PackMatch(m);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Filling by bands.
+//
+// The hash chain is built in parallel over bands of pixels, each with its own
+// hash table. The band starts are moved so that no stretch of identical pixels
+// straddles two bands. The pixels seen first in a band are temporarily linked
+// to -2 - hash, to be linked later to the last pixel with the same hash in the
+// previous bands.
+// The matches are then searched in parallel over bands too, from right to left.
+// Each band starts with a new search at its last pixel, while a single pass
+// could have extended the match of the next band instead. So the end of each
+// band is redone, from the last band to the first one, until both passes
+// agree.
+
+static int LinkBandHook(void* data, int band) {
+  HashChainFiller* const f = (HashChainFiller*)data;
+  int32_t* const last = f->hash_tables + (size_t)band * HASH_SIZE;
+  int pos;
+  if (band == 0) {
+    memset(last, 0xff, HASH_SIZE * sizeof(*last));
+  } else {
+    int i;
+    for (i = 0; i < HASH_SIZE; ++i) last[i] = -2 - i;
+  }
+  pos = LinkPixels(f, f->starts[band], f->starts[band + 1], last);
+  assert(pos == f->starts[band + 1]);
+  (void)pos;
+  return 1;
+}
+
+static int RelinkBandHook(void* data, int band) {
+  HashChainFiller* const f = (HashChainFiller*)data;
+  int pos;
+  if (band > 0) {
+    // Last position of each hash in the previous bands.
+    const int32_t* const last =
+        f->hash_tables + (size_t)(band - 1) * HASH_SIZE;
+    for (pos = f->starts[band]; pos < f->starts[band + 1]; ++pos) {
+      const int32_t prev = f->chain[pos];
+      if (prev < -1) f->chain[pos] = last[-2 - prev];
+    }
+  }
+  return 1;
+}
 
+// Returns the first pixel of the band the matches are searched over, in
+// [1, size - 2]. 'band' can be 'num_bands' to get the end of the last band.
+static WEBP_INLINE int GetMatchBandStart(const HashChainFiller* const f,
+                                         int band) {
+  const int start = (int)((int64_t)band * f->size / f->num_bands);
+  if (band == f->num_bands) return f->size - 1;
+  return (start < 1) ? 1 : start;
+}
+
+static int FindBandMatchesHook(void* data, int band) {
+  HashChainFiller* const f = (HashChainFiller*)data;
+  const int lo = GetMatchBandStart(f, band);
+  const int hi = GetMatchBandStart(f, band + 1) - 1;
+  HashChainMatch* const m = &f->matches[band];
+  m->distance = 0;
+  FindMatches(f, lo, hi, m);
+  return 1;
+}
+
+// Redoes the end of 'band' in the same way as a single right-to-left pass
+// would, 'm' being the match of the pixel right after the band in such a
+// pass. 'm' receives the match of the first pixel of the band.
+static void FixBandMatches(const HashChainFiller* const f, int band,
+                           HashChainMatch* const m) {
+  const int lo = GetMatchBandStart(f, band);
+  const int hi = GetMatchBandStart(f, band + 1) - 1;
+  HashChainMatch band_match;  // replays the pass done over the band alone
+  int base_position;
+  band_match.distance = 0;
+  for (base_position = hi; base_position >= lo; --base_position) {
+    const uint32_t offset_length = f->offset_length[base_position];
+    int band_searched = 0;
+    if (!ExtendMatch(f->argb, base_position, &band_match)) {
+      band_match.length = (int)(offset_length & MAX_LENGTH);
+      band_match.distance = offset_length >> MAX_LENGTH_BITS;
+      band_match.max_base_position = base_position;
+      band_searched = 1;
+    }
+    if (!ExtendMatch(f->argb, base_position, m)) {
+      if (band_searched) {
+        *m = band_match;
+      } else {
+        FindMatch(f, base_position, m);
+      }
+    }
+    if (m->length == band_match.length &&
+        m->distance == band_match.distance &&
+        m->max_base_position == band_match.max_base_position) {
+      // Both passes agree from now on.
+      *m = f->matches[band];
+      return;
+    }
+    f->offset_length[base_position] = PackMatch(m);
+  }
+}
+
+// Returns false in case of memory error, in which case the caller should fill
+// the hash chain in a single pass.
+static int FillByBands(HashChainFiller* const f, int num_threads) {
+  const uint32_t* const argb = f->argb;
+  const int size = f->size;
+  int32_t* mem;
+  int band, i;
+  int ok;
+
+  mem = (int32_t*)WebPSafeMalloc(
+      (uint64_t)size + (uint64_t)f->num_bands * HASH_SIZE, sizeof(*mem));
+  if (mem == NULL) return 0;
+  f->chain = mem;
+  f->hash_tables = mem + size;
+
+  // Start the bands where a new color starts.
+  f->starts[0] = 0;
+  for (band = 1; band < f->num_bands; ++band) {
+    int start = (int)((int64_t)band * size / f->num_bands);
+    if (start < f->starts[band - 1]) start = f->starts[band - 1];
+    while (start < size - 2 && argb[start - 1] == argb[start]) ++start;
+    f->starts[band] = start;
+  }
+  f->starts[f->num_bands] = size - 2;
+
+  ok = WebPParallelFor(f->num_bands, num_threads, LinkBandHook, f);
+  // Turn each hash table into the last position of each hash up to its band.
+  for (band = 1; ok && band < f->num_bands; ++band) {
+    const int32_t* const prev = f->hash_tables + (size_t)(band - 1) * HASH_SIZE;
+    int32_t* const last = f->hash_tables + (size_t)band * HASH_SIZE;
+    for (i = 0; i < HASH_SIZE; ++i) {
+      if (last[i] < 0) last[i] = prev[i];
+    }
+  }
+  ok = ok && WebPParallelFor(f->num_bands, num_threads, RelinkBandHook, f);
+  if (ok) {
+    // Process the penultimate pixel.
+    f->chain[size - 2] =
+        f->hash_tables[(size_t)(f->num_bands - 1) * HASH_SIZE +
+                       GetPixPairHash64(argb + size - 2)];
+  }
+
+  ok = ok &&
+       WebPParallelFor(f->num_bands, num_threads, FindBandMatchesHook, f);
+  if (ok) {
+    HashChainMatch m = f->matches[f->num_bands - 1];
+    for (band = f->num_bands - 2; band >= 0; --band) {
+      FixBandMatches(f, band, &m);
+    }
+  }
+  assert(ok);  // the hooks can't fail
+  WebPSafeFree(mem);
+  return ok;
+}
+
+// Fills the hash chain in a single pass, temporarily using f->offset_length as
+// the chain.
+static int FillSinglePass(HashChainFiller* const f,
+                          const WebPPicture* const pic, int percent_range,
+                          int* const percent) {
+  const uint32_t* const argb = f->argb;
+  const int xsize = f->xsize;
+  const int size = f->size;
+  int remaining_percent = percent_range;
+  int percent_start = *percent;
+  int pos;
+  int32_t* hash_to_first_index;
+
+  f->chain = (int32_t*)f->offset_length;
+  hash_to_first_index =
+      (int32_t*)WebPSafeMalloc(HASH_SIZE, sizeof(*hash_to_first_index));
+  if (hash_to_first_index == NULL) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+
+  percent_range = remaining_percent / 2;
+  remaining_percent -= percent_range;
+
+  // Set the int32_t array to -1.
+  memset(hash_to_first_index, 0xff, HASH_SIZE * sizeof(*hash_to_first_index));
+  // Fill the chain linking pixels with the same hash, one row at a time.
+  for (pos = 0; pos < size - 2;) {
+    const int end = (size - 2 - pos > xsize) ? pos + xsize : size - 2;
+    pos = LinkPixels(f, pos, end, hash_to_first_index);
     if (!WebPReportProgress(
             pic, percent_start + percent_range * pos / (size - 2), percent)) {
       WebPSafeFree(hash_to_first_index);
       return 0;
     }
   }
+  assert(pos == size - 2);
   // Process the penultimate pixel.
-  chain[pos] = hash_to_first_index[GetPixPairHash64(argb + pos)];
+  f->chain[pos] = hash_to_first_index[GetPixPairHash64(argb + pos)];
 
   WebPSafeFree(hash_to_first_index);
 
@@ -347,106 +665,328 @@ int VP8LHashChainFill(VP8LHashChain* const p, int quality,
   percent_range = remaining_percent;
 
   // Find the best match interval at each pixel, defined by an offset to the
-  // pixel and a length. The right-most pixel cannot match anything to the right
-  // (hence a best length of 0) and the left-most pixel nothing to the left
-  // (hence an offset of 0).
-  assert(size > 2);
-  p->offset_length[0] = p->offset_length[size - 1] = 0;
-  for (base_position = size - 2; base_position > 0;) {
-    const int max_len = MaxFindCopyLength(size - 1 - base_position);
-    const uint32_t* const argb_start = argb + base_position;
-    int iter = iter_max;
-    int best_length = 0;
-    uint32_t best_distance = 0;
-    uint32_t best_argb;
-    const int min_pos =
-        (base_position > window_size) ? base_position - window_size : 0;
-    const int length_max = (max_len < 256) ? max_len : 256;
-    uint32_t max_base_position;
-
-    pos = chain[base_position];
-    if (!low_effort) {
-      int curr_length;
-      // Heuristic: use the comparison with the above line as an initialization.
-      if (base_position >= (uint32_t)xsize) {
-        curr_length = FindMatchLength(argb_start - xsize, argb_start,
-                                      best_length, max_len);
-        if (curr_length > best_length) {
-          best_length = curr_length;
-          best_distance = xsize;
-        }
-        --iter;
-      }
-      // Heuristic: compare to the previous pixel.
-      curr_length =
-          FindMatchLength(argb_start - 1, argb_start, best_length, max_len);
-      if (curr_length > best_length) {
-        best_length = curr_length;
-        best_distance = 1;
+  // pixel and a length, one row at a time.
+  {
+    HashChainMatch m;
+    int hi;
+    m.distance = 0;
+    for (hi = size - 2; hi > 0; hi -= xsize) {
+      const int lo = (hi > xsize) ? hi - xsize + 1 : 1;
+      FindMatches(f, lo, hi, &m);
+      if (!WebPReportProgress(
+              pic, percent_start + percent_range * (size - 1 - lo) / (size - 2),
+              percent)) {
+        return 0;
       }
-      --iter;
-      // Skip the for loop if we already have the maximum.
-      if (best_length == MAX_LENGTH) pos = min_pos - 1;
     }
-    best_argb = argb_start[best_length];
-
-    for (; pos >= min_pos && --iter; pos = chain[pos]) {
-      int curr_length;
-      assert(base_position > (uint32_t)pos);
+  }
+  return 1;
+}
 
-      if (argb[pos + best_length] != best_argb) continue;
+//------------------------------------------------------------------------------
+// Binary trees.
+//
+// For the kLZ77Tree LZ77 type, the pixels with the same hash are kept in a
+// binary tree instead of a chain, as in high-end LZ77 compressors. Each tree is
+// sorted on the pixels following its nodes, with the most recent one at the
+// root, so that inserting a pixel walks down towards the previous pixels
+// sharing the longest prefix with it: long matches are found in a few probes,
+// even far back in the window. The trees are filled from left to right,
+// comparing pixels up to BINARY_TREE_NICE_LENGTH only, and the matches are then
+// extended from right to left as with the hash chain.
+
+// Pixels are not compared further than this while filling the trees: a pixel
+// matching a node that far replaces it.
+#define BINARY_TREE_NICE_LENGTH 32
+
+// Returns roughly the number of extra bits needed to code 'distance'.
+static WEBP_INLINE int GetDistanceBits(int xsize, uint32_t distance) {
+  // Short cut for the distances that are too far to have a plane code.
+  if (distance >= 8u * xsize) return BitsLog2Floor(distance + 120);
+  return BitsLog2Floor(VP8LDistanceToPlaneCode(xsize, distance));
+}
 
-      curr_length = VP8LVectorMismatch(argb + pos, argb_start, max_len);
-      if (best_length < curr_length) {
-        best_length = curr_length;
-        best_distance = base_position - pos;
-        best_argb = argb_start[best_length];
-        // Stop if we have reached a good enough length.
-        if (best_length >= length_max) break;
+// Inserts the pixel at 'pos' in the tree of its hash, whose root is in
+// 'roots', and returns the best match found on the way, compared up to
+// BINARY_TREE_NICE_LENGTH pixels. A match is deemed better if it is longer by
+// more pixels than it needs extra bits for its distance. 'children' holds the
+// smaller and larger child of each node.
+static uint32_t InsertInBinaryTree(const HashChainFiller* const f, int pos,
+                                   int32_t* const roots,
+                                   int32_t* const children) {
+  const uint32_t* const argb = f->argb;
+  const uint32_t* const argb_start = argb + pos;
+  const int max_len = (f->size - 1 - pos < BINARY_TREE_NICE_LENGTH)
+                          ? f->size - 1 - pos
+                          : BINARY_TREE_NICE_LENGTH;
+  const int min_pos = (pos > (int)f->window_size) ? pos - f->window_size : 0;
+  const uint32_t hash_code = GetPixPairHash64(argb_start);
+  // Where to link the next nodes smaller and larger than 'pos'.
+  int32_t* smaller = &children[2 * pos + 0];
+  int32_t* larger = &children[2 * pos + 1];
+  // Number of pixels 'pos' has in common with the last smaller and larger
+  // nodes: the nodes below share at least the minimum of both.
+  int smaller_len = 0, larger_len = 0;
+  // The trees find good matches in less probes than the chains.
+  int iter = f->iter_max / 4;
+  int node = roots[hash_code];
+  HashChainMatch m;
+  int best_score = 0;
+  assert(max_len > 0);
+  m.length = 0;
+  m.distance = 0;
+  roots[hash_code] = pos;
+
+  while (node >= min_pos && iter-- > 0) {
+    int32_t* const node_children = &children[2 * node];
+    const uint32_t* const argb_node = argb + node;
+    int len = (smaller_len < larger_len) ? smaller_len : larger_len;
+    // Most nodes differ right away: only call VP8LVectorMismatch() otherwise.
+    if (argb_node[len] == argb_start[len]) {
+      ++len;
+      if (len < max_len && argb_node[len] == argb_start[len]) {
+        len += VP8LVectorMismatch(argb_node + len, argb_start + len,
+                                  max_len - len);
       }
     }
-    // We have the best match but in case the two intervals continue matching
-    // to the left, we have the best matches for the left-extended pixels.
-    max_base_position = base_position;
-    while (1) {
-      assert(best_length <= MAX_LENGTH);
-      assert(best_distance <= WINDOW_SIZE);
-      p->offset_length[base_position] =
-          (best_distance << MAX_LENGTH_BITS) | (uint32_t)best_length;
-      --base_position;
-      // Stop if we don't have a match or if we are out of bounds.
-      if (best_distance == 0 || base_position == 0) break;
-      // Stop if we cannot extend the matching intervals to the left.
-      if (base_position < best_distance ||
-          argb[base_position - best_distance] != argb[base_position]) {
-        break;
-      }
-      // Stop if we are matching at its limit because there could be a closer
-      // matching interval with the same maximum length. Then again, if the
-      // matching interval is as close as possible (best_distance == 1), we will
-      // never find anything better so let's continue.
-      if (best_length == MAX_LENGTH && best_distance != 1 &&
-          base_position + MAX_LENGTH < max_base_position) {
-        break;
-      }
-      if (best_length < MAX_LENGTH) {
-        ++best_length;
-        max_base_position = base_position;
+    if (len > 0 && (m.length == 0 || len > best_score)) {
+      const uint32_t distance = pos - node;
+      const int score = len - GetDistanceBits(f->xsize, distance);
+      if (m.length == 0 || score > best_score) {
+        best_score = score;
+        m.length = len;
+        m.distance = distance;
       }
     }
+    if (len == max_len) {
+      // 'pos' cannot be told apart from 'node': it takes its place.
+      *smaller = node_children[0];
+      *larger = node_children[1];
+      return PackMatch(&m);
+    }
+    if (argb_node[len] < argb_start[len]) {
+      // 'node' and its smaller children are smaller than 'pos'.
+      *smaller = node;
+      smaller = &node_children[1];
+      smaller_len = len;
+      node = *smaller;
+    } else {
+      *larger = node;
+      larger = &node_children[0];
+      larger_len = len;
+      node = *larger;
+    }
+  }
+  // The rest of the tree is out of the window or too deep to be searched.
+  *smaller = -1;
+  *larger = -1;
+  return PackMatch(&m);
+}
+
+// Same as FindMatch() except that the match 'offset_length' found in the
+// binary tree is used instead of the hash chain.
+static void FindBinaryTreeMatch(const HashChainFiller* const f,
+                                uint32_t base_position, uint32_t offset_length,
+                                HashChainMatch* const m) {
+  const uint32_t* const argb_start = f->argb + base_position;
+  const int xsize = f->xsize;
+  const int max_len = MaxFindCopyLength(f->size - 1 - base_position);
+  const uint32_t distance = offset_length >> MAX_LENGTH_BITS;
+  int length = (int)(offset_length & MAX_LENGTH);
+  int best_length = 0;
+  uint32_t best_distance = 0;
+  int curr_length;
+  // Same heuristics as FindMatch(), as their distances are cheap to code.
+  if (base_position >= (uint32_t)xsize) {
+    curr_length = FindMatchLength(argb_start - xsize, argb_start, best_length,
+                                  max_len);
+    if (curr_length > best_length) {
+      best_length = curr_length;
+      best_distance = xsize;
+    }
+  }
+  curr_length =
+      FindMatchLength(argb_start - 1, argb_start, best_length, max_len);
+  if (curr_length > best_length) {
+    best_length = curr_length;
+    best_distance = 1;
+  }
+  if (length > best_length) {
+    // The match may go on beyond what was compared in the tree.
+    if (length == BINARY_TREE_NICE_LENGTH) {
+      length = VP8LVectorMismatch(argb_start - distance, argb_start, max_len);
+    }
+    best_length = length;
+    best_distance = distance;
+  }
+  m->length = best_length;
+  m->distance = best_distance;
+  m->max_base_position = base_position;
+}
 
-    if (!WebPReportProgress(pic,
-                            percent_start + percent_range *
-                                                (size - 2 - base_position) /
-                                                (size - 2),
-                            percent)) {
+// Fills f->offset_length using binary trees stored in 'mem', which holds
+// 2 * f->size + HASH_SIZE entries. Returns false if the user aborted.
+static int FillWithBinaryTrees(const HashChainFiller* const f,
+                               int32_t* const mem,
+                               const WebPPicture* const pic, int percent_range,
+                               int* const percent) {
+  const uint32_t* const argb = f->argb;
+  const int xsize = f->xsize;
+  const int size = f->size;
+  const int ysize = size / xsize;
+  int32_t* const children = mem;
+  int32_t* const roots = mem + 2 * (size_t)size;
+  uint32_t* const offset_length = f->offset_length;
+  const int percent_start = *percent;
+  HashChainMatch m;
+  int pos;
+  int run_end = 0;  // end of the stretch of identical pixels at 'pos'
+
+  // Insert all the pixels but the last one from left to right, and keep the
+  // match found for each.
+  memset(roots, 0xff, HASH_SIZE * sizeof(*roots));
+  for (pos = 0; pos < size - 1; ++pos) {
+    if (pos >= run_end) {
+      run_end = pos + 1;
+      while (run_end < size && argb[run_end] == argb[pos]) ++run_end;
+    }
+    if (pos > 0 && argb[pos - 1] == argb[pos] &&
+        run_end - pos > BINARY_TREE_NICE_LENGTH) {
+      // Within a long stretch of identical pixels, 'pos' would just replace
+      // its predecessor in the tree and be replaced by its follower: only its
+      // match at a distance of 1 is kept.
+      int length = run_end - pos;
+      if (length > size - 1 - pos) length = size - 1 - pos;
+      offset_length[pos] =
+          (1u << MAX_LENGTH_BITS) | (uint32_t)MaxFindCopyLength(length);
+    } else if (pos > 0 && pos + BINARY_TREE_NICE_LENGTH < size &&
+               (offset_length[pos - 1] & MAX_LENGTH) ==
+                   BINARY_TREE_NICE_LENGTH &&
+               argb[pos + BINARY_TREE_NICE_LENGTH - 1] ==
+                   argb[pos + BINARY_TREE_NICE_LENGTH - 1 -
+                        (offset_length[pos - 1] >> MAX_LENGTH_BITS)]) {
+      // The match of the previous pixel goes on at least as far: 'pos' is not
+      // inserted, as an equivalent pixel is already in the tree.
+      offset_length[pos] = offset_length[pos - 1];
+    } else {
+      offset_length[pos] = InsertInBinaryTree(f, pos, roots, children);
+    }
+    if ((pos + 1) % xsize == 0 &&
+        !WebPReportProgress(
+            pic, percent_start + percent_range / 2 * (pos / xsize) / ysize,
+            percent)) {
       return 0;
     }
   }
 
-  return WebPReportProgress(pic, percent_start + percent_range, percent);
+  // Extend the matches from right to left, as in FindMatches(), unless the
+  // tree found a longer one.
+  m.length = 0;
+  m.distance = 0;
+  m.max_base_position = 0;
+  for (pos = size - 2; pos > 0; --pos) {
+    const uint32_t tree_match = offset_length[pos];
+    if (!ExtendMatch(argb, pos, &m) ||
+        m.length < (int)(tree_match & MAX_LENGTH)) {
+      FindBinaryTreeMatch(f, pos, tree_match, &m);
+    }
+    offset_length[pos] = PackMatch(&m);
+    if (pos % xsize == 0 &&
+        !WebPReportProgress(
+            pic,
+            percent_start + percent_range / 2 +
+                (percent_range - percent_range / 2) * (ysize - pos / xsize) /
+                    ysize,
+            percent)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Same as VP8LHashChainFill() with binary trees instead of chains, on a single
+// thread. Returns false in case of error (stored in pic->error_code).
+static int HashChainFillWithBinaryTrees(VP8LHashChain* const p, int quality,
+                                        const uint32_t* const argb, int xsize,
+                                        int ysize, const WebPPicture* const pic,
+                                        int percent_range,
+                                        int* const percent) {
+  const int size = xsize * ysize;
+  const int percent_end = *percent + percent_range;
+  HashChainFiller f;
+  int32_t* mem;
+  int ok;
+  assert(size > 0);
+  assert(p->size != 0);
+  assert(p->offset_length != NULL);
+
+  if (size <= 2) {
+    p->offset_length[0] = p->offset_length[size - 1] = 0;
+    return 1;
+  }
+
+  mem = (int32_t*)WebPSafeMalloc(2 * (uint64_t)size + HASH_SIZE, sizeof(*mem));
+  if (mem == NULL) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  f.argb = argb;
+  f.xsize = xsize;
+  f.size = size;
+  f.iter_max = GetMaxItersForQuality(quality);
+  f.window_size = GetWindowSizeForHashChain(quality, xsize);
+  f.low_effort = 0;
+  f.offset_length = p->offset_length;
+  ok = FillWithBinaryTrees(&f, mem, pic, percent_range, percent);
+  WebPSafeFree(mem);
+  if (!ok) return 0;
+  // Same as in VP8LHashChainFill().
+  p->offset_length[0] = p->offset_length[size - 1] = 0;
+
+  return WebPReportProgress(pic, percent_end, percent);
+}
+
+int VP8LHashChainFill(VP8LHashChain* const p, int quality,
+                      const uint32_t* const argb, int xsize, int ysize,
+                      int low_effort, int num_threads,
+                      const WebPPicture* const pic, int percent_range,
+                      int* const percent) {
+  const int size = xsize * ysize;
+  const int percent_end = *percent + percent_range;
+  HashChainFiller f;
+  assert(size > 0);
+  assert(p->size != 0);
+  assert(p->offset_length != NULL);
+
+  if (size <= 2) {
+    p->offset_length[0] = p->offset_length[size - 1] = 0;
+    return 1;
+  }
+
+  f.argb = argb;
+  f.xsize = xsize;
+  f.size = size;
+  f.iter_max = GetMaxItersForQuality(quality);
+  f.window_size = GetWindowSizeForHashChain(quality, xsize);
+  f.low_effort = low_effort;
+  f.offset_length = p->offset_length;
+  f.num_bands = size / HASH_CHAIN_MIN_BAND_SIZE;
+  if (f.num_bands > num_threads) f.num_bands = num_threads;
+  if (f.num_bands > HASH_CHAIN_MAX_BANDS) f.num_bands = HASH_CHAIN_MAX_BANDS;
+  if (f.num_bands <= 1 || !FillByBands(&f, num_threads)) {
+    if (!FillSinglePass(&f, pic, percent_range, percent)) return 0;
+  }
+  // The left-most pixel cannot match anything to the left (hence an offset of
+  // 0) and the right-most pixel nothing to the right (hence a best length of
+  // 0).
+  p->offset_length[0] = p->offset_length[size - 1] = 0;
+
+  return WebPReportProgress(pic, percent_end, percent);
 }
 
+#undef HASH_CHAIN_MAX_BANDS
+#undef HASH_CHAIN_MIN_BAND_SIZE
+#undef BINARY_TREE_NICE_LENGTH
+
 static WEBP_INLINE void AddSingleLiteral(uint32_t pixel, int use_color_cache,
                                          VP8LColorCache* const hashers,
                                          VP8LBackwardRefs* const refs) {
@@ -509,16 +1049,18 @@ static int BackwardReferencesRle(int xsize, int ysize,
   return !refs->error;
 }
 
-static int BackwardReferencesLz77(int xsize, int ysize,
-                                  const uint32_t* const argb, int cache_bits,
-                                  const VP8LHashChain* const hash_chain,
-                                  VP8LBackwardRefs* const refs) {
+// Computes the references of the pixels [start, pix_count) of 'argb', which
+// may point before 'start'.
+static int BackwardReferencesLz77FromPos(int start, int pix_count,
+                                         const uint32_t* const argb,
+                                         int cache_bits,
+                                         const VP8LHashChain* const hash_chain,
+                                         VP8LBackwardRefs* const refs) {
   int i;
   int i_last_check = -1;
   int ok = 0;
   int cc_init = 0;
   const int use_color_cache = (cache_bits > 0);
-  const int pix_count = xsize * ysize;
   VP8LColorCache hashers;
 
   if (use_color_cache) {
@@ -526,7 +1068,7 @@ static int BackwardReferencesLz77(int xsize, int ysize,
     if (!cc_init) goto Error;
   }
   VP8LClearBackwardRefs(refs);
-  for (i = 0; i < pix_count;) {
+  for (i = start; i < pix_count;) {
     // Alternative#1: Code the pixels starting at 'i' using backward reference.
     int offset = 0;
     int len = 0;
@@ -577,6 +1119,14 @@ Error:
   return ok;
 }
 
+static int BackwardReferencesLz77(int xsize, int ysize,
+                                  const uint32_t* const argb, int cache_bits,
+                                  const VP8LHashChain* const hash_chain,
+                                  VP8LBackwardRefs* const refs) {
+  return BackwardReferencesLz77FromPos(0, xsize * ysize, argb, cache_bits,
+                                       hash_chain, refs);
+}
+
 // Compute an LZ77 by forcing matches to happen within a given distance cost.
 // We therefore limit the algorithm to the lowest 32 values in the PlaneCode
 // definition.
@@ -749,28 +1299,40 @@ static void BackwardReferences2DLocality(int xsize,
 // The input *best_cache_bits sets the maximum cache bits to use (passing 0
 // implies disabling the local color cache). The local color cache is also
 // disabled for the lower (<= 25) quality.
+// bit_costs[0] receives the estimated cost of 'refs' with the best cache bits,
+// and bit_costs[1] without color cache.
 // Returns 0 in case of memory error.
 static int CalculateBestCacheSize(const uint32_t* argb, int quality,
                                   const VP8LBackwardRefs* const refs,
-                                  int* const best_cache_bits) {
-  int i;
+                                  int* const best_cache_bits,
+                                  uint64_t bit_costs[2]) {
+  int i, k;
   const int cache_bits_max = (quality <= 25) ? 0 : *best_cache_bits;
+  const int cache_size_max = 1 << cache_bits_max;
   uint64_t entropy_min = WEBP_UINT64_MAX;
   int cc_init[MAX_COLOR_CACHE_BITS + 1] = {0};
   VP8LColorCache hashers[MAX_COLOR_CACHE_BITS + 1];
   VP8LRefsCursor c = VP8LRefsCursorInit(refs);
   VP8LHistogram* histos[MAX_COLOR_CACHE_BITS + 1] = {NULL};
+  uint32_t length_counts[NUM_LENGTH_CODES] = {0};
+  uint32_t distance_counts[NUM_DISTANCE_CODES] = {0};
+  // Counts of the alpha, red, green and blue values of the literals missed by
+  // the caches with less than 'b' bits, and found in the others, for each 'b'
+  // in [1, cache_bits_max + 1].
+  uint32_t* literal_counts = NULL;
+  // Counts of the keys with cache_bits_max bits of the same literals, for each
+  // 'b' in [1, cache_bits_max].
+  uint32_t* key_counts = NULL;
   int ok = 0;
 
   assert(cache_bits_max >= 0 && cache_bits_max <= MAX_COLOR_CACHE_BITS);
 
-  if (cache_bits_max == 0) {
-    *best_cache_bits = 0;
-    // Local color cache is disabled.
-    return 1;
-  }
-
   // Allocate data.
+  literal_counts = (uint32_t*)WebPSafeCalloc(
+      (uint64_t)(cache_bits_max + 2) * 4 * 256, sizeof(*literal_counts));
+  key_counts = (uint32_t*)WebPSafeCalloc(
+      (uint64_t)(cache_bits_max + 1) * cache_size_max, sizeof(*key_counts));
+  if (literal_counts == NULL || key_counts == NULL) goto Error;
   for (i = 0; i <= cache_bits_max; ++i) {
     histos[i] = VP8LAllocateHistogram(i);
     if (histos[i] == NULL) goto Error;
@@ -780,52 +1342,46 @@ static int CalculateBestCacheSize(const uint32_t* argb, int quality,
     if (!cc_init[i]) goto Error;
   }
 
-  // Find the cache_bits giving the lowest entropy. The search is done in a
-  // brute-force way as the function (entropy w.r.t cache_bits) can be
-  // anything in practice.
+  // The keys of a cache are the prefixes of the keys of the bigger caches, so
+  // a color that is the last one inserted with its key in a cache is also the
+  // last one inserted with its key in the bigger caches: the caches holding a
+  // literal are the ones with at least some number of bits 'b', and each
+  // literal is counted for its 'b' only. The histograms of the caches are
+  // summed up from these counts afterwards.
   while (VP8LRefsCursorOk(&c)) {
     const PixOrCopy* const v = c.cur_pos;
     if (PixOrCopyIsLiteral(v)) {
       const uint32_t pix = *argb++;
-      const uint32_t a = (pix >> 24) & 0xff;
-      const uint32_t r = (pix >> 16) & 0xff;
-      const uint32_t g = (pix >> 8) & 0xff;
-      const uint32_t b = (pix >> 0) & 0xff;
+      uint32_t* counts;
       // The keys of the caches can be derived from the longest one.
-      int key = VP8LHashPix(pix, 32 - cache_bits_max);
-      // Do not use the color cache for cache_bits = 0.
-      ++histos[0]->blue[b];
-      ++histos[0]->literal[g];
-      ++histos[0]->red[r];
-      ++histos[0]->alpha[a];
-      // Deal with cache_bits > 0.
+      const int key_max =
+          (cache_bits_max > 0) ? VP8LHashPix(pix, 32 - cache_bits_max) : 0;
+      int key = key_max;
+      // Find the smallest cache holding the literal, from the biggest one.
       for (i = cache_bits_max; i >= 1; --i, key >>= 1) {
-        if (VP8LColorCacheLookup(&hashers[i], key) == pix) {
-          ++histos[i]->literal[NUM_LITERAL_CODES + NUM_LENGTH_CODES + key];
-        } else {
-          VP8LColorCacheSet(&hashers[i], key, pix);
-          ++histos[i]->blue[b];
-          ++histos[i]->literal[g];
-          ++histos[i]->red[r];
-          ++histos[i]->alpha[a];
-        }
+        if (VP8LColorCacheLookup(&hashers[i], key) != pix) break;
       }
+      // The caches with at least i + 1 bits hold the literal.
+      if (i < cache_bits_max) ++key_counts[(i + 1) * cache_size_max + key_max];
+      counts = &literal_counts[(i + 1) * 4 * 256];
+      ++counts[0 * 256 + ((pix >> 24) & 0xff)];
+      ++counts[1 * 256 + ((pix >> 16) & 0xff)];
+      ++counts[2 * 256 + ((pix >> 8) & 0xff)];
+      ++counts[3 * 256 + ((pix >> 0) & 0xff)];
+      // The other caches miss it.
+      for (; i >= 1; --i, key >>= 1) VP8LColorCacheSet(&hashers[i], key, pix);
     } else {
-      int code, extra_bits, extra_bits_value;
-      // We should compute the contribution of the (distance,length)
-      // histograms but those are the same independently from the cache size.
-      // As those constant contributions are in the end added to the other
-      // histogram contributions, we can ignore them, except for the length
-      // prefix that is part of the 'literal' histogram.
+      int code, extra_bits;
       int len = PixOrCopyLength(v);
       uint32_t argb_prev = *argb ^ 0xffffffffu;
-      VP8LPrefixEncode(len, &code, &extra_bits, &extra_bits_value);
-      for (i = 0; i <= cache_bits_max; ++i) {
-        ++histos[i]->literal[NUM_LITERAL_CODES + code];
-      }
+      // The (distance,length) histograms are the same for all cache sizes.
+      VP8LPrefixEncodeBits(len, &code, &extra_bits);
+      ++length_counts[code];
+      VP8LPrefixEncodeBits(PixOrCopyDistance(v), &code, &extra_bits);
+      ++distance_counts[code];
       // Update the color caches.
-      do {
-        if (*argb != argb_prev) {
+      for (; len > 0; --len, ++argb) {
+        if (cache_bits_max > 0 && *argb != argb_prev) {
           // Efficiency: insert only if the color changes.
           int key = VP8LHashPix(*argb, 32 - cache_bits_max);
           for (i = cache_bits_max; i >= 1; --i, key >>= 1) {
@@ -833,47 +1389,82 @@ static int CalculateBestCacheSize(const uint32_t* argb, int quality,
           }
           argb_prev = *argb;
         }
-        argb++;
-      } while (--len != 0);
+      }
     }
     VP8LRefsCursorNext(&c);
   }
 
+  // Sum up the histograms, from the biggest cache: the literals missed by a
+  // cache are the ones missed by the next one, plus the ones it holds.
+  for (i = cache_bits_max; i >= 0; --i) {
+    VP8LHistogram* const h = histos[i];
+    const VP8LHistogram* const next =
+        (i < cache_bits_max) ? histos[i + 1] : NULL;
+    const uint32_t* const counts = &literal_counts[(i + 1) * 4 * 256];
+    for (k = 0; k < 256; ++k) {
+      h->alpha[k] = counts[0 * 256 + k] + ((next != NULL) ? next->alpha[k] : 0);
+      h->red[k] = counts[1 * 256 + k] + ((next != NULL) ? next->red[k] : 0);
+      h->literal[k] =
+          counts[2 * 256 + k] + ((next != NULL) ? next->literal[k] : 0);
+      h->blue[k] = counts[3 * 256 + k] + ((next != NULL) ? next->blue[k] : 0);
+    }
+    memcpy(h->literal + NUM_LITERAL_CODES, length_counts,
+           sizeof(length_counts));
+    memcpy(h->distance, distance_counts, sizeof(distance_counts));
+  }
+  // The literals held by a cache are the ones held by the previous one, plus
+  // the ones it is the smallest to hold.
+  for (i = 1; i <= cache_bits_max; ++i) {
+    uint32_t* const counts = &key_counts[i * cache_size_max];
+    uint32_t* const cache_codes =
+        histos[i]->literal + NUM_LITERAL_CODES + NUM_LENGTH_CODES;
+    const int shift = cache_bits_max - i;
+    for (k = 0; k < cache_size_max; ++k) {
+      counts[k] += counts[k - cache_size_max];
+      cache_codes[k >> shift] += counts[k];
+    }
+  }
+
+  // Find the cache_bits giving the lowest entropy. The search is done in a
+  // brute-force way as the function (entropy w.r.t cache_bits) can be
+  // anything in practice.
   for (i = 0; i <= cache_bits_max; ++i) {
     const uint64_t entropy = VP8LHistogramEstimateBits(histos[i]);
+    if (i == 0) bit_costs[1] = entropy;
     if (i == 0 || entropy < entropy_min) {
       entropy_min = entropy;
       *best_cache_bits = i;
     }
   }
+  bit_costs[0] = entropy_min;
   ok = 1;
 Error:
   for (i = 0; i <= cache_bits_max; ++i) {
     if (cc_init[i]) VP8LColorCacheClear(&hashers[i]);
     VP8LFreeHistogram(histos[i]);
   }
+  WebPSafeFree(literal_counts);
+  WebPSafeFree(key_counts);
   return ok;
 }
 
-// Update (in-place) backward references for specified cache_bits.
-static int BackwardRefsWithLocalCache(const uint32_t* const argb,
-                                      int cache_bits,
-                                      VP8LBackwardRefs* const refs) {
+// Update (in-place) backward references of the pixels starting at 'argb' with
+// the color cache 'hashers', which is updated too.
+static void BackwardRefsApplyCache(const uint32_t* const argb,
+                                   VP8LColorCache* const hashers,
+                                   VP8LBackwardRefs* const refs) {
   int pixel_index = 0;
-  VP8LColorCache hashers;
   VP8LRefsCursor c = VP8LRefsCursorInit(refs);
-  if (!VP8LColorCacheInit(&hashers, cache_bits)) return 0;
-
   while (VP8LRefsCursorOk(&c)) {
     PixOrCopy* const v = c.cur_pos;
     if (PixOrCopyIsLiteral(v)) {
       const uint32_t argb_literal = v->argb_or_distance;
-      const int ix = VP8LColorCacheContains(&hashers, argb_literal);
+      const int ix = VP8LColorCacheContains(hashers, argb_literal);
       if (ix >= 0) {
         // hashers contains argb_literal
         *v = PixOrCopyCreateCacheIdx(ix);
       } else {
-        VP8LColorCacheInsert(&hashers, argb_literal);
+        VP8LColorCacheInsert(hashers, argb_literal);
       }
       ++pixel_index;
     } else {
@@ -881,11 +1472,20 @@ static int BackwardRefsWithLocalCache(const uint32_t* const argb,
       int k;
       assert(PixOrCopyIsCopy(v));
       for (k = 0; k < v->len; ++k) {
-        VP8LColorCacheInsert(&hashers, argb[pixel_index++]);
+        VP8LColorCacheInsert(hashers, argb[pixel_index++]);
       }
     }
     VP8LRefsCursorNext(&c);
   }
+}
+
+// Update (in-place) backward references for specified cache_bits.
+static int BackwardRefsWithLocalCache(const uint32_t* const argb,
+                                      int cache_bits,
+                                      VP8LBackwardRefs* const refs) {
+  VP8LColorCache hashers;
+  if (!VP8LColorCacheInit(&hashers, cache_bits)) return 0;
+  BackwardRefsApplyCache(argb, &hashers, refs);
   VP8LColorCacheClear(&hashers);
   return 1;
 }
@@ -905,140 +1505,215 @@ extern int VP8LBackwardReferencesTraceBackwards(
     int xsize, int ysize, const uint32_t* const argb, int cache_bits,
     const VP8LHashChain* const hash_chain,
     const VP8LBackwardRefs* const refs_src, VP8LBackwardRefs* const refs_dst);
+
+// Maximum number of LZ77 types tried at once.
+#define MAX_LZ77_TYPES 4
+
+// Backward references found with one LZ77 type, without color cache.
+typedef struct {
+  int lz77_type;
+  VP8LBackwardRefs* refs;
+  int cache_bits;         // best number of bits for the color cache
+  uint64_t bit_costs[2];  // with the best color cache, and without
+} LZ77TypeRefs;
+
+// Backward references improved by TraceBackwards, with or without cache.
+typedef struct {
+  const VP8LHashChain* hash_chain;
+  int cache_bits;
+  uint64_t bit_cost;             // cost of 'refs'
+  VP8LBackwardRefs* refs;        // replaced by the result if better
+  VP8LBackwardRefs* refs_trace;  // temporary
+} TracedRefs;
+
+typedef struct {
+  int width;
+  int height;
+  const uint32_t* argb;
+  int quality;
+  const VP8LHashChain* hash_chain;
+  VP8LHashChain* hash_chain_box;
+  const VP8LHashChain* hash_chain_tree;
+  LZ77TypeRefs types[MAX_LZ77_TYPES];
+  TracedRefs traces[2];  // with the color cache, and without
+} BackwardRefsSearch;
+
+static int FindLZ77TypeRefsHook(void* data, int index) {
+  BackwardRefsSearch* const s = (BackwardRefsSearch*)data;
+  LZ77TypeRefs* const t = &s->types[index];
+  int ok = 0;
+  switch (t->lz77_type) {
+    case kLZ77RLE:
+      ok = BackwardReferencesRle(s->width, s->height, s->argb, 0, t->refs);
+      break;
+    case kLZ77Standard:
+      // Compute LZ77 with no cache (0 bits), as the ideal LZ77 with a color
+      // cache is not that different in practice.
+      ok = BackwardReferencesLz77(s->width, s->height, s->argb, 0,
+                                  s->hash_chain, t->refs);
+      break;
+    case kLZ77Box:
+      ok = VP8LHashChainInit(s->hash_chain_box, s->width * s->height) &&
+           BackwardReferencesLz77Box(s->width, s->height, s->argb, 0,
+                                     s->hash_chain, s->hash_chain_box,
+                                     t->refs);
+      break;
+    case kLZ77Tree:
+      ok = BackwardReferencesLz77(s->width, s->height, s->argb, 0,
+                                  s->hash_chain_tree, t->refs);
+      break;
+    default:
+      assert(0);
+  }
+  return ok && CalculateBestCacheSize(s->argb, s->quality, t->refs,
+                                      &t->cache_bits, t->bit_costs);
+}
+
+static int TraceBackwardsHook(void* data, int index) {
+  BackwardRefsSearch* const s = (BackwardRefsSearch*)data;
+  TracedRefs* const t = &s->traces[index];
+  VP8LHistogram* histo;
+  uint64_t bit_cost_trace;
+  if (t->refs == NULL) return 1;  // nothing to improve
+  if (!VP8LBackwardReferencesTraceBackwards(s->width, s->height, s->argb,
+                                            t->cache_bits, t->hash_chain,
+                                            t->refs, t->refs_trace)) {
+    return 0;
+  }
+  histo = VP8LAllocateHistogram(t->cache_bits);
+  if (histo == NULL) return 0;
+  VP8LHistogramCreate(histo, t->refs_trace, t->cache_bits);
+  bit_cost_trace = VP8LHistogramEstimateBits(histo);
+  VP8LFreeHistogram(histo);
+  if (bit_cost_trace < t->bit_cost) BackwardRefsSwap(t->refs_trace, t->refs);
+  return 1;
+}
+
+// The LZ77 types are tried in parallel, each with all the cache sizes, with
+// up to 'num_threads' threads. The best ones with and without color cache are
+// then improved by TraceBackwards in parallel too. 'hash_chain_tree' is only
+// needed for kLZ77Tree.
 static int GetBackwardReferences(int width, int height,
                                  const uint32_t* const argb, int quality,
                                  int lz77_types_to_try, int cache_bits_max,
-                                 int do_no_cache,
+                                 int do_no_cache, int num_threads,
                                  const VP8LHashChain* const hash_chain,
+                                 const VP8LHashChain* const hash_chain_tree,
                                  VP8LBackwardRefs* const refs,
                                  int* const cache_bits_best) {
-  VP8LHistogram* histo = NULL;
+  BackwardRefsSearch s;
+  // The last element of 'refs' is a temporary, more are needed to try the
+  // LZ77 types at the same time.
+  VP8LBackwardRefs* const refs_tmp = &refs[do_no_cache ? 2 : 1];
+  VP8LBackwardRefs refs_extra[MAX_LZ77_TYPES - 1];
   int i, lz77_type;
+  int num_types = 0;
   // Index 0 is for a color cache, index 1 for no cache (if needed).
-  int lz77_types_best[2] = {0, 0};
-  uint64_t bit_costs_best[2] = {WEBP_UINT64_MAX, WEBP_UINT64_MAX};
+  int types_best[2] = {0, 0};
+  int same_refs;
   VP8LHashChain hash_chain_box;
-  VP8LBackwardRefs* const refs_tmp = &refs[do_no_cache ? 2 : 1];
   int status = 0;
   memset(&hash_chain_box, 0, sizeof(hash_chain_box));
+  for (i = 0; i < MAX_LZ77_TYPES - 1; ++i) {
+    VP8LBackwardRefsInit(&refs_extra[i], refs[0].block_size);
+  }
 
-  histo = VP8LAllocateHistogram(MAX_COLOR_CACHE_BITS);
-  if (histo == NULL) goto Error;
-
+  s.width = width;
+  s.height = height;
+  s.argb = argb;
+  s.quality = quality;
+  s.hash_chain = hash_chain;
+  s.hash_chain_box = &hash_chain_box;
+  s.hash_chain_tree = hash_chain_tree;
   for (lz77_type = 1; lz77_types_to_try;
        lz77_types_to_try &= ~lz77_type, lz77_type <<= 1) {
-    int res = 0;
-    uint64_t bit_cost = 0u;
+    LZ77TypeRefs* const t = &s.types[num_types];
     if ((lz77_types_to_try & lz77_type) == 0) continue;
-    switch (lz77_type) {
-      case kLZ77RLE:
-        res = BackwardReferencesRle(width, height, argb, 0, refs_tmp);
-        break;
-      case kLZ77Standard:
-        // Compute LZ77 with no cache (0 bits), as the ideal LZ77 with a color
-        // cache is not that different in practice.
-        res = BackwardReferencesLz77(width, height, argb, 0, hash_chain,
-                                     refs_tmp);
-        break;
-      case kLZ77Box:
-        if (!VP8LHashChainInit(&hash_chain_box, width * height)) goto Error;
-        res = BackwardReferencesLz77Box(width, height, argb, 0, hash_chain,
-                                        &hash_chain_box, refs_tmp);
-        break;
-      default:
-        assert(0);
-    }
-    if (!res) goto Error;
-
-    // Start with the no color cache case.
-    for (i = 1; i >= 0; --i) {
-      int cache_bits = (i == 1) ? 0 : cache_bits_max;
-
-      if (i == 1 && !do_no_cache) continue;
-
-      if (i == 0) {
-        // Try with a color cache.
-        if (!CalculateBestCacheSize(argb, quality, refs_tmp, &cache_bits)) {
-          goto Error;
-        }
-        if (cache_bits > 0) {
-          if (!BackwardRefsWithLocalCache(argb, cache_bits, refs_tmp)) {
-            goto Error;
-          }
-        }
-      }
-
-      if (i == 0 && do_no_cache && cache_bits == 0) {
-        // No need to re-compute bit_cost as it was computed at i == 1.
-      } else {
-        VP8LHistogramCreate(histo, refs_tmp, cache_bits);
-        bit_cost = VP8LHistogramEstimateBits(histo);
-      }
+    assert(num_types < MAX_LZ77_TYPES);
+    t->lz77_type = lz77_type;
+    t->refs = (num_types == 0) ? refs_tmp : &refs_extra[num_types - 1];
+    t->cache_bits = cache_bits_max;
+    ++num_types;
+  }
+  if (!WebPParallelFor(num_types, num_threads, FindLZ77TypeRefsHook, &s)) {
+    goto Error;
+  }
 
-      if (bit_cost < bit_costs_best[i]) {
-        if (i == 1) {
-          // Do not swap as the full cache analysis would have the wrong
-          // VP8LBackwardRefs to start with.
-          if (!BackwardRefsClone(refs_tmp, &refs[1])) goto Error;
-        } else {
-          BackwardRefsSwap(refs_tmp, &refs[0]);
-        }
-        bit_costs_best[i] = bit_cost;
-        lz77_types_best[i] = lz77_type;
-        if (i == 0) *cache_bits_best = cache_bits;
-      }
+  // Keep the first best type, with and without color cache.
+  for (i = 1; i < num_types; ++i) {
+    if (s.types[i].bit_costs[0] < s.types[types_best[0]].bit_costs[0]) {
+      types_best[0] = i;
+    }
+    if (s.types[i].bit_costs[1] < s.types[types_best[1]].bit_costs[1]) {
+      types_best[1] = i;
+    }
+  }
+  *cache_bits_best = s.types[types_best[0]].cache_bits;
+  BackwardRefsSwap(s.types[types_best[0]].refs, &refs[0]);
+  if (do_no_cache) {
+    if (types_best[1] == types_best[0]) {
+      if (!BackwardRefsClone(&refs[0], &refs[1])) goto Error;
+    } else {
+      BackwardRefsSwap(s.types[types_best[1]].refs, &refs[1]);
     }
   }
-  assert(lz77_types_best[0] > 0);
-  assert(!do_no_cache || lz77_types_best[1] > 0);
+  if (*cache_bits_best > 0 &&
+      !BackwardRefsWithLocalCache(argb, *cache_bits_best, &refs[0])) {
+    goto Error;
+  }
 
   // Improve on simple LZ77 but only for high quality (TraceBackwards is
   // costly).
-  for (i = 1; i >= 0; --i) {
-    if (i == 1 && !do_no_cache) continue;
-    if ((lz77_types_best[i] == kLZ77Standard ||
-         lz77_types_best[i] == kLZ77Box) &&
-        quality >= 25) {
-      const VP8LHashChain* const hash_chain_tmp =
-          (lz77_types_best[i] == kLZ77Standard) ? hash_chain : &hash_chain_box;
-      const int cache_bits = (i == 1) ? 0 : *cache_bits_best;
-      uint64_t bit_cost_trace;
-      if (!VP8LBackwardReferencesTraceBackwards(width, height, argb, cache_bits,
-                                                hash_chain_tmp, &refs[i],
-                                                refs_tmp)) {
-        goto Error;
-      }
-      VP8LHistogramCreate(histo, refs_tmp, cache_bits);
-      bit_cost_trace = VP8LHistogramEstimateBits(histo);
-      if (bit_cost_trace < bit_costs_best[i]) {
-        BackwardRefsSwap(refs_tmp, &refs[i]);
-      }
+  for (i = 0; i < 2; ++i) {
+    const int lz77_type_best = s.types[types_best[i]].lz77_type;
+    TracedRefs* const t = &s.traces[i];
+    if (lz77_type_best == kLZ77Box) {
+      t->hash_chain = &hash_chain_box;
+    } else if (lz77_type_best == kLZ77Tree) {
+      t->hash_chain = hash_chain_tree;
+    } else {
+      t->hash_chain = hash_chain;
     }
-
-    BackwardReferences2DLocality(width, &refs[i]);
-
-    if (i == 1 && lz77_types_best[0] == lz77_types_best[1] &&
-        *cache_bits_best == 0) {
-      // If the best cache size is 0 and we have the same best LZ77, just copy
-      // the data over and stop here.
-      if (!BackwardRefsClone(&refs[1], &refs[0])) goto Error;
-      break;
+    t->cache_bits = (i == 0) ? *cache_bits_best : 0;
+    t->bit_cost = s.types[types_best[i]].bit_costs[i];
+    t->refs = &refs[i];
+    t->refs_trace = (i == 0) ? refs_tmp : &refs_extra[0];
+    if ((i == 1 && !do_no_cache) ||
+        lz77_type_best == kLZ77RLE || quality < 25) {
+      t->refs = NULL;
     }
   }
+  // If the best cache size is 0 and we have the same best LZ77, the result
+  // without cache is just copied over.
+  same_refs =
+      do_no_cache && types_best[0] == types_best[1] && *cache_bits_best == 0;
+  if (same_refs) s.traces[0].refs = NULL;
+  if (!WebPParallelFor(2, num_threads, TraceBackwardsHook, &s)) goto Error;
+
+  if (do_no_cache) BackwardReferences2DLocality(width, &refs[1]);
+  if (same_refs) {
+    if (!BackwardRefsClone(&refs[1], &refs[0])) goto Error;
+  } else {
+    BackwardReferences2DLocality(width, &refs[0]);
+  }
   status = 1;
 
 Error:
   VP8LHashChainClear(&hash_chain_box);
-  VP8LFreeHistogram(histo);
+  for (i = 0; i < MAX_LZ77_TYPES - 1; ++i) {
+    VP8LBackwardRefsClear(&refs_extra[i]);
+  }
   return status;
 }
 
+#undef MAX_LZ77_TYPES
+
 int VP8LGetBackwardReferences(
     int width, int height, const uint32_t* const argb, int quality,
     int low_effort, int lz77_types_to_try, int cache_bits_max, int do_no_cache,
-    const VP8LHashChain* const hash_chain, VP8LBackwardRefs* const refs,
-    int* const cache_bits_best, const WebPPicture* const pic, int percent_range,
-    int* const percent) {
+    int num_threads, const VP8LHashChain* const hash_chain,
+    VP8LBackwardRefs* const refs, int* const cache_bits_best,
+    const WebPPicture* const pic, int percent_range, int* const percent) {
   if (low_effort) {
     VP8LBackwardRefs* refs_best;
     *cache_bits_best = cache_bits_max;
@@ -1050,12 +1725,81 @@ int VP8LGetBackwardReferences(
     // Set it in first position.
     BackwardRefsSwap(refs_best, &refs[0]);
   } else {
-    if (!GetBackwardReferences(width, height, argb, quality, lz77_types_to_try,
-                               cache_bits_max, do_no_cache, hash_chain, refs,
-                               cache_bits_best)) {
-      return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    VP8LHashChain hash_chain_tree;
+    int ok;
+    memset(&hash_chain_tree, 0, sizeof(hash_chain_tree));
+    if (lz77_types_to_try & kLZ77Tree) {
+      const int tree_percent_range = percent_range / 2;
+      if (!VP8LHashChainInit(&hash_chain_tree, width * height)) {
+        return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      }
+      if (!HashChainFillWithBinaryTrees(&hash_chain_tree, quality, argb, width,
+                                        height, pic, tree_percent_range,
+                                        percent)) {
+        VP8LHashChainClear(&hash_chain_tree);
+        return 0;
+      }
+      percent_range -= tree_percent_range;
     }
+    ok = GetBackwardReferences(
+        width, height, argb, quality, lz77_types_to_try, cache_bits_max,
+        do_no_cache, num_threads, hash_chain,
+        (lz77_types_to_try & kLZ77Tree) ? &hash_chain_tree : NULL, refs,
+        cache_bits_best);
+    VP8LHashChainClear(&hash_chain_tree);
+    if (!ok) return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
   }
 
   return WebPReportProgress(pic, *percent + percent_range, percent);
 }
+
+int VP8LGetBackwardReferencesBand(int xsize, int start, int size,
+                                  const uint32_t* const argb, int quality,
+                                  int low_effort,
+                                  const VP8LHashChain* const hash_chain,
+                                  int* const cache_bits,
+                                  VP8LColorCache* const hashers,
+                                  VP8LBackwardRefs* const refs) {
+  if (!BackwardReferencesLz77FromPos(start, size, argb, /*cache_bits=*/0,
+                                     hash_chain, &refs[0])) {
+    return 0;
+  }
+  if (!low_effort && quality >= 25) {
+    // Trace the band as an image of its own, its matches still reaching
+    // before it.
+    VP8LHashChain band_chain;
+    VP8LHistogram* const histo = VP8LAllocateHistogram(/*cache_bits=*/0);
+    uint64_t bit_cost, bit_cost_trace;
+    if (histo == NULL) return 0;
+    band_chain.offset_length = hash_chain->offset_length + start;
+    band_chain.size = size - start;
+    band_chain.owns_memory = 0;
+    if (!VP8LBackwardReferencesTraceBackwards(
+            xsize, (size - start) / xsize, argb + start, /*cache_bits=*/0,
+            &band_chain, &refs[0], &refs[1])) {
+      VP8LFreeHistogram(histo);
+      return 0;
+    }
+    VP8LHistogramCreate(histo, &refs[0], /*palette_code_bits=*/0);
+    bit_cost = VP8LHistogramEstimateBits(histo);
+    VP8LHistogramCreate(histo, &refs[1], /*palette_code_bits=*/0);
+    bit_cost_trace = VP8LHistogramEstimateBits(histo);
+    VP8LFreeHistogram(histo);
+    if (bit_cost_trace < bit_cost) BackwardRefsSwap(&refs[0], &refs[1]);
+  }
+  if (cache_bits != NULL) {
+    uint64_t bit_costs[2];
+    if (!CalculateBestCacheSize(argb + start, quality, &refs[0], cache_bits,
+                                bit_costs)) {
+      return 0;
+    }
+    if (*cache_bits > 0 && !VP8LColorCacheInit(hashers, *cache_bits)) {
+      return 0;
+    }
+  }
+  if (hashers->colors != NULL) {
+    BackwardRefsApplyCache(argb + start, hashers, &refs[0]);
+  }
+  BackwardReferences2DLocality(xsize, &refs[0]);
+  return !refs[0].error;
+}
@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include "src/utils/color_cache_utils.h"
 #include "src/webp/encode.h"
 #include "src/webp/format_constants.h"
 #include "src/webp/types.h"
@@ -126,15 +127,25 @@ struct VP8LHashChain {
   // This is the maximum size of the hash_chain that can be constructed.
   // Typically this is the pixel count (width x height) for a given image.
   int size;
+  // False if 'offset_length' belongs to the caller of
+  // VP8LHashChainInitWithMemory().
+  int owns_memory;
 };
 
 // Must be called first, to set size.
 int VP8LHashChainInit(VP8LHashChain* const p, int size);
+// Same as VP8LHashChainInit(), except that the 'size' entries of
+// 'offset_length' are taken from 'memory'. The caller keeps ownership of
+// 'memory', which must outlive the hash chain.
+void VP8LHashChainInitWithMemory(VP8LHashChain* const p, uint32_t* memory,
+                                 int size);
 // Pre-compute the best matches for argb. pic and percent are for progress.
+// The work is split over up to 'num_threads' threads, with the same result.
 int VP8LHashChainFill(VP8LHashChain* const p, int quality,
                       const uint32_t* const argb, int xsize, int ysize,
-                      int low_effort, const WebPPicture* const pic,
-                      int percent_range, int* const percent);
+                      int low_effort, int num_threads,
+                      const WebPPicture* const pic, int percent_range,
+                      int* const percent);
 void VP8LHashChainClear(VP8LHashChain* const p);  // release memory
 
 static WEBP_INLINE int VP8LHashChainFindOffset(const VP8LHashChain* const p,
@@ -207,7 +218,12 @@ static WEBP_INLINE void VP8LRefsCursorNext(VP8LRefsCursor* const c) {
 // -----------------------------------------------------------------------------
 // Main entry points
 
-enum VP8LLZ77Type { kLZ77Standard = 1, kLZ77RLE = 2, kLZ77Box = 4 };
+enum VP8LLZ77Type {
+  kLZ77Standard = 1,
+  kLZ77RLE = 2,
+  kLZ77Box = 4,
+  kLZ77Tree = 8  // same as kLZ77Standard with binary trees instead of a chain
+};
 
 // Evaluates best possible backward references for specified quality.
 // The input cache_bits to 'VP8LGetBackwardReferences' sets the maximum cache
@@ -220,14 +236,32 @@ enum VP8LLZ77Type { kLZ77Standard = 1, kLZ77RLE = 2, kLZ77Box = 4 };
 // VP8LBackwardRefs is put in the first element, the best value with no-cache in
 // the second element.
 // In both cases, the last element is used as temporary internally.
+// The LZ77 types are tried with up to 'num_threads' threads, with the same
+// result.
 // pic and percent are for progress.
 // Returns false in case of error (stored in pic->error_code).
 int VP8LGetBackwardReferences(
     int width, int height, const uint32_t* const argb, int quality,
     int low_effort, int lz77_types_to_try, int cache_bits_max, int do_no_cache,
-    const VP8LHashChain* const hash_chain, VP8LBackwardRefs* const refs,
-    int* const cache_bits_best, const WebPPicture* const pic, int percent_range,
-    int* const percent);
+    int num_threads, const VP8LHashChain* const hash_chain,
+    VP8LBackwardRefs* const refs, int* const cache_bits_best,
+    const WebPPicture* const pic, int percent_range, int* const percent);
+
+// Computes the references of the pixels [start, size) of 'argb' into refs[0],
+// refs[1] being a temporary. The matches found by 'hash_chain' may point
+// before 'start', which allows coding an image band by band. Unless
+// 'low_effort', they are refined with TraceBackwards. If 'cache_bits' is not
+// NULL, the best color cache size up to *cache_bits is evaluated on the band
+// and stored in *cache_bits, and 'hashers' is initialized with it unless it is
+// 0. If 'hashers' holds a color cache, it is applied to the references,
+// starting from its current state. Returns false in case of memory error.
+int VP8LGetBackwardReferencesBand(int xsize, int start, int size,
+                                  const uint32_t* const argb, int quality,
+                                  int low_effort,
+                                  const VP8LHashChain* const hash_chain,
+                                  int* const cache_bits,
+                                  VP8LColorCache* const hashers,
+                                  VP8LBackwardRefs* const refs);
 
 #ifdef __cplusplus
 }
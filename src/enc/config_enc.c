@@ -102,7 +102,9 @@ int WebPValidateConfig(const WebPConfig* config) {
   if (config->quality < 0 || config->quality > 100) return 0;
   if (config->target_size < 0) return 0;
   if (config->target_PSNR < 0) return 0;
-  if (config->method < 0 || config->method > 6) return 0;
+  if (config->method < (config->lossless ? -1 : 0) || config->method > 6) {
+    return 0;
+  }
   if (config->segments < 1 || config->segments > 4) return 0;
   if (config->sns_strength < 0 || config->sns_strength > 100) return 0;
   if (config->filter_strength < 0 || config->filter_strength > 100) return 0;
@@ -124,7 +126,7 @@ int WebPValidateConfig(const WebPConfig* config) {
   if (config->near_lossless < 0 || config->near_lossless > 100) return 0;
   if (config->image_hint >= WEBP_HINT_LAST) return 0;
   if (config->emulate_jpeg_size < 0 || config->emulate_jpeg_size > 1) return 0;
-  if (config->thread_level < 0 || config->thread_level > 1) return 0;
+  if (config->thread_level < 0) return 0;
   if (config->low_memory < 0 || config->low_memory > 1) return 0;
   if (config->exact < 0 || config->exact > 1) return 0;
   if (config->use_sharp_yuv < 0 || config->use_sharp_yuv > 1) return 0;
@@ -145,8 +147,13 @@ static const struct {
                                      {5, 90}, {6, 100}};
 
 int WebPConfigLosslessPreset(WebPConfig* config, int level) {
-  if (config == NULL || level < 0 || level > MAX_LEVEL) return 0;
+  if (config == NULL || level < -1 || level > MAX_LEVEL) return 0;
   config->lossless = 1;
+  if (level < 0) {  // Real-time mode.
+    config->method = -1;
+    config->quality = 0;
+    return 1;
+  }
   config->method = kLosslessPresets[level].method;
   config->quality = kLosslessPresets[level].quality;
   return 1;
@@ -412,8 +412,17 @@ static void RecordResiduals(VP8EncIterator* const it,
 
 #if !defined(DISABLE_TOKEN_BUFFER)
 
+// Same as VP8InitResidual(), but with the statistics recorded into 'stats'.
+static void InitTokenResidual(int first, int coeff_type,
+                              StatsArray (*const stats)[NUM_BANDS],
+                              VP8Encoder* const enc, VP8Residual* const res) {
+  VP8InitResidual(first, coeff_type, enc, res);
+  res->stats = stats[coeff_type];
+}
+
 static int RecordTokens(VP8EncIterator* const it, const VP8ModeScore* const rd,
-                        VP8TBuffer* const tokens) {
+                        VP8TBuffer* const tokens,
+                        StatsArray (*const stats)[NUM_BANDS]) {
   int x, y, ch;
   VP8Residual res;
   VP8Encoder* const enc = it->enc;
@@ -421,12 +430,12 @@ static int RecordTokens(VP8EncIterator* const it, const VP8ModeScore* const rd,
   VP8IteratorNzToBytes(it);
   if (it->mb->type == 1) {  // i16x16
     const int ctx = it->top_nz[8] + it->left_nz[8];
-    VP8InitResidual(0, 1, enc, &res);
+    InitTokenResidual(0, 1, stats, enc, &res);
     VP8SetResidualCoeffs(rd->y_dc_levels, &res);
     it->top_nz[8] = it->left_nz[8] = VP8RecordCoeffTokens(ctx, &res, tokens);
-    VP8InitResidual(1, 0, enc, &res);
+    InitTokenResidual(1, 0, stats, enc, &res);
   } else {
-    VP8InitResidual(0, 3, enc, &res);
+    InitTokenResidual(0, 3, stats, enc, &res);
   }
 
   // luma-AC
@@ -439,7 +448,7 @@ static int RecordTokens(VP8EncIterator* const it, const VP8ModeScore* const rd,
   }
 
   // U/V
-  VP8InitResidual(0, 2, enc, &res);
+  InitTokenResidual(0, 2, stats, enc, &res);
   for (ch = 0; ch <= 2; ch += 2) {
     for (y = 0; y < 2; ++y) {
       for (x = 0; x < 2; ++x) {
@@ -479,27 +488,28 @@ static void ResetSSE(VP8Encoder* const enc) {
   enc->sse_count = 0;
 }
 
-static void StoreSSE(const VP8EncIterator* const it) {
-  VP8Encoder* const enc = it->enc;
+static void StoreSSE(VP8EncIterator* const it) {
   const uint8_t* const in = it->yuv_in;
   const uint8_t* const out = it->yuv_out;
   // Note: not totally accurate at boundary. And doesn't include in-loop filter.
-  enc->sse[0] += VP8SSE16x16(in + Y_OFF_ENC, out + Y_OFF_ENC);
-  enc->sse[1] += VP8SSE8x8(in + U_OFF_ENC, out + U_OFF_ENC);
-  enc->sse[2] += VP8SSE8x8(in + V_OFF_ENC, out + V_OFF_ENC);
-  enc->sse_count += 16 * 16;
+  it->sse[0] += VP8SSE16x16(in + Y_OFF_ENC, out + Y_OFF_ENC);
+  it->sse[1] += VP8SSE8x8(in + U_OFF_ENC, out + U_OFF_ENC);
+  it->sse[2] += VP8SSE8x8(in + V_OFF_ENC, out + V_OFF_ENC);
+  it->sse_count += 16 * 16;
 }
 
-static void StoreSideInfo(const VP8EncIterator* const it) {
+// The counters are accumulated in the iterator, and stored into 'enc' by
+// PostLoopFinalize().
+static void StoreSideInfo(VP8EncIterator* const it) {
   VP8Encoder* const enc = it->enc;
   const VP8MBInfo* const mb = it->mb;
   WebPPicture* const pic = enc->pic;
 
   if (pic->stats != NULL) {
     StoreSSE(it);
-    enc->block_count[0] += (mb->type == 0);
-    enc->block_count[1] += (mb->type == 1);
-    enc->block_count[2] += (mb->skip != 0);
+    it->block_count[0] += (mb->type == 0);
+    it->block_count[1] += (mb->type == 1);
+    it->block_count[2] += (mb->skip != 0);
   }
 
   if (pic->extra_info != NULL) {
@@ -540,17 +550,9 @@ static void StoreSideInfo(const VP8EncIterator* const it) {
 #endif
 }
 
-static void ResetSideInfo(const VP8EncIterator* const it) {
-  VP8Encoder* const enc = it->enc;
-  WebPPicture* const pic = enc->pic;
-  if (pic->stats != NULL) {
-    memset(enc->block_count, 0, sizeof(enc->block_count));
-  }
-  ResetSSE(enc);
-}
 #else   // defined(WEBP_DISABLE_STATS)
 static void ResetSSE(VP8Encoder* const enc) { (void)enc; }
-static void StoreSideInfo(const VP8EncIterator* const it) {
+static void StoreSideInfo(VP8EncIterator* const it) {
   VP8Encoder* const enc = it->enc;
   WebPPicture* const pic = enc->pic;
   if (pic->extra_info != NULL) {
@@ -560,8 +562,6 @@ static void StoreSideInfo(const VP8EncIterator* const it) {
     }
   }
 }
-
-static void ResetSideInfo(const VP8EncIterator* const it) { (void)it; }
 #endif  // !defined(WEBP_DISABLE_STATS)
 
 static double GetPSNR(uint64_t mse, uint64_t size) {
@@ -724,7 +724,10 @@ static int PostLoopFinalize(VP8EncIterator* const it, int ok) {
         for (s = 0; s < NUM_MB_SEGMENTS; ++s) {
           enc->residual_bytes[i][s] = (int)((it->bit_count[s][i] + 7) >> 3);
         }
+        enc->sse[i] = it->sse[i];
+        enc->block_count[i] = it->block_count[i];
       }
+      enc->sse_count = it->sse_count;
     }
 #endif
     VP8AdjustFilterStrength(it);  // ...and store filter stats.
@@ -792,6 +795,225 @@ int VP8EncLoop(VP8Encoder* const enc) {
 
 #define MIN_COUNT 96  // minimum number of macroblocks before updating stats
 
+//------------------------------------------------------------------------------
+// Multi-threaded token loop.
+//
+// The macroblock rows are dispatched in a round-robin fashion to the workers
+// and coded as a wavefront: row N+1 trails row N by two macroblocks, because
+// of the top-right samples used by intra4x4 prediction. Each worker records
+// the tokens and statistics of its current row separately, and merges them
+// into the encoder's ones once the previous row is merged, i.e. in row order.
+// The probabilities and costs are refreshed between groups of rows, when the
+// workers are idle, so that the output doesn't depend on the number of threads.
+
+typedef struct {
+  VP8EncIterator it;                       // iterator for the assigned rows
+  VP8TBuffer tokens;                       // tokens of the current row
+  StatsArray stats[NUM_TYPES][NUM_BANDS];  // token statistics of the row
+  LFStats lf_stats;                        // filter statistics of the row
+  uint64_t size_p0;                        // accumulated for the current pass
+  uint64_t distortion;                     // accumulated for the current pass
+  int ok;                                  // false in case of memory error
+  WebPWorker worker;
+  // Number of macroblocks of the current row that are coded, offset by
+  // 'base + y * (mb_w + 1)' so that it stays monotonic. The row is merged
+  // when it reaches 'base + (y + 1) * (mb_w + 1)'.
+  WebPCounter progress;
+} RowWorker;
+
+typedef struct {
+  VP8Encoder* enc;
+  RowWorker* workers;
+  int num_workers;
+  VP8RDLevel rd_opt;
+  int is_last_pass;
+  int y_start, y_end;  // rows of the current group
+  int base;            // offset of the progress counters for the current pass
+} Wavefront;
+
+// Adds the 'src' statistics to 'dst', halving them as VP8RecordStats() does
+// in case of overflow.
+static void MergeTokenStats(proba_t* const dst, const proba_t* const src,
+                            int size) {
+  int i;
+  for (i = 0; i < size; ++i) {
+    uint32_t nb = (dst[i] & 0xffffu) + (src[i] & 0xffffu);
+    uint32_t total = (dst[i] >> 16) + (src[i] >> 16);
+    while (total >= 0xfffeu) {
+      nb = (nb + 1) >> 1;
+      total = (total + 1) >> 1;
+    }
+    dst[i] = (total << 16) | nb;
+  }
+}
+
+static int MergeRow(const Wavefront* const wf, RowWorker* const w) {
+  VP8Encoder* const enc = wf->enc;
+  if (wf->is_last_pass && w->it.lf_stats != NULL) {
+    int s, i;
+    for (s = 0; s < NUM_MB_SEGMENTS; ++s) {
+      for (i = 0; i < MAX_LF_LEVELS; ++i) {
+        (*enc->lf_stats)[s][i] += w->lf_stats[s][i];
+      }
+    }
+  }
+  MergeTokenStats(&enc->proba.stats[0][0][0][0], &w->stats[0][0][0][0],
+                  sizeof(w->stats) / sizeof(proba_t));
+  return VP8TBufferAppend(&enc->tokens, &w->tokens);
+}
+
+static int CodeRowsHook(void* arg1, void* arg2) {
+  const Wavefront* const wf = (const Wavefront*)arg1;
+  RowWorker* const w = (RowWorker*)arg2;
+  VP8EncIterator* const it = &w->it;
+  const int num_workers = wf->num_workers;
+  const int mb_w = wf->enc->mb_w;
+  const int stride = mb_w + 1;
+  const int id = (int)(w - wf->workers);
+  int y = wf->y_start + (id - wf->y_start % num_workers + num_workers) %
+                            num_workers;
+  for (; y < wf->y_end; y += num_workers) {
+    RowWorker* const prev = &wf->workers[(y + num_workers - 1) % num_workers];
+    const int prev_base = wf->base + (y - 1) * stride;
+    int x;
+    VP8IteratorSetRow(it, y);
+    VP8TBufferReset(&w->tokens);
+    memset(w->stats, 0, sizeof(w->stats));
+    if (it->lf_stats != NULL) memset(w->lf_stats, 0, sizeof(w->lf_stats));
+    for (x = 0; x < mb_w; ++x) {
+      VP8ModeScore info;
+      if (y > 0) {
+        const int needed = (x + 2 < mb_w) ? x + 2 : mb_w;
+        WebPCounterWait(&prev->progress, prev_base + needed);
+      }
+      VP8IteratorImport(it, NULL);
+      VP8Decimate(it, &info, wf->rd_opt);
+      w->ok &= RecordTokens(it, &info, &w->tokens, w->stats);
+      w->size_p0 += info.H;
+      w->distortion += info.D;
+      if (wf->is_last_pass) {
+        StoreSideInfo(it);
+        VP8StoreFilterStats(it);
+        VP8IteratorExport(it);
+      }
+      VP8IteratorSaveBoundary(it);
+      VP8IteratorNext(it);
+      WebPCounterSet(&w->progress, wf->base + y * stride + x + 1);
+    }
+    if (y > 0) WebPCounterWait(&prev->progress, prev_base + stride);
+    if (w->ok) w->ok = MergeRow(wf, w);
+    // Always signal the row as merged, so that the next ones don't block.
+    WebPCounterSet(&w->progress, wf->base + (y + 1) * stride);
+  }
+  return w->ok;
+}
+
+// Sets up the workers, if the wavefront is used (otherwise, num_workers is 0).
+// Returns false in case of memory error.
+static int InitWavefront(VP8Encoder* const enc, Wavefront* const wf) {
+  const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
+  const int num_workers =
+      (enc->num_threads < enc->mb_h) ? enc->num_threads : enc->mb_h;
+  int i;
+  memset(wf, 0, sizeof(*wf));
+  if (num_workers < 2) return 1;
+  wf->workers =
+      (RowWorker*)WebPSafeCalloc((uint64_t)num_workers, sizeof(*wf->workers));
+  if (wf->workers == NULL) {
+    return WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  wf->enc = enc;
+  wf->rd_opt = enc->rd_opt_level;
+  for (i = 0; i < num_workers; ++i) {
+    RowWorker* const w = &wf->workers[i];
+    VP8TBufferInit(&w->tokens, 0);
+    winterface->Init(&w->worker);
+    w->worker.data1 = wf;
+    w->worker.data2 = w;
+    w->worker.hook = CodeRowsHook;
+    wf->num_workers = i + 1;  // for the cleanup, in case of error
+    if (!WebPCounterInit(&w->progress, 0) ||
+        (i > 0 && !winterface->Reset(&w->worker))) {
+      return WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+  }
+  return 1;
+}
+
+static void ClearWavefront(Wavefront* const wf) {
+  int i;
+  for (i = 0; i < wf->num_workers; ++i) {
+    RowWorker* const w = &wf->workers[i];
+    WebPGetWorkerInterface()->End(&w->worker);
+    WebPCounterDelete(&w->progress);
+    VP8TBufferClear(&w->tokens);
+  }
+  WebPSafeFree(wf->workers);
+  wf->workers = NULL;
+  wf->num_workers = 0;
+}
+
+// Codes all the rows, using the wavefront. The statistics are accumulated in
+// 'it', 'size_p0' and 'distortion'.
+static int CodeRowsMT(Wavefront* const wf, VP8EncIterator* const it,
+                      int is_last_pass, int max_count, int percent_delta,
+                      uint64_t* const size_p0, uint64_t* const distortion) {
+  const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
+  VP8Encoder* const enc = wf->enc;
+  const int mb_h = enc->mb_h;
+  const int group_rows = (max_count + enc->mb_w - 1) / enc->mb_w;
+  int ok = 1;
+  int i, y;
+
+  wf->is_last_pass = is_last_pass;
+  for (i = 0; i < wf->num_workers; ++i) {
+    RowWorker* const w = &wf->workers[i];
+    VP8IteratorInit(enc, &w->it);  // note: resets the shared top samples too
+    w->it.lf_stats = (enc->lf_stats != NULL) ? &w->lf_stats : NULL;
+    w->size_p0 = 0;
+    w->distortion = 0;
+    w->ok = 1;
+  }
+  for (y = 0; ok && y < mb_h; y += group_rows) {
+    wf->y_start = y;
+    wf->y_end = (y + group_rows < mb_h) ? y + group_rows : mb_h;
+    if (y > 0) {
+      FinalizeTokenProbas(&enc->proba);
+      VP8CalculateLevelCosts(&enc->proba);  // refresh cost tables for rd-opt
+    }
+    for (i = 1; i < wf->num_workers; ++i) {
+      winterface->Launch(&wf->workers[i].worker);
+    }
+    winterface->Execute(&wf->workers[0].worker);
+    for (i = 0; i < wf->num_workers; ++i) {
+      ok &= winterface->Sync(&wf->workers[i].worker);
+    }
+    if (!ok) {
+      WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    } else if (percent_delta) {
+      ok = WebPReportProgress(
+          enc->pic, it->percent0 + percent_delta * wf->y_end / mb_h,
+          &enc->percent);
+    }
+  }
+  wf->base += mb_h * (enc->mb_w + 1);
+
+  for (i = 0; i < wf->num_workers; ++i) {
+    const VP8EncIterator* const w_it = &wf->workers[i].it;
+    int k;
+    *size_p0 += wf->workers[i].size_p0;
+    *distortion += wf->workers[i].distortion;
+    for (k = 0; k < 3; ++k) {
+      it->sse[k] += w_it->sse[k];
+      it->block_count[k] += w_it->block_count[k];
+    }
+    it->sse_count += w_it->sse_count;
+  }
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+
 int VP8EncTokenLoop(VP8Encoder* const enc) {
   // Roughly refresh the proba eight times per pass
   int max_count = (enc->mb_w * enc->mb_h) >> 3;
@@ -803,11 +1025,18 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
   const VP8RDLevel rd_opt = enc->rd_opt_level;
   const uint64_t pixel_count = (uint64_t)enc->mb_w * enc->mb_h * 384;
   PassStats stats;
+  Wavefront wf;
   int ok;
 
   InitPassStats(enc, &stats);
   ok = PreLoopInitialize(enc);
   if (!ok) return 0;
+  if (!InitWavefront(enc, &wf)) {
+    ClearWavefront(&wf);
+    VP8EncFreeBitWriters(enc);
+    return 0;
+  }
+  if (wf.num_workers > enc->threads_used) enc->threads_used = wf.num_workers;
 
   if (max_count < MIN_COUNT) max_count = MIN_COUNT;
 
@@ -833,31 +1062,36 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
       ResetTokenStats(enc);
       VP8InitFilter(&it);  // don't collect stats until last pass (too costly)
     }
-    VP8TBufferClear(&enc->tokens);
-    do {
-      VP8ModeScore info;
-      VP8IteratorImport(&it, NULL);
-      if (--cnt < 0) {
-        FinalizeTokenProbas(proba);
-        VP8CalculateLevelCosts(proba);  // refresh cost tables for rd-opt
-        cnt = max_count;
-      }
-      VP8Decimate(&it, &info, rd_opt);
-      ok = RecordTokens(&it, &info, &enc->tokens);
-      if (!ok) {
-        WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
-        break;
-      }
-      size_p0 += info.H;
-      distortion += info.D;
-      if (is_last_pass) {
-        StoreSideInfo(&it);
-        VP8StoreFilterStats(&it);
-        VP8IteratorExport(&it);
-        ok = VP8IteratorProgress(&it, pass_progress);
-      }
-      VP8IteratorSaveBoundary(&it);
-    } while (ok && VP8IteratorNext(&it));
+    VP8TBufferReset(&enc->tokens);
+    if (wf.num_workers > 0) {
+      ok = CodeRowsMT(&wf, &it, is_last_pass, max_count,
+                      is_last_pass ? pass_progress : 0, &size_p0, &distortion);
+    } else {
+      do {
+        VP8ModeScore info;
+        VP8IteratorImport(&it, NULL);
+        if (--cnt < 0) {
+          FinalizeTokenProbas(proba);
+          VP8CalculateLevelCosts(proba);  // refresh cost tables for rd-opt
+          cnt = max_count;
+        }
+        VP8Decimate(&it, &info, rd_opt);
+        ok = RecordTokens(&it, &info, &enc->tokens, proba->stats);
+        if (!ok) {
+          WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+          break;
+        }
+        size_p0 += info.H;
+        distortion += info.D;
+        if (is_last_pass) {
+          StoreSideInfo(&it);
+          VP8StoreFilterStats(&it);
+          VP8IteratorExport(&it);
+          ok = VP8IteratorProgress(&it, pass_progress);
+        }
+        VP8IteratorSaveBoundary(&it);
+      } while (ok && VP8IteratorNext(&it));
+    }
     if (!ok) break;
 
     size_p0 += enc->segment_hdr.size;
@@ -881,10 +1115,7 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
     if (enc->max_i4_header_bits > 0 && size_p0 > PARTITION0_SIZE_LIMIT) {
       ++num_pass_left;
       enc->max_i4_header_bits >>= 1;  // strengthen header bit limitation...
-      if (is_last_pass) {
-        ResetSideInfo(&it);
-      }
-      continue;  // ...and start over
+      continue;                       // ...and start over
     }
     if (is_last_pass) {
       break;  // done
@@ -897,11 +1128,13 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
     if (!stats.do_size_search) {
       FinalizeTokenProbas(&enc->proba);
     }
+    // The token pages are kept for the next picture if there is a context.
     ok = VP8EmitTokens(&enc->tokens, enc->parts + 0,
-                       (const uint8_t*)proba->coeffs, 1);
+                       (const uint8_t*)proba->coeffs, enc->context == NULL);
   }
   ok = ok && WebPReportProgress(enc->pic, enc->percent + remaining_progress,
                                 &enc->percent);
+  ClearWavefront(&wf);
   return PostLoopFinalize(&it, ok);
 }
 
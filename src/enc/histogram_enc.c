@@ -22,6 +22,7 @@
 #include "src/enc/backward_references_enc.h"
 #include "src/enc/histogram_enc.h"
 #include "src/enc/vp8i_enc.h"
+#include "src/utils/thread_utils.h"
 #include "src/utils/utils.h"
 #include "src/webp/encode.h"
 #include "src/webp/format_constants.h"
@@ -607,16 +608,14 @@ static int GetHistoBinIndex(const VP8LHistogram* const h,
   return bin_id;
 }
 
-// Construct the histograms from backward references.
-static void HistogramBuild(int xsize, int histo_bits,
-                           const VP8LBackwardRefs* const backward_refs,
-                           VP8LHistogramSet* const image_histo) {
-  int x = 0, y = 0;
+void VP8LHistogramAddRefsToTiles(int xsize, int y, int histo_bits,
+                                 const VP8LBackwardRefs* const backward_refs,
+                                 VP8LHistogramSet* const image_histo) {
+  int x = 0;
   const int histo_xsize = VP8LSubSampleSize(xsize, histo_bits);
   VP8LHistogram** const histograms = image_histo->histograms;
   VP8LRefsCursor c = VP8LRefsCursorInit(backward_refs);
   assert(histo_bits > 0);
-  VP8LHistogramSetClear(image_histo);
   while (VP8LRefsCursorOk(&c)) {
     const PixOrCopy* const v = c.cur_pos;
     const int ix = (y >> histo_bits) * histo_xsize + (x >> histo_bits);
@@ -630,6 +629,15 @@ static void HistogramBuild(int xsize, int histo_bits,
   }
 }
 
+// Construct the histograms from backward references.
+static void HistogramBuild(int xsize, int histo_bits,
+                           const VP8LBackwardRefs* const backward_refs,
+                           VP8LHistogramSet* const image_histo) {
+  VP8LHistogramSetClear(image_histo);
+  VP8LHistogramAddRefsToTiles(xsize, /*y=*/0, histo_bits, backward_refs,
+                              image_histo);
+}
+
 // Copies the histograms and computes its bit_cost.
 static void HistogramCopyAndAnalyze(VP8LHistogramSet* const orig_histo,
                                     VP8LHistogramSet* const image_histo) {
@@ -859,102 +867,232 @@ WEBP_NODISCARD static int HistoQueueUpdatePair(const VP8LHistogram* const h1,
   return 1;
 }
 
-// Create a pair from indices "idx1" and "idx2" provided its cost
-// is inferior to "threshold", a negative entropy.
-// It returns the cost of the pair, or 0 if it superior to threshold.
-static int64_t HistoQueuePush(HistoQueue* const histo_queue,
-                              VP8LHistogram** const histograms, int idx1,
-                              int idx2, int64_t threshold) {
-  const VP8LHistogram* h1;
-  const VP8LHistogram* h2;
-  HistogramPair pair;
+// Adds a pair evaluated by HistoQueueUpdatePair() to the queue, which should
+// not be full.
+static void HistoQueuePush(HistoQueue* const histo_queue,
+                           const HistogramPair* const pair) {
+  assert(pair->cost_diff < 0);
+  assert(histo_queue->size < histo_queue->max_size);
+  histo_queue->queue[histo_queue->size++] = *pair;
+  HistoQueueUpdateHead(histo_queue, &histo_queue->queue[histo_queue->size - 1]);
+}
 
-  // Stop here if the queue is full.
-  if (histo_queue->size == histo_queue->max_size) return 0;
-  assert(threshold <= 0);
-  if (idx1 > idx2) {
-    const int tmp = idx2;
-    idx2 = idx1;
-    idx1 = tmp;
+// Pairs whose cost diffs are evaluated in parallel.
+typedef struct {
+  VP8LHistogram** histograms;
+  HistogramPair* pairs;
+  int64_t threshold;  // same as for HistoQueueUpdatePair()
+} PairEvaluation;
+
+static int EvaluatePairHook(void* data, int index) {
+  const PairEvaluation* const e = (const PairEvaluation*)data;
+  HistogramPair* const pair = &e->pairs[index];
+  if (!HistoQueueUpdatePair(e->histograms[pair->idx1],
+                            e->histograms[pair->idx2], e->threshold, pair)) {
+    pair->cost_diff = 0;
   }
-  pair.idx1 = idx1;
-  pair.idx2 = idx2;
-  h1 = histograms[idx1];
-  h2 = histograms[idx2];
+  return 1;
+}
 
-  // Do not even consider the pair if it does not improve the entropy.
-  if (!HistoQueueUpdatePair(h1, h2, threshold, &pair)) return 0;
+// Computes the cost diff and combo of the 'num_pairs' 'pairs' with up to
+// 'num_threads' threads. The cost diff of a pair is set to 0 if it is not less
+// than 'threshold', which should not be positive.
+static void EvaluatePairs(VP8LHistogram** const histograms,
+                          HistogramPair* const pairs, int num_pairs,
+                          int64_t threshold, int num_threads) {
+  PairEvaluation e;
+  int ok;
+  assert(threshold <= 0);
+  e.histograms = histograms;
+  e.pairs = pairs;
+  e.threshold = threshold;
+  ok = WebPParallelFor(num_pairs, num_threads, EvaluatePairHook, &e);
+  assert(ok);  // the hook cannot fail
+  (void)ok;
+}
 
-  histo_queue->queue[histo_queue->size++] = pair;
-  HistoQueueUpdateHead(histo_queue, &histo_queue->queue[histo_queue->size - 1]);
+// -----------------------------------------------------------------------------
+// Histogram pairs heap
+
+// Pair of histograms referred to by stable ids, with the versions the
+// histograms had when the pair was evaluated.
+typedef struct {
+  HistogramPair pair;
+  int version1;
+  int version2;
+} HistoHeapItem;
+
+// Binary min-heap of pairs on their cost diff. When a histogram changes, its
+// version is incremented: its pairs are not removed right away, but discarded
+// once they reach the top.
+typedef struct {
+  HistoHeapItem* items;
+  int size;
+  int max_size;
+} HistoHeap;
 
-  return pair.cost_diff;
+static int HistoHeapInit(HistoHeap* const heap, int max_size) {
+  heap->size = 0;
+  heap->max_size = max_size;
+  heap->items = (HistoHeapItem*)WebPSafeMalloc(max_size, sizeof(*heap->items));
+  return heap->items != NULL;
+}
+
+static void HistoHeapClear(HistoHeap* const heap) {
+  WebPSafeFree(heap->items);
+  heap->size = 0;
+  heap->max_size = 0;
+}
+
+// Ties are broken on the ids so that the order does not depend on the heap
+// layout.
+static WEBP_INLINE int HistoHeapLess(const HistoHeapItem* const a,
+                                     const HistoHeapItem* const b) {
+  if (a->pair.cost_diff != b->pair.cost_diff) {
+    return a->pair.cost_diff < b->pair.cost_diff;
+  }
+  if (a->pair.idx1 != b->pair.idx1) return a->pair.idx1 < b->pair.idx1;
+  return a->pair.idx2 < b->pair.idx2;
+}
+
+static void HistoHeapPush(HistoHeap* const heap,
+                          const HistoHeapItem* const item) {
+  int i = heap->size++;
+  assert(heap->size <= heap->max_size);
+  while (i > 0) {
+    const int parent = (i - 1) >> 1;
+    if (!HistoHeapLess(item, &heap->items[parent])) break;
+    heap->items[i] = heap->items[parent];
+    i = parent;
+  }
+  heap->items[i] = *item;
+}
+
+static void HistoHeapPop(HistoHeap* const heap, HistoHeapItem* const top) {
+  const HistoHeapItem* last;
+  int i = 0;
+  assert(heap->size > 0);
+  *top = heap->items[0];
+  last = &heap->items[--heap->size];
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= heap->size) break;
+    if (child + 1 < heap->size &&
+        HistoHeapLess(&heap->items[child + 1], &heap->items[child])) {
+      ++child;
+    }
+    if (!HistoHeapLess(&heap->items[child], last)) break;
+    heap->items[i] = heap->items[child];
+    i = child;
+  }
+  heap->items[i] = *last;
 }
 
 // -----------------------------------------------------------------------------
 
 // Combines histograms by continuously choosing the one with the highest cost
 // reduction.
-static int HistogramCombineGreedy(VP8LHistogramSet* const image_histo) {
+static int HistogramCombineGreedy(VP8LHistogramSet* const image_histo,
+                                  int num_threads) {
   int ok = 0;
   const int image_histo_size = image_histo->size;
-  int i, j;
+  int i, j, num_pairs;
   VP8LHistogram** const histograms = image_histo->histograms;
-  // Priority queue of histogram pairs.
-  HistoQueue histo_queue;
-
-  // image_histo_size^2 for the queue size is safe. If you look at
-  // HistogramCombineGreedy, and imagine that UpdateQueueFront always pushes
-  // data to the queue, you insert at most:
-  // - image_histo_size*(image_histo_size-1)/2 (the first two for loops)
-  // - image_histo_size - 1 in the last for loop at the first iteration of
-  //   the while loop, image_histo_size - 2 at the second iteration ...
-  //   therefore image_histo_size*(image_histo_size-1)/2 overall too
-  if (!HistoQueueInit(&histo_queue, image_histo_size * image_histo_size)) {
+  // The histograms move when one is removed from 'image_histo': the pairs refer
+  // to them by id. The histogram 'id' is in the slot 'slots[id]', and
+  // 'ids[slot]' is the reverse mapping.
+  int* const ids =
+      (int*)WebPSafeMalloc(3 * (uint64_t)image_histo_size, sizeof(*ids));
+  int* const slots = ids + image_histo_size;
+  int* const versions = slots + image_histo_size;
+  // Pairs being evaluated, of slots.
+  HistogramPair* const pairs = (HistogramPair*)WebPSafeMalloc(
+      (uint64_t)image_histo_size * image_histo_size / 2 + 1, sizeof(*pairs));
+  HistoHeap heap;
+
+  // Each pair is evaluated once: there are at most
+  // image_histo_size*(image_histo_size-1)/2 pairs at the beginning, and
+  // image_histo_size-1 more after each of the image_histo_size-1 merges.
+  if (!HistoHeapInit(&heap, image_histo_size * image_histo_size) ||
+      ids == NULL || pairs == NULL) {
     goto End;
   }
+  for (i = 0; i < image_histo_size; ++i) {
+    ids[i] = slots[i] = i;
+    versions[i] = 0;
+  }
 
-  // Initialize the queue.
+  // Initialize the heap.
+  num_pairs = 0;
   for (i = 0; i < image_histo_size; ++i) {
     for (j = i + 1; j < image_histo_size; ++j) {
-      HistoQueuePush(&histo_queue, histograms, i, j, 0);
+      pairs[num_pairs].idx1 = i;
+      pairs[num_pairs].idx2 = j;
+      ++num_pairs;
     }
   }
 
-  while (histo_queue.size > 0) {
-    const int idx1 = histo_queue.queue[0].idx1;
-    const int idx2 = histo_queue.queue[0].idx2;
-    HistogramAdd(histograms[idx2], histograms[idx1], histograms[idx1]);
-    UpdateHistogramCost(histo_queue.queue[0].cost_combo,
-                        histo_queue.queue[0].costs, histograms[idx1]);
-
-    // Remove merged histogram.
-    HistogramSetRemoveHistogram(image_histo, idx2);
+  for (;;) {
+    HistoHeapItem top;
+    int slot1, slot2, last_id;
+    // Push the pairs that improve the entropy. They are evaluated in parallel
+    // but pushed in order.
+    EvaluatePairs(histograms, pairs, num_pairs, 0, num_threads);
+    for (i = 0; i < num_pairs; ++i) {
+      HistoHeapItem item;
+      if (pairs[i].cost_diff >= 0) continue;
+      item.pair = pairs[i];
+      item.pair.idx1 = ids[pairs[i].idx1];
+      item.pair.idx2 = ids[pairs[i].idx2];
+      item.version1 = versions[item.pair.idx1];
+      item.version2 = versions[item.pair.idx2];
+      HistoHeapPush(&heap, &item);
+    }
 
-    // Remove pairs intersecting the just combined best pair.
-    for (i = 0; i < histo_queue.size;) {
-      HistogramPair* const p = histo_queue.queue + i;
-      if (p->idx1 == idx1 || p->idx2 == idx1 || p->idx1 == idx2 ||
-          p->idx2 == idx2) {
-        HistoQueuePopPair(&histo_queue, p);
-      } else {
-        HistoQueueFixPair(image_histo->size, idx2, p);
-        HistoQueueUpdateHead(&histo_queue, p);
-        ++i;
+    // Find the best valid pair.
+    do {
+      if (heap.size == 0) {
+        ok = 1;
+        goto End;
       }
+      HistoHeapPop(&heap, &top);
+    } while (top.version1 != versions[top.pair.idx1] ||
+             top.version2 != versions[top.pair.idx2]);
+
+    // Merge the histogram in the highest slot into the other one.
+    slot1 = slots[top.pair.idx1];
+    slot2 = slots[top.pair.idx2];
+    if (slot1 > slot2) {
+      const int tmp = slot1;
+      slot1 = slot2;
+      slot2 = tmp;
     }
+    HistogramAdd(histograms[slot2], histograms[slot1], histograms[slot1]);
+    UpdateHistogramCost(top.pair.cost_combo, top.pair.costs,
+                        histograms[slot1]);
+    ++versions[ids[slot1]];
+    ++versions[ids[slot2]];
 
-    // Push new pairs formed with combined histogram to the queue.
+    // Remove merged histogram.
+    last_id = ids[image_histo->size - 1];
+    HistogramSetRemoveHistogram(image_histo, slot2);
+    ids[slot2] = last_id;
+    slots[last_id] = slot2;
+
+    // Evaluate the new pairs formed with the combined histogram.
+    num_pairs = 0;
     for (i = 0; i < image_histo->size; ++i) {
-      if (i == idx1) continue;
-      HistoQueuePush(&histo_queue, image_histo->histograms, idx1, i, 0);
+      if (i == slot1) continue;
+      pairs[num_pairs].idx1 = (i < slot1) ? i : slot1;
+      pairs[num_pairs].idx2 = (i < slot1) ? slot1 : i;
+      ++num_pairs;
     }
   }
 
-  ok = 1;
-
 End:
-  HistoQueueClear(&histo_queue);
+  HistoHeapClear(&heap);
+  WebPSafeFree(pairs);
+  WebPSafeFree(ids);
   return ok;
 }
 
@@ -962,7 +1100,7 @@ End:
 // 'do_greedy' is set to 1 if a greedy approach needs to be performed
 // afterwards, 0 otherwise.
 static int HistogramCombineStochastic(VP8LHistogramSet* const image_histo,
-                                      int min_cluster_size,
+                                      int min_cluster_size, int num_threads,
                                       int* const do_greedy) {
   int j, iter;
   uint32_t seed = 1;
@@ -975,14 +1113,29 @@ static int HistogramCombineStochastic(VP8LHistogramSet* const image_histo,
   // faster but the worse for the compression.
   HistoQueue histo_queue;
   const int kHistoQueueSize = 9;
+  // The random samples are evaluated by batches, in parallel. The batches
+  // start with one sample per thread and grow up to 'max_batch_size', so that
+  // few evaluations are lost when the queue gets full. A single thread
+  // evaluates them one at a time, against the lowest threshold.
+  const int max_batch_size = (num_threads > 1) ? 16 * num_threads : 1;
+  HistogramPair* const samples =
+      (HistogramPair*)WebPSafeMalloc(max_batch_size, sizeof(*samples));
+  // Seed after picking each sample.
+  uint32_t* const sample_seeds =
+      (uint32_t*)WebPSafeMalloc(max_batch_size, sizeof(*sample_seeds));
   int ok = 0;
 
+  histo_queue.queue = NULL;
   if (image_histo->size < min_cluster_size) {
     *do_greedy = 1;
-    return 1;
+    ok = 1;
+    goto End;
   }
 
-  if (!HistoQueueInit(&histo_queue, kHistoQueueSize)) goto End;
+  if (samples == NULL || sample_seeds == NULL ||
+      !HistoQueueInit(&histo_queue, kHistoQueueSize)) {
+    goto End;
+  }
 
   // Collapse similar histograms in 'image_histo'.
   for (iter = 0; iter < outer_iters && image_histo->size >= min_cluster_size &&
@@ -996,22 +1149,43 @@ static int HistogramCombineStochastic(VP8LHistogramSet* const image_histo,
     // worse compression.
     const int num_tries = (image_histo->size) / 2;
 
-    // Pick random samples.
-    for (j = 0; image_histo->size >= 2 && j < num_tries; ++j) {
-      int64_t curr_cost;
-      // Choose two different histograms at random and try to combine them.
-      const uint32_t tmp = MyRand(&seed) % rand_range;
-      uint32_t idx1 = tmp / (image_histo->size - 1);
-      uint32_t idx2 = tmp % (image_histo->size - 1);
-      if (idx2 >= idx1) ++idx2;
+    // Pick random samples. The samples of a batch are evaluated against the
+    // best cost at the start of the batch, which is not lower than when they
+    // are pushed: the result is the same as with one sample at a time.
+    int batch_size = num_threads;
+    int is_queue_full = 0;
+    for (j = 0; image_histo->size >= 2 && j < num_tries && !is_queue_full;
+         j += batch_size) {
+      int k;
+      if (j > 0 && batch_size < max_batch_size) batch_size *= 2;
+      if (batch_size > num_tries - j) batch_size = num_tries - j;
+      for (k = 0; k < batch_size; ++k) {
+        // Choose two different histograms at random and try to combine them.
+        const uint32_t tmp = MyRand(&seed) % rand_range;
+        const int idx1 = (int)(tmp / (image_histo->size - 1));
+        int idx2 = (int)(tmp % (image_histo->size - 1));
+        if (idx2 >= idx1) ++idx2;
+        samples[k].idx1 = (idx1 < idx2) ? idx1 : idx2;
+        samples[k].idx2 = (idx1 < idx2) ? idx2 : idx1;
+        sample_seeds[k] = seed;
+      }
 
       // Calculate cost reduction on combination.
-      curr_cost =
-          HistoQueuePush(&histo_queue, histograms, idx1, idx2, best_cost);
-      if (curr_cost < 0) {  // found a better pair?
-        best_cost = curr_cost;
-        // Empty the queue if we reached full capacity.
-        if (histo_queue.size == histo_queue.max_size) break;
+      EvaluatePairs(histograms, samples, batch_size, best_cost, num_threads);
+      for (k = 0; k < batch_size; ++k) {
+        // Found a better pair?
+        if (samples[k].cost_diff < best_cost &&
+            histo_queue.size < histo_queue.max_size) {
+          best_cost = samples[k].cost_diff;
+          HistoQueuePush(&histo_queue, &samples[k]);
+          // Empty the queue if we reached full capacity.
+          if (histo_queue.size == histo_queue.max_size) {
+            // The next samples were not picked.
+            seed = sample_seeds[k];
+            is_queue_full = 1;
+            break;
+          }
+        }
       }
     }
     if (histo_queue.size == 0) continue;
@@ -1060,42 +1234,90 @@ static int HistogramCombineStochastic(VP8LHistogramSet* const image_histo,
 
 End:
   HistoQueueClear(&histo_queue);
+  WebPSafeFree(sample_seeds);
+  WebPSafeFree(samples);
   return ok;
 }
 
 // -----------------------------------------------------------------------------
 // Histogram refinement
 
+// Number of consecutive 'in' histograms remapped by a thread at once.
+#define REMAP_CHUNK_SIZE 64
+
+typedef struct {
+  const VP8LHistogramSet* in;
+  const VP8LHistogramSet* out;
+  uint32_t* symbols;
+} HistogramRemapper;
+
+// Finds the best 'out' histogram for the 'in' histograms of a chunk. The 'out'
+// histogram chosen for the previous one is tried first, as neighbors are
+// usually alike: the others can then bail out early. The result is the same as
+// trying them in order: the first one of lowest cost.
+static int RemapChunkHook(void* data, int chunk) {
+  const HistogramRemapper* const r = (const HistogramRemapper*)data;
+  VP8LHistogram** const in_histo = r->in->histograms;
+  VP8LHistogram** const out_histo = r->out->histograms;
+  const int out_size = r->out->size;
+  const int start = chunk * REMAP_CHUNK_SIZE;
+  const int end = (start + REMAP_CHUNK_SIZE < r->out->max_size)
+                      ? start + REMAP_CHUNK_SIZE
+                      : r->out->max_size;
+  int guess = 0;
+  int i;
+  for (i = start; i < end; ++i) {
+    int best_out = guess;
+    int64_t best_bits = WEBP_INT64_MAX;
+    int k, ok;
+    // Unused histograms are handled once all the chunks are done.
+    if (in_histo[i] == NULL) continue;
+    ok = HistogramAddThresh(out_histo[best_out], in_histo[i], WEBP_INT64_MAX,
+                            &best_bits);
+    assert(ok);  // cannot fail without a threshold
+    (void)ok;
+    for (k = 0; k < out_size; ++k) {
+      int64_t cur_bits;
+      if (k == guess) continue;
+      // On equal costs, the lowest index wins.
+      if (HistogramAddThresh(out_histo[k], in_histo[i],
+                             best_bits + (k < best_out), &cur_bits)) {
+        best_bits = cur_bits;
+        best_out = k;
+      }
+    }
+    r->symbols[i] = best_out;
+    guess = best_out;
+  }
+  return 1;
+}
+
 // Find the best 'out' histogram for each of the 'in' histograms.
 // At call-time, 'out' contains the histograms of the clusters.
 // Note: we assume that out[]->bit_cost is already up-to-date.
 static void HistogramRemap(const VP8LHistogramSet* const in,
                            VP8LHistogramSet* const out,
-                           uint32_t* const symbols) {
+                           uint32_t* const symbols, int num_threads) {
   int i;
   VP8LHistogram** const in_histo = in->histograms;
   VP8LHistogram** const out_histo = out->histograms;
   const int in_size = out->max_size;
   const int out_size = out->size;
   if (out_size > 1) {
+    HistogramRemapper r;
+    int ok;
+    r.in = in;
+    r.out = out;
+    r.symbols = symbols;
+    ok = WebPParallelFor((in_size + REMAP_CHUNK_SIZE - 1) / REMAP_CHUNK_SIZE,
+                         num_threads, RemapChunkHook, &r);
+    assert(ok);  // the hook cannot fail
+    (void)ok;
     for (i = 0; i < in_size; ++i) {
-      int best_out = 0;
-      int64_t best_bits = WEBP_INT64_MAX;
-      int k;
       if (in_histo[i] == NULL) {
         // Arbitrarily set to the previous value if unused to help future LZ77.
         symbols[i] = symbols[i - 1];
-        continue;
       }
-      for (k = 0; k < out_size; ++k) {
-        int64_t cur_bits;
-        if (HistogramAddThresh(out_histo[k], in_histo[i], best_bits,
-                               &cur_bits)) {
-          best_bits = cur_bits;
-          best_out = k;
-        }
-      }
-      symbols[i] = best_out;
     }
   } else {
     assert(out_size == 1);
@@ -1116,6 +1338,8 @@ static void HistogramRemap(const VP8LHistogramSet* const in,
   }
 }
 
+#undef REMAP_CHUNK_SIZE
+
 static int32_t GetCombineCostFactor(int histo_size, int quality) {
   int32_t combine_cost_factor = 16;
   if (quality < 90) {
@@ -1127,33 +1351,21 @@ static int32_t GetCombineCostFactor(int histo_size, int quality) {
   return combine_cost_factor;
 }
 
-int VP8LGetHistoImageSymbols(int xsize, int ysize,
-                             const VP8LBackwardRefs* const refs, int quality,
-                             int low_effort, int histogram_bits, int cache_bits,
-                             VP8LHistogramSet* const image_histo,
-                             VP8LHistogram* const tmp_histo,
-                             uint32_t* const histogram_symbols,
-                             const WebPPicture* const pic, int percent_range,
-                             int* const percent) {
-  const int histo_xsize =
-      histogram_bits ? VP8LSubSampleSize(xsize, histogram_bits) : 1;
-  const int histo_ysize =
-      histogram_bits ? VP8LSubSampleSize(ysize, histogram_bits) : 1;
-  const int image_histo_raw_size = histo_xsize * histo_ysize;
-  VP8LHistogramSet* const orig_histo =
-      VP8LAllocateHistogramSet(image_histo_raw_size, cache_bits);
+int VP8LGetHistoImageSymbolsFromTiles(VP8LHistogramSet* const orig_histo,
+                                      int quality, int low_effort,
+                                      int num_threads,
+                                      VP8LHistogramSet* const image_histo,
+                                      VP8LHistogram* const tmp_histo,
+                                      uint32_t* const histogram_symbols,
+                                      const WebPPicture* const pic,
+                                      int percent_range, int* const percent) {
+  const int image_histo_raw_size = orig_histo->max_size;
   // Don't attempt linear bin-partition heuristic for
   // histograms of small sizes (as bin_map will be very sparse) and
   // maximum quality q==100 (to preserve the compression gains at that level).
   const int entropy_combine_num_bins = low_effort ? NUM_PARTITIONS : BIN_SIZE;
   int entropy_combine;
-  if (orig_histo == NULL) {
-    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    goto Error;
-  }
 
-  // Construct the histograms from backward references.
-  HistogramBuild(xsize, histogram_bits, refs, orig_histo);
   HistogramCopyAndAnalyze(orig_histo, image_histo);
   entropy_combine =
       (image_histo->size > entropy_combine_num_bins * 2) && (quality < 100);
@@ -1176,12 +1388,13 @@ int VP8LGetHistoImageSymbols(int xsize, int ysize,
         (int)(1 + DivRound(quality * quality * quality * (MAX_HISTO_GREEDY - 1),
                            100 * 100 * 100));
     int do_greedy;
-    if (!HistogramCombineStochastic(image_histo, threshold_size, &do_greedy)) {
+    if (!HistogramCombineStochastic(image_histo, threshold_size, num_threads,
+                                    &do_greedy)) {
       WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
       goto Error;
     }
     if (do_greedy) {
-      if (!HistogramCombineGreedy(image_histo)) {
+      if (!HistogramCombineGreedy(image_histo, num_threads)) {
         WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
         goto Error;
       }
@@ -1189,13 +1402,41 @@ int VP8LGetHistoImageSymbols(int xsize, int ysize,
   }
 
   // Find the optimal map from original histograms to the final ones.
-  HistogramRemap(orig_histo, image_histo, histogram_symbols);
+  HistogramRemap(orig_histo, image_histo, histogram_symbols, num_threads);
 
   if (!WebPReportProgress(pic, *percent + percent_range, percent)) {
     goto Error;
   }
 
 Error:
-  VP8LFreeHistogramSet(orig_histo);
   return (pic->error_code == VP8_ENC_OK);
 }
+
+int VP8LGetHistoImageSymbols(int xsize, int ysize,
+                             const VP8LBackwardRefs* const refs, int quality,
+                             int low_effort, int num_threads,
+                             int histogram_bits, int cache_bits,
+                             VP8LHistogramSet* const image_histo,
+                             VP8LHistogram* const tmp_histo,
+                             uint32_t* const histogram_symbols,
+                             const WebPPicture* const pic, int percent_range,
+                             int* const percent) {
+  const int histo_xsize =
+      histogram_bits ? VP8LSubSampleSize(xsize, histogram_bits) : 1;
+  const int histo_ysize =
+      histogram_bits ? VP8LSubSampleSize(ysize, histogram_bits) : 1;
+  const int image_histo_raw_size = histo_xsize * histo_ysize;
+  VP8LHistogramSet* const orig_histo =
+      VP8LAllocateHistogramSet(image_histo_raw_size, cache_bits);
+  int ok;
+  if (orig_histo == NULL) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  // Construct the histograms from backward references.
+  HistogramBuild(xsize, histogram_bits, refs, orig_histo);
+  ok = VP8LGetHistoImageSymbolsFromTiles(
+      orig_histo, quality, low_effort, num_threads, image_histo, tmp_histo,
+      histogram_symbols, pic, percent_range, percent);
+  VP8LFreeHistogramSet(orig_histo);
+  return ok;
+}
@@ -102,17 +102,36 @@ static WEBP_INLINE int VP8LHistogramNumCodes(int palette_code_bits) {
          ((palette_code_bits > 0) ? (1 << palette_code_bits) : 0);
 }
 
-// Builds the histogram image. pic and percent are for progress.
+// Builds the histogram image, with up to 'num_threads' threads. The result
+// does not depend on the number of threads. pic and percent are for progress.
 // Returns false in case of error (stored in pic->error_code).
 int VP8LGetHistoImageSymbols(int xsize, int ysize,
                              const VP8LBackwardRefs* const refs, int quality,
-                             int low_effort, int histogram_bits, int cache_bits,
+                             int low_effort, int num_threads,
+                             int histogram_bits, int cache_bits,
                              VP8LHistogramSet* const image_histo,
                              VP8LHistogram* const tmp_histo,
                              uint32_t* const histogram_symbols,
                              const WebPPicture* const pic, int percent_range,
                              int* const percent);
 
+// Adds the references 'refs' of the rows starting at 'y' to the histograms of
+// their tiles of 'histo_bits' bits in 'image_histo' (without reset).
+void VP8LHistogramAddRefsToTiles(int xsize, int y, int histo_bits,
+                                 const VP8LBackwardRefs* const refs,
+                                 VP8LHistogramSet* const image_histo);
+
+// Same as VP8LGetHistoImageSymbols(), with the histograms of all the tiles
+// already built in 'orig_histo', which is modified.
+int VP8LGetHistoImageSymbolsFromTiles(VP8LHistogramSet* const orig_histo,
+                                      int quality, int low_effort,
+                                      int num_threads,
+                                      VP8LHistogramSet* const image_histo,
+                                      VP8LHistogram* const tmp_histo,
+                                      uint32_t* const histogram_symbols,
+                                      const WebPPicture* const pic,
+                                      int percent_range, int* const percent);
+
 // Returns the entropy for the symbols in the input array.
 uint64_t VP8LBitsEntropy(const uint32_t* const array, int n);
 
@@ -64,6 +64,9 @@ static void VP8IteratorReset(VP8EncIterator* const it) {
   VP8IteratorSetCountDown(it, enc->mb_w * enc->mb_h);  // default
   InitTop(it);
   memset(it->bit_count, 0, sizeof(it->bit_count));
+  memset(it->sse, 0, sizeof(it->sse));
+  it->sse_count = 0;
+  memset(it->block_count, 0, sizeof(it->block_count));
   it->do_trellis = 0;
 }
 
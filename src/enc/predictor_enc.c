@@ -458,11 +458,15 @@ static void ComputeResidualsForTile(
   }
 }
 
-// Converts pixels of the image to residuals with respect to predictions.
+// Converts the pixels of the rows [y_start, y_end) of the image to residuals
+// with respect to predictions. 'argb' starts at row y_start and also holds the
+// following row if any. The row before y_start is read from 'argb_scratch',
+// where the last converted row is left if the image is not finished.
 // If max_quantization > 1, applies near lossless processing, quantizing
 // residuals to multiples of quantization levels up to max_quantization
 // (the actual quantization level depends on smoothness near the given pixel).
-static void CopyImageWithPrediction(int width, int height, int bits,
+static void CopyImageWithPrediction(int width, int height, int y_start,
+                                    int y_end, int bits,
                                     const uint32_t* const modes,
                                     uint32_t* const argb_scratch,
                                     uint32_t* const argb, int low_effort,
@@ -479,18 +483,19 @@ static void CopyImageWithPrediction(int width, int height, int bits,
   uint8_t* lower_max_diffs = current_max_diffs + width;
 #endif
   int y;
+  // The max_diffs are computed one row ahead, from the start of the image.
+  assert(max_quantization == 1 || y_start == 0);
 
-  for (y = 0; y < height; ++y) {
+  for (y = y_start; y < y_end; ++y) {
+    uint32_t* const row = argb + (size_t)(y - y_start) * width;
     int x;
     uint32_t* const tmp32 = upper_row;
     upper_row = current_row;
     current_row = tmp32;
-    memcpy(current_row, argb + y * width,
-           sizeof(*argb) * (width + (y + 1 < height)));
+    memcpy(current_row, row, sizeof(*argb) * (width + (y + 1 < height)));
 
     if (low_effort) {
-      PredictBatch(kPredLowEffort, 0, y, width, current_row, upper_row,
-                   argb + y * width);
+      PredictBatch(kPredLowEffort, 0, y, width, current_row, upper_row, row);
     } else {
 #if (WEBP_NEAR_LOSSLESS == 1)
       if (max_quantization > 1) {
@@ -501,7 +506,7 @@ static void CopyImageWithPrediction(int width, int height, int bits,
         current_max_diffs = lower_max_diffs;
         lower_max_diffs = tmp8;
         if (y + 2 < height) {
-          MaxDiffsForRow(width, width, argb + (y + 1) * width, lower_max_diffs,
+          MaxDiffsForRow(width, width, row + width, lower_max_diffs,
                          used_subtract_green);
         }
       }
@@ -513,11 +518,16 @@ static void CopyImageWithPrediction(int width, int height, int bits,
         if (x_end > width) x_end = width;
         GetResidual(width, height, upper_row, current_row, current_max_diffs,
                     mode, x, x_end, y, max_quantization, exact,
-                    used_subtract_green, argb + y * width + x);
+                    used_subtract_green, row + x);
         x = x_end;
       }
     }
   }
+  // Keep the last row where the first upper_row of the next call is read from.
+  if (y_end < height && current_row != argb_scratch + width + 1) {
+    memcpy(argb_scratch + width + 1, current_row,
+           (width + 1) * sizeof(*argb_scratch));
+  }
 }
 
 // Checks whether 'image' can be subsampled by finding the biggest power of 2
@@ -758,9 +768,6 @@ static void GetBestPredictorsAndSubSampling(
   }
 
   WebPSafeFree(raw_data);
-
-  VP8LOptimizeSampling(*best_mode, width, height, *best_bits,
-                       MAX_TRANSFORM_BITS, best_bits);
 }
 
 // Finds the best predictor for each tile, and converts the image to residuals
@@ -818,14 +825,52 @@ int VP8LResidualImage(int width, int height, int min_bits, int max_bits,
            VP8LSubSampleSize(width, *best_bits) *
                VP8LSubSampleSize(height, *best_bits) * sizeof(*image));
     WebPSafeFree(modes_raw);
+    VP8LOptimizeSampling(image, width, height, *best_bits, MAX_TRANSFORM_BITS,
+                         best_bits);
   }
 
-  CopyImageWithPrediction(width, height, *best_bits, image, argb_scratch, argb,
-                          low_effort, max_quantization, exact,
-                          used_subtract_green);
+  CopyImageWithPrediction(width, height, 0, height, *best_bits, image,
+                          argb_scratch, argb, low_effort, max_quantization,
+                          exact, used_subtract_green);
   return WebPReportProgress(pic, percent_start + percent_range, percent);
 }
 
+int VP8LGetBandPredictors(int width, int height, int bits, int low_effort,
+                          uint32_t* const argb_scratch,
+                          const uint32_t* const argb, int exact,
+                          int used_subtract_green,
+                          const WebPPicture* const pic, uint32_t* const modes) {
+  int percent = 0;
+  int best_bits;
+  uint32_t* best_mode;
+  uint32_t* all_modes[1];
+  if (low_effort) {
+    const int num_tiles =
+        VP8LSubSampleSize(width, bits) * VP8LSubSampleSize(height, bits);
+    int i;
+    for (i = 0; i < num_tiles; ++i) {
+      modes[i] = ARGB_BLACK | (kPredLowEffort << 8);
+    }
+    return 1;
+  }
+  all_modes[0] = modes;
+  GetBestPredictorsAndSubSampling(width, height, bits, bits, argb_scratch,
+                                  argb, /*max_quantization=*/1, exact,
+                                  used_subtract_green, pic,
+                                  /*percent_range=*/0, &percent, all_modes,
+                                  &best_bits, &best_mode);
+  return (best_bits != 0);
+}
+
+void VP8LResidualRows(int width, int height, int y_start, int y_end, int bits,
+                      const uint32_t* const modes, int low_effort,
+                      uint32_t* const argb_scratch, uint32_t* const argb,
+                      int exact, int used_subtract_green) {
+  CopyImageWithPrediction(width, height, y_start, y_end, bits, modes,
+                          argb_scratch, argb, low_effort,
+                          /*max_quantization=*/1, exact, used_subtract_green);
+}
+
 //------------------------------------------------------------------------------
 // Color transform functions.
 
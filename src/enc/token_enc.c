@@ -53,25 +53,68 @@ void VP8TBufferInit(VP8TBuffer* const b, int page_size) {
   b->left = 0;
   b->page_size = (page_size < MIN_PAGE_SIZE) ? MIN_PAGE_SIZE : page_size;
   b->error = 0;
+  b->free_pages = NULL;
+}
+
+static void FreePages(VP8Tokens* p) {
+  while (p != NULL) {
+    VP8Tokens* const next = p->next;
+    WebPSafeFree(p);
+    p = next;
+  }
 }
 
 void VP8TBufferClear(VP8TBuffer* const b) {
   if (b != NULL) {
-    VP8Tokens* p = b->pages;
-    while (p != NULL) {
-      VP8Tokens* const next = p->next;
-      WebPSafeFree(p);
-      p = next;
-    }
+    FreePages(b->pages);
+    FreePages(b->free_pages);
     VP8TBufferInit(b, b->page_size);
   }
 }
 
+void VP8TBufferReset(VP8TBuffer* const b) {
+  if (b->pages != NULL) {
+    *b->last_page = b->free_pages;
+    b->free_pages = b->pages;
+  }
+  b->tokens = NULL;
+  b->pages = NULL;
+  b->last_page = &b->pages;
+  b->left = 0;
+  b->error = 0;
+}
+
+void VP8TBufferMovePages(VP8TBuffer* const dst, VP8TBuffer* const src) {
+  assert(dst->pages == NULL && dst->free_pages == NULL);
+  VP8TBufferReset(src);
+  if (src->page_size >= dst->page_size) {
+    dst->page_size = src->page_size;
+    dst->free_pages = src->free_pages;
+  } else {
+    FreePages(src->free_pages);
+  }
+  src->free_pages = NULL;
+}
+
+size_t VP8TBufferMemory(const VP8TBuffer* const b) {
+  const size_t page_size = sizeof(VP8Tokens) + b->page_size * sizeof(token_t);
+  size_t size = 0;
+  const VP8Tokens* p;
+  for (p = b->pages; p != NULL; p = p->next) size += page_size;
+  for (p = b->free_pages; p != NULL; p = p->next) size += page_size;
+  return size;
+}
+
 static int TBufferNewPage(VP8TBuffer* const b) {
   VP8Tokens* page = NULL;
   if (!b->error) {
-    const size_t size = sizeof(*page) + b->page_size * sizeof(token_t);
-    page = (VP8Tokens*)WebPSafeMalloc(1ULL, size);
+    if (b->free_pages != NULL) {  // recycle from free-list
+      page = b->free_pages;
+      b->free_pages = page->next;
+    } else {
+      const size_t size = sizeof(*page) + b->page_size * sizeof(token_t);
+      page = (VP8Tokens*)WebPSafeMalloc(1ULL, size);
+    }
   }
   if (page == NULL) {
     b->error = 1;
@@ -86,6 +129,26 @@ static int TBufferNewPage(VP8TBuffer* const b) {
   return 1;
 }
 
+int VP8TBufferAppend(VP8TBuffer* const dst, const VP8TBuffer* const src) {
+  const VP8Tokens* p;
+  assert(!src->error);
+  // Tokens are stored from the end of the pages down to 'left'.
+  for (p = src->pages; p != NULL; p = p->next) {
+    const int N = (p->next == NULL) ? src->left : 0;
+    const token_t* const tokens = TOKEN_DATA(p);
+    int n = src->page_size;
+    while (n > N) {
+      int k;
+      if (dst->left == 0 && !TBufferNewPage(dst)) return 0;
+      k = (n - N < dst->left) ? n - N : dst->left;
+      dst->left -= k;
+      n -= k;
+      memcpy(dst->tokens + dst->left, tokens + n, k * sizeof(*tokens));
+    }
+  }
+  return 1;
+}
+
 //------------------------------------------------------------------------------
 
 #define TOKEN_ID(t, b, ctx) \
@@ -258,5 +321,19 @@ void VP8TBufferInit(VP8TBuffer* const b, int page_size) {
   (void)page_size;
 }
 void VP8TBufferClear(VP8TBuffer* const b) { (void)b; }
+void VP8TBufferReset(VP8TBuffer* const b) { (void)b; }
+void VP8TBufferMovePages(VP8TBuffer* const dst, VP8TBuffer* const src) {
+  (void)dst;
+  (void)src;
+}
+size_t VP8TBufferMemory(const VP8TBuffer* const b) {
+  (void)b;
+  return 0;
+}
+int VP8TBufferAppend(VP8TBuffer* const dst, const VP8TBuffer* const src) {
+  (void)dst;
+  (void)src;
+  return 1;
+}
 
 #endif  // !DISABLE_TOKEN_BUFFER
@@ -126,6 +126,9 @@ static WEBP_INLINE int QUANTDIV(uint32_t n, uint32_t iQ, uint32_t B) {
 // quality below which error-diffusion is enabled
 #define ERROR_DIFFUSION_QUALITY 98
 
+// maximum number of threads used by any encoding stage
+#define MAX_ENCODING_THREADS 32
+
 //------------------------------------------------------------------------------
 // Headers
 
@@ -247,6 +250,9 @@ typedef struct {
   int top_nz[9];             // top-non-zero context.
   int left_nz[9];            // left-non-zero. left_nz[8] is independent.
   uint64_t bit_count[4][3];  // bit counters for coded levels.
+  uint64_t sse[3];           // sum of Y/U/V squared errors (if pic->stats)
+  uint64_t sse_count;        // pixel count for the sse[] stats
+  int block_count[3];        // number of i4/i16/skipped macroblocks
   uint64_t luma_bits;        // macroblock bit-cost for luma
   uint64_t uv_bits;          // macroblock bit-cost for chroma
   LFStats* lf_stats;         // filter stats (borrowed from enc)
@@ -321,6 +327,7 @@ typedef struct {
   uint16_t* tokens;       // set to (*last_page)->tokens
   int left;               // how many free tokens left before the page is full
   int page_size;          // number of tokens per page
+  VP8Tokens* free_pages;  // recycled pages, used before allocating new ones
 #endif
   int error;  // true in case of malloc error
 } VP8TBuffer;
@@ -328,11 +335,22 @@ typedef struct {
 // initialize an empty buffer
 void VP8TBufferInit(VP8TBuffer* const b, int page_size);
 void VP8TBufferClear(VP8TBuffer* const b);  // de-allocate pages memory
+// Empties the buffer, keeping the pages memory for recording new tokens.
+void VP8TBufferReset(VP8TBuffer* const b);
+// Transfers all the pages of 'src' to the (empty) 'dst' buffer for reuse,
+// provided they are large enough. Otherwise, they are de-allocated.
+void VP8TBufferMovePages(VP8TBuffer* const dst, VP8TBuffer* const src);
+// Returns the size of the pages memory, in bytes.
+size_t VP8TBufferMemory(const VP8TBuffer* const b);
+// Appends a copy of the tokens of 'src' at the end of 'dst'.
+// Returns false in case of memory error.
+int VP8TBufferAppend(VP8TBuffer* const dst, const VP8TBuffer* const src);
 
 #if !defined(DISABLE_TOKEN_BUFFER)
 
 // Finalizes bitstream when probabilities are known.
-// Deletes the allocated token memory if final_pass is true.
+// Deletes the allocated token memory if final_pass is true. Otherwise, it is
+// kept for recording new tokens after VP8TBufferReset().
 int VP8EmitTokens(VP8TBuffer* const b, VP8BitWriter* const bw,
                   const uint8_t* const probas, int final_pass);
 
@@ -403,9 +421,14 @@ struct VP8Encoder {
   int max_i4_header_bits;   // partition #0 safeness factor
   int mb_header_limit;      // rough limit for header bits per MB
   int thread_level;         // derived from config->thread_level
+  int num_threads;          // maximum number of threads, in [1..32]
+  int threads_used;         // most threads actually used by a stage
   int do_search;            // derived from config->target_XXX
   int use_tokens;           // if true, use token buffer
 
+  // if not NULL, the memory and token pages are kept there between pictures
+  WebPEncoderContext* context;
+
   // Memory
   VP8MBInfo* mb_info;  // contextual macroblock infos (mb_w + 1)
   uint8_t* preds;      // predictions modes: (4*mb_w+1) * (4*mb_h+1)
@@ -462,6 +485,10 @@ int VP8EncTokenLoop(VP8Encoder* const enc);
 int WebPEncodingSetError(const WebPPicture* const pic, WebPEncodingError error);
 int WebPReportProgress(const WebPPicture* const pic, int percent,
                        int* const percent_store);
+// Returns the maximum number of threads (including the calling one) that a
+// stage may use, as derived from config->thread_level. Always 1 when
+// threading is not available.
+int WebPEncGetNumThreads(const WebPConfig* const config);
 
 // in analysis.c
 // Main analysis loop. Decides the segmentations and complexity.
@@ -24,6 +24,7 @@
 #include "src/enc/vp8i_enc.h"
 #include "src/enc/vp8li_enc.h"
 #include "src/utils/bit_writer_utils.h"
+#include "src/utils/color_cache_utils.h"
 #include "src/utils/huffman_encode_utils.h"
 #include "src/utils/palette.h"
 #include "src/utils/thread_utils.h"
@@ -37,6 +38,8 @@
 // compute the best predictor image.
 #define MAX_PREDICTOR_IMAGE_SIZE (1 << 14)
 
+extern int VP8LDistanceToPlaneCode(int xsize, int dist);
+
 // -----------------------------------------------------------------------------
 // Palette
 
@@ -271,7 +274,7 @@ static int GetTransformBits(int method, int histo_bits) {
 }
 
 // Set of parameters to be used in each iteration of the cruncher.
-#define CRUNCH_SUBCONFIGS_MAX 2
+#define CRUNCH_SUBCONFIGS_MAX 3
 typedef struct {
   int lz77;
   int do_no_cache;
@@ -287,10 +290,13 @@ typedef struct {
 // kPaletteAndSpatial.
 #define CRUNCH_CONFIGS_MAX (kNumEntropyIx + 2 * kPaletteSortingNum)
 
+// If 'allow_brute_force' is false, a single config is tried at most for each
+// transform, the guessed best one coming first.
 static int EncoderAnalyze(VP8LEncoder* const enc,
                           CrunchConfig crunch_configs[CRUNCH_CONFIGS_MAX],
                           int* const crunch_configs_size,
-                          int* const red_and_blue_always_zero) {
+                          int* const red_and_blue_always_zero,
+                          int allow_brute_force) {
   const WebPPicture* const pic = enc->pic;
   const int width = pic->width;
   const int height = pic->height;
@@ -334,7 +340,7 @@ static int EncoderAnalyze(VP8LEncoder* const enc,
                         red_and_blue_always_zero)) {
       return 0;
     }
-    if (method == 6 && config->quality == 100) {
+    if (method == 6 && config->quality == 100 && allow_brute_force) {
       do_no_cache = 1;
       // Go brute force on all transforms.
       *crunch_configs_size = 0;
@@ -397,26 +403,51 @@ static int EncoderAnalyze(VP8LEncoder* const enc,
       crunch_configs[i].sub_configs[j].do_no_cache = do_no_cache;
     }
     crunch_configs[i].sub_configs_size = n_lz77s;
+    // The binary trees find farther matches than the hash chain. Their
+    // references are often estimated costlier but end up smaller once
+    // entropy coded, so they are compared on the actual output.
+    if (config->quality >= 95 && !low_effort) {
+      assert(n_lz77s < CRUNCH_SUBCONFIGS_MAX);
+      crunch_configs[i].sub_configs[n_lz77s].lz77 = kLZ77Tree;
+      crunch_configs[i].sub_configs[n_lz77s].do_no_cache = do_no_cache;
+      ++crunch_configs[i].sub_configs_size;
+    }
   }
   return 1;
 }
 
-static int EncoderInit(VP8LEncoder* const enc) {
-  const WebPPicture* const pic = enc->pic;
-  const int width = pic->width;
-  const int height = pic->height;
-  const int pix_cnt = width * height;
+static void ClearHashChainBuffer(VP8LEncoder* const enc) {
+  WebPSafeFree(enc->hash_chain_mem);
+  enc->hash_chain_mem = NULL;
+  enc->hash_chain_mem_size = 0;
+}
+
+// Sets up the hash chain and the backward references for images of up to
+// 'pix_cnt' pixels.
+static int EncoderInitForSize(VP8LEncoder* const enc, int pix_cnt) {
   // we round the block size up, so we're guaranteed to have
   // at most MAX_REFS_BLOCK_PER_IMAGE blocks used:
   const int refs_block_size = (pix_cnt - 1) / MAX_REFS_BLOCK_PER_IMAGE + 1;
   int i;
-  if (!VP8LHashChainInit(&enc->hash_chain, pix_cnt)) return 0;
+  if (enc->hash_chain_mem == NULL ||
+      (size_t)pix_cnt > enc->hash_chain_mem_size) {
+    ClearHashChainBuffer(enc);
+    enc->hash_chain_mem =
+        (uint32_t*)WebPSafeMalloc(pix_cnt, sizeof(*enc->hash_chain_mem));
+    if (enc->hash_chain_mem == NULL) return 0;
+    enc->hash_chain_mem_size = (size_t)pix_cnt;
+  }
+  VP8LHashChainInitWithMemory(&enc->hash_chain, enc->hash_chain_mem, pix_cnt);
 
   for (i = 0; i < 4; ++i) VP8LBackwardRefsInit(&enc->refs[i], refs_block_size);
 
   return 1;
 }
 
+static int EncoderInit(VP8LEncoder* const enc) {
+  return EncoderInitForSize(enc, enc->pic->width * enc->pic->height);
+}
+
 // Returns false in case of memory error.
 static int GetHuffBitLengthsAndCodes(
     const VP8LHistogramSet* const histogram_image,
@@ -676,7 +707,8 @@ static WEBP_INLINE void WriteHuffmanCodeWithExtraBits(
   VP8LPutBits(bw, (bits << depth) | symbol, depth + n_bits);
 }
 
-static int StoreImageToBitMask(VP8LBitWriter* const bw, int width,
+// Stores the references 'refs' of the rows starting at 'y_start'.
+static int StoreImageToBitMask(VP8LBitWriter* const bw, int width, int y_start,
                                int histo_bits,
                                const VP8LBackwardRefs* const refs,
                                const uint32_t* histogram_symbols,
@@ -686,10 +718,11 @@ static int StoreImageToBitMask(VP8LBitWriter* const bw, int width,
   const int tile_mask = (histo_bits == 0) ? 0 : -(1 << histo_bits);
   // x and y trace the position in the image.
   int x = 0;
-  int y = 0;
+  int y = y_start;
   int tile_x = x & tile_mask;
   int tile_y = y & tile_mask;
-  int histogram_ix = (histogram_symbols[0] >> 8) & 0xffff;
+  int histogram_ix = (histogram_symbols[(y >> histo_bits) * histo_xsize] >> 8) &
+                     0xffff;
   const HuffmanTreeCode* codes = huffman_codes + 5 * histogram_ix;
   VP8LRefsCursor c = VP8LRefsCursorInit(refs);
   while (VP8LRefsCursorOk(&c)) {
@@ -768,13 +801,13 @@ static int EncodeImageNoHuffman(VP8LBitWriter* const bw,
 
   // Calculate backward references from ARGB image.
   if (!VP8LHashChainFill(hash_chain, quality, argb, width, height, low_effort,
-                         pic, percent_range / 2, percent)) {
+                         /*num_threads=*/1, pic, percent_range / 2, percent)) {
     goto Error;
   }
   if (!VP8LGetBackwardReferences(width, height, argb, quality, /*low_effort=*/0,
                                  kLZ77Standard | kLZ77RLE, cache_bits,
-                                 /*do_no_cache=*/0, hash_chain, refs_array,
-                                 &cache_bits, pic,
+                                 /*do_no_cache=*/0, /*num_threads=*/1,
+                                 hash_chain, refs_array, &cache_bits, pic,
                                  percent_range - percent_range / 2, percent)) {
     goto Error;
   }
@@ -823,8 +856,8 @@ static int EncodeImageNoHuffman(VP8LBitWriter* const bw,
   }
 
   // Store actual literals.
-  if (!StoreImageToBitMask(bw, width, 0, refs, histogram_symbols, huffman_codes,
-                           pic)) {
+  if (!StoreImageToBitMask(bw, width, /*y_start=*/0, 0, refs, histogram_symbols,
+                           huffman_codes, pic)) {
     goto Error;
   }
 
@@ -840,10 +873,10 @@ Error:
 static int EncodeImageInternal(
     VP8LBitWriter* const bw, const uint32_t* const argb,
     VP8LHashChain* const hash_chain, VP8LBackwardRefs refs_array[4], int width,
-    int height, int quality, int low_effort, const CrunchConfig* const config,
-    int* cache_bits, int histogram_bits_in, size_t init_byte_position,
-    int* const hdr_size, int* const data_size, const WebPPicture* const pic,
-    int percent_range, int* const percent) {
+    int height, int quality, int low_effort, int num_threads,
+    const CrunchConfig* const config, int* cache_bits, int histogram_bits_in,
+    size_t init_byte_position, int* const hdr_size, int* const data_size,
+    const WebPPicture* const pic, int percent_range, int* const percent) {
   const uint32_t histogram_image_xysize =
       VP8LSubSampleSize(width, histogram_bits_in) *
       VP8LSubSampleSize(height, histogram_bits_in);
@@ -885,7 +918,7 @@ static int EncodeImageInternal(
 
   percent_range = remaining_percent / 5;
   if (!VP8LHashChainFill(hash_chain, quality, argb, width, height, low_effort,
-                         pic, percent_range, percent)) {
+                         num_threads, pic, percent_range, percent)) {
     goto Error;
   }
   percent_start += percent_range;
@@ -912,7 +945,7 @@ static int EncodeImageInternal(
 
     if (!VP8LGetBackwardReferences(
             width, height, argb, quality, low_effort, sub_config->lz77,
-            cache_bits_init, sub_config->do_no_cache, hash_chain,
+            cache_bits_init, sub_config->do_no_cache, num_threads, hash_chain,
             &refs_array[0], &cache_bits_best, pic, i_percent_range, percent)) {
       goto Error;
     }
@@ -940,8 +973,8 @@ static int EncodeImageInternal(
       i_remaining_percent -= i_percent_range;
       if (!VP8LGetHistoImageSymbols(
               width, height, &refs_array[i_cache], quality, low_effort,
-              histogram_bits, cache_bits_tmp, histogram_image, tmp_histo,
-              histogram_argb, pic, i_percent_range, percent)) {
+              num_threads, histogram_bits, cache_bits_tmp, histogram_image,
+              tmp_histo, histogram_argb, pic, i_percent_range, percent)) {
         goto Error;
       }
       // Create Huffman bit lengths and codes for each histogram image.
@@ -1022,8 +1055,9 @@ static int EncodeImageInternal(
       }
       // Store actual literals.
       hdr_size_tmp = (int)(VP8LBitWriterNumBytes(bw) - init_byte_position);
-      if (!StoreImageToBitMask(bw, width, histogram_bits, &refs_array[i_cache],
-                               histogram_argb, huffman_codes, pic)) {
+      if (!StoreImageToBitMask(bw, width, /*y_start=*/0, histogram_bits,
+                               &refs_array[i_cache], histogram_argb,
+                               huffman_codes, pic)) {
         goto Error;
       }
       // Keep track of the smallest image so far.
@@ -1388,6 +1422,14 @@ static int ApplyPalette(const uint32_t* src, uint32_t src_stride, uint32_t* dst,
 #undef PALETTE_INV_SIZE
 #undef APPLY_PALETTE_GREEDY_MAX
 
+// Returns the number of bits of the pixel packing for 'palette_size' colors.
+static int GetPaletteXBits(int palette_size) {
+  if (palette_size <= 4) {
+    return (palette_size <= 2) ? 3 : 2;
+  }
+  return (palette_size <= 16) ? 1 : 0;
+}
+
 // Note: Expects "enc->palette" to be set properly.
 static int MapImageFromPalette(VP8LEncoder* const enc) {
   const WebPPicture* const pic = enc->pic;
@@ -1395,16 +1437,10 @@ static int MapImageFromPalette(VP8LEncoder* const enc) {
   const int height = pic->height;
   const uint32_t* const palette = enc->palette;
   const int palette_size = enc->palette_size;
-  int xbits;
+  const int xbits = GetPaletteXBits(palette_size);
 
   // Replace each input pixel by corresponding palette index.
   // This is done line by line.
-  if (palette_size <= 4) {
-    xbits = (palette_size <= 2) ? 3 : 2;
-  } else {
-    xbits = (palette_size <= 16) ? 1 : 0;
-  }
-
   if (!AllocateTransformBuffer(enc, VP8LSubSampleSize(width, xbits), height)) {
     return 0;
   }
@@ -1447,8 +1483,8 @@ static int EncodePalette(VP8LBitWriter* const bw, int low_effort,
 // -----------------------------------------------------------------------------
 // VP8LEncoder
 
-static VP8LEncoder* VP8LEncoderNew(const WebPConfig* const config,
-                                   const WebPPicture* const picture) {
+VP8LEncoder* VP8LEncoderNew(const WebPConfig* const config,
+                            const WebPPicture* const picture) {
   VP8LEncoder* const enc = (VP8LEncoder*)WebPSafeCalloc(1ULL, sizeof(*enc));
   if (enc == NULL) {
     WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
@@ -1457,18 +1493,55 @@ static VP8LEncoder* VP8LEncoderNew(const WebPConfig* const config,
   enc->config = config;
   enc->pic = picture;
   enc->argb_content = kEncoderNone;
+  enc->num_threads = 1;
 
   VP8LEncDspInit();
 
   return enc;
 }
 
-static void VP8LEncoderDelete(VP8LEncoder* enc) {
+void VP8LEncoderReset(VP8LEncoder* const enc, size_t max_memory) {
+  const WebPConfig* config;
+  const WebPPicture* pic;
+  uint32_t* transform_mem;
+  size_t transform_mem_size;
+  uint32_t* hash_chain_mem;
+  size_t hash_chain_mem_size;
+  int i;
+  if (enc == NULL) return;
+  VP8LHashChainClear(&enc->hash_chain);
+  for (i = 0; i < 4; ++i) VP8LBackwardRefsClear(&enc->refs[i]);
+  if (enc->transform_mem_size * sizeof(*enc->transform_mem) > max_memory) {
+    ClearTransformBuffer(enc);
+  }
+  if ((enc->transform_mem_size + enc->hash_chain_mem_size) * sizeof(uint32_t) >
+      max_memory) {
+    ClearHashChainBuffer(enc);
+  }
+  config = enc->config;
+  pic = enc->pic;
+  transform_mem = enc->transform_mem;
+  transform_mem_size = enc->transform_mem_size;
+  hash_chain_mem = enc->hash_chain_mem;
+  hash_chain_mem_size = enc->hash_chain_mem_size;
+  memset(enc, 0, sizeof(*enc));
+  enc->config = config;
+  enc->pic = pic;
+  enc->argb_content = kEncoderNone;
+  enc->transform_mem = transform_mem;
+  enc->transform_mem_size = transform_mem_size;
+  enc->hash_chain_mem = hash_chain_mem;
+  enc->hash_chain_mem_size = hash_chain_mem_size;
+  enc->num_threads = 1;
+}
+
+void VP8LEncoderDelete(VP8LEncoder* enc) {
   if (enc != NULL) {
     int i;
     VP8LHashChainClear(&enc->hash_chain);
     for (i = 0; i < 4; ++i) VP8LBackwardRefsClear(&enc->refs[i]);
     ClearTransformBuffer(enc);
+    ClearHashChainBuffer(enc);
     WebPSafeFree(enc);
   }
 }
@@ -1476,345 +1549,1259 @@ static void VP8LEncoderDelete(VP8LEncoder* enc) {
 // -----------------------------------------------------------------------------
 // Main call
 
+// State of one of the threads crunching the configs.
 typedef struct {
-  const WebPConfig* config;
   const WebPPicture* picture;
-  VP8LBitWriter* bw;
+  VP8LBitWriter* bw;      // where the current task is written
+  VP8LBitWriter bw_init;  // state of 'bw' before any task was written
+  VP8LBitWriter bw_best;  // smallest result so far
+  int best_task;          // task that produced 'bw_best', -1 if none yet
   VP8LEncoder* enc;
-  CrunchConfig crunch_configs[CRUNCH_CONFIGS_MAX];
-  int num_crunch_configs;
-  int red_and_blue_always_zero;
   WebPAuxStats* stats;
+  int percent;  // for WebPProgressHook
+  // Side threads (thread index > 0) own their picture, bit writer, encoder
+  // and stats. The main thread uses the caller's ones.
+  WebPPicture side_picture;  // view of the main picture (error_code is not
+                             // thread-safe)
+  VP8LBitWriter side_bw;
+  WebPAuxStats side_stats;
+} StreamEncodeThread;
+
+typedef struct {
+  const WebPConfig* config;
+  // Crunch configs to try, each one being an independent task.
+  CrunchConfig tasks[CRUNCH_CONFIGS_MAX * CRUNCH_SUBCONFIGS_MAX];
+  int num_tasks;
+  int red_and_blue_always_zero;
+  StreamEncodeThread* threads;
+  size_t* task_sizes;  // if not NULL, receives the size of each task
 } StreamEncodeContext;
 
-static int EncodeStreamHook(void* input, void* data2) {
-  StreamEncodeContext* const params = (StreamEncodeContext*)input;
+static int EncodeStreamHook(void* data, int index, int thread) {
+  const StreamEncodeContext* const params = (const StreamEncodeContext*)data;
+  StreamEncodeThread* const t = &params->threads[thread];
   const WebPConfig* const config = params->config;
-  const WebPPicture* const picture = params->picture;
-  VP8LBitWriter* const bw = params->bw;
-  VP8LEncoder* const enc = params->enc;
-  const CrunchConfig* const crunch_configs = params->crunch_configs;
-  const int num_crunch_configs = params->num_crunch_configs;
+  const WebPPicture* const picture = t->picture;
+  VP8LBitWriter* const bw = t->bw;
+  VP8LEncoder* const enc = t->enc;
+  const CrunchConfig* const crunch_config = &params->tasks[index];
+  const int entropy_idx = crunch_config->entropy_idx;
   const int red_and_blue_always_zero = params->red_and_blue_always_zero;
 #if !defined(WEBP_DISABLE_STATS)
-  WebPAuxStats* const stats = params->stats;
+  WebPAuxStats* const stats = t->stats;
 #endif
   const int quality = (int)config->quality;
   const int low_effort = (config->method == 0);
 #if (WEBP_NEAR_LOSSLESS == 1)
   const int width = picture->width;
-#endif
-  const int height = picture->height;
-  const size_t byte_position = VP8LBitWriterNumBytes(bw);
-  int percent = 2;  // for WebPProgressHook
-#if (WEBP_NEAR_LOSSLESS == 1)
   int use_near_lossless = 0;
 #endif
+  const int height = picture->height;
+  const size_t byte_position = VP8LBitWriterNumBytes(&t->bw_init);
+  int remaining_percent = 97 / params->num_tasks, percent_range;
+  int predictor_transform_bits = 0, cross_color_transform_bits = 0;
   int hdr_size = 0;
   int data_size = 0;
-  int idx;
-  size_t best_size = ~(size_t)0;
-  VP8LBitWriter bw_init = *bw, bw_best;
-  (void)data2;
 
-  if (!VP8LBitWriterInit(&bw_best, 0) ||
-      (num_crunch_configs > 1 && !VP8LBitWriterClone(bw, &bw_best))) {
-    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    goto Error;
+  enc->use_palette =
+      (entropy_idx == kPalette) || (entropy_idx == kPaletteAndSpatial);
+  enc->use_subtract_green =
+      (entropy_idx == kSubGreen) || (entropy_idx == kSpatialSubGreen);
+  enc->use_predict = (entropy_idx == kSpatial) ||
+                     (entropy_idx == kSpatialSubGreen) ||
+                     (entropy_idx == kPaletteAndSpatial);
+  // When using a palette, R/B==0, hence no need to test for cross-color.
+  if (low_effort || enc->use_palette) {
+    enc->use_cross_color = 0;
+  } else {
+    enc->use_cross_color = red_and_blue_always_zero ? 0 : enc->use_predict;
   }
-
-  for (idx = 0; idx < num_crunch_configs; ++idx) {
-    const int entropy_idx = crunch_configs[idx].entropy_idx;
-    int remaining_percent = 97 / num_crunch_configs, percent_range;
-    int predictor_transform_bits = 0, cross_color_transform_bits = 0;
-    enc->use_palette =
-        (entropy_idx == kPalette) || (entropy_idx == kPaletteAndSpatial);
-    enc->use_subtract_green =
-        (entropy_idx == kSubGreen) || (entropy_idx == kSpatialSubGreen);
-    enc->use_predict = (entropy_idx == kSpatial) ||
-                       (entropy_idx == kSpatialSubGreen) ||
-                       (entropy_idx == kPaletteAndSpatial);
-    // When using a palette, R/B==0, hence no need to test for cross-color.
-    if (low_effort || enc->use_palette) {
-      enc->use_cross_color = 0;
-    } else {
-      enc->use_cross_color = red_and_blue_always_zero ? 0 : enc->use_predict;
-    }
-    // Reset any parameter in the encoder that is set in the previous iteration.
-    enc->cache_bits = 0;
-    VP8LBackwardRefsClear(&enc->refs[0]);
-    VP8LBackwardRefsClear(&enc->refs[1]);
+  // Reset any parameter in the encoder that is set in the previous task.
+  enc->cache_bits = 0;
+  VP8LBackwardRefsClear(&enc->refs[0]);
+  VP8LBackwardRefsClear(&enc->refs[1]);
 
 #if (WEBP_NEAR_LOSSLESS == 1)
-    // Apply near-lossless preprocessing.
-    use_near_lossless =
-        (config->near_lossless < 100) && !enc->use_palette && !enc->use_predict;
-    if (use_near_lossless) {
-      if (!AllocateTransformBuffer(enc, width, height)) goto Error;
-      if ((enc->argb_content != kEncoderNearLossless) &&
-          !VP8ApplyNearLossless(picture, config->near_lossless, enc->argb)) {
-        WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-        goto Error;
-      }
-      enc->argb_content = kEncoderNearLossless;
-    } else {
-      enc->argb_content = kEncoderNone;
+  // Apply near-lossless preprocessing.
+  use_near_lossless =
+      (config->near_lossless < 100) && !enc->use_palette && !enc->use_predict;
+  if (use_near_lossless) {
+    if (!AllocateTransformBuffer(enc, width, height)) goto Error;
+    if ((enc->argb_content != kEncoderNearLossless) &&
+        !VP8ApplyNearLossless(picture, config->near_lossless, enc->argb)) {
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      goto Error;
     }
-#else
+    enc->argb_content = kEncoderNearLossless;
+  } else {
     enc->argb_content = kEncoderNone;
+  }
+#else
+  enc->argb_content = kEncoderNone;
 #endif
 
-    // Encode palette
-    if (enc->use_palette) {
-      if (!PaletteSort(crunch_configs[idx].palette_sorting_type, enc->pic,
-                       enc->palette_sorted, enc->palette_size, enc->palette)) {
-        WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
-        goto Error;
-      }
-      percent_range = remaining_percent / 4;
-      if (!EncodePalette(bw, low_effort, enc, percent_range, &percent)) {
-        goto Error;
-      }
-      remaining_percent -= percent_range;
-      if (!MapImageFromPalette(enc)) goto Error;
-      // If using a color cache, do not have it bigger than the number of
-      // colors.
-      if (enc->palette_size < (1 << MAX_COLOR_CACHE_BITS)) {
-        enc->cache_bits = BitsLog2Floor(enc->palette_size) + 1;
-      }
+  // Encode palette
+  if (enc->use_palette) {
+    if (!PaletteSort(crunch_config->palette_sorting_type, enc->pic,
+                     enc->palette_sorted, enc->palette_size, enc->palette)) {
+      WebPEncodingSetError(enc->pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      goto Error;
+    }
+    percent_range = remaining_percent / 4;
+    if (!EncodePalette(bw, low_effort, enc, percent_range, &t->percent)) {
+      goto Error;
+    }
+    remaining_percent -= percent_range;
+    if (!MapImageFromPalette(enc)) goto Error;
+    // If using a color cache, do not have it bigger than the number of
+    // colors.
+    if (enc->palette_size < (1 << MAX_COLOR_CACHE_BITS)) {
+      enc->cache_bits = BitsLog2Floor(enc->palette_size) + 1;
+    }
+  }
+  // In case image is not packed.
+  if (enc->argb_content != kEncoderNearLossless &&
+      enc->argb_content != kEncoderPalette) {
+    if (!MakeInputImageCopy(enc)) goto Error;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Apply transforms and write transform data.
+
+  if (enc->use_subtract_green) {
+    ApplySubtractGreen(enc, enc->current_width, height, bw);
+  }
+
+  if (enc->use_predict) {
+    percent_range = remaining_percent / 3;
+    if (!ApplyPredictFilter(enc, enc->current_width, height, quality,
+                            low_effort, enc->use_subtract_green, bw,
+                            percent_range, &t->percent,
+                            &predictor_transform_bits)) {
+      goto Error;
     }
-    // In case image is not packed.
-    if (enc->argb_content != kEncoderNearLossless &&
-        enc->argb_content != kEncoderPalette) {
-      if (!MakeInputImageCopy(enc)) goto Error;
+    remaining_percent -= percent_range;
+  }
+
+  if (enc->use_cross_color) {
+    percent_range = remaining_percent / 2;
+    if (!ApplyCrossColorFilter(enc, enc->current_width, height, quality,
+                               low_effort, bw, percent_range, &t->percent,
+                               &cross_color_transform_bits)) {
+      goto Error;
     }
+    remaining_percent -= percent_range;
+  }
+
+  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
 
-    // -------------------------------------------------------------------------
-    // Apply transforms and write transform data.
+  // ---------------------------------------------------------------------------
+  // Encode and write the transformed image.
+  if (!EncodeImageInternal(bw, enc->argb, &enc->hash_chain, enc->refs,
+                           enc->current_width, height, quality, low_effort,
+                           enc->num_threads, crunch_config, &enc->cache_bits,
+                           enc->histo_bits, byte_position, &hdr_size,
+                           &data_size, picture, remaining_percent,
+                           &t->percent)) {
+    goto Error;
+  }
+  if (params->task_sizes != NULL) {
+    params->task_sizes[index] = VP8LBitWriterNumBytes(bw) - byte_position;
+  }
 
-    if (enc->use_subtract_green) {
-      ApplySubtractGreen(enc, enc->current_width, height, bw);
+  // If we are better than what this thread already has. Tasks are handed out
+  // in increasing order, so ties are kept by the earliest one.
+  if (t->best_task < 0 ||
+      VP8LBitWriterNumBytes(bw) < VP8LBitWriterNumBytes(&t->bw_best)) {
+    t->best_task = index;
+    // Store the BitWriter.
+    VP8LBitWriterSwap(bw, &t->bw_best);
+#if !defined(WEBP_DISABLE_STATS)
+    // Update the stats.
+    if (stats != NULL) {
+      stats->lossless_features = 0;
+      if (enc->use_predict) stats->lossless_features |= 1;
+      if (enc->use_cross_color) stats->lossless_features |= 2;
+      if (enc->use_subtract_green) stats->lossless_features |= 4;
+      if (enc->use_palette) stats->lossless_features |= 8;
+      stats->histogram_bits = enc->histo_bits;
+      stats->transform_bits = predictor_transform_bits;
+      stats->cross_color_transform_bits = cross_color_transform_bits;
+      stats->cache_bits = enc->cache_bits;
+      stats->palette_size = enc->palette_size;
+      stats->lossless_size =
+          (int)(VP8LBitWriterNumBytes(&t->bw_best) - byte_position);
+      stats->lossless_hdr_size = hdr_size;
+      stats->lossless_data_size = data_size;
     }
+#endif
+  }
+  // Reset the bit writer for the following task if any.
+  VP8LBitWriterReset(&t->bw_init, bw);
 
-    if (enc->use_predict) {
-      percent_range = remaining_percent / 3;
-      if (!ApplyPredictFilter(enc, enc->current_width, height, quality,
-                              low_effort, enc->use_subtract_green, bw,
-                              percent_range, &percent,
-                              &predictor_transform_bits)) {
-        goto Error;
+Error:
+  // The hook should return false in case of error.
+  return (picture->error_code == VP8_ENC_OK);
+}
+
+// Copies the values EncoderAnalyze() computed for 'src' into 'dst'.
+static void CopyAnalysis(const VP8LEncoder* const src, VP8LEncoder* const dst) {
+  dst->histo_bits = src->histo_bits;
+  dst->predictor_transform_bits = src->predictor_transform_bits;
+  dst->cross_color_transform_bits = src->cross_color_transform_bits;
+  dst->palette_size = src->palette_size;
+  memcpy(dst->palette, src->palette, sizeof(src->palette));
+  memcpy(dst->palette_sorted, src->palette_sorted,
+         sizeof(src->palette_sorted));
+}
+
+// Encodes 'picture' with each of the crunch configs and keeps the smallest
+// result in 'bw_main'. If not NULL, 'config_sizes' receives the size obtained
+// with each config.
+static int CrunchConfigs(const WebPConfig* const config,
+                         const WebPPicture* const picture,
+                         VP8LBitWriter* const bw_main,
+                         VP8LEncoder* const enc_main,
+                         const CrunchConfig* const crunch_configs,
+                         int num_crunch_configs, int red_and_blue_always_zero,
+                         size_t* const config_sizes) {
+  StreamEncodeContext params;
+  StreamEncodeThread* threads = NULL;
+  int task_configs[CRUNCH_CONFIGS_MAX * CRUNCH_SUBCONFIGS_MAX];
+  size_t task_sizes[CRUNCH_CONFIGS_MAX * CRUNCH_SUBCONFIGS_MAX];
+  int num_threads, threads_per_task;
+  int idx, best;
+
+  // Each crunch config is a task. If there are more threads than configs, the
+  // sub-configs become tasks of their own: their transforms are then computed
+  // several times, but more threads are kept busy. In both cases the same
+  // candidates are compared in the same order, so the output is the same.
+  num_threads = WebPEncGetNumThreads(config);
+  params.config = config;
+  params.red_and_blue_always_zero = red_and_blue_always_zero;
+  params.task_sizes = (config_sizes != NULL) ? task_sizes : NULL;
+  params.num_tasks = 0;
+  for (idx = 0; idx < num_crunch_configs; ++idx) {
+    const CrunchConfig* const crunch_config = &crunch_configs[idx];
+    if (num_threads > num_crunch_configs) {
+      int j;
+      for (j = 0; j < crunch_config->sub_configs_size; ++j) {
+        CrunchConfig* const task = &params.tasks[params.num_tasks];
+        *task = *crunch_config;
+        task->sub_configs[0] = crunch_config->sub_configs[j];
+        task->sub_configs_size = 1;
+        task_configs[params.num_tasks++] = idx;
       }
-      remaining_percent -= percent_range;
+    } else {
+      params.tasks[params.num_tasks] = *crunch_config;
+      task_configs[params.num_tasks++] = idx;
     }
+  }
+  // The threads left over by the tasks are shared among them.
+  threads_per_task = num_threads / params.num_tasks;
+  if (threads_per_task < 1) threads_per_task = 1;
+  if (num_threads > params.num_tasks) num_threads = params.num_tasks;
 
-    if (enc->use_cross_color) {
-      percent_range = remaining_percent / 2;
-      if (!ApplyCrossColorFilter(enc, enc->current_width, height, quality,
-                                 low_effort, bw, percent_range, &percent,
-                                 &cross_color_transform_bits)) {
+  threads =
+      (StreamEncodeThread*)WebPSafeCalloc(num_threads, sizeof(*threads));
+  if (threads == NULL) {
+    return WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  params.threads = threads;
+
+  // Fill in the state of each thread.
+  for (idx = 0; idx < num_threads; ++idx) {
+    StreamEncodeThread* const t = &threads[idx];
+    t->best_task = -1;
+    t->percent = 2;
+    if (idx == 0) {
+      t->picture = picture;
+      t->stats = picture->stats;
+      t->bw = bw_main;
+      t->enc = enc_main;
+    } else {
+      VP8LEncoder* enc_side;
+      // Avoid "garbage value" error from Clang's static analysis tool.
+      if (!WebPPictureInit(&t->side_picture)) {
+        goto Error;
+      }
+      // Create a side picture (error_code is not thread-safe).
+      if (!WebPPictureView(picture, /*left=*/0, /*top=*/0, picture->width,
+                           picture->height, &t->side_picture)) {
+        assert(0);
+      }
+      // Progress hook is not thread-safe.
+      t->side_picture.progress_hook = NULL;
+      t->picture = &t->side_picture;  // No need to free a view afterwards.
+#if !defined(WEBP_DISABLE_STATS)
+      if (picture->stats != NULL) {
+        memcpy(&t->side_stats, picture->stats, sizeof(t->side_stats));
+      }
+#endif
+      t->stats = (picture->stats == NULL) ? NULL : &t->side_stats;
+      // Create a side bit writer.
+      if (!VP8LBitWriterInit(&t->side_bw, 0) ||
+          !VP8LBitWriterClone(bw_main, &t->side_bw)) {
+        WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+        goto Error;
+      }
+      t->bw = &t->side_bw;
+      // Create a side encoder.
+      enc_side = VP8LEncoderNew(config, &t->side_picture);
+      t->enc = enc_side;
+      if (enc_side == NULL || !EncoderInit(enc_side)) {
+        WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
         goto Error;
       }
-      remaining_percent -= percent_range;
+      CopyAnalysis(enc_main, enc_side);
     }
-
-    VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
-
-    // -------------------------------------------------------------------------
-    // Encode and write the transformed image.
-    if (!EncodeImageInternal(
-            bw, enc->argb, &enc->hash_chain, enc->refs, enc->current_width,
-            height, quality, low_effort, &crunch_configs[idx], &enc->cache_bits,
-            enc->histo_bits, byte_position, &hdr_size, &data_size, picture,
-            remaining_percent, &percent)) {
+    t->enc->num_threads = threads_per_task;
+    t->bw_init = *t->bw;
+    if (!VP8LBitWriterInit(&t->bw_best, 0) ||
+        !VP8LBitWriterClone(t->bw, &t->bw_best)) {
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
       goto Error;
     }
+  }
 
-    // If we are better than what we already have.
-    if (VP8LBitWriterNumBytes(bw) < best_size) {
-      best_size = VP8LBitWriterNumBytes(bw);
-      // Store the BitWriter.
-      VP8LBitWriterSwap(bw, &bw_best);
+  // Crunch. The tasks are handed out to the threads as they become idle.
+  if (!WebPParallelForThreads(params.num_tasks, num_threads, EncodeStreamHook,
+                              &params)) {
+    for (idx = 1; idx < num_threads; ++idx) {
+      if (picture->error_code != VP8_ENC_OK) break;
+      WebPEncodingSetError(picture, threads[idx].side_picture.error_code);
+    }
+    assert(picture->error_code != VP8_ENC_OK);
+    goto Error;
+  }
+  // Keep the smallest result. Ties go to the earliest task, so that the output
+  // doesn't depend on the number of threads nor on the scheduling.
+  best = 0;
+  for (idx = 0; idx < num_threads; ++idx) {
+    StreamEncodeThread* const t = &threads[idx];
+    size_t size, best_size;
+    if (t->best_task < 0) continue;  // this thread got no task
+    size = VP8LBitWriterNumBytes(&t->bw_best);
+    best_size = VP8LBitWriterNumBytes(&threads[best].bw_best);
+    if (size < best_size ||
+        (size == best_size && t->best_task < threads[best].best_task)) {
+      best = idx;
+    }
+  }
+  assert(threads[0].best_task >= 0);  // thread 0 always runs task 0
+  VP8LBitWriterSwap(bw_main, &threads[best].bw_best);
 #if !defined(WEBP_DISABLE_STATS)
-      // Update the stats.
-      if (stats != NULL) {
-        stats->lossless_features = 0;
-        if (enc->use_predict) stats->lossless_features |= 1;
-        if (enc->use_cross_color) stats->lossless_features |= 2;
-        if (enc->use_subtract_green) stats->lossless_features |= 4;
-        if (enc->use_palette) stats->lossless_features |= 8;
-        stats->histogram_bits = enc->histo_bits;
-        stats->transform_bits = predictor_transform_bits;
-        stats->cross_color_transform_bits = cross_color_transform_bits;
-        stats->cache_bits = enc->cache_bits;
-        stats->palette_size = enc->palette_size;
-        stats->lossless_size = (int)(best_size - byte_position);
-        stats->lossless_hdr_size = hdr_size;
-        stats->lossless_data_size = data_size;
-      }
+  if (picture->stats != NULL) {
+    if (best != 0) {
+      memcpy(picture->stats, &threads[best].side_stats,
+             sizeof(*picture->stats));
+    }
+    picture->stats->threads_used = num_threads;
+  }
 #endif
+  if (config_sizes != NULL) {
+    // The size of a config is the one of its best sub-config.
+    for (idx = 0; idx < num_crunch_configs; ++idx) {
+      config_sizes[idx] = ~(size_t)0;
+    }
+    for (idx = 0; idx < params.num_tasks; ++idx) {
+      size_t* const size = &config_sizes[task_configs[idx]];
+      if (task_sizes[idx] < *size) *size = task_sizes[idx];
     }
-    // Reset the bit writer for the following iteration if any.
-    if (num_crunch_configs > 1) VP8LBitWriterReset(&bw_init, bw);
   }
-  VP8LBitWriterSwap(&bw_best, bw);
 
 Error:
-  VP8LBitWriterWipeOut(&bw_best);
-  // The hook should return false in case of error.
-  return (params->picture->error_code == VP8_ENC_OK);
+  for (idx = 0; idx < num_threads; ++idx) {
+    VP8LBitWriterWipeOut(&threads[idx].bw_best);
+    if (idx > 0) {
+      VP8LBitWriterWipeOut(&threads[idx].side_bw);
+      VP8LEncoderDelete(threads[idx].enc);
+    }
+  }
+  WebPSafeFree(threads);
+  return (picture->error_code == VP8_ENC_OK);
 }
 
-int VP8LEncodeStream(const WebPConfig* const config,
-                     const WebPPicture* const picture,
-                     VP8LBitWriter* const bw_main) {
-  VP8LEncoder* const enc_main = VP8LEncoderNew(config, picture);
-  VP8LEncoder* enc_side = NULL;
-  CrunchConfig crunch_configs[CRUNCH_CONFIGS_MAX];
-  int num_crunch_configs_main, num_crunch_configs_side = 0;
-  int idx;
-  int red_and_blue_always_zero = 0;
-  WebPWorker worker_main, worker_side;
-  StreamEncodeContext params_main, params_side;
-  // The main thread uses picture->stats, the side thread uses stats_side.
-  WebPAuxStats stats_side;
-  VP8LBitWriter bw_side;
-  WebPPicture picture_side;
-  const WebPWorkerInterface* const worker_interface = WebPGetWorkerInterface();
-  int ok_main;
-
-  if (enc_main == NULL || !VP8LBitWriterInit(&bw_side, 0)) {
-    VP8LEncoderDelete(enc_main);
+// The configs are ranked on a sample made of horizontal bands of the picture,
+// covering about 1/CRUNCH_SAMPLE_RATIO of its rows.
+#define CRUNCH_SAMPLE_BAND_HEIGHT 32
+#define CRUNCH_SAMPLE_RATIO 8
+
+// Fills 'sample' with bands of 'picture' evenly spread over its height.
+// Returns false if the picture is too small to be sampled or in case of memory
+// error, in which case 'sample' must still be freed.
+static int GetCrunchSample(const WebPPicture* const picture,
+                           WebPPicture* const sample) {
+  const int num_bands =
+      picture->height / (CRUNCH_SAMPLE_BAND_HEIGHT * CRUNCH_SAMPLE_RATIO);
+  int i;
+  if (num_bands == 0) return 0;
+  sample->use_argb = 1;
+  sample->width = picture->width;
+  sample->height = num_bands * CRUNCH_SAMPLE_BAND_HEIGHT;
+  if (!WebPPictureAlloc(sample)) return 0;
+  for (i = 0; i < num_bands; ++i) {
+    // Take the band around the middle of the i-th slice of the picture.
+    const int top = (2 * i + 1) * picture->height / (2 * num_bands) -
+                    CRUNCH_SAMPLE_BAND_HEIGHT / 2;
+    WebPCopyPlane(
+        (const uint8_t*)(picture->argb + top * picture->argb_stride),
+        picture->argb_stride * (int)sizeof(*picture->argb),
+        (uint8_t*)(sample->argb +
+                   i * CRUNCH_SAMPLE_BAND_HEIGHT * sample->argb_stride),
+        sample->argb_stride * (int)sizeof(*sample->argb),
+        picture->width * (int)sizeof(*picture->argb),
+        CRUNCH_SAMPLE_BAND_HEIGHT);
+  }
+  return 1;
+}
+
+// When there are more crunch configs than 'max_configs', encodes a sample of
+// the picture with each of them and only keeps the 'max_configs' ones giving
+// the smallest sizes, in their original order.
+static int PruneCrunchConfigs(const WebPConfig* const config,
+                              const WebPPicture* const picture,
+                              const VP8LEncoder* const enc_main,
+                              CrunchConfig* const crunch_configs,
+                              int* const num_crunch_configs,
+                              int red_and_blue_always_zero, int max_configs) {
+  WebPPicture sample;
+  VP8LBitWriter bw;
+  VP8LEncoder* enc = NULL;
+  CrunchConfig sample_configs[CRUNCH_CONFIGS_MAX];
+  size_t sizes[CRUNCH_CONFIGS_MAX];
+  int i, j, num_kept;
+  int ok = 0;
+
+  if (*num_crunch_configs <= max_configs) return 1;
+  if (!WebPPictureInit(&sample)) return 0;
+  if (!VP8LBitWriterInit(&bw, 0)) {
     return WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
   }
+  if (!GetCrunchSample(picture, &sample)) {
+    // Small picture (or no memory for the sample): try all the configs.
+    ok = 1;
+    goto End;
+  }
+  enc = VP8LEncoderNew(config, &sample);
+  if (enc == NULL || !EncoderInit(enc)) {
+    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto End;
+  }
+  // The palette and the bits are the ones of the whole picture.
+  CopyAnalysis(enc_main, enc);
+  // The binary trees are slow: the configs are ranked without them, and they
+  // are only tried with the configs kept.
+  memcpy(sample_configs, crunch_configs,
+         *num_crunch_configs * sizeof(*sample_configs));
+  for (i = 0; i < *num_crunch_configs; ++i) {
+    CrunchConfig* const c = &sample_configs[i];
+    if (c->sub_configs[c->sub_configs_size - 1].lz77 == kLZ77Tree) {
+      --c->sub_configs_size;
+    }
+  }
+  if (!CrunchConfigs(config, &sample, &bw, enc, sample_configs,
+                     *num_crunch_configs, red_and_blue_always_zero, sizes)) {
+    WebPEncodingSetError(picture, sample.error_code);
+    goto End;
+  }
+  // Keep the configs ranked below 'max_configs'. Ties go to the earliest ones.
+  num_kept = 0;
+  for (i = 0; i < *num_crunch_configs; ++i) {
+    int rank = 0;
+    for (j = 0; j < *num_crunch_configs; ++j) {
+      if (sizes[j] < sizes[i] || (sizes[j] == sizes[i] && j < i)) ++rank;
+    }
+    if (rank < max_configs) crunch_configs[num_kept++] = crunch_configs[i];
+  }
+  assert(num_kept == max_configs);
+  *num_crunch_configs = num_kept;
+  ok = 1;
+
+End:
+  VP8LEncoderDelete(enc);
+  VP8LBitWriterWipeOut(&bw);
+  WebPPictureFree(&sample);
+  return ok;
+}
+
+#undef CRUNCH_SAMPLE_BAND_HEIGHT
+#undef CRUNCH_SAMPLE_RATIO
+
+//------------------------------------------------------------------------------
+// Real-time encoding (method -1).
+// There is no image analysis nor trial: the subtract-green transform and a
+// single predictor are applied, then the pixels are coded with RLE copies only
+// and a fixed color cache. The Huffman codes are estimated on bands of rows
+// sampled over the image, which is then written in a single pass.
+
+#define REAL_TIME_CACHE_BITS 10
+#define REAL_TIME_MIN_COPY_LENGTH 4
+// Images of at most this many pixels are fully sampled, which gives the exact
+// Huffman codes. Otherwise, bands of REAL_TIME_SAMPLE_ROWS rows are sampled
+// every REAL_TIME_SAMPLE_PERIOD rows.
+#define REAL_TIME_FULL_SAMPLE_SIZE (1 << 16)
+#define REAL_TIME_SAMPLE_ROWS 8
+#define REAL_TIME_SAMPLE_PERIOD 64
+
+// Stores an image made of a single 'color', without color cache. Each Huffman
+// code has a single symbol, so the pixels themselves take no bits.
+static void StoreUniformImage(VP8LBitWriter* const bw, uint32_t color) {
+  const int symbols[5] = {(color >> 8) & 0xff, (color >> 16) & 0xff,
+                          (color >> 0) & 0xff, (color >> 24) & 0xff, 0};
+  uint8_t code_lengths[NUM_LITERAL_CODES] = {0};
+  HuffmanTreeCode huffman_code;
+  int k;
+  huffman_code.num_symbols = NUM_LITERAL_CODES;
+  huffman_code.code_lengths = code_lengths;
+  huffman_code.codes = NULL;
+  VP8LPutBits(bw, 0, 1);  // No color cache.
+  for (k = 0; k < 5; ++k) {
+    // Single symbol trees are small trees, which need no buffer.
+    code_lengths[symbols[k]] = 1;
+    StoreHuffmanCode(bw, NULL, NULL, &huffman_code);
+    code_lengths[symbols[k]] = 0;
+  }
+}
+
+// Counts or writes a copy of 'len' pixels at the distance of code 'dist_code',
+// as described in RealTimeCodePixels().
+static WEBP_INLINE void RealTimeCodeCopy(int len, int dist_code,
+                                         VP8LHistogram* const histo,
+                                         const HuffmanTreeCode* const codes,
+                                         VP8LBitWriter* const bw) {
+  int len_code, n_bits, bits;
+  VP8LPrefixEncode(len, &len_code, &n_bits, &bits);
+  if (histo != NULL) {
+    ++histo->literal[NUM_LITERAL_CODES + len_code];
+    ++histo->distance[dist_code];
+  } else {
+    WriteHuffmanCodeWithExtraBits(bw, &codes[0], NUM_LITERAL_CODES + len_code,
+                                  bits, n_bits);
+    // The distance codes of RLE copies have no extra bits.
+    WriteHuffmanCode(bw, &codes[4], dist_code);
+  }
+}
+
+// Codes the pixels [start, end) of 'argb' as RLE copies of the pixel on the
+// left or of the one above, or else as color cache indices or literals.
+// 'dist_codes' are the distance codes of these two copies. The symbols are
+// counted in 'histo' if not NULL, and written to 'bw' with 'codes' otherwise.
+static WEBP_INLINE void RealTimeCodePixels(
+    const uint32_t* const argb, int xsize, int start, int end,
+    const int dist_codes[2], VP8LColorCache* const hashers,
+    VP8LHistogram* const histo, const HuffmanTreeCode* const codes,
+    VP8LBitWriter* const bw) {
+  int i = start;
+  while (i < end) {
+    const uint32_t pix = argb[i];
+    const int max_len = (end - i < MAX_LENGTH) ? end - i : MAX_LENGTH;
+    const int rle_len =
+        (i > start && argb[i - 1] == pix)
+            ? VP8LVectorMismatch(argb + i, argb + i - 1, max_len)
+            : 0;
+    const int prev_row_len =
+        (i - start >= xsize && argb[i - xsize] == pix)
+            ? VP8LVectorMismatch(argb + i, argb + i - xsize, max_len)
+            : 0;
+    if (rle_len >= prev_row_len && rle_len >= REAL_TIME_MIN_COPY_LENGTH) {
+      // No need to update the color cache: it already has the copied pixel.
+      RealTimeCodeCopy(rle_len, dist_codes[0], histo, codes, bw);
+      i += rle_len;
+    } else if (prev_row_len >= REAL_TIME_MIN_COPY_LENGTH) {
+      int k;
+      for (k = 0; k < prev_row_len; ++k) {
+        VP8LColorCacheInsert(hashers, argb[i + k]);
+      }
+      RealTimeCodeCopy(prev_row_len, dist_codes[1], histo, codes, bw);
+      i += prev_row_len;
+    } else {
+      const int key = VP8LColorCacheGetIndex(hashers, pix);
+      const int cache_code = NUM_LITERAL_CODES + NUM_LENGTH_CODES + key;
+      // Cache indices missing in the sample have no code: such pixels are
+      // written as literals instead, which leaves the cache unchanged.
+      if (hashers->colors[key] == pix &&
+          (histo != NULL || codes[0].code_lengths[cache_code] != 0)) {
+        if (histo != NULL) {
+          ++histo->literal[cache_code];
+        } else {
+          WriteHuffmanCode(bw, &codes[0], cache_code);
+        }
+      } else {
+        const int a = (pix >> 24) & 0xff;
+        const int r = (pix >> 16) & 0xff;
+        const int g = (pix >> 8) & 0xff;
+        const int b = (pix >> 0) & 0xff;
+        VP8LColorCacheSet(hashers, key, pix);
+        if (histo != NULL) {
+          ++histo->literal[g];
+          ++histo->red[r];
+          ++histo->blue[b];
+          ++histo->alpha[a];
+        } else {
+          // Write green and red, then blue and alpha, with one call each.
+          const int depth_g = codes[0].code_lengths[g];
+          const int depth_b = codes[2].code_lengths[b];
+          VP8LPutBits(bw, codes[0].codes[g] | (codes[1].codes[r] << depth_g),
+                      depth_g + codes[1].code_lengths[r]);
+          VP8LPutBits(bw, codes[2].codes[b] | (codes[3].codes[a] << depth_b),
+                      depth_b + codes[3].code_lengths[a]);
+        }
+      }
+      ++i;
+    }
+  }
+}
+
+// Scales the 'size' counts of a sample by 'scale' and makes them non-zero, so
+// that all the symbols, even those missing in the sample, can be written.
+static void ScaleSampledCounts(uint32_t* const counts, int size, int scale) {
+  int i;
+  for (i = 0; i < size; ++i) counts[i] = counts[i] * scale + 1;
+}
+
+// Encodes the picture in real-time mode, as described above. 'has_alpha' tells
+// whether the picture has transparency. 'enc' can be NULL.
+static int EncodeStreamRealTime(const WebPConfig* const config,
+                                const WebPPicture* const pic, int has_alpha,
+                                VP8LBitWriter* const bw,
+                                VP8LEncoder* const enc) {
+  VP8LEncoder* const enc_main =
+      (enc != NULL) ? enc : VP8LEncoderNew(config, pic);
+  const int width = pic->width;
+  const int height = pic->height;
+  const int cache_bits = REAL_TIME_CACHE_BITS;
+  const size_t byte_position = VP8LBitWriterNumBytes(bw);
+  const int full_sample =
+      ((uint64_t)width * height <= REAL_TIME_FULL_SAMPLE_SIZE);
+  const int sample_rows = full_sample ? height : REAL_TIME_SAMPLE_ROWS;
+  const int sample_period = full_sample ? height : REAL_TIME_SAMPLE_PERIOD;
+  int dist_codes[2];
+  int predictor_bits, percent = 0;
+  int i, y, max_tokens = 0;
+  size_t hdr_size;
+  VP8LColorCache hashers;
+  VP8LHistogramSet* histogram_image = NULL;
+  HuffmanTreeCode huffman_codes[5] = {{0, NULL, NULL}};
+  HuffmanTree* huff_tree = NULL;
+  HuffmanTreeToken* tokens = NULL;
+
+  memset(&hashers, 0, sizeof(hashers));
+  if (enc_main == NULL) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  enc_main->use_palette = 0;
+  enc_main->use_subtract_green = 1;
+  enc_main->use_predict = 1;
+  enc_main->use_cross_color = 0;
+  enc_main->histo_bits = 0;
+  enc_main->cache_bits = cache_bits;
+  enc_main->argb_content = kEncoderNone;
+  if (!MakeInputImageCopy(enc_main)) goto Error;
+
+  // Apply the transforms. A single predictor needs a single tile.
+  ApplySubtractGreen(enc_main, width, height, bw);
+  if (!VP8LResidualImage(width, height, MAX_TRANSFORM_BITS, MAX_TRANSFORM_BITS,
+                         /*low_effort=*/1, enc_main->argb,
+                         enc_main->argb_scratch, enc_main->transform_data,
+                         /*near_lossless_quality=*/100, config->exact,
+                         /*used_subtract_green=*/1, pic, /*percent_range=*/0,
+                         &percent, &predictor_bits)) {
+    goto Error;
+  }
+  VP8LPutBits(bw, TRANSFORM_PRESENT, 1);
+  VP8LPutBits(bw, PREDICTOR_TRANSFORM, 2);
+  VP8LPutBits(bw, predictor_bits - MIN_TRANSFORM_BITS, NUM_TRANSFORM_BITS);
+  StoreUniformImage(bw, enc_main->transform_data[0]);
+  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
 
-  // Avoid "garbage value" error from Clang's static analysis tool.
-  if (!WebPPictureInit(&picture_side)) {
+  // Estimate the Huffman codes.
+  histogram_image = VP8LAllocateHistogramSet(1, cache_bits);
+  if (histogram_image == NULL || !VP8LColorCacheInit(&hashers, cache_bits)) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+  VP8LHistogramSetClear(histogram_image);
+  for (i = 0; i < 2; ++i) {
+    const int dist = (i == 0) ? 1 : width;
+    int n_bits, bits;
+    VP8LPrefixEncode(VP8LDistanceToPlaneCode(width, dist), &dist_codes[i],
+                     &n_bits, &bits);
+    assert(n_bits == 0);
+  }
+  for (y = 0; y < height; y += sample_period) {
+    const int y_end = (y + sample_rows < height) ? y + sample_rows : height;
+    memset(hashers.colors, 0, sizeof(*hashers.colors) << cache_bits);
+    RealTimeCodePixels(enc_main->argb, width, y * width, y_end * width,
+                       dist_codes, &hashers, histogram_image->histograms[0],
+                       /*codes=*/NULL, /*bw=*/NULL);
+  }
+  if (!full_sample) {
+    VP8LHistogram* const histo = histogram_image->histograms[0];
+    const int scale = REAL_TIME_SAMPLE_PERIOD / REAL_TIME_SAMPLE_ROWS;
+    ScaleSampledCounts(histo->literal, NUM_LITERAL_CODES + NUM_LENGTH_CODES,
+                       scale);
+    // The cache indices are only scaled.
+    for (i = NUM_LITERAL_CODES + NUM_LENGTH_CODES;
+         i < VP8LHistogramNumCodes(cache_bits); ++i) {
+      histo->literal[i] *= scale;
+    }
+    ScaleSampledCounts(histo->red, NUM_LITERAL_CODES, scale);
+    ScaleSampledCounts(histo->blue, NUM_LITERAL_CODES, scale);
+    // Without transparency, all the alpha residuals are 0.
+    if (has_alpha) {
+      ScaleSampledCounts(histo->alpha, NUM_LITERAL_CODES, scale);
+    }
+    ScaleSampledCounts(&histo->distance[dist_codes[0]], 1, scale);
+    if (dist_codes[1] != dist_codes[0]) {
+      ScaleSampledCounts(&histo->distance[dist_codes[1]], 1, scale);
+    }
+  }
+  if (!GetHuffBitLengthsAndCodes(histogram_image, huffman_codes)) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
     goto Error;
   }
 
-  // Analyze image (entropy, num_palettes etc)
-  if (!EncoderAnalyze(enc_main, crunch_configs, &num_crunch_configs_main,
-                      &red_and_blue_always_zero) ||
-      !EncoderInit(enc_main)) {
-    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  // Color cache, no Huffman image.
+  VP8LPutBits(bw, 1, 1);
+  VP8LPutBits(bw, cache_bits, 4);
+  VP8LPutBits(bw, 0, 1);
+
+  // Store the Huffman codes.
+  for (i = 0; i < 5; ++i) {
+    if (max_tokens < huffman_codes[i].num_symbols) {
+      max_tokens = huffman_codes[i].num_symbols;
+    }
+  }
+  huff_tree = (HuffmanTree*)WebPSafeMalloc(3ULL * CODE_LENGTH_CODES,
+                                           sizeof(*huff_tree));
+  tokens = (HuffmanTreeToken*)WebPSafeMalloc(max_tokens, sizeof(*tokens));
+  if (huff_tree == NULL || tokens == NULL) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+  for (i = 0; i < 5; ++i) {
+    StoreHuffmanCode(bw, huff_tree, tokens, &huffman_codes[i]);
+    ClearHuffmanTreeIfOnlyOneSymbol(&huffman_codes[i]);
+  }
+  hdr_size = VP8LBitWriterNumBytes(bw) - byte_position;
+
+  // Store the pixels.
+  memset(hashers.colors, 0, sizeof(*hashers.colors) << cache_bits);
+  RealTimeCodePixels(enc_main->argb, width, 0, width * height, dist_codes,
+                     &hashers, /*histo=*/NULL, huffman_codes, bw);
+  if (bw->error) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
     goto Error;
   }
 
-  // Split the configs between the main and side threads (if any).
-  if (config->thread_level > 0) {
-    num_crunch_configs_side = num_crunch_configs_main / 2;
-    for (idx = 0; idx < num_crunch_configs_side; ++idx) {
-      params_side.crunch_configs[idx] =
-          crunch_configs[num_crunch_configs_main - num_crunch_configs_side +
-                         idx];
+#if !defined(WEBP_DISABLE_STATS)
+  if (pic->stats != NULL) {
+    WebPAuxStats* const stats = pic->stats;
+    const size_t size = VP8LBitWriterNumBytes(bw) - byte_position;
+    stats->lossless_features = 1 | 4;  // Predictor and subtract-green.
+    stats->histogram_bits = 0;
+    stats->transform_bits = predictor_bits;
+    stats->cross_color_transform_bits = 0;
+    stats->cache_bits = cache_bits;
+    stats->palette_size = 0;
+    stats->lossless_size = (int)size;
+    stats->lossless_hdr_size = (int)hdr_size;
+    stats->lossless_data_size = (int)(size - hdr_size);
+  }
+#endif
+
+Error:
+  WebPSafeFree(tokens);
+  WebPSafeFree(huff_tree);
+  WebPSafeFree(huffman_codes[0].codes);
+  VP8LFreeHistogramSet(histogram_image);
+  VP8LColorCacheClear(&hashers);
+  if (enc_main != enc) VP8LEncoderDelete(enc_main);
+  return (pic->error_code == VP8_ENC_OK);
+}
+
+#undef REAL_TIME_SAMPLE_PERIOD
+#undef REAL_TIME_SAMPLE_ROWS
+#undef REAL_TIME_FULL_SAMPLE_SIZE
+#undef REAL_TIME_MIN_COPY_LENGTH
+#undef REAL_TIME_CACHE_BITS
+
+//------------------------------------------------------------------------------
+// Low-memory encoding (config->low_memory).
+// The transformed image is never held in full: it is processed in bands of
+// rows, the LZ77 references of each band reaching into a window of the rows
+// above it. As the transforms and the entropy codes come first in the
+// bitstream, the bands are processed twice: once to find the predictors and to
+// gather the histograms, and once to write the pixels. Only the guessed best
+// config is used, with the standard LZ77 and without cross-color transform nor
+// near-lossless.
+
+// Budget, in bytes, of the encoder's working memory.
+#define LOW_MEMORY_BUDGET ((size_t)64 << 20)
+// Approximate memory per pixel of the regular encoder, which is still used if
+// the image fits in the budget.
+#define LOW_MEMORY_REGULAR_BYTES_PER_PIXEL 24
+// Memory per pixel of a band: the transformed pixel, its hash chain entry, at
+// most two references and the path of TraceBackwards.
+#define LOW_MEMORY_BAND_BYTES_PER_PIXEL \
+  (2 * sizeof(uint32_t) + 2 * sizeof(PixOrCopy) + sizeof(uint16_t))
+// Memory per pixel of the window: the transformed pixel and its hash chain
+// entry.
+#define LOW_MEMORY_WINDOW_BYTES_PER_PIXEL (2 * sizeof(uint32_t))
+
+static int UseLowMemoryEncoding(const WebPConfig* const config,
+                                const WebPPicture* const pic) {
+  return config->low_memory && config->method >= 0 &&
+         (uint64_t)pic->width * pic->height *
+                 LOW_MEMORY_REGULAR_BYTES_PER_PIXEL >
+             LOW_MEMORY_BUDGET;
+}
+
+typedef struct {
+  VP8LEncoder* enc;
+  int width;  // packed width
+  int height;
+  int xbits;  // pixel packing of the palette
+  int quality;
+  int low_effort;
+  int band_rows;    // rows coded at once
+  int window_rows;  // rows kept above the band for the LZ77 references
+  int num_rows;     // rows currently in enc->argb
+  int predictor_bits;
+  uint32_t* modes;           // predictor image of the whole picture
+  uint32_t* search_scratch;  // scratch rows for the predictor search
+  int cache_bits;
+  VP8LColorCache hashers;  // color cache, carried from band to band
+  int percent;             // for WebPProgressHook
+} BandEncoder;
+
+// Reads the rows [y, y_end) of the picture into 'dst' with the palette or the
+// subtract-green transform applied, plus the following row if any, needed to
+// predict the last one.
+static int ReadBandRows(const BandEncoder* const b, int y, int y_end,
+                        uint32_t* const dst) {
+  const VP8LEncoder* const enc = b->enc;
+  const WebPPicture* const pic = enc->pic;
+  const uint32_t* const src = pic->argb + (size_t)y * pic->argb_stride;
+  const int num_rows = ((y_end < b->height) ? y_end + 1 : y_end) - y;
+  int i;
+  if (enc->use_palette) {
+    return ApplyPalette(src, pic->argb_stride, dst, b->width, enc->palette,
+                        enc->palette_size, pic->width, num_rows, b->xbits,
+                        pic);
+  }
+  for (i = 0; i < num_rows; ++i) {
+    memcpy(dst + (size_t)i * b->width, src + (size_t)i * pic->argb_stride,
+           b->width * sizeof(*dst));
+  }
+  if (enc->use_subtract_green) {
+    VP8LSubtractGreenFromBlueAndRed(dst, num_rows * b->width);
+  }
+  return 1;
+}
+
+// Transforms the rows [y, y_end) below the window and computes their backward
+// references into enc->refs[0]. The predictors are searched in the first pass,
+// as well as the color cache size on the first band.
+static int TransformBand(BandEncoder* const b, int y, int y_end,
+                         int first_pass) {
+  VP8LEncoder* const enc = b->enc;
+  const WebPConfig* const config = enc->config;
+  const WebPPicture* const pic = enc->pic;
+  const int width = b->width;
+  const int context_rows =
+      (b->num_rows < b->window_rows) ? b->num_rows : b->window_rows;
+  uint32_t* const band = enc->argb + (size_t)context_rows * width;
+
+  if (context_rows > 0) {
+    memmove(enc->argb, enc->argb + (size_t)(b->num_rows - context_rows) * width,
+            (size_t)context_rows * width * sizeof(*enc->argb));
+  }
+  if (!ReadBandRows(b, y, y_end, band)) return 0;
+  if (enc->use_predict) {
+    const int bits = b->predictor_bits;
+    if (first_pass &&
+        !VP8LGetBandPredictors(
+            width, y_end - y, bits, b->low_effort, b->search_scratch, band,
+            config->exact, enc->use_subtract_green, pic,
+            b->modes + (y >> bits) * VP8LSubSampleSize(width, bits))) {
+      return 0;
+    }
+    VP8LResidualRows(width, b->height, y, y_end, bits, b->modes, b->low_effort,
+                     enc->argb_scratch, band, config->exact,
+                     enc->use_subtract_green);
+  }
+  b->num_rows = context_rows + y_end - y;
+
+  if (!VP8LHashChainFill(&enc->hash_chain, b->quality, enc->argb, width,
+                         b->num_rows, b->low_effort, /*num_threads=*/1, pic,
+                         /*percent_range=*/0, &b->percent) ||
+      !VP8LGetBackwardReferencesBand(
+          width, context_rows * width, b->num_rows * width, enc->argb,
+          b->quality, b->low_effort, &enc->hash_chain,
+          (first_pass && y == 0) ? &b->cache_bits : NULL, &b->hashers,
+          enc->refs)) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  return 1;
+}
+
+// Picks the transforms and the sizes of the bands, allocates the buffers and
+// writes the palette and subtract-green transforms.
+static int BandEncoderInit(BandEncoder* const b, VP8LEncoder* const enc,
+                           VP8LBitWriter* const bw, int* const histo_bits) {
+  const WebPConfig* const config = enc->config;
+  const WebPPicture* const pic = enc->pic;
+  const size_t budget = LOW_MEMORY_BUDGET;
+  const size_t histo_size =
+      sizeof(VP8LHistogram) + sizeof(VP8LHistogram*) +
+      sizeof(uint32_t) * VP8LHistogramNumCodes(MAX_COLOR_CACHE_BITS);
+  CrunchConfig crunch_configs[CRUNCH_CONFIGS_MAX];
+  int num_crunch_configs, red_and_blue_always_zero = 0;
+  int entropy_idx, tile_rows = 1, num_tiles, num_predictors = 0;
+  size_t used, row_size;
+
+  memset(b, 0, sizeof(*b));
+  b->enc = enc;
+  b->height = pic->height;
+  b->quality = (int)config->quality;
+  b->low_effort = (config->method == 0);
+  enc->num_threads = WebPEncGetNumThreads(config);
+  if (!EncoderAnalyze(enc, crunch_configs, &num_crunch_configs,
+                      &red_and_blue_always_zero, /*allow_brute_force=*/0)) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  entropy_idx = crunch_configs[0].entropy_idx;
+  enc->use_palette =
+      (entropy_idx == kPalette) || (entropy_idx == kPaletteAndSpatial);
+  enc->use_subtract_green =
+      (entropy_idx == kSubGreen) || (entropy_idx == kSpatialSubGreen);
+  enc->use_predict = (entropy_idx == kSpatial) ||
+                     (entropy_idx == kSpatialSubGreen) ||
+                     (entropy_idx == kPaletteAndSpatial);
+  enc->use_cross_color = 0;
+  b->cache_bits = MAX_COLOR_CACHE_BITS;
+  if (enc->use_palette) {
+    b->xbits = GetPaletteXBits(enc->palette_size);
+    if (enc->palette_size < (1 << MAX_COLOR_CACHE_BITS)) {
+      b->cache_bits = BitsLog2Floor(enc->palette_size) + 1;
     }
-    params_side.num_crunch_configs = num_crunch_configs_side;
   }
-  num_crunch_configs_main -= num_crunch_configs_side;
-  for (idx = 0; idx < num_crunch_configs_main; ++idx) {
-    params_main.crunch_configs[idx] = crunch_configs[idx];
+  b->width = VP8LSubSampleSize(pic->width, b->xbits);
+
+  // Keep the histograms within a quarter of the budget.
+  *histo_bits = enc->histo_bits;
+  num_tiles = VP8LSubSampleSize(b->width, *histo_bits) *
+              VP8LSubSampleSize(b->height, *histo_bits);
+  while (*histo_bits < MAX_HUFFMAN_BITS &&
+         2 * num_tiles * histo_size > budget / 4) {
+    ++*histo_bits;
+    num_tiles = VP8LSubSampleSize(b->width, *histo_bits) *
+                VP8LSubSampleSize(b->height, *histo_bits);
+  }
+  if (enc->use_predict) {
+    b->predictor_bits =
+        ClampBits(b->width, b->height, enc->predictor_transform_bits,
+                  MIN_TRANSFORM_BITS, MAX_TRANSFORM_BITS,
+                  MAX_PREDICTOR_IMAGE_SIZE);
+    tile_rows = 1 << b->predictor_bits;
+    num_predictors = VP8LSubSampleSize(b->width, b->predictor_bits) *
+                     VP8LSubSampleSize(b->height, b->predictor_bits);
+  }
+
+  // Share the rest between the band and the window, the band being made of
+  // whole rows of predictor tiles.
+  used = 2 * num_tiles * histo_size + num_predictors * sizeof(uint32_t);
+  row_size = (size_t)b->width * LOW_MEMORY_BAND_BYTES_PER_PIXEL;
+  b->band_rows = (budget > used) ? (int)((budget - used) / 2 / row_size) : 0;
+  b->band_rows -= b->band_rows % tile_rows;
+  if (b->band_rows < tile_rows) b->band_rows = tile_rows;
+  if (b->band_rows >= b->height) {
+    b->band_rows = b->height;
+  } else {
+    used += b->band_rows * row_size;
+    row_size = (size_t)b->width * LOW_MEMORY_WINDOW_BYTES_PER_PIXEL;
+    b->window_rows = (budget > used) ? (int)((budget - used) / row_size) : 0;
+    if (b->window_rows > (1 << WINDOW_SIZE_BITS) / b->width) {
+      b->window_rows = (1 << WINDOW_SIZE_BITS) / b->width;
+    }
   }
-  params_main.num_crunch_configs = num_crunch_configs_main;
 
-  // Fill in the parameters for the thread workers.
   {
-    const int params_size = (num_crunch_configs_side > 0) ? 2 : 1;
-    for (idx = 0; idx < params_size; ++idx) {
-      // Create the parameters for each worker.
-      WebPWorker* const worker = (idx == 0) ? &worker_main : &worker_side;
-      StreamEncodeContext* const param =
-          (idx == 0) ? &params_main : &params_side;
-      param->config = config;
-      param->red_and_blue_always_zero = red_and_blue_always_zero;
-      if (idx == 0) {
-        param->picture = picture;
-        param->stats = picture->stats;
-        param->bw = bw_main;
-        param->enc = enc_main;
-      } else {
-        // Create a side picture (error_code is not thread-safe).
-        if (!WebPPictureView(picture, /*left=*/0, /*top=*/0, picture->width,
-                             picture->height, &picture_side)) {
-          assert(0);
-        }
-        picture_side.progress_hook = NULL;  // Progress hook is not thread-safe.
-        param->picture = &picture_side;  // No need to free a view afterwards.
-        param->stats = (picture->stats == NULL) ? NULL : &stats_side;
-        // Create a side bit writer.
-        if (!VP8LBitWriterClone(bw_main, &bw_side)) {
-          WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-          goto Error;
-        }
-        param->bw = &bw_side;
-        // Create a side encoder.
-        enc_side = VP8LEncoderNew(config, &picture_side);
-        if (enc_side == NULL || !EncoderInit(enc_side)) {
-          WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-          goto Error;
-        }
-        // Copy the values that were computed for the main encoder.
-        enc_side->histo_bits = enc_main->histo_bits;
-        enc_side->predictor_transform_bits = enc_main->predictor_transform_bits;
-        enc_side->cross_color_transform_bits =
-            enc_main->cross_color_transform_bits;
-        enc_side->palette_size = enc_main->palette_size;
-        memcpy(enc_side->palette, enc_main->palette, sizeof(enc_main->palette));
-        memcpy(enc_side->palette_sorted, enc_main->palette_sorted,
-               sizeof(enc_main->palette_sorted));
-        param->enc = enc_side;
+    int max_size = (b->window_rows + b->band_rows) * b->width;
+    if (max_size < num_tiles) max_size = num_tiles;
+    if (max_size < num_predictors) max_size = num_predictors;
+    if (max_size < MAX_PALETTE_SIZE) max_size = MAX_PALETTE_SIZE;
+    if (!AllocateTransformBuffer(enc, b->width,
+                                 b->window_rows + b->band_rows + 1)) {
+      return 0;
+    }
+    if (!EncoderInitForSize(enc, max_size)) {
+      return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+  }
+  if (enc->use_predict) {
+    const uint64_t scratch_size =
+        (b->width + 1) * 2 +
+        (b->width * 2 + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+    b->modes = (uint32_t*)WebPSafeMalloc(num_predictors, sizeof(*b->modes));
+    b->search_scratch =
+        (uint32_t*)WebPSafeMalloc(scratch_size, sizeof(*b->search_scratch));
+    if (b->modes == NULL || b->search_scratch == NULL) {
+      return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+  }
+
+  if (enc->use_palette) {
+    if (!PaletteSort(crunch_configs[0].palette_sorting_type, pic,
+                     enc->palette_sorted, enc->palette_size, enc->palette)) {
+      return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+    if (!EncodePalette(bw, b->low_effort, enc, /*percent_range=*/0,
+                       &b->percent)) {
+      return 0;
+    }
+  }
+  if (enc->use_subtract_green) {
+    VP8LPutBits(bw, TRANSFORM_PRESENT, 1);
+    VP8LPutBits(bw, SUBTRACT_GREEN_TRANSFORM, 2);
+  }
+  return 1;
+}
+
+// Encodes the picture band by band, as described above. 'enc' can be NULL.
+static int EncodeStreamLowMemory(const WebPConfig* const config,
+                                 const WebPPicture* const pic,
+                                 VP8LBitWriter* const bw,
+                                 VP8LEncoder* const enc) {
+  VP8LEncoder* const enc_main =
+      (enc != NULL) ? enc : VP8LEncoderNew(config, pic);
+  const size_t byte_position = VP8LBitWriterNumBytes(bw);
+  const int height = pic->height;
+  BandEncoder b;
+  int histo_bits = 0, histogram_bits, num_tiles, histogram_image_size = 0;
+  int y, i, max_tokens = 0, hdr_size = 0;
+  VP8LHistogramSet* orig_histo = NULL;
+  VP8LHistogramSet* histogram_image = NULL;
+  VP8LHistogram* tmp_histo = NULL;
+  uint32_t* histogram_symbols = NULL;
+  HuffmanTreeCode* huffman_codes = NULL;
+  HuffmanTree* huff_tree = NULL;
+  HuffmanTreeToken* tokens = NULL;
+
+  memset(&b, 0, sizeof(b));
+  if (enc_main == NULL) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+  if (!BandEncoderInit(&b, enc_main, bw, &histo_bits)) goto Error;
+  num_tiles = VP8LSubSampleSize(b.width, histo_bits) *
+              VP8LSubSampleSize(height, histo_bits);
+
+  // First pass: predictors and histograms.
+  for (y = 0; y < height; y += b.band_rows) {
+    const int y_end = (y + b.band_rows < height) ? y + b.band_rows : height;
+    if (!TransformBand(&b, y, y_end, /*first_pass=*/1)) goto Error;
+    if (y == 0) {
+      enc_main->cache_bits = b.cache_bits;
+      orig_histo = VP8LAllocateHistogramSet(num_tiles, b.cache_bits);
+      if (orig_histo == NULL) {
+        WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+        goto Error;
       }
-      // Create the workers.
-      worker_interface->Init(worker);
-      worker->data1 = param;
-      worker->data2 = NULL;
-      worker->hook = EncodeStreamHook;
+      VP8LHistogramSetClear(orig_histo);
+    }
+    VP8LHistogramAddRefsToTiles(b.width, y, histo_bits, &enc_main->refs[0],
+                                orig_histo);
+    if (!WebPReportProgress(pic, 2 + 45 * y_end / height, &b.percent)) {
+      goto Error;
     }
   }
 
-  // Start the second thread if needed.
-  if (num_crunch_configs_side != 0) {
-    if (!worker_interface->Reset(&worker_side)) {
-      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  if (enc_main->use_predict) {
+    VP8LOptimizeSampling(b.modes, b.width, height, b.predictor_bits,
+                         MAX_TRANSFORM_BITS, &b.predictor_bits);
+    VP8LPutBits(bw, TRANSFORM_PRESENT, 1);
+    VP8LPutBits(bw, PREDICTOR_TRANSFORM, 2);
+    VP8LPutBits(bw, b.predictor_bits - MIN_TRANSFORM_BITS, NUM_TRANSFORM_BITS);
+    if (!EncodeImageNoHuffman(
+            bw, b.modes, &enc_main->hash_chain, enc_main->refs,
+            VP8LSubSampleSize(b.width, b.predictor_bits),
+            VP8LSubSampleSize(height, b.predictor_bits), b.quality,
+            b.low_effort, pic, /*percent_range=*/0, &b.percent)) {
       goto Error;
     }
-#if !defined(WEBP_DISABLE_STATS)
-    // This line is here and not in the param initialization above to remove a
-    // Clang static analyzer warning.
-    if (picture->stats != NULL) {
-      memcpy(&stats_side, picture->stats, sizeof(stats_side));
+  }
+  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
+
+  // Cluster the histograms and build their Huffman codes.
+  histogram_image = VP8LAllocateHistogramSet(num_tiles, b.cache_bits);
+  tmp_histo = VP8LAllocateHistogram(b.cache_bits);
+  histogram_symbols =
+      (uint32_t*)WebPSafeMalloc(num_tiles, sizeof(*histogram_symbols));
+  if (histogram_image == NULL || tmp_histo == NULL ||
+      histogram_symbols == NULL) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+  if (!VP8LGetHistoImageSymbolsFromTiles(
+          orig_histo, b.quality, b.low_effort, enc_main->num_threads,
+          histogram_image, tmp_histo, histogram_symbols, pic,
+          /*percent_range=*/5, &b.percent)) {
+    goto Error;
+  }
+  VP8LFreeHistogramSet(orig_histo);
+  orig_histo = NULL;
+  huffman_codes = (HuffmanTreeCode*)WebPSafeCalloc(5 * histogram_image->size,
+                                                   sizeof(*huffman_codes));
+  if (huffman_codes == NULL ||
+      !GetHuffBitLengthsAndCodes(histogram_image, huffman_codes)) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+  VP8LFreeHistogramSet(histogram_image);
+  histogram_image = NULL;
+  VP8LFreeHistogram(tmp_histo);
+  tmp_histo = NULL;
+
+  // Color cache, Huffman image and Huffman codes.
+  if (b.cache_bits > 0) {
+    VP8LPutBits(bw, 1, 1);
+    VP8LPutBits(bw, b.cache_bits, 4);
+  } else {
+    VP8LPutBits(bw, 0, 1);
+  }
+  for (i = 0; i < num_tiles; ++i) {
+    if ((int)histogram_symbols[i] >= histogram_image_size) {
+      histogram_image_size = histogram_symbols[i] + 1;
     }
-#endif
-    worker_interface->Launch(&worker_side);
-  }
-  // Execute the main thread.
-  worker_interface->Execute(&worker_main);
-  ok_main = worker_interface->Sync(&worker_main);
-  worker_interface->End(&worker_main);
-  if (num_crunch_configs_side != 0) {
-    // Wait for the second thread.
-    const int ok_side = worker_interface->Sync(&worker_side);
-    worker_interface->End(&worker_side);
-    if (!ok_main || !ok_side) {
-      if (picture->error_code == VP8_ENC_OK) {
-        assert(picture_side.error_code != VP8_ENC_OK);
-        WebPEncodingSetError(picture, picture_side.error_code);
-      }
+    histogram_symbols[i] <<= 8;
+  }
+  histogram_bits = histo_bits;
+  VP8LPutBits(bw, histogram_image_size > 1, 1);
+  if (histogram_image_size > 1) {
+    VP8LOptimizeSampling(histogram_symbols, b.width, height, histo_bits,
+                         MAX_HUFFMAN_BITS, &histogram_bits);
+    VP8LPutBits(bw, histogram_bits - 2, 3);
+    if (!EncodeImageNoHuffman(
+            bw, histogram_symbols, &enc_main->hash_chain, enc_main->refs,
+            VP8LSubSampleSize(b.width, histogram_bits),
+            VP8LSubSampleSize(height, histogram_bits), b.quality,
+            b.low_effort, pic, /*percent_range=*/0, &b.percent)) {
+      goto Error;
+    }
+  }
+  for (i = 0; i < 5 * histogram_image_size; ++i) {
+    if (max_tokens < huffman_codes[i].num_symbols) {
+      max_tokens = huffman_codes[i].num_symbols;
+    }
+  }
+  huff_tree = (HuffmanTree*)WebPSafeMalloc(3ULL * CODE_LENGTH_CODES,
+                                           sizeof(*huff_tree));
+  tokens = (HuffmanTreeToken*)WebPSafeMalloc(max_tokens, sizeof(*tokens));
+  if (huff_tree == NULL || tokens == NULL) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+  for (i = 0; i < 5 * histogram_image_size; ++i) {
+    StoreHuffmanCode(bw, huff_tree, tokens, &huffman_codes[i]);
+    ClearHuffmanTreeIfOnlyOneSymbol(&huffman_codes[i]);
+  }
+  hdr_size = (int)(VP8LBitWriterNumBytes(bw) - byte_position);
+
+  // Second pass: the bands are transformed again, identically, and written.
+  b.num_rows = 0;
+  if (b.hashers.colors != NULL) {
+    memset(b.hashers.colors, 0, sizeof(*b.hashers.colors) << b.cache_bits);
+  }
+  for (y = 0; y < height; y += b.band_rows) {
+    const int y_end = (y + b.band_rows < height) ? y + b.band_rows : height;
+    if (!TransformBand(&b, y, y_end, /*first_pass=*/0) ||
+        !StoreImageToBitMask(bw, b.width, y, histogram_bits,
+                             &enc_main->refs[0], histogram_symbols,
+                             huffman_codes, pic)) {
+      goto Error;
+    }
+    if (!WebPReportProgress(pic, 52 + 45 * y_end / height, &b.percent)) {
       goto Error;
     }
-    if (VP8LBitWriterNumBytes(&bw_side) < VP8LBitWriterNumBytes(bw_main)) {
-      VP8LBitWriterSwap(bw_main, &bw_side);
+  }
+
 #if !defined(WEBP_DISABLE_STATS)
-      if (picture->stats != NULL) {
-        memcpy(picture->stats, &stats_side, sizeof(*picture->stats));
-      }
+  if (pic->stats != NULL) {
+    WebPAuxStats* const stats = pic->stats;
+    const size_t size = VP8LBitWriterNumBytes(bw) - byte_position;
+    stats->lossless_features = 0;
+    if (enc_main->use_predict) stats->lossless_features |= 1;
+    if (enc_main->use_subtract_green) stats->lossless_features |= 4;
+    if (enc_main->use_palette) stats->lossless_features |= 8;
+    stats->histogram_bits = histo_bits;
+    stats->transform_bits = b.predictor_bits;
+    stats->cross_color_transform_bits = 0;
+    stats->cache_bits = b.cache_bits;
+    stats->palette_size = enc_main->palette_size;
+    stats->lossless_size = (int)size;
+    stats->lossless_hdr_size = hdr_size;
+    stats->lossless_data_size = (int)size - hdr_size;
+  }
 #endif
-    }
+
+Error:
+  WebPSafeFree(tokens);
+  WebPSafeFree(huff_tree);
+  if (huffman_codes != NULL) {
+    WebPSafeFree(huffman_codes->codes);
+    WebPSafeFree(huffman_codes);
+  }
+  WebPSafeFree(histogram_symbols);
+  VP8LFreeHistogram(tmp_histo);
+  VP8LFreeHistogramSet(histogram_image);
+  VP8LFreeHistogramSet(orig_histo);
+  VP8LColorCacheClear(&b.hashers);
+  WebPSafeFree(b.search_scratch);
+  WebPSafeFree(b.modes);
+  if (enc_main != enc) VP8LEncoderDelete(enc_main);
+  return (pic->error_code == VP8_ENC_OK);
+}
+
+#undef LOW_MEMORY_WINDOW_BYTES_PER_PIXEL
+#undef LOW_MEMORY_BAND_BYTES_PER_PIXEL
+#undef LOW_MEMORY_REGULAR_BYTES_PER_PIXEL
+
+int VP8LEncodeStream(const WebPConfig* const config,
+                     const WebPPicture* const picture,
+                     VP8LBitWriter* const bw_main, VP8LEncoder* const enc) {
+  VP8LEncoder* const enc_main =
+      (enc != NULL) ? enc : VP8LEncoderNew(config, picture);
+  CrunchConfig crunch_configs[CRUNCH_CONFIGS_MAX];
+  int num_crunch_configs;
+  int red_and_blue_always_zero = 0;
+
+  if (enc_main == NULL) {
+    return WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+  }
+
+  // Analyze image (entropy, num_palettes etc)
+  if (!EncoderAnalyze(enc_main, crunch_configs, &num_crunch_configs,
+                      &red_and_blue_always_zero, /*allow_brute_force=*/1) ||
+      !EncoderInit(enc_main)) {
+    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    goto Error;
+  }
+
+  // Only fully encode the 'config->pass' most promising configs.
+  if (!PruneCrunchConfigs(config, picture, enc_main, crunch_configs,
+                          &num_crunch_configs, red_and_blue_always_zero,
+                          config->pass)) {
+    goto Error;
   }
 
+  (void)CrunchConfigs(config, picture, bw_main, enc_main, crunch_configs,
+                      num_crunch_configs, red_and_blue_always_zero,
+                      /*config_sizes=*/NULL);
+
 Error:
-  VP8LBitWriterWipeOut(&bw_side);
-  VP8LEncoderDelete(enc_main);
-  VP8LEncoderDelete(enc_side);
+  if (enc_main != enc) VP8LEncoderDelete(enc_main);
   return (picture->error_code == VP8_ENC_OK);
 }
 
@@ -1822,7 +2809,7 @@ Error:
 #undef CRUNCH_SUBCONFIGS_MAX
 
 int VP8LEncodeImage(const WebPConfig* const config,
-                    const WebPPicture* const picture) {
+                    const WebPPicture* const picture, VP8LEncoder* const enc) {
   int width, height;
   int has_alpha;
   size_t coded_size;
@@ -1842,6 +2829,13 @@ int VP8LEncodeImage(const WebPConfig* const config,
   // 8 bpp for graphical images.
   initial_size = (config->image_hint == WEBP_HINT_GRAPH) ? width * height
                                                          : width * height * 2;
+  if (UseLowMemoryEncoding(config, picture)) {
+    // Let the output grow as needed rather than reserving it all upfront.
+    const size_t max_initial_size = LOW_MEMORY_BUDGET / 8;
+    if ((size_t)initial_size > max_initial_size) {
+      initial_size = (int)max_initial_size;
+    }
+  }
   if (!VP8LBitWriterInit(&bw, initial_size)) {
     WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
     goto Error;
@@ -1879,7 +2873,15 @@ int VP8LEncodeImage(const WebPConfig* const config,
   if (!WebPReportProgress(picture, 2, &percent)) goto UserAbort;
 
   // Encode main image stream.
-  if (!VP8LEncodeStream(config, picture, &bw)) goto Error;
+  if (config->method < 0) {
+    if (!EncodeStreamRealTime(config, picture, has_alpha, &bw, enc)) {
+      goto Error;
+    }
+  } else if (UseLowMemoryEncoding(config, picture)) {
+    if (!EncodeStreamLowMemory(config, picture, &bw, enc)) goto Error;
+  } else if (!VP8LEncodeStream(config, picture, &bw, enc)) {
+    goto Error;
+  }
 
   if (!WebPReportProgress(picture, 99, &percent)) goto UserAbort;
 
@@ -1910,4 +2912,6 @@ Error:
   return (picture->error_code == VP8_ENC_OK);
 }
 
+#undef LOW_MEMORY_BUDGET
+
 //------------------------------------------------------------------------------
@@ -81,21 +81,41 @@ typedef struct {
   struct VP8LBackwardRefs refs[4];  // Backward Refs array for temporaries.
   VP8LHashChain hash_chain;         // HashChain data for constructing
                                     // backward references.
+  uint32_t* hash_chain_mem;         // Memory of 'hash_chain', kept for reuse.
+  size_t hash_chain_mem_size;       // Currently allocated memory size.
+
+  int num_threads;  // Maximum number of threads to use, in [1..32].
 } VP8LEncoder;
 
 //------------------------------------------------------------------------------
 // internal functions. Not public.
 
+// Creates an encoder for 'picture'. Returns NULL in case of memory error
+// (stored in picture->error_code).
+VP8LEncoder* VP8LEncoderNew(const WebPConfig* const config,
+                            const WebPPicture* const picture);
+
+// Prepares the encoder for a new picture, but keeps the transform and hash
+// chain buffers for reuse unless they are larger than 'max_memory' bytes (the
+// transform buffer having the priority).
+void VP8LEncoderReset(VP8LEncoder* const enc, size_t max_memory);
+
+void VP8LEncoderDelete(VP8LEncoder* enc);
+
 // Encodes the picture.
+// If 'enc' is not NULL, it is used as the main encoder (with its config and
+// pic fields already set) and is not deleted. Otherwise, one is created.
 // Returns 0 if config or picture is NULL or picture doesn't have valid argb
 // input.
 int VP8LEncodeImage(const WebPConfig* const config,
-                    const WebPPicture* const picture);
+                    const WebPPicture* const picture, VP8LEncoder* const enc);
 
 // Encodes the main image stream using the supplied bit writer.
+// 'enc' is used as for VP8LEncodeImage().
 // Returns false in case of error (stored in picture->error_code).
 int VP8LEncodeStream(const WebPConfig* const config,
-                     const WebPPicture* const picture, VP8LBitWriter* const bw);
+                     const WebPPicture* const picture, VP8LBitWriter* const bw,
+                     VP8LEncoder* const enc);
 
 #if (WEBP_NEAR_LOSSLESS == 1)
 // in near_lossless.c
@@ -116,6 +136,25 @@ int VP8LResidualImage(int width, int height, int min_bits, int max_bits,
                       const WebPPicture* const pic, int percent_range,
                       int* const percent, int* const best_bits);
 
+// Finds the best predictor of each tile of 'bits' bits of the 'height' rows of
+// 'argb', a band of a bigger image searched as an image of its own, and stores
+// them in 'modes'. With 'low_effort', the same fixed predictor is used
+// everywhere. Returns false in case of error (stored in pic->error_code).
+int VP8LGetBandPredictors(int width, int height, int bits, int low_effort,
+                          uint32_t* const argb_scratch,
+                          const uint32_t* const argb, int exact,
+                          int used_subtract_green,
+                          const WebPPicture* const pic, uint32_t* const modes);
+
+// Converts the rows [y_start, y_end) of an image of 'height' rows to residuals
+// with the predictor image 'modes' of 'bits' bits. 'argb' starts at row
+// y_start and also holds the next row if any. The bands of the image must be
+// converted in order, with the same 'argb_scratch' keeping the previous row.
+void VP8LResidualRows(int width, int height, int y_start, int y_end, int bits,
+                      const uint32_t* const modes, int low_effort,
+                      uint32_t* const argb_scratch, uint32_t* const argb,
+                      int exact, int used_subtract_green);
+
 int VP8LColorSpaceTransform(int width, int height, int bits, int quality,
                             uint32_t* const argb, uint32_t* image,
                             const WebPPicture* const pic, int percent_range,
@@ -41,6 +41,14 @@ int WebPGetEncoderVersion(void) {
 // VP8Encoder
 //------------------------------------------------------------------------------
 
+struct WebPEncoderContext {
+  uint8_t* mem;           // lossy encoder memory chunk, kept between calls
+  size_t mem_size;        // size of 'mem', in bytes
+  VP8TBuffer tokens;      // token pages, recycled between calls
+  VP8LEncoder* vp8l_enc;  // lossless encoder, kept between calls
+  size_t max_memory;      // maximum size of the buffers kept between calls
+};
+
 static void ResetSegmentHeader(VP8Encoder* const enc) {
   VP8EncSegmentHeader* const hdr = &enc->segment_hdr;
   hdr->num_segments = enc->config->segments;
@@ -114,6 +122,8 @@ static void MapConfigToTools(VP8Encoder* const enc) {
       (score_t)256 * 510 * 8 * 1024 / (enc->mb_w * enc->mb_h);
 
   enc->thread_level = config->thread_level;
+  enc->num_threads = WebPEncGetNumThreads(config);
+  enc->threads_used = 1;
 
   enc->do_search = (config->target_size > 0 || config->target_PSNR > 0);
   if (!config->low_memory) {
@@ -146,7 +156,8 @@ static void MapConfigToTools(VP8Encoder* const enc) {
 // Picture size (yuv): 419328
 
 static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
-                                  WebPPicture* const picture) {
+                                  WebPPicture* const picture,
+                                  WebPEncoderContext* const context) {
   VP8Encoder* enc;
   const int use_filter =
       (config->filter_strength > 0) || (config->autofilter > 0);
@@ -203,10 +214,23 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
   printf("Picture size (yuv): %ld\n", mb_w * mb_h * 384 * sizeof(uint8_t));
   printf("===================================\n");
 #endif
-  mem = (uint8_t*)WebPSafeMalloc(size, sizeof(*mem));
-  if (mem == NULL) {
-    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    return NULL;
+  if (context != NULL && context->mem != NULL && size <= context->mem_size) {
+    mem = context->mem;  // reuse the chunk of the previous picture
+  } else {
+    if (context != NULL) {
+      WebPSafeFree(context->mem);
+      context->mem = NULL;
+      context->mem_size = 0;
+    }
+    mem = (uint8_t*)WebPSafeMalloc(size, sizeof(*mem));
+    if (mem == NULL) {
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      return NULL;
+    }
+    if (context != NULL) {
+      context->mem = mem;
+      context->mem_size = (size_t)size;
+    }
   }
   enc = (VP8Encoder*)mem;
   mem = (uint8_t*)WEBP_ALIGN(mem + sizeof(*enc));
@@ -237,6 +261,7 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
   enc->profile = use_filter ? ((config->filter_type == 1) ? 0 : 1) : 2;
   enc->pic = picture;
   enc->percent = 0;
+  enc->context = context;
 
   MapConfigToTools(enc);
   VP8EncDspInit();
@@ -253,15 +278,49 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
     const float scale = 1.f + config->quality * 5.f / 100.f;  // in [1,6]
     VP8TBufferInit(&enc->tokens, (int)(mb_w * mb_h * 4 * scale));
   }
+  if (context != NULL) VP8TBufferMovePages(&enc->tokens, &context->tokens);
   return enc;
 }
 
+// Releases the buffers kept by 'context' so that their total size fits within
+// context->max_memory. The encoder just used ('lossy' or not) gets the
+// priority over the other one.
+static void TrimContextMemory(WebPEncoderContext* const context, int lossy) {
+  VP8LEncoder* const vp8l_enc = context->vp8l_enc;
+  size_t max_memory = context->max_memory;
+  if (!lossy && vp8l_enc != NULL) {
+    VP8LEncoderReset(vp8l_enc, max_memory);
+    max_memory -=
+        vp8l_enc->transform_mem_size * sizeof(*vp8l_enc->transform_mem) +
+        vp8l_enc->hash_chain_mem_size * sizeof(*vp8l_enc->hash_chain_mem);
+  }
+  if (context->mem_size > max_memory) {
+    WebPSafeFree(context->mem);
+    context->mem = NULL;
+    context->mem_size = 0;
+  }
+  if (context->mem_size + VP8TBufferMemory(&context->tokens) > max_memory) {
+    VP8TBufferClear(&context->tokens);
+  }
+  if (lossy && vp8l_enc != NULL) {
+    VP8LEncoderReset(vp8l_enc, max_memory - context->mem_size -
+                                   VP8TBufferMemory(&context->tokens));
+  }
+}
+
 static int DeleteVP8Encoder(VP8Encoder* enc) {
   int ok = 1;
   if (enc != NULL) {
+    WebPEncoderContext* const context = enc->context;
     ok = VP8EncDeleteAlpha(enc);
-    VP8TBufferClear(&enc->tokens);
-    WebPSafeFree(enc);
+    if (context != NULL) {
+      // 'enc' lives in context->mem, which may be released below.
+      VP8TBufferMovePages(&context->tokens, &enc->tokens);
+      TrimContextMemory(context, /*lossy=*/1);
+    } else {
+      VP8TBufferClear(&enc->tokens);
+      WebPSafeFree(enc);
+    }
   }
   return ok;
 }
@@ -302,6 +361,10 @@ static void StoreStats(VP8Encoder* const enc) {
     for (i = 0; i < 3; ++i) {
       stats->block_count[i] = enc->block_count[i];
     }
+    // The alpha encoding may already have reported its own thread count.
+    if (enc->threads_used > stats->threads_used) {
+      stats->threads_used = enc->threads_used;
+    }
   }
 #else   // defined(WEBP_DISABLE_STATS)
   WebPReportProgress(enc->pic, 100, &enc->percent);  // done!
@@ -330,9 +393,39 @@ int WebPReportProgress(const WebPPicture* const pic, int percent,
   }
   return 1;  // ok
 }
+
+int WebPEncGetNumThreads(const WebPConfig* const config) {
+#ifdef WEBP_USE_THREAD
+  // Level 1 historically meant 'use a side thread', hence the 2 threads.
+  if (config->thread_level <= 0) return 1;
+  if (config->thread_level == 1) return 2;
+  return (config->thread_level > MAX_ENCODING_THREADS) ? MAX_ENCODING_THREADS
+                                                       : config->thread_level;
+#else
+  (void)config;
+  return 1;
+#endif
+}
+
 //------------------------------------------------------------------------------
 
-int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
+// Returns the lossless encoder kept by 'context', set up for 'pic', or NULL
+// if 'context' is NULL (or in case of memory error).
+static VP8LEncoder* GetVP8LEncoder(WebPEncoderContext* const context,
+                                   const WebPConfig* const config,
+                                   const WebPPicture* const pic) {
+  if (context == NULL) return NULL;
+  if (context->vp8l_enc == NULL) {
+    context->vp8l_enc = VP8LEncoderNew(config, pic);
+  } else {
+    context->vp8l_enc->config = config;
+    context->vp8l_enc->pic = pic;
+  }
+  return context->vp8l_enc;
+}
+
+static int Encode(WebPEncoderContext* const context,
+                  const WebPConfig* config, WebPPicture* pic) {
   int ok = 0;
   if (pic == NULL) return 0;
 
@@ -378,7 +471,7 @@ int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
       WebPCleanupTransparentArea(pic);
     }
 
-    enc = InitVP8Encoder(config, pic);
+    enc = InitVP8Encoder(config, pic, context);
     if (enc == NULL) return 0;  // pic->error is already set.
     // Note: each of the tasks below account for 20% in the progress report.
     ok = VP8EncAnalyze(enc);
@@ -408,8 +501,50 @@ int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
       WebPReplaceTransparentPixels(pic, 0x000000);
     }
 
-    ok = VP8LEncodeImage(config, pic);  // Sets pic->error in case of problem.
+    if (context == NULL) {
+      ok = VP8LEncodeImage(config, pic, NULL);  // Sets pic->error if problem.
+    } else {
+      VP8LEncoder* const enc = GetVP8LEncoder(context, config, pic);
+      if (enc == NULL) return 0;  // pic->error is already set.
+      ok = VP8LEncodeImage(config, pic, enc);
+      TrimContextMemory(context, /*lossy=*/0);
+    }
   }
 
   return ok;
 }
+
+int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
+  return Encode(NULL, config, pic);
+}
+
+//------------------------------------------------------------------------------
+// WebPEncoderContext
+
+WebPEncoderContext* WebPEncoderContextNew(size_t max_memory) {
+  WebPEncoderContext* const context =
+      (WebPEncoderContext*)WebPSafeCalloc(1ULL, sizeof(*context));
+  if (context != NULL) {
+    VP8TBufferInit(&context->tokens, 0);
+    context->max_memory = max_memory;
+  }
+  return context;
+}
+
+void WebPEncoderContextDelete(WebPEncoderContext* context) {
+  if (context == NULL) return;
+  WebPSafeFree(context->mem);
+  VP8TBufferClear(&context->tokens);
+  VP8LEncoderDelete(context->vp8l_enc);
+  WebPSafeFree(context);
+}
+
+int WebPEncodeWithContext(WebPEncoderContext* context,
+                          const WebPConfig* config, WebPPicture* picture) {
+  if (picture == NULL) return 0;
+  if (context == NULL) {
+    picture->error_code = VP8_ENC_OK;
+    return WebPEncodingSetError(picture, VP8_ENC_ERROR_NULL_PARAMETER);
+  }
+  return Encode(context, config, picture);
+}
@@ -314,12 +314,15 @@ int VP8LHuffmanTablesAllocate(int size, HuffmanTables* huffman_tables) {
     root->start = start;
   }
   root->curr_table = root->start;
+  huffman_tables->literal_tables = NULL;
   return 1;
 }
 
 void VP8LHuffmanTablesDeallocate(HuffmanTables* const huffman_tables) {
   HuffmanTablesSegment *current, *next;
   if (huffman_tables == NULL) return;
+  WebPSafeFree(huffman_tables->literal_tables);
+  huffman_tables->literal_tables = NULL;
   // Free the root node.
   current = &huffman_tables->root;
   next = current->next;
@@ -62,6 +62,8 @@ typedef struct HuffmanTables {
   HuffmanTablesSegment root;
   // Currently processed segment. At first, this is 'root'.
   HuffmanTablesSegment* curr_segment;
+  // Memory of the literal tables of the HTreeGroups, if any.
+  uint32_t* literal_tables;
 } HuffmanTables;
 
 // Allocates a HuffmanTables with 'size' contiguous HuffmanCodes. Returns 0 on
@@ -73,12 +75,17 @@ void VP8LHuffmanTablesDeallocate(HuffmanTables* const huffman_tables);
 #define HUFFMAN_PACKED_BITS 6
 #define HUFFMAN_PACKED_TABLE_SIZE (1u << HUFFMAN_PACKED_BITS)
 
+// Maximum number of bits indexing a literal table.
+#define HUFFMAN_LITERAL_BITS 11
+
 // Huffman table group.
 // Includes special handling for the following cases:
 //  - is_trivial_literal: one common literal base for RED/BLUE/ALPHA (not GREEN)
 //  - is_trivial_code: only 1 code (no bit is read from bitstream)
 //  - use_packed_table: few enough literal symbols, so all the bit codes
 //    can fit into a small look-up table packed_table[]
+//  - literal_table: look-up table decoding the red, blue and alpha codes of a
+//    literal at once, when they fit in the next 'literal_bits' bits
 // The common literal base, if applicable, is stored in 'literal_arb'.
 typedef struct HTreeGroup HTreeGroup;
 struct HTreeGroup {
@@ -92,6 +99,11 @@ struct HTreeGroup {
   int use_packed_table;    // use packed table below for short literal code
   // table mapping input bits to a packed values, or escape case to literal code
   HuffmanCode32 packed_table[HUFFMAN_PACKED_TABLE_SIZE];
+  int literal_bits;  // number of bits indexing 'literal_table'
+  // table mapping input bits to the ARGB value of the red, blue and alpha
+  // codes, with the number of bits they use in place of green (0 if they do
+  // not fit). Can be NULL.
+  const uint32_t* literal_table;
 };
 
 // Creates the instance of HTreeGroup with specified number of tree-groups.
@@ -21,6 +21,10 @@
 
 WEBP_ASSUME_UNSAFE_INDEXABLE_ABI
 
+static WebPExecutor g_executor = {NULL, NULL};
+
+#define MAX_POOL_THREADS 256  // maximum size of the built-in thread pool
+
 #ifdef WEBP_USE_THREAD
 
 #if defined(_WIN32)
@@ -33,6 +37,7 @@ typedef HANDLE pthread_t;
 #endif
 typedef SRWLOCK pthread_mutex_t;
 typedef CONDITION_VARIABLE pthread_cond_t;
+#define PTHREAD_MUTEX_INITIALIZER SRWLOCK_INIT
 
 #ifndef WINAPI_FAMILY_PARTITION
 #define WINAPI_PARTITION_DESKTOP 1
@@ -53,6 +58,8 @@ typedef struct {
   pthread_mutex_t mutex;
   pthread_cond_t condition;
   pthread_t thread;
+  int on_executor;  // true if the loop runs as a task of the executor
+  int finished;     // set when the executor's task is done with the worker
 } WebPWorkerImpl;
 
 #if defined(_WIN32)
@@ -90,6 +97,10 @@ static int pthread_join(pthread_t thread, void** value_ptr) {
           CloseHandle(thread) == 0);
 }
 
+static int pthread_detach(pthread_t thread) {
+  return (CloseHandle(thread) == 0);
+}
+
 // Mutex
 static int pthread_mutex_init(pthread_mutex_t* const mutex, void* mutexattr) {
   (void)mutexattr;
@@ -129,6 +140,11 @@ static int pthread_cond_signal(pthread_cond_t* const condition) {
   return 0;
 }
 
+static int pthread_cond_broadcast(pthread_cond_t* const condition) {
+  WakeAllConditionVariable(condition);
+  return 0;
+}
+
 static int pthread_cond_wait(pthread_cond_t* const condition,
                              pthread_mutex_t* const mutex) {
   const int ok = SleepConditionVariableSRW(condition, mutex, INFINITE, 0);
@@ -142,8 +158,7 @@ static int pthread_cond_wait(pthread_cond_t* const condition,
 
 //------------------------------------------------------------------------------
 
-static THREADFN ThreadLoop(void* ptr) {
-  WebPWorker* const worker = (WebPWorker*)ptr;
+static void WorkerLoop(WebPWorker* const worker) {
   WebPWorkerImpl* const impl = (WebPWorkerImpl*)worker->impl;
   int done = 0;
   while (!done) {
@@ -156,6 +171,15 @@ static THREADFN ThreadLoop(void* ptr) {
       worker->status = OK;
     } else if (worker->status == NOT_OK) {  // finish the worker
       done = 1;
+      if (impl->on_executor) {
+        // There's no thread to join, so End() waits for this flag instead.
+        // The signal is sent with the mutex held, since 'impl' may be freed
+        // as soon as it is released.
+        impl->finished = 1;
+        pthread_cond_signal(&impl->condition);
+        pthread_mutex_unlock(&impl->mutex);
+        break;
+      }
     }
     // signal to the main thread that we're done (for Sync())
     // Note the associated mutex does not need to be held when signaling the
@@ -165,9 +189,108 @@ static THREADFN ThreadLoop(void* ptr) {
     pthread_mutex_unlock(&impl->mutex);
     pthread_cond_signal(&impl->condition);
   }
+}
+
+static THREADFN ThreadLoop(void* ptr) {
+  WorkerLoop((WebPWorker*)ptr);
   return THREAD_RETURN(NULL);  // Thread is finished
 }
 
+static void TaskLoop(void* ptr) { WorkerLoop((WebPWorker*)ptr); }
+
+//------------------------------------------------------------------------------
+// Built-in thread pool, used when no executor was installed and the pool was
+// enabled with WebPSetThreadPoolSize()
+
+typedef struct {
+  pthread_t thread;
+  pthread_cond_t condition;  // signaled when a task is assigned, or to quit
+  WebPTaskHook hook;         // task to run, or NULL if the thread is idle
+  void* arg;
+  int quit;
+  int detached;              // if true, the thread releases itself on exit
+} PoolThread;
+
+// All the fields of the pool and of its threads are guarded by this mutex.
+static pthread_mutex_t g_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static PoolThread* g_pool_threads[MAX_POOL_THREADS];
+static int g_pool_num_threads = 0;
+static int g_pool_max_threads = 0;  // disabled by default
+
+static THREADFN PoolLoop(void* ptr) {
+  PoolThread* const thread = (PoolThread*)ptr;
+  pthread_mutex_lock(&g_pool_mutex);
+  while (1) {
+    while (thread->hook == NULL && !thread->quit) {
+      pthread_cond_wait(&thread->condition, &g_pool_mutex);
+    }
+    if (thread->hook == NULL) break;  // asked to quit
+    {
+      const WebPTaskHook hook = thread->hook;
+      void* const arg = thread->arg;
+      pthread_mutex_unlock(&g_pool_mutex);
+      hook(arg);
+      pthread_mutex_lock(&g_pool_mutex);
+      thread->hook = NULL;  // idle again
+    }
+  }
+  {
+    const int detached = thread->detached;
+    pthread_mutex_unlock(&g_pool_mutex);
+    if (detached) {
+      // Removed from the pool by WebPThreadPoolShutdown(): nobody else refers
+      // to this thread anymore.
+      pthread_cond_destroy(&thread->condition);
+      WebPSafeFree(thread);
+    }
+  }
+  return THREAD_RETURN(NULL);
+}
+
+// Hands the task over to an idle thread of the pool, or to a new one if the
+// pool isn't full yet. Returns false if neither is possible.
+static int PoolSubmit(WebPTaskHook hook, void* arg) {
+  PoolThread* thread = NULL;
+  int ok = 0;
+  int i;
+  pthread_mutex_lock(&g_pool_mutex);
+  for (i = 0; i < g_pool_num_threads; ++i) {
+    if (g_pool_threads[i]->hook == NULL) {
+      thread = g_pool_threads[i];
+      thread->hook = hook;
+      thread->arg = arg;
+      pthread_cond_signal(&thread->condition);
+      ok = 1;
+      break;
+    }
+  }
+  if (!ok && g_pool_num_threads < g_pool_max_threads) {
+    thread = (PoolThread*)WebPSafeCalloc(1, sizeof(*thread));
+    if (thread != NULL && !pthread_cond_init(&thread->condition, NULL)) {
+      thread->hook = hook;
+      thread->arg = arg;
+      if (!pthread_create(&thread->thread, NULL, PoolLoop, thread)) {
+        g_pool_threads[g_pool_num_threads++] = thread;
+        ok = 1;
+      } else {
+        pthread_cond_destroy(&thread->condition);
+      }
+    }
+    if (!ok) WebPSafeFree(thread);
+  }
+  pthread_mutex_unlock(&g_pool_mutex);
+  return ok;
+}
+
+// Starts 'hook(arg)' on the installed executor, or else on the built-in pool.
+// Returns false if the task should run on a thread of its own instead.
+static int SubmitTask(WebPTaskHook hook, void* arg) {
+  if (g_executor.Submit != NULL) {
+    return g_executor.Submit(g_executor.pool, hook, arg);
+  }
+  return PoolSubmit(hook, arg);
+}
+
 // main thread state control
 static void ChangeState(WebPWorker* const worker, WebPWorkerStatus new_status) {
   // No-op when attempting to change state on a thread that didn't come up.
@@ -233,7 +356,9 @@ static int Reset(WebPWorker* const worker) {
       goto Error;
     }
     pthread_mutex_lock(&impl->mutex);
-    ok = !pthread_create(&impl->thread, NULL, ThreadLoop, worker);
+    impl->on_executor = SubmitTask(TaskLoop, worker);
+    ok = impl->on_executor ||
+         !pthread_create(&impl->thread, NULL, ThreadLoop, worker);
     if (ok) worker->status = OK;
     pthread_mutex_unlock(&impl->mutex);
     if (!ok) {
@@ -273,7 +398,15 @@ static void End(WebPWorker* const worker) {
   if (worker->impl != NULL) {
     WebPWorkerImpl* const impl = (WebPWorkerImpl*)worker->impl;
     ChangeState(worker, NOT_OK);
-    pthread_join(impl->thread, NULL);
+    if (impl->on_executor) {
+      pthread_mutex_lock(&impl->mutex);
+      while (!impl->finished) {
+        pthread_cond_wait(&impl->condition, &impl->mutex);
+      }
+      pthread_mutex_unlock(&impl->mutex);
+    } else {
+      pthread_join(impl->thread, NULL);
+    }
     pthread_mutex_destroy(&impl->mutex);
     pthread_cond_destroy(&impl->condition);
     WebPSafeFree(impl);
@@ -286,6 +419,88 @@ static void End(WebPWorker* const worker) {
   assert(worker->status == NOT_OK);
 }
 
+//------------------------------------------------------------------------------
+// WebPCounter
+
+#ifdef WEBP_USE_THREAD
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+  int num_waiting;  // number of threads blocked in WebPCounterWait()
+} WebPCounterImpl;
+#endif
+
+int WebPCounterInit(WebPCounter* const counter, int value) {
+  counter->value = value;
+  counter->impl = NULL;
+#ifdef WEBP_USE_THREAD
+  {
+    WebPCounterImpl* const impl =
+        (WebPCounterImpl*)WebPSafeCalloc(1, sizeof(WebPCounterImpl));
+    if (impl == NULL) return 0;
+    if (pthread_mutex_init(&impl->mutex, NULL)) {
+      WebPSafeFree(impl);
+      return 0;
+    }
+    if (pthread_cond_init(&impl->condition, NULL)) {
+      pthread_mutex_destroy(&impl->mutex);
+      WebPSafeFree(impl);
+      return 0;
+    }
+    counter->impl = (void*)impl;
+  }
+#endif
+  return 1;
+}
+
+void WebPCounterSet(WebPCounter* const counter, int value) {
+#ifdef WEBP_USE_THREAD
+  WebPCounterImpl* const impl = (WebPCounterImpl*)counter->impl;
+  if (impl != NULL) {
+    int wake_up;
+    pthread_mutex_lock(&impl->mutex);
+    assert(value >= counter->value);
+    counter->value = value;
+    wake_up = (impl->num_waiting > 0);
+    pthread_mutex_unlock(&impl->mutex);
+    if (wake_up) pthread_cond_broadcast(&impl->condition);
+    return;
+  }
+#endif
+  counter->value = value;
+}
+
+void WebPCounterWait(WebPCounter* const counter, int value) {
+#ifdef WEBP_USE_THREAD
+  WebPCounterImpl* const impl = (WebPCounterImpl*)counter->impl;
+  if (impl != NULL) {
+    pthread_mutex_lock(&impl->mutex);
+    while (counter->value < value) {
+      ++impl->num_waiting;
+      pthread_cond_wait(&impl->condition, &impl->mutex);
+      --impl->num_waiting;
+    }
+    pthread_mutex_unlock(&impl->mutex);
+    return;
+  }
+#endif
+  // Without threads, nobody else could ever increase the value.
+  assert(counter->value >= value);
+  (void)value;
+}
+
+void WebPCounterDelete(WebPCounter* const counter) {
+#ifdef WEBP_USE_THREAD
+  WebPCounterImpl* const impl = (WebPCounterImpl*)counter->impl;
+  if (impl != NULL) {
+    pthread_mutex_destroy(&impl->mutex);
+    pthread_cond_destroy(&impl->condition);
+    WebPSafeFree(impl);
+  }
+#endif
+  counter->impl = NULL;
+}
+
 //------------------------------------------------------------------------------
 
 static WebPWorkerInterface g_worker_interface = {Init,   Reset,   Sync,
@@ -306,4 +521,203 @@ const WebPWorkerInterface* WebPGetWorkerInterface(void) {
   return &g_worker_interface;
 }
 
+int WebPSetExecutor(const WebPExecutor* const executor) {
+  if (executor == NULL) {
+    g_executor.Submit = NULL;
+    g_executor.pool = NULL;
+    return 1;
+  }
+  if (executor->Submit == NULL) return 0;
+  g_executor = *executor;
+  return 1;
+}
+
+int WebPSetThreadPoolSize(int size) {
+  if (size < 0 || size > MAX_POOL_THREADS) return 0;
+#ifdef WEBP_USE_THREAD
+  pthread_mutex_lock(&g_pool_mutex);
+  g_pool_max_threads = size;
+  pthread_mutex_unlock(&g_pool_mutex);
+#endif
+  return 1;
+}
+
+void WebPThreadPoolShutdown(void) {
+#ifdef WEBP_USE_THREAD
+  PoolThread* threads[MAX_POOL_THREADS];
+  int num_threads = 0, i;
+  pthread_mutex_lock(&g_pool_mutex);
+  for (i = 0; i < g_pool_num_threads; ++i) {
+    PoolThread* const thread = g_pool_threads[i];
+    thread->quit = 1;
+    if (thread->hook == NULL) {
+      threads[num_threads++] = thread;
+      pthread_cond_signal(&thread->condition);
+    } else {
+      // The thread still runs a task, e.g. the worker of a decoder context
+      // that is still alive, which may not end for a while. Rather than
+      // waiting for it, the thread is left to release itself once it's done.
+      thread->detached = 1;
+      pthread_detach(thread->thread);
+    }
+  }
+  g_pool_num_threads = 0;
+  pthread_mutex_unlock(&g_pool_mutex);
+  for (i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i]->thread, NULL);
+    pthread_cond_destroy(&threads[i]->condition);
+    WebPSafeFree(threads[i]);
+  }
+#endif
+}
+
+int WebPWorkersArePooled(void) {
+#ifdef WEBP_USE_THREAD
+  int pooled;
+  if (g_executor.Submit != NULL) return 1;
+  pthread_mutex_lock(&g_pool_mutex);
+  pooled = (g_pool_max_threads > 0);
+  pthread_mutex_unlock(&g_pool_mutex);
+  return pooled;
+#else
+  return 0;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// WebPParallelFor
+
+typedef struct {
+  WebPParallelForThreadHook hook;
+  void* data;
+  int count;
+  int next;         // next index to hand out
+  int next_thread;  // next thread index to hand out
+#ifdef WEBP_USE_THREAD
+  int use_mutex;
+  pthread_mutex_t mutex;
+#endif
+} ParallelForState;
+
+// Returns the next index to process, or 'count' if there is none left. An
+// error cancels the remaining indices.
+static int ParallelForNext(ParallelForState* const state, int had_error) {
+  int index;
+#ifdef WEBP_USE_THREAD
+  if (state->use_mutex) pthread_mutex_lock(&state->mutex);
+#endif
+  if (had_error) state->next = state->count;
+  index = state->next;
+  if (index < state->count) ++state->next;
+#ifdef WEBP_USE_THREAD
+  if (state->use_mutex) pthread_mutex_unlock(&state->mutex);
+#endif
+  return index;
+}
+
+static int ParallelForNewThread(ParallelForState* const state) {
+  int thread;
+#ifdef WEBP_USE_THREAD
+  if (state->use_mutex) pthread_mutex_lock(&state->mutex);
+#endif
+  thread = state->next_thread++;
+#ifdef WEBP_USE_THREAD
+  if (state->use_mutex) pthread_mutex_unlock(&state->mutex);
+#endif
+  return thread;
+}
+
+static int ParallelForLoop(ParallelForState* const state, int thread) {
+  int ok = 1;
+  int index;
+  while ((index = ParallelForNext(state, !ok)) < state->count) {
+    ok = state->hook(state->data, index, thread);
+  }
+  return ok;
+}
+
+static int ParallelForHook(void* arg1, void* arg2) {
+  ParallelForState* const state = (ParallelForState*)arg1;
+  (void)arg2;
+  return ParallelForLoop(state, ParallelForNewThread(state));
+}
+
+int WebPParallelForThreads(int count, int num_threads,
+                           WebPParallelForThreadHook hook, void* data) {
+  const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
+  ParallelForState state;
+  WebPWorker* workers = NULL;
+  int num_workers = 0;
+  int ok, i;
+
+  if (count <= 0) return 1;
+  state.hook = hook;
+  state.data = data;
+  state.count = count;
+  state.next = 1;         // index 0 is reserved for the calling thread
+  state.next_thread = 1;  // and so is thread index 0
+#ifdef WEBP_USE_THREAD
+  state.use_mutex = 0;
+  if (num_threads > count) num_threads = count;
+  if (num_threads > 1 && !pthread_mutex_init(&state.mutex, NULL)) {
+    state.use_mutex = 1;
+    workers = (WebPWorker*)WebPSafeMalloc(num_threads - 1, sizeof(*workers));
+  }
+  if (workers != NULL) {
+    // Workers that fail to start are simply not used.
+    for (i = 0; i < num_threads - 1; ++i) {
+      WebPWorker* const worker = &workers[num_workers];
+      winterface->Init(worker);
+      worker->hook = ParallelForHook;
+      worker->data1 = &state;
+      worker->data2 = NULL;
+      if (!winterface->Reset(worker)) {
+        winterface->End(worker);
+        break;
+      }
+      winterface->Launch(worker);
+      ++num_workers;
+    }
+  }
+#else
+  (void)num_threads;
+  (void)winterface;
+#endif
+  if (hook(data, 0, 0)) {
+    ok = ParallelForLoop(&state, 0);
+  } else {
+    ok = 0;
+    (void)ParallelForNext(&state, /*had_error=*/1);  // cancel the other ones
+  }
+  for (i = 0; i < num_workers; ++i) {
+    ok &= winterface->Sync(&workers[i]);
+    winterface->End(&workers[i]);
+  }
+  WebPSafeFree(workers);
+#ifdef WEBP_USE_THREAD
+  if (state.use_mutex) pthread_mutex_destroy(&state.mutex);
+#endif
+  return ok;
+}
+
+typedef struct {
+  WebPParallelForHook hook;
+  void* data;
+} ParallelForIndexOnly;
+
+static int ParallelForIndexOnlyHook(void* data, int index, int thread) {
+  const ParallelForIndexOnly* const p = (const ParallelForIndexOnly*)data;
+  (void)thread;
+  return p->hook(p->data, index);
+}
+
+int WebPParallelFor(int count, int num_threads, WebPParallelForHook hook,
+                    void* data) {
+  ParallelForIndexOnly p;
+  p.hook = hook;
+  p.data = data;
+  return WebPParallelForThreads(count, num_threads, ParallelForIndexOnlyHook,
+                                &p);
+}
+
 //------------------------------------------------------------------------------
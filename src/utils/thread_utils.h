@@ -84,6 +84,95 @@ WEBP_EXTERN int WebPSetWorkerInterface(
 // Retrieve the currently set thread worker interface.
 WEBP_EXTERN const WebPWorkerInterface* WebPGetWorkerInterface(void);
 
+//------------------------------------------------------------------------------
+// Executor
+
+// Task started by an executor. 'arg' is the pointer passed to Submit().
+typedef void (*WebPTaskHook)(void* arg);
+
+// Lets the application run libwebp's threads on its own thread pool, instead
+// of having a thread created and joined for each worker.
+typedef struct {
+  // Starts 'hook(arg)' on a thread of the pool. The task can block while
+  // waiting for other tasks, so it must not be queued behind them: if no
+  // thread is available right away, Submit() must return false and libwebp
+  // will create a thread of its own for this task.
+  int (*Submit)(void* pool, WebPTaskHook hook, void* arg);
+  void* pool;  // opaque pointer passed to Submit()
+} WebPExecutor;
+
+// Installs the executor used by the default worker interface, or reverts to
+// the default behavior if 'executor' is NULL. Like WebPSetWorkerInterface(),
+// this should be done before any encoding or decoding takes place, and is not
+// thread-safe. The struct is copied. Returns false in case of invalid methods.
+WEBP_EXTERN int WebPSetExecutor(const WebPExecutor* const executor);
+
+// By default, a thread is created for each worker. Alternatively, when no
+// executor is installed, workers can run on a built-in process-wide pool,
+// started lazily, which keeps its threads alive between calls so that small
+// images don't pay for a thread creation each time. This sets the maximum
+// number of threads the pool may hold, in [0..256]. The default is 0, which
+// disables the pool. Once the pool is full, a thread is created for each
+// worker as well. The pool's threads are not duplicated by fork(): the pool
+// must be shut down before forking. Returns false if 'size' is invalid.
+WEBP_EXTERN int WebPSetThreadPoolSize(int size);
+
+// Stops the threads of the built-in pool and releases its resources. The pool
+// is restarted if needed. Must not be called while any encoding or decoding
+// is in progress. Threads still held by a WebPDecoderContext are only released
+// once it is deleted: all contexts must be deleted first for the pool to be
+// fully released when this function returns.
+WEBP_EXTERN void WebPThreadPoolShutdown(void);
+
+// Returns true if the workers run on an executor or on the built-in pool,
+// which makes starting them cheap.
+int WebPWorkersArePooled(void);
+
+//------------------------------------------------------------------------------
+// Parallel loop
+
+// Function called for each index of a WebPParallelFor() loop. Should return
+// false in case of error.
+typedef int (*WebPParallelForHook)(void* data, int index);
+
+// Calls hook(data, i) for all i in [0, count), spreading the calls over up to
+// 'num_threads' threads (including the calling one) through the current
+// worker interface. Indices are handed out in increasing order, and index 0
+// is always processed by the calling thread. If some threads can't be
+// started, the others do their share of the work. Returns false if a call
+// failed, in which case the remaining indices may be skipped.
+WEBP_NODISCARD int WebPParallelFor(int count, int num_threads,
+                                   WebPParallelForHook hook, void* data);
+
+// Same as WebPParallelFor(), except that the hook is also passed the index of
+// the thread making the call, in [0, num_threads). The calling thread is
+// thread 0. This lets the caller keep per-thread state (scratch buffers,
+// encoders...) while the indices are still handed out on demand.
+typedef int (*WebPParallelForThreadHook)(void* data, int index, int thread);
+WEBP_NODISCARD int WebPParallelForThreads(int count, int num_threads,
+                                          WebPParallelForThreadHook hook,
+                                          void* data);
+
+//------------------------------------------------------------------------------
+// Progress counter
+
+// Monotonic counter that concurrently running workers can wait on. It is used
+// to express fine-grained dependencies between jobs, e.g. a row of macroblocks
+// waiting for the row above it to be far enough ahead (wavefront).
+typedef struct {
+  void* impl;  // platform-dependent mutex/condition (NULL if no threading)
+  int value;   // current value. Only access it through the functions below.
+} WebPCounter;
+
+// Initializes the counter to 'value'. Returns false in case of error.
+WEBP_NODISCARD int WebPCounterInit(WebPCounter* const counter, int value);
+// Sets a new (larger) value and wakes up the waiting threads.
+void WebPCounterSet(WebPCounter* const counter, int value);
+// Blocks until the counter's value is greater or equal to 'value'.
+void WebPCounterWait(WebPCounter* const counter, int value);
+// Releases the resources. The counter must not be waited upon anymore.
+void WebPCounterDelete(WebPCounter* const counter);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
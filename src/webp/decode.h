@@ -37,6 +37,7 @@ typedef struct WebPIDecoder WebPIDecoder;
 typedef struct WebPBitstreamFeatures WebPBitstreamFeatures;
 typedef struct WebPDecoderOptions WebPDecoderOptions;
 typedef struct WebPDecoderConfig WebPDecoderConfig;
+typedef struct WebPDecoderContext WebPDecoderContext;
 
 // Return the decoder's version number, packed in hexadecimal using 8bits for
 // each of major/minor/revision. E.g: v2.5.7 is 0x020507.
@@ -490,7 +491,10 @@ struct WebPDecoderOptions {
   int scaled_width, scaled_height;  // final resolution. if one is 0, it is
                                     // guessed from the other one to keep the
                                     // original ratio.
-  int use_threads;                  // if true, use multi-threaded decoding
+  int use_threads;                  // if true, use multi-threaded decoding.
+                                    // Values above 1 set the maximum number
+                                    // of threads for lossy bitstreams.
+                                    // Lossless ones use one extra thread.
   int dithering_strength;           // dithering strength (0=Off, 100=full)
   int flip;                         // if true, flip output vertically
   int alpha_dithering_strength;     // alpha dithering strength in [0..100]
@@ -545,6 +549,41 @@ WEBP_EXTERN VP8StatusCode WebPDecode(const uint8_t* WEBP_COUNTED_BY(data_size)
                                      size_t data_size,
                                      WebPDecoderConfig* config);
 
+//------------------------------------------------------------------------------
+// Reusable decoding context.
+//
+// When decoding many pictures in a row, the decoder objects, their internal
+// buffers and their worker threads can be kept alive between calls instead of
+// being re-created for each picture. Typical use:
+//
+//   WebPDecoderContext* const ctx = WebPDecoderContextNew(1 << 20);
+//   if (ctx == NULL) return 0;   // Out of memory.
+//   for each picture {
+//     ... setup 'config' as for WebPDecode() ...
+//     status = WebPDecodeWithContext(ctx, data, data_size, &config);
+//     ...
+//   }
+//   WebPDecoderContextDelete(ctx);
+//
+// A context must not be used by several threads at the same time.
+
+// Creates a new decoding context. Once a picture is decoded, the internal
+// buffers are kept for the next call, unless their total size exceeds
+// 'max_memory' bytes, in which case they are released.
+// Returns NULL in case of memory error.
+WEBP_NODISCARD WEBP_EXTERN WebPDecoderContext* WebPDecoderContextNew(
+    size_t max_memory);
+
+// Releases the context and all the resources it holds.
+WEBP_EXTERN void WebPDecoderContextDelete(WebPDecoderContext* context);
+
+// Same as WebPDecode(), but reusing the resources held by 'context'.
+// The resulting pixels are identical to the ones WebPDecode() produces.
+WEBP_EXTERN VP8StatusCode WebPDecodeWithContext(
+    WebPDecoderContext* context,
+    const uint8_t* WEBP_COUNTED_BY(data_size) data, size_t data_size,
+    WebPDecoderConfig* config);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -22,7 +22,7 @@
 extern "C" {
 #endif
 
-#define WEBP_ENCODER_ABI_VERSION 0x0210  // MAJOR(8b) + MINOR(8b)
+#define WEBP_ENCODER_ABI_VERSION 0x0211  // MAJOR(8b) + MINOR(8b)
 
 // Note: forward declaring enumerations is not allowed in (strict) C and C++,
 // the types are left here for reference.
@@ -34,6 +34,7 @@ typedef struct WebPConfig WebPConfig;
 typedef struct WebPPicture WebPPicture;  // main structure for I/O
 typedef struct WebPAuxStats WebPAuxStats;
 typedef struct WebPMemoryWriter WebPMemoryWriter;
+typedef struct WebPEncoderContext WebPEncoderContext;
 
 // Return the encoder's version number, packed in hexadecimal using 8bits for
 // each of major/minor/revision. E.g: v2.5.7 is 0x020507.
@@ -103,6 +104,8 @@ struct WebPConfig {
                   // compression: 0 is the fastest but gives larger
                   // files compared to the slowest, but best, 100.
   int method;     // quality/speed trade-off (0=fast, 6=slower-better)
+                  // For lossless, -1 selects a real-time mode (see
+                  // WebPConfigLosslessPreset()).
 
   WebPImageHint image_hint;  // Hint for image type (lossless only for now).
 
@@ -124,6 +127,9 @@ struct WebPConfig {
   int alpha_quality;      // Between 0 (smallest size) and 100 (lossless).
                           // Default is 100.
   int pass;               // number of entropy-analysis passes (in [1..10]).
+                          // For lossless, the number of candidate transform
+                          // sets that are fully encoded when several are
+                          // tried (-z 8 and 9), after a trial on a sample.
 
   int show_compressed;    // if true, export the compressed picture back.
                           // In-loop filtering is not applied.
@@ -139,7 +145,12 @@ struct WebPConfig {
                           // JPEG compression. Generally, the output size will
                           // be similar but the degradation will be lower.
   int thread_level;       // If non-zero, try and use multi-threaded encoding.
+                          // 1 uses two threads, while values above 1 set
+                          // the maximum number of threads (at most 32).
   int low_memory;         // If set, reduce memory usage (but increase CPU use).
+                          // For lossless, large pictures are then encoded
+                          // within about 64 MB, the picture itself and the
+                          // output excluded.
 
   int near_lossless;  // Near lossless encoding [0 = max loss .. 100 = off
                       // (default)].
@@ -193,7 +204,9 @@ WEBP_NODISCARD static WEBP_INLINE int WebPConfigPreset(WebPConfig* config,
 // Activate the lossless compression mode with the desired efficiency level
 // between 0 (fastest, lowest compression) and 9 (slower, best compression).
 // A good default level is '6', providing a fair tradeoff between compression
-// speed and final compressed size.
+// speed and final compressed size. Level -1 selects a real-time mode, several
+// times faster than level 0, which skips the image analysis and uses a single
+// fixed set of transforms.
 // This function will overwrite several fields from config: 'method', 'quality'
 // and 'lossless'. Returns false in case of parameter error.
 WEBP_NODISCARD WEBP_EXTERN int WebPConfigLosslessPreset(WebPConfig* config,
@@ -234,8 +247,7 @@ struct WebPAuxStats {
   int lossless_hdr_size;       // lossless header (transform, huffman etc) size
   int lossless_data_size;      // lossless image data size
   int cross_color_transform_bits;  // precision bits for cross-color transform
-
-  uint32_t pad[1];  // padding for later use
+  int threads_used;  // largest number of threads used by an encoding stage
 };
 
 // Signature for output function. Should return true if writing was successful.
@@ -559,6 +571,40 @@ WEBP_EXTERN void WebPBlendAlpha(WebPPicture* picture, uint32_t background_rgb);
 WEBP_NODISCARD WEBP_EXTERN int WebPEncode(const WebPConfig* config,
                                           WebPPicture* picture);
 
+//------------------------------------------------------------------------------
+// Reusable encoding context.
+//
+// When encoding many pictures in a row, the encoders' internal buffers (main
+// memory chunk, token pages, lossless transform buffer) can be kept alive
+// between calls instead of being re-created for each picture:
+//
+//   WebPEncoderContext* const ctx = WebPEncoderContextNew(4 << 20);
+//   if (ctx == NULL) return 0;   // Out of memory.
+//   for each picture {
+//     ... setup 'config' and 'picture' as for WebPEncode() ...
+//     ok = WebPEncodeWithContext(ctx, &config, &picture);
+//     ...
+//   }
+//   WebPEncoderContextDelete(ctx);
+//
+// A context must not be used by several threads at the same time.
+
+// Creates a new encoding context. Once a picture is encoded, the internal
+// buffers are kept for the next call, unless their total size exceeds
+// 'max_memory' bytes, in which case they are released.
+// Returns NULL in case of memory error.
+WEBP_NODISCARD WEBP_EXTERN WebPEncoderContext* WebPEncoderContextNew(
+    size_t max_memory);
+
+// Releases the context and all the resources it holds.
+WEBP_EXTERN void WebPEncoderContextDelete(WebPEncoderContext* context);
+
+// Same as WebPEncode(), but reusing the resources held by 'context'.
+// The resulting bitstream is identical to the one WebPEncode() produces.
+WEBP_NODISCARD WEBP_EXTERN int WebPEncodeWithContext(
+    WebPEncoderContext* context, const WebPConfig* config,
+    WebPPicture* picture);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
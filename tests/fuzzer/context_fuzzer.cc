@@ -0,0 +1,218 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks that decoding or encoding several pictures back to back through one
+// context gives the same results as processing each of them separately.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "./fuzz_utils.h"
+#include "webp/decode.h"
+#include "webp/encode.h"
+
+namespace {
+
+using PictureAndConfig =
+    std::tuple<fuzz_utils::WebPPictureCpp, WebPConfig, int, int>;
+
+// Returns true if both buffers hold the same decoded samples.
+bool IsSameOutput(const WebPDecBuffer& a, const WebPDecBuffer& b) {
+  if (a.colorspace != b.colorspace || a.width != b.width ||
+      a.height != b.height) {
+    return false;
+  }
+  if (WebPIsRGBMode(a.colorspace)) {
+    return a.u.RGBA.size == b.u.RGBA.size &&
+           std::memcmp(a.u.RGBA.rgba, b.u.RGBA.rgba, a.u.RGBA.size) == 0;
+  }
+  const WebPYUVABuffer& yuva_a = a.u.YUVA;
+  const WebPYUVABuffer& yuva_b = b.u.YUVA;
+  return yuva_a.y_size == yuva_b.y_size && yuva_a.u_size == yuva_b.u_size &&
+         yuva_a.v_size == yuva_b.v_size && yuva_a.a_size == yuva_b.a_size &&
+         std::memcmp(yuva_a.y, yuva_b.y, yuva_a.y_size) == 0 &&
+         std::memcmp(yuva_a.u, yuva_b.u, yuva_a.u_size) == 0 &&
+         std::memcmp(yuva_a.v, yuva_b.v, yuva_a.v_size) == 0 &&
+         (yuva_a.a_size == 0 ||
+          std::memcmp(yuva_a.a, yuva_b.a, yuva_a.a_size) == 0);
+}
+
+// Decodes all 'inputs' with WebPDecode() and with one shared context, and
+// aborts if the results differ.
+void DecodeWithContextTest(
+    const std::vector<std::string>& inputs,
+    const fuzz_utils::WebPDecoderOptionsCpp& decoder_options, int colorspace,
+    size_t max_memory) {
+  std::unique_ptr<WebPDecoderContext, fuzz_utils::UniquePtrDeleter> context(
+      WebPDecoderContextNew(max_memory));
+  if (context == nullptr) return;
+
+  for (const std::string& input : inputs) {
+    const uint8_t* const data = reinterpret_cast<const uint8_t*>(input.data());
+    const size_t size = input.size();
+    if (fuzz_utils::IsImageTooBig(data, size)) continue;
+
+    WebPDecoderConfig dec_configs[2];
+    std::unique_ptr<WebPDecoderConfig, fuzz_utils::UniquePtrDeleter>
+        dec_config_owners[2];
+    VP8StatusCode status[2];
+    for (int i = 0; i < 2; ++i) {
+      WebPDecoderConfig& dec_config = dec_configs[i];
+      if (!WebPInitDecoderConfig(&dec_config)) {
+        fprintf(stderr, "WebPInitDecoderConfig failed.\n");
+        std::abort();
+      }
+      dec_config_owners[i].reset(&dec_config);
+      dec_config.output.colorspace = (WEBP_CSP_MODE)colorspace;
+      std::memcpy(&dec_config.options, &decoder_options,
+                  sizeof(decoder_options));
+      status[i] = (i == 0) ? WebPDecode(data, size, &dec_config)
+                           : WebPDecodeWithContext(context.get(), data, size,
+                                                   &dec_config);
+    }
+    if (status[0] == VP8_STATUS_OUT_OF_MEMORY ||
+        status[1] == VP8_STATUS_OUT_OF_MEMORY) {
+      continue;
+    }
+    if (status[0] != status[1]) {
+      fprintf(stderr, "WebPDecodeWithContext status %d instead of %d.\n",
+              status[1], status[0]);
+      std::abort();
+    }
+    if (status[0] == VP8_STATUS_OK &&
+        !IsSameOutput(dec_configs[0].output, dec_configs[1].output)) {
+      fprintf(stderr, "WebPDecodeWithContext output differs.\n");
+      std::abort();
+    }
+  }
+}
+
+// Rescales 'pic' to 'width' x 'height'. Returns false in case of memory error.
+bool Rescale(WebPPicture& pic, int width, int height) {
+  if (!WebPPictureRescale(&pic, width, height)) {
+    if (pic.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) return false;
+    fprintf(stderr, "WebPPictureRescale failed. Error code: %d\n",
+            pic.error_code);
+    std::abort();
+  }
+  return true;
+}
+
+// Encodes 'pic' with 'config', through 'context' if it is not null.
+// Returns an empty string in case of memory error.
+std::string Encode(WebPEncoderContext* const context, const WebPConfig& config,
+                   WebPPicture& pic) {
+  WebPMemoryWriter memory_writer;
+  WebPMemoryWriterInit(&memory_writer);
+  std::unique_ptr<WebPMemoryWriter, fuzz_utils::UniquePtrDeleter>
+      memory_writer_owner(&memory_writer);
+  pic.writer = WebPMemoryWrite;
+  pic.custom_ptr = &memory_writer;
+  const int ok = (context == nullptr)
+                     ? WebPEncode(&config, &pic)
+                     : WebPEncodeWithContext(context, &config, &pic);
+  if (!ok) {
+    if (pic.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) return std::string();
+    fprintf(stderr, "WebPEncode failed. Error code: %d\n", pic.error_code);
+    std::abort();
+  }
+  return std::string(reinterpret_cast<const char*>(memory_writer.mem),
+                     memory_writer.size);
+}
+
+void EncDecWithContextTest(
+    std::vector<PictureAndConfig> pictures,
+    const fuzz_utils::WebPDecoderOptionsCpp& decoder_options, int colorspace,
+    size_t max_memory) {
+  std::vector<std::string> inputs;
+  for (PictureAndConfig& picture : pictures) {
+    WebPPicture& pic = std::get<0>(picture).ref();
+    WebPConfig& config = std::get<1>(picture);
+    if (config.method == 6) config.method = 5;  // avoid timeouts
+    if (!Rescale(pic, std::get<2>(picture), std::get<3>(picture))) continue;
+    inputs.push_back(Encode(/*context=*/nullptr, config, pic));
+  }
+  DecodeWithContextTest(inputs, decoder_options, colorspace, max_memory);
+}
+
+// Encodes all 'pictures' with WebPEncode() and with one shared context, and
+// aborts if the bitstreams differ.
+void EncodeWithContextTest(std::vector<PictureAndConfig> pictures,
+                           size_t max_memory) {
+  std::unique_ptr<WebPEncoderContext, fuzz_utils::UniquePtrDeleter> context(
+      WebPEncoderContextNew(max_memory));
+  if (context == nullptr) return;
+
+  for (PictureAndConfig& picture : pictures) {
+    WebPPicture& pic = std::get<0>(picture).ref();
+    WebPConfig& config = std::get<1>(picture);
+    if (config.method == 6) config.method = 5;  // avoid timeouts
+    if (!Rescale(pic, std::get<2>(picture), std::get<3>(picture))) continue;
+    // WebPEncode() may convert the samples in place, hence the copy.
+    WebPPicture pic_copy;
+    if (!WebPPictureInit(&pic_copy)) std::abort();
+    std::unique_ptr<WebPPicture, fuzz_utils::UniquePtrDeleter> pic_copy_owner(
+        &pic_copy);
+    if (!WebPPictureCopy(&pic, &pic_copy)) continue;
+
+    const std::string expected = Encode(/*context=*/nullptr, config, pic);
+    const std::string actual = Encode(context.get(), config, pic_copy);
+    if (expected.empty() || actual.empty()) continue;
+    if (expected != actual) {
+      fprintf(stderr, "WebPEncodeWithContext output differs.\n");
+      std::abort();
+    }
+  }
+}
+
+// Pictures wide enough to be decoded with several threads, to make sure the
+// worker threads kept by the context are reused correctly.
+auto ArbitraryPicturesAndConfigs() {
+  return fuzztest::VectorOf(
+             fuzztest::TupleOf(fuzz_utils::ArbitraryWebPPictureFromIndex(),
+                               fuzz_utils::ArbitraryWebPConfig(),
+                               /*width=*/fuzztest::InRange<int>(1, 400),
+                               /*height=*/fuzztest::InRange<int>(1, 100)))
+      .WithMinSize(1)
+      .WithMaxSize(4);
+}
+
+}  // namespace
+
+FUZZ_TEST(DecoderContext, DecodeWithContextTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::String().WithMaxSize(
+                                        fuzz_utils::kMaxWebPFileSize + 1))
+                     .WithMaxSize(4),
+                 fuzz_utils::ArbitraryValidWebPDecoderOptions(),
+                 /*colorspace=*/fuzztest::InRange<int>(0, MODE_LAST - 1),
+                 /*max_memory=*/fuzztest::InRange<size_t>(0, 1 << 24));
+
+FUZZ_TEST(DecoderContext, EncDecWithContextTest)
+    .WithDomains(ArbitraryPicturesAndConfigs(),
+                 fuzz_utils::ArbitraryValidWebPDecoderOptions(),
+                 /*colorspace=*/fuzztest::InRange<int>(0, MODE_LAST - 1),
+                 /*max_memory=*/fuzztest::InRange<size_t>(0, 1 << 24));
+
+FUZZ_TEST(EncoderContext, EncodeWithContextTest)
+    .WithDomains(ArbitraryPicturesAndConfigs(),
+                 /*max_memory=*/fuzztest::InRange<size_t>(0, 1 << 24));
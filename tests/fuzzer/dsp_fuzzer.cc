@@ -0,0 +1,489 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks that the optimized versions of the dsp functions (SSE2, SSE4.1,
+// AVX2...) give the same results as the plain C ones, by running them with
+// each level of optimization of fuzz_utils::SetOptimization().
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "./fuzz_utils.h"
+#include "src/dsp/cpu.h"
+#include "src/dsp/dsp.h"
+#include "src/dsp/yuv.h"
+#include "src/enc/vp8i_enc.h"
+#include "webp/decode.h"
+
+namespace {
+
+const VP8CPUInfo default_VP8GetCPUInfo = fuzz_utils::VP8GetCPUInfo;
+
+// Calls 'run()' for each level of optimization, which returns the resulting
+// samples. Aborts if they differ from the plain C ones. 'name' and 'id' tell
+// which function was tested.
+template <typename T, typename Run>
+void CompareOptimizations(const char* const name, int id, Run run) {
+  std::vector<T> reference;
+  for (uint32_t index = 0; index <= fuzz_utils::kMaxOptimizationIndex;
+       ++index) {
+    fuzz_utils::SetOptimization(default_VP8GetCPUInfo, index);
+    const std::vector<T> result = run();
+    if (index == 0) {
+      reference = result;
+    } else if (result != reference) {
+      fprintf(stderr, "%s #%d differs with optimization index %u.\n", name,
+              id, index);
+      std::abort();
+    }
+  }
+}
+
+// Maps the arbitrary bytes to samples around 128. The larger 'smoothness', the
+// closer the samples are to each other.
+std::vector<uint8_t> MakeSamples(const std::vector<uint8_t>& bytes,
+                                 int smoothness) {
+  std::vector<uint8_t> samples(bytes.size());
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    samples[i] = (uint8_t)(128 + ((int8_t)bytes[i] >> smoothness));
+  }
+  return samples;
+}
+
+//------------------------------------------------------------------------------
+// Decoder
+
+// The edges are filtered around a 16x16 luma and two 8x8 chroma blocks, which
+// are surrounded by enough samples for all the filters.
+constexpr int kFilterYStride = 32;
+constexpr int kFilterUVStride = 24;
+constexpr size_t kFilterYSize = 32 * kFilterYStride;
+constexpr size_t kFilterUVSize = 24 * kFilterUVStride;
+constexpr size_t kFilterSize = kFilterYSize + 2 * kFilterUVSize;
+constexpr int kNumFilters = 16;
+
+void DecFilterTest(const std::vector<uint8_t>& bytes, int smoothness,
+                   int filter, int thresh, int ithresh, int hev_thresh) {
+  CompareOptimizations<uint8_t>("Filter", filter, [&]() {
+    VP8DspInit();
+    std::vector<uint8_t> samples = MakeSamples(bytes, smoothness);
+    uint8_t* const y = &samples[8 * kFilterYStride + 8];
+    uint8_t* const u = &samples[kFilterYSize + 8 * kFilterUVStride + 8];
+    uint8_t* const v = u + kFilterUVSize;
+    const int y_stride = kFilterYStride, uv_stride = kFilterUVStride;
+    switch (filter) {
+      case 0:
+        VP8SimpleVFilter16(y, y_stride, thresh);
+        break;
+      case 1:
+        VP8SimpleHFilter16(y, y_stride, thresh);
+        break;
+      case 2:
+        VP8SimpleVFilter16i(y, y_stride, thresh);
+        break;
+      case 3:
+        VP8SimpleHFilter16i(y, y_stride, thresh);
+        break;
+      case 4:
+        VP8VFilter16(y, y_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 5:
+        VP8HFilter16(y, y_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 6:
+        VP8VFilter16i(y, y_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 7:
+        VP8HFilter16i(y, y_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 8:
+        VP8VFilter8(u, v, uv_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 9:
+        VP8HFilter8(u, v, uv_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 10:
+        VP8VFilter8i(u, v, uv_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 11:
+        VP8HFilter8i(u, v, uv_stride, thresh, ithresh, hev_thresh);
+        break;
+      case 12:
+        VP8VFilterMB(y, y_stride, u, v, uv_stride, thresh, ithresh,
+                     hev_thresh);
+        break;
+      case 13:
+        VP8HFilterMB(y, y_stride, u, v, uv_stride, thresh, ithresh,
+                     hev_thresh);
+        break;
+      case 14:
+        VP8VFilterMBi(y, y_stride, u, v, uv_stride, thresh, ithresh,
+                      hev_thresh);
+        break;
+      default:
+        VP8HFilterMBi(y, y_stride, u, v, uv_stride, thresh, ithresh,
+                      hev_thresh);
+        break;
+    }
+    return samples;
+  });
+}
+
+constexpr int kNumDecTransforms = 6;
+
+void DecTransformTest(const std::vector<int16_t>& coeffs,
+                      const std::vector<uint8_t>& bytes, int transform) {
+  CompareOptimizations<uint8_t>("Transform", transform, [&]() {
+    VP8DspInit();
+    std::vector<uint8_t> dst = MakeSamples(bytes, /*smoothness=*/0);
+    switch (transform) {
+      case 0:
+        VP8Transform(coeffs.data(), dst.data(), /*do_two=*/0);
+        break;
+      case 1:
+        VP8Transform(coeffs.data(), dst.data(), /*do_two=*/1);
+        break;
+      case 2:
+        VP8TransformAC3(coeffs.data(), dst.data());
+        break;
+      case 3:
+        VP8TransformDC(coeffs.data(), dst.data());
+        break;
+      case 4:
+        VP8TransformUV(coeffs.data(), dst.data());
+        break;
+      default:
+        VP8TransformDCUV(coeffs.data(), dst.data());
+        break;
+    }
+    return dst;
+  });
+}
+
+//------------------------------------------------------------------------------
+// Encoder
+
+// Source and prediction blocks are 16x16 samples with a stride of BPS, like
+// the ones of VP8EncIterator.
+constexpr size_t kEncBlockSize = 16 * BPS;
+constexpr int kNumMetrics = 4;
+
+void EncTransformTest(const std::vector<uint8_t>& src,
+                      const std::vector<uint8_t>& ref) {
+  CompareOptimizations<int16_t>("FTransform2", 0, [&]() {
+    VP8EncDspInit();
+    std::vector<int16_t> out(2 * 16);
+    VP8FTransform2(src.data(), ref.data(), out.data());
+    return out;
+  });
+}
+
+// 'blocks' 0 and 1 are the luma and chroma ranges of VP8DspScan[], as used by
+// the analysis.
+void EncHistogramTest(const std::vector<uint8_t>& src,
+                      const std::vector<uint8_t>& ref, int blocks) {
+  CompareOptimizations<int>("CollectHistogram", blocks, [&]() {
+    VP8EncDspInit();
+    VP8Histogram histo;
+    if (blocks == 0) {
+      VP8CollectHistogram(src.data(), ref.data(), 0, 16, &histo);
+    } else {
+      VP8CollectHistogram(src.data(), ref.data(), 16, 16 + 4 + 4, &histo);
+    }
+    return std::vector<int>{histo.max_value, histo.last_non_zero};
+  });
+}
+
+void EncMetricTest(const std::vector<uint8_t>& bytes_a,
+                   const std::vector<uint8_t>& bytes_b, int smoothness,
+                   std::vector<uint16_t> weights, int metric) {
+  // The weights are a symmetric 4x4 matrix.
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < i; ++j) weights[i * 4 + j] = weights[j * 4 + i];
+  }
+  const std::vector<uint8_t> a = MakeSamples(bytes_a, smoothness);
+  const std::vector<uint8_t> b = MakeSamples(bytes_b, smoothness);
+  CompareOptimizations<int>("Metric", metric, [&]() {
+    VP8EncDspInit();
+    switch (metric) {
+      case 0:
+        return std::vector<int>{VP8SSE16x16(a.data(), b.data())};
+      case 1:
+        return std::vector<int>{VP8SSE16x8(a.data(), b.data())};
+      case 2:
+        return std::vector<int>{VP8SSE8x8(a.data(), b.data())};
+      default:
+        return std::vector<int>{
+            VP8TDisto16x16(a.data(), b.data(), weights.data())};
+    }
+  });
+}
+
+// Fills 'mtx' the way ExpandMatrix() does in quant_enc.c, with the quantizer
+// steps 'q_dc' and 'q_ac' and the rounding biases 'bias_dc' and 'bias_ac'.
+void MakeMatrix(int q_dc, int q_ac, int bias_dc, int bias_ac, bool sharpen,
+                VP8Matrix* const mtx) {
+  static const uint8_t kFreqSharpening[16] = {0,  30, 60, 90, 30, 60, 90, 90,
+                                              60, 90, 90, 90, 90, 90, 90, 90};
+  for (int i = 0; i < 16; ++i) {
+    mtx->q[i] = (uint16_t)((i == 0) ? q_dc : q_ac);
+    mtx->iq[i] = (uint16_t)((1 << QFIX) / mtx->q[i]);
+    mtx->bias[i] = BIAS((i == 0) ? bias_dc : bias_ac);
+    mtx->zthresh[i] = ((1 << QFIX) - 1 - mtx->bias[i]) / mtx->iq[i];
+    mtx->sharpen[i] =
+        sharpen ? (uint16_t)((kFreqSharpening[i] * mtx->q[i]) >> 11) : 0;
+  }
+}
+
+void EncQuantizeTest(const std::vector<int16_t>& coeffs, int q_dc, int q_ac,
+                     int bias_dc, int bias_ac, bool sharpen) {
+  VP8Matrix mtx;
+  MakeMatrix(q_dc, q_ac, bias_dc, bias_ac, sharpen, &mtx);
+  CompareOptimizations<int16_t>("Quantize2Blocks", 0, [&]() {
+    VP8EncDspInit();
+    std::vector<int16_t> in = coeffs;
+    std::vector<int16_t> out(2 * 16);
+    const int nz = VP8EncQuantize2Blocks(in.data(), out.data(), &mtx);
+    out.insert(out.end(), in.begin(), in.end());
+    out.push_back((int16_t)nz);
+    return out;
+  });
+}
+
+//------------------------------------------------------------------------------
+// YUV <-> RGB
+
+// Rows are wide enough for several iterations of the widest SIMD loops and
+// for their left-overs. The functions get buffers of the exact size they
+// need, so that out-of-bounds accesses are caught by the sanitizers.
+constexpr int kMaxWidth = 200;
+constexpr size_t kYuvBytesSize = 8 * kMaxWidth;
+
+// Bytes per pixel of the RGB modes, up to MODE_rgbA_4444.
+constexpr int kBytesPerPixel[MODE_rgbA_4444 + 1] = {3, 4, 3, 4, 4, 2,
+                                                    2, 4, 4, 4, 2};
+constexpr int kNumYuvToRgbFunctions = 4;
+
+// Returns the 'size' bytes starting at 'bytes[index * kMaxWidth]'.
+std::vector<uint8_t> GetRow(const std::vector<uint8_t>& bytes, int index,
+                            size_t size) {
+  const uint8_t* const start = &bytes[index * kMaxWidth];
+  return std::vector<uint8_t>(start, start + size);
+}
+
+void YuvToRgbTest(const std::vector<uint8_t>& bytes, int width, int mode,
+                  int function) {
+  const int uv_width = (width + 1) >> 1;
+  const int is_yuv444 = (function == 3);
+  const std::vector<uint8_t> top_y = GetRow(bytes, 0, width);
+  const std::vector<uint8_t> bottom_y = GetRow(bytes, 1, width);
+  const std::vector<uint8_t> top_u =
+      GetRow(bytes, 2, is_yuv444 ? width : uv_width);
+  const std::vector<uint8_t> top_v =
+      GetRow(bytes, 3, is_yuv444 ? width : uv_width);
+  const std::vector<uint8_t> cur_u = GetRow(bytes, 4, uv_width);
+  const std::vector<uint8_t> cur_v = GetRow(bytes, 5, uv_width);
+  const size_t row_size = (size_t)width * kBytesPerPixel[mode];
+  CompareOptimizations<uint8_t>("YuvToRgb", function, [&]() {
+    std::vector<uint8_t> dst(row_size);
+    std::vector<uint8_t> bottom_dst(row_size);
+    switch (function) {
+      case 0:
+        WebPInitSamplers();
+        WebPSamplers[mode](top_y.data(), top_u.data(), top_v.data(),
+                           dst.data(), width);
+        break;
+      case 1:
+        WebPInitUpsamplers();
+        WebPUpsamplers[mode](top_y.data(), bottom_y.data(), top_u.data(),
+                             top_v.data(), cur_u.data(), cur_v.data(),
+                             dst.data(), bottom_dst.data(), width);
+        break;
+      case 2:  // last row of an odd-sized picture
+        WebPInitUpsamplers();
+        WebPUpsamplers[mode](top_y.data(), nullptr, top_u.data(),
+                             top_v.data(), cur_u.data(), cur_v.data(),
+                             dst.data(), nullptr, width);
+        break;
+      default:
+        WebPInitYUV444Converters();
+        WebPYUV444Converters[mode](top_y.data(), top_u.data(), top_v.data(),
+                                   dst.data(), width);
+        break;
+    }
+    dst.insert(dst.end(), bottom_dst.begin(), bottom_dst.end());
+    return dst;
+  });
+}
+
+constexpr int kNumRgbToYuvFunctions = 4;
+
+// 'flag' is 'do_store' for WebPConvertARGBToUV() and selects BGR for
+// WebPConvertRGBToY().
+void RgbToYuvTest(const std::vector<uint8_t>& bytes, int width, int step,
+                  bool flag, int function) {
+  const int uv_width = (width + 1) >> 1;
+  std::vector<uint32_t> argb(width);
+  std::memcpy(argb.data(), bytes.data(), width * sizeof(argb[0]));
+  const std::vector<uint8_t> rgb = GetRow(bytes, 0, (size_t)width * step);
+  // Sums of four samples, as computed by WebPAccumulateRGB().
+  std::vector<uint16_t> rgba32(4 * uv_width);
+  for (size_t i = 0; i < rgba32.size(); ++i) {
+    rgba32[i] = (uint16_t)((bytes[2 * i] | (bytes[2 * i + 1] << 8)) % 1021);
+  }
+  // Previous U/V values, for WebPConvertARGBToUV() without 'do_store'.
+  const std::vector<uint8_t> u = GetRow(bytes, 6, uv_width);
+  const std::vector<uint8_t> v = GetRow(bytes, 7, uv_width);
+  CompareOptimizations<uint8_t>("RgbToYuv", function, [&]() {
+    WebPInitConvertARGBToYUV();
+    std::vector<uint8_t> dst_y(width);
+    std::vector<uint8_t> dst_u = u, dst_v = v;
+    switch (function) {
+      case 0:
+        WebPConvertARGBToY(argb.data(), dst_y.data(), width);
+        break;
+      case 1:
+        WebPConvertARGBToUV(argb.data(), dst_u.data(), dst_v.data(), width,
+                            flag);
+        break;
+      case 2:
+        if (flag) {
+          WebPConvertBGRToY(rgb.data(), dst_y.data(), width, step);
+        } else {
+          WebPConvertRGBToY(rgb.data(), dst_y.data(), width, step);
+        }
+        break;
+      default:
+        WebPConvertRGBA32ToUV(rgba32.data(), dst_u.data(), dst_v.data(),
+                              uv_width);
+        break;
+    }
+    dst_y.insert(dst_y.end(), dst_u.begin(), dst_u.end());
+    dst_y.insert(dst_y.end(), dst_v.begin(), dst_v.end());
+    return dst_y;
+  });
+}
+
+// Averages two rows of packed RGB or BGR samples, or one if not 'two_rows'.
+void AccumulateRGBTest(const std::vector<uint8_t>& bytes, int width, int step,
+                       bool is_bgr, bool two_rows) {
+  const size_t row_size = (size_t)width * step;
+  const std::vector<uint8_t> rgb(bytes.begin(),
+                                 bytes.begin() + (two_rows ? 2 : 1) * row_size);
+  const uint8_t* const r_ptr = rgb.data() + (is_bgr ? 2 : 0);
+  const uint8_t* const g_ptr = rgb.data() + 1;
+  const uint8_t* const b_ptr = rgb.data() + (is_bgr ? 0 : 2);
+  const int rgb_stride = two_rows ? (int)row_size : 0;
+  CompareOptimizations<uint16_t>("AccumulateRGB", step, [&]() {
+    WebPInitGammaTables();
+    WebPInitConvertARGBToYUV();
+    // WebPAccumulateRGB_C() leaves the fourth (alpha) values untouched.
+    std::vector<uint16_t> dst(4 * ((width + 1) >> 1), 0);
+    WebPAccumulateRGB(r_ptr, g_ptr, b_ptr, step, rgb_stride, dst.data(),
+                      width);
+    for (size_t i = 3; i < dst.size(); i += 4) dst[i] = 0;
+    return dst;
+  });
+}
+
+}  // namespace
+
+// Filter limits as computed by the decoder: 'thresh' is at most
+// 2 * 63 + 63 + 4, 'ithresh' at most 63 and 'hev_thresh' at most 2.
+FUZZ_TEST(Dsp, DecFilterTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kFilterSize),
+                 /*smoothness=*/fuzztest::InRange<int>(0, 7),
+                 /*filter=*/fuzztest::InRange<int>(0, kNumFilters - 1),
+                 /*thresh=*/fuzztest::InRange<int>(0, 193),
+                 /*ithresh=*/fuzztest::InRange<int>(1, 63),
+                 /*hev_thresh=*/fuzztest::InRange<int>(0, 2));
+
+// Up to four 4x4 blocks of coefficients, added to 8x8 samples. Beyond this
+// range, the 16-bit arithmetic of the SIMD versions may saturate where the C
+// one doesn't.
+FUZZ_TEST(Dsp, DecTransformTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::InRange<int16_t>(-2048, 2047))
+                     .WithSize(4 * 16),
+                 fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(8 * BPS),
+                 /*transform=*/
+                 fuzztest::InRange<int>(0, kNumDecTransforms - 1));
+
+FUZZ_TEST(Dsp, EncTransformTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize),
+                 fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize));
+
+FUZZ_TEST(Dsp, EncHistogramTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize),
+                 fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize),
+                 /*blocks=*/fuzztest::InRange<int>(0, 1));
+
+// The weights are at most the ones of kWeightY[] in quant_enc.c.
+FUZZ_TEST(Dsp, EncMetricTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize),
+                 fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kEncBlockSize),
+                 /*smoothness=*/fuzztest::InRange<int>(0, 7),
+                 fuzztest::VectorOf(fuzztest::InRange<uint16_t>(0, 38))
+                     .WithSize(16),
+                 /*metric=*/fuzztest::InRange<int>(0, kNumMetrics - 1));
+
+// Two blocks of coefficients, with the quantizer steps of the kDcTable[],
+// kAcTable[] and kAcTable2[] ranges and the biases of kBiasMatrices[] in
+// quant_enc.c.
+FUZZ_TEST(Dsp, EncQuantizeTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::InRange<int16_t>(-2048, 2047))
+                     .WithSize(2 * 16),
+                 /*q_dc=*/fuzztest::InRange<int>(4, 314),
+                 /*q_ac=*/fuzztest::InRange<int>(4, 440),
+                 /*bias_dc=*/fuzztest::InRange<int>(96, 110),
+                 /*bias_ac=*/fuzztest::InRange<int>(108, 115),
+                 /*sharpen=*/fuzztest::Arbitrary<bool>());
+
+FUZZ_TEST(Dsp, YuvToRgbTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kYuvBytesSize),
+                 /*width=*/fuzztest::InRange<int>(1, kMaxWidth),
+                 /*mode=*/fuzztest::InRange<int>(MODE_RGB, MODE_rgbA_4444),
+                 /*function=*/
+                 fuzztest::InRange<int>(0, kNumYuvToRgbFunctions - 1));
+
+FUZZ_TEST(Dsp, RgbToYuvTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kYuvBytesSize),
+                 /*width=*/fuzztest::InRange<int>(1, kMaxWidth),
+                 /*step=*/fuzztest::InRange<int>(3, 4),
+                 /*flag=*/fuzztest::Arbitrary<bool>(),
+                 /*function=*/
+                 fuzztest::InRange<int>(0, kNumRgbToYuvFunctions - 1));
+
+FUZZ_TEST(Dsp, AccumulateRGBTest)
+    .WithDomains(fuzztest::VectorOf(fuzztest::Arbitrary<uint8_t>())
+                     .WithSize(kYuvBytesSize),
+                 /*width=*/fuzztest::InRange<int>(1, kMaxWidth),
+                 /*step=*/fuzztest::InRange<int>(3, 4),
+                 /*is_bgr=*/fuzztest::Arbitrary<bool>(),
+                 /*two_rows=*/fuzztest::Arbitrary<bool>());
@@ -216,6 +216,74 @@ void EncDecTest(bool use_argb, fuzz_utils::WebPPictureCpp pic_cpp,
   }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+// Lossy multi-threaded decoding needs wide pictures, with several token
+// partitions to also parse them concurrently. The result must not depend on the
+// number of threads.
+void EncDecThreadsTest(fuzz_utils::WebPPictureCpp pic_cpp, WebPConfig config,
+                       int optimization_index, int width, int height,
+                       int num_threads,
+                       const fuzz_utils::WebPDecoderOptionsCpp& decoder_options) {
+  fuzz_utils::SetOptimization(default_VP8GetCPUInfo, optimization_index);
+
+  WebPPicture& pic = pic_cpp.ref();
+  if (!WebPPictureRescale(&pic, width, height)) {
+    if (pic.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) return;
+    fprintf(stderr, "WebPPictureRescale failed. Error code: %d\n",
+            pic.error_code);
+    std::abort();
+  }
+  config.lossless = 0;
+  if (config.method == 6) config.method = 5;  // avoid timeouts
+
+  WebPMemoryWriter memory_writer;
+  WebPMemoryWriterInit(&memory_writer);
+  std::unique_ptr<WebPMemoryWriter, fuzz_utils::UniquePtrDeleter>
+      memory_writer_owner(&memory_writer);
+  pic.writer = WebPMemoryWrite;
+  pic.custom_ptr = &memory_writer;
+  if (!WebPEncode(&config, &pic)) {
+    if (pic.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) return;
+    fprintf(stderr, "WebPEncode failed. Error code: %d\n", pic.error_code);
+    std::abort();
+  }
+
+  WebPDecoderConfig dec_configs[2];
+  std::unique_ptr<WebPDecoderConfig, fuzz_utils::UniquePtrDeleter>
+      dec_config_owners[2];
+  VP8StatusCode status[2];
+  for (int i = 0; i < 2; ++i) {
+    WebPDecoderConfig& dec_config = dec_configs[i];
+    if (!WebPInitDecoderConfig(&dec_config)) {
+      fprintf(stderr, "WebPInitDecoderConfig failed.\n");
+      std::abort();
+    }
+    dec_config_owners[i].reset(&dec_config);
+    dec_config.output.colorspace = MODE_RGBA;
+    std::memcpy(&dec_config.options, &decoder_options,
+                sizeof(decoder_options));
+    dec_config.options.use_threads = (i == 0) ? 0 : num_threads;
+    status[i] = WebPDecode(memory_writer.mem, memory_writer.size, &dec_config);
+    if (status[i] != VP8_STATUS_OK && status[i] != VP8_STATUS_OUT_OF_MEMORY &&
+        status[i] != VP8_STATUS_INVALID_PARAM) {
+      fprintf(stderr, "WebPDecode failed. status: %d.\n", status[i]);
+      std::abort();
+    }
+  }
+  if (status[0] != VP8_STATUS_OK || status[1] != VP8_STATUS_OK) return;
+  const WebPRGBABuffer& rgba0 = dec_configs[0].output.u.RGBA;
+  const WebPRGBABuffer& rgba1 = dec_configs[1].output.u.RGBA;
+  if (dec_configs[0].output.width != dec_configs[1].output.width ||
+      dec_configs[0].output.height != dec_configs[1].output.height ||
+      rgba0.size != rgba1.size ||
+      std::memcmp(rgba0.rgba, rgba1.rgba, rgba0.size) != 0) {
+    fprintf(stderr, "Multi-threaded decoding differs with %d threads.\n",
+            num_threads);
+    std::abort();
+  }
+}
+
 }  // namespace
 
 FUZZ_TEST(EncIndexDec, EncDecValidTest)
@@ -261,3 +329,14 @@ FUZZ_TEST(EncArbitraryDec, EncDecTest)
                  fuzz_utils::ArbitraryCropOrScaleParams(),
                  /*colorspace=*/fuzztest::Arbitrary<int>(),
                  fuzz_utils::ArbitraryWebPDecoderOptions());
+
+FUZZ_TEST(EncIndexDec, EncDecThreadsTest)
+    .WithDomains(fuzz_utils::ArbitraryWebPPictureFromIndex(),
+                 fuzz_utils::ArbitraryWebPConfig(),
+                 /*optimization_index=*/
+                 fuzztest::InRange<uint32_t>(0,
+                                             fuzz_utils::kMaxOptimizationIndex),
+                 /*width=*/fuzztest::InRange<int>(256, 400),
+                 /*height=*/fuzztest::InRange<int>(1, 100),
+                 /*num_threads=*/fuzztest::InRange<int>(2, 8),
+                 fuzz_utils::ArbitraryValidWebPDecoderOptions());
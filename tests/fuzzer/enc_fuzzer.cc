@@ -137,6 +137,72 @@ void EncArbitraryTest(
   EncTestImpl(pic, optimization_index, use_argb, config, crop_or_scale_params);
 }
 
+// Returns the lossless encoding of a copy of 'pic' with 'num_threads' threads,
+// or an empty string in case of memory error.
+std::string EncodeLosslessWithThreads(const WebPPicture& pic, int level,
+                                      int num_threads) {
+  WebPConfig config;
+  if (!WebPConfigInit(&config) ||
+      !WebPConfigLosslessPreset(&config, level)) {
+    std::cerr << "WebPConfigLosslessPreset failed.\n";
+    std::abort();
+  }
+  config.thread_level = num_threads;
+  WebPPicture pic_copy;
+  if (!WebPPictureInit(&pic_copy)) std::abort();
+  std::unique_ptr<WebPPicture, fuzz_utils::UniquePtrDeleter> pic_copy_owner(
+      &pic_copy);
+  if (!WebPPictureCopy(&pic, &pic_copy)) return std::string();
+
+  WebPMemoryWriter memory_writer;
+  WebPMemoryWriterInit(&memory_writer);
+  std::unique_ptr<WebPMemoryWriter, fuzz_utils::UniquePtrDeleter>
+      memory_writer_owner(&memory_writer);
+  pic_copy.writer = WebPMemoryWrite;
+  pic_copy.custom_ptr = &memory_writer;
+  if (!WebPEncode(&config, &pic_copy)) {
+    if (pic_copy.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) {
+      return std::string();
+    }
+    std::cerr << "WebPEncode failed. Error code: " << pic_copy.error_code
+              << "\n";
+    std::abort();
+  }
+  return std::string(reinterpret_cast<const char*>(memory_writer.mem),
+                     memory_writer.size);
+}
+
+// The lossless bitstream must not depend on the number of threads, which are
+// shared between the crunch configs and the searches within each of them.
+void EncThreadsTest(fuzz_utils::WebPPictureCpp pic_cpp,
+                    uint32_t optimization_index, int level, int width,
+                    int height) {
+  fuzz_utils::SetOptimization(default_VP8GetCPUInfo, optimization_index);
+
+  WebPPicture& pic = pic_cpp.ref();
+  if (!WebPPictureRescale(&pic, width, height)) {
+    if (pic.error_code == VP8_ENC_ERROR_OUT_OF_MEMORY) return;
+    std::cerr << "WebPPictureRescale failed. Error code: " << pic.error_code
+              << "\n";
+    std::abort();
+  }
+
+  const int kNumThreads[] = {0, 2, 8};
+  std::string expected;
+  for (int num_threads : kNumThreads) {
+    const std::string actual =
+        EncodeLosslessWithThreads(pic, level, num_threads);
+    if (actual.empty()) return;
+    if (expected.empty()) {
+      expected = actual;
+    } else if (actual != expected) {
+      std::cerr << "Lossless encoding differs with " << num_threads
+                << " threads.\n";
+      std::abort();
+    }
+  }
+}
+
 }  // namespace
 
 FUZZ_TEST(Enc, EncArbitraryTest)
@@ -147,3 +213,13 @@ FUZZ_TEST(Enc, EncArbitraryTest)
                  /*use_argb=*/fuzztest::Arbitrary<bool>(),
                  fuzz_utils::ArbitraryWebPConfig(),
                  fuzz_utils::ArbitraryCropOrScaleParams());
+
+FUZZ_TEST(Enc, EncThreadsTest)
+    .WithDomains(fuzz_utils::ArbitraryWebPPictureFromIndex(),
+                 /*optimization_index=*/
+                 fuzztest::InRange<uint32_t>(0,
+                                             fuzz_utils::kMaxOptimizationIndex),
+                 /*level=*/fuzztest::InRange<int>(5, 9),
+                 // Keep the cruncher fast enough, with several rows of tiles.
+                 /*width=*/fuzztest::InRange<int>(16, 128),
+                 /*height=*/fuzztest::InRange<int>(16, 96));
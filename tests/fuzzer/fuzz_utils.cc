@@ -84,12 +84,12 @@ extern "C" VP8CPUInfo VP8GetCPUInfo;
 static VP8CPUInfo GetCPUInfo;
 
 static WEBP_INLINE int GetCPUInfoNoSSE41(CPUFeature feature) {
-  if (feature == kSSE4_1 || feature == kAVX) return 0;
+  if (feature == kSSE4_1 || feature == kAVX || feature == kAVX2) return 0;
   return GetCPUInfo(feature);
 }
 
 static WEBP_INLINE int GetCPUInfoNoAVX(CPUFeature feature) {
-  if (feature == kAVX) return 0;
+  if (feature == kAVX || feature == kAVX2) return 0;
   return GetCPUInfo(feature);
 }
 
@@ -93,6 +93,12 @@ struct UniquePtrDeleter {
   void operator()(WebPDecoderConfig* config) const {
     WebPFreeDecBuffer(&config->output);
   }
+  void operator()(WebPDecoderContext* context) const {
+    WebPDecoderContextDelete(context);
+  }
+  void operator()(WebPEncoderContext* context) const {
+    WebPEncoderContextDelete(context);
+  }
 };
 
 // Like WebPPicture but with no C array.
@@ -260,7 +266,7 @@ static inline auto ArbitraryWebPConfig() {
       /*partitions=*/fuzztest::InRange<int>(0, 3),
       /*partition_limit=*/fuzztest::InRange<int>(0, 10),
       /*emulate_jpeg_size=*/fuzztest::InRange<int>(0, 1),
-      /*thread_level=*/fuzztest::InRange<int>(0, 1),
+      /*thread_level=*/fuzztest::InRange<int>(0, 4),
       /*low_memory=*/fuzztest::InRange<int>(0, 1),
       /*near_lossless=*/fuzztest::InRange<int>(0, 5),
       /*exact=*/fuzztest::InRange<int>(0, 1),
@@ -328,7 +334,7 @@ static inline auto ArbitraryValidWebPDecoderOptions() {
       /*use_scaling=*/fuzztest::InRange<int>(0, 1),
       /*scaled_width=*/fuzztest::InRange<int>(1, 10),
       /*scaled_height=*/fuzztest::InRange<int>(1, 10),
-      /*use_threads=*/fuzztest::InRange<int>(0, 1),
+      /*use_threads=*/fuzztest::InRange<int>(0, 8),
       /*dithering_strength=*/fuzztest::InRange<int>(0, 100),
       /*flip=*/fuzztest::InRange<int>(0, 1),
       /*alpha_dithering_strength=*/fuzztest::InRange<int>(0, 100));